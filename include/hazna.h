@@ -29,6 +29,20 @@ enum hza_error_enum
     HZAE_MOD00_MAGIC,
     HZAE_MOD00_CORRUPT,
     HZAE_COND_CREATE,
+    HZAE_MOD00_CHECKSUM,
+    HZAE_NAME_TAKEN,
+    HZAE_NOT_FOUND,
+    HZAE_IMPORT_MODULE,
+    HZAE_IMPORT_PROC,
+    HZAE_CHAN_SIZE,
+    HZAE_NOT_SUPPORTED,
+    HZAE_GEN_PARAMS,
+    HZAE_NODE,
+    HZAE_IMAGE_IO,
+    HZAE_IMAGE_CORRUPT,
+    HZAE_IMAGE_MODULE,
+    HZAE_HOST_LIMIT,
+    HZAE_HOST_CALL,
 
     HZA_FATAL = 0x80,
     HZAF_BUG,
@@ -48,6 +62,10 @@ enum hza_error_enum
 #define HZA_INIT_MODULE_MUTEX                   (1 << 2)
 #define HZA_INIT_TASK_MUTEX                     (1 << 3)
 
+/* module load flags {{{1 */
+#define HZA_LOAD_NO_CHECKSUM                    (1 << 0)
+    /*< skip checksum verification (for trusted in-memory images) */
+
 /* operand types {{{1 */
 enum hza_operand_types
 {
@@ -91,10 +109,10 @@ enum hza_operand_types
 #define HZAOC_RA4 0x15 /* load/store from addr_reg + 16bit-displacement */
 #define HZAOC_RA5 0x16 /* load/store from addr_reg + 32bit-displacement */
 #define HZAOC_RA6 0x17 /* load/store from addr_reg + 64bit-displacement */
-#define HZAOC_x18
-#define HZAOC_x19
-#define HZAOC_x1A
-#define HZAOC_x1B
+#define HZAOC_R4S 0x18 /* block ops on reg range (a, b items), count reg c */
+#define HZAOC_R44 0x19 /* reg window a of b bytes, 16-bit index c */
+#define HZAOC_W4N 0x1A /* call: callee regs at a, 16-bit proc index b */
+#define HZAOC_VVV 0x1B /* lane-wise ops on 128-bit regs a, b, c */
 #define HZAOC_x1C
 #define HZAOC_x1D
 #define HZAOC_x1E
@@ -131,6 +149,9 @@ enum hza_operand_types
 /* rnn */
 #define HZAO_DEBUG_OUT_16       HZA_OPCODE1(HZAOC_RNN, HZAS_16, 0x000)
 #define HZAO_DEBUG_OUT_32       HZA_OPCODE1(HZAOC_RNN, HZAS_32, 0x000)
+#define HZAO_OUT_8              HZA_OPCODE1(HZAOC_RNN, HZAS_8, 0x001)
+    /*< appends a byte to the task's output channel; stops hza_run() with
+     *  HZA_RUN_OUTPUT if the channel is full */
 
 /* rnc */
 #define HZAO_INIT_8             HZA_OPCODE1(HZAOC_RCN, HZAS_8, 0x000)
@@ -148,6 +169,82 @@ enum hza_operand_types
 #define HZAO_BRANCH_ZERO_32     HZA_OPCODE1(HZAOC_RNP, HZAS_32, 0x000)
 #define HZAO_BRANCH_ZERO_64     HZA_OPCODE1(HZAOC_RNP, HZAS_64, 0x000)
 #define HZAO_BRANCH_ZERO_128    HZA_OPCODE1(HZAOC_RNP, HZAS_128, 0x000)
+#define HZAO_IN_8               HZA_OPCODE1(HZAOC_RNP, HZAS_8, 0x001)
+    /*< reads a byte from the task's input channel and jumps to target c;
+     *  jumps to target c + 1 at end of input; stops hza_run() with
+     *  HZA_RUN_INPUT if the channel is drained but not at end */
+
+/* r4s */
+#define HZAO_IN_BLOCK_8         HZA_OPCODE2(HZAOC_R4S, HZAS_8, HZAS_16, 0x000)
+    /*< reads up to b bytes from the input channel into the registers
+     *  starting at a and stores the count in c; the count is 0 only at end
+     *  of input; stops with HZA_RUN_INPUT if the channel is drained */
+#define HZAO_OUT_BLOCK_8        HZA_OPCODE2(HZAOC_R4S, HZAS_8, HZAS_16, 0x001)
+    /*< writes c bytes (at most b) from the registers starting at a to the
+     *  output channel; stops with HZA_RUN_OUTPUT if they do not fit */
+
+/* r44 */
+#define HZAO_HOST_CALL          HZA_OPCODE1(HZAOC_R44, HZAS_64, 0x000)
+    /*< calls host function c (see hza_host_register()) with the b bytes of
+     *  registers starting at a; stops with HZA_RUN_HOST after the call if
+     *  the function asks for it */
+
+/* w4n */
+#define HZAO_CALL               HZA_OPCODE1(HZAOC_W4N, HZAS_128, 0x000)
+    /*< calls proc b of the caller's module with its registers starting at
+     *  reg a of the caller, like hza_enter() with reg_shift a */
+#define HZAO_CALL_IMPORT        HZA_OPCODE1(HZAOC_W4N, HZAS_128, 0x001)
+    /*< calls import b of the caller's module the same way */
+#define HZAO_TAIL_CALL          HZA_OPCODE1(HZAOC_W4N, HZAS_128, 0x002)
+    /*< replaces the caller's frame with proc b of its module, with the
+     *  registers starting at reg a of the caller; the callee returns to
+     *  the caller's caller */
+#define HZAO_TAIL_CALL_IMPORT   HZA_OPCODE1(HZAOC_W4N, HZAS_128, 0x003)
+    /*< tail calls import b of the caller's module the same way */
+
+/* vvv: the secondary size is the lane size; lanes are in host byte order */
+#define HZAO_VADD_8             HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x00)
+#define HZAO_VADD_16            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x00)
+#define HZAO_VADD_32            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x00)
+#define HZAO_VADD_64            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x00)
+    /*< a = b + c in each lane, wrapping */
+#define HZAO_VSUB_8             HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x01)
+#define HZAO_VSUB_16            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x01)
+#define HZAO_VSUB_32            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x01)
+#define HZAO_VSUB_64            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x01)
+    /*< a = b - c in each lane, wrapping */
+#define HZAO_VCMP_EQ_8          HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x02)
+#define HZAO_VCMP_EQ_16         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x02)
+#define HZAO_VCMP_EQ_32         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x02)
+#define HZAO_VCMP_EQ_64         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x02)
+    /*< sets the lanes of a to all ones where b == c, to 0 elsewhere */
+#define HZAO_VCMP_GT_8          HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x03)
+#define HZAO_VCMP_GT_16         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x03)
+#define HZAO_VCMP_GT_32         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x03)
+#define HZAO_VCMP_GT_64         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x03)
+    /*< same for b > c, unsigned */
+#define HZAO_VMIN_8             HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x04)
+#define HZAO_VMIN_16            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x04)
+#define HZAO_VMIN_32            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x04)
+#define HZAO_VMIN_64            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x04)
+    /*< a = unsigned min of b and c in each lane */
+#define HZAO_VMAX_8             HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x05)
+#define HZAO_VMAX_16            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_16, 0x05)
+#define HZAO_VMAX_32            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_32, 0x05)
+#define HZAO_VMAX_64            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_64, 0x05)
+    /*< a = unsigned max of b and c in each lane */
+#define HZAO_VSHUFFLE_8         HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_8, 0x06)
+    /*< byte k of a = byte (c[k] & 15) of b, or 0 if bit 7 of c[k] is set;
+     *  an all-zero c broadcasts byte 0 of b */
+#define HZAO_VAND_128           HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_128, 0x00)
+#define HZAO_VOR_128            HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_128, 0x01)
+#define HZAO_VXOR_128           HZA_OPCODE2(HZAOC_VVV, HZAS_128, HZAS_128, 0x02)
+    /*< bitwise ops; lanes do not matter */
+
+/* srn */
+#define HZAO_VMOVEMASK_8        HZA_OPCODE2(HZAOC_SRN, HZAS_128, HZAS_16, 0x00)
+    /*< sets bit k of the 16-bit reg a to the top bit of byte k of the
+     *  128-bit reg b */
 
 
 /* log levels {{{1 */
@@ -165,11 +262,74 @@ enum hza_operand_types
 #define HZA_TASK_SUSPENDED      3
 #define HZA_TASK_STATES         4
 
+/* memory categories {{{1 */
+#define HZA_MEM_MODULE          0 /* module images */
+#define HZA_MEM_TASK            1 /* task structs */
+#define HZA_MEM_REG             2 /* register spaces */
+#define HZA_MEM_FRAME           3 /* frame tables */
+#define HZA_MEM_NAME            4 /* module name cells */
+#define HZA_MEM_OTHER           5 /* module maps, channel buffers, profiles */
+#define HZA_MEM_CATEGORIES      6
+
+/* module generator insn kinds {{{1 */
+#define HZA_GEN_NOP             0 /* nop */
+#define HZA_GEN_INIT            1 /* init_8, init_16 */
+#define HZA_GEN_ADD             2 /* wrap_add_const_8 */
+#define HZA_GEN_BRANCH          3 /* forward branch_zero_8, branch_zero_16 */
+#define HZA_GEN_KINDS           4
+
+/* proc hook events {{{1 */
+#define HZA_PROC_ENTER          0 /* frame pushed or reused by a tail call;
+                                   about to run its first insn */
+#define HZA_PROC_EXIT           1 /* ret or tail call reached; frame about to
+                                   be popped or reused */
+
+/* world mutexes {{{1 */
+/* in the order they follow the world struct */
+#define HZA_MUTEX_WORLD         0
+#define HZA_MUTEX_LOG           1
+#define HZA_MUTEX_MODULE        2
+#define HZA_MUTEX_TASK          3
+#define HZA_MUTEXES             4
+
+/* run stop reasons {{{1 */
+#define HZA_RUN_LIMIT           0 /* iteration limit reached */
+#define HZA_RUN_FRAME           1 /* returned to frame_stop */
+#define HZA_RUN_HALT            2 /* halt insn */
+#define HZA_RUN_INPUT           3 /* input channel drained; feed more */
+#define HZA_RUN_OUTPUT          4 /* output channel full; drain it */
+#define HZA_RUN_HOST            5 /* a host function asked to stop */
+
 /* other constants {{{1 */
 #define HZA_MAX_PROC 0x01000000 // 16M procs per module tops! or else...
+#define HZA_SAMPLE_PERIOD 0x10000 // default iterations between stack samples
+#define HZA_CACHE_LINE 64 // alignment of tasks
+#define HZA_TASK_ALLOC_SIZE (sizeof(hza_task_t) + HZA_CACHE_LINE - 1)
+#define HZA_NODE_LIMIT 8 // NUMA nodes that can have their own task allocator
+#define HZA_HOST_LIMIT 0x40 // host functions per world
+
+/* task images (see hza_task_save()) {{{1 */
+#define HZA_IMAGE_MAGIC 0x485A5431 // "HZT1"
+#define HZA_IMAGE_PAGE 0x1000 // reg space granule; all-zero pages are skipped
+#define HZA_IMAGE_END 0xFFFFFFFF // page index ending the page list
+/*
+ * task image format (written and read front to back so it can be streamed;
+ * the fields are big endian but page bytes are the reg space as is, in
+ * host byte order, so images are not portable across byte orders):
+ *  header      magic, module_count, frame_count, reg_limit (4 bytes each)
+ *  module      (module_count - 1) * 0x18 bytes: checksum, proc_count,
+ *              insn_count, data_size, anchor (8 bytes); the core module
+ *              at index 0 is implied
+ *  frame       frame_count * 0x10 bytes: module index, proc index,
+ *              insn_index, reg_base
+ *  page        page index (4 bytes) and HZA_IMAGE_PAGE bytes (fewer for
+ *              the end of the reg space) for each page that is not all
+ *              zero, in increasing order; HZA_IMAGE_END ends the list
+ */
 
 #define HZA_MOD00_MAGIC "[hza00]\x0A"
 #define HZA_MOD00_MAGIC_LEN 8
+#define HZA_MOD00_CHECKSUM_OFS 0x0C
 
 /* forward type declarations {{{1 */
 /* hza_error_t **************************************************************/
@@ -236,6 +396,87 @@ typedef struct hza_proc_s                       hza_proc_t;
  */
 typedef struct hza_insn_s                       hza_insn_t;
 
+/* hza_chan_t ***************************************************************/
+/**
+ * Byte channel between a task and its host.
+ */
+typedef struct hza_chan_s                       hza_chan_t;
+
+/* hza_prof_t ***************************************************************/
+/**
+ * Profiling counters: executions per opcode and branch outcomes per site.
+ */
+typedef struct hza_prof_s                       hza_prof_t;
+
+/* hza_prof_branch_t ********************************************************/
+/**
+ * Taken/not taken counts of one branch insn.
+ */
+typedef struct hza_prof_branch_s                hza_prof_branch_t;
+
+/* hza_sample_t *************************************************************/
+/**
+ * One distinct VM call stack seen by the sampling profiler and its count.
+ */
+typedef struct hza_sample_s                     hza_sample_t;
+
+/* hza_arena_chunk_t ********************************************************/
+/**
+ * Header of a block that the world arena carves into modules and module name
+ * cells (see hza_world_t.arena_chunk_list).
+ */
+typedef struct hza_arena_chunk_s                hza_arena_chunk_t;
+
+/* hza_lock_stats_t *********************************************************/
+/**
+ * Acquisition counters of one world mutex (see hza_lock_stats_enable()).
+ */
+typedef struct hza_lock_stats_s                 hza_lock_stats_t;
+
+/* hza_clock_f **************************************************************/
+/**
+ * Host clock: returns monotonic time in nanoseconds.
+ */
+typedef uint64_t (C41_CALL * hza_clock_f) (void);
+
+/* hza_image_io_f ***********************************************************/
+/**
+ * Host I/O for task images: writes (hza_task_save()) or reads
+ * (hza_task_restore()) exactly size bytes; returns 0 on success.
+ */
+typedef uint_t (C41_CALL * hza_image_io_f)
+    (void * ctx, void * data, size_t size);
+
+/* hza_proc_hook_f **********************************************************/
+/**
+ * Called on proc enter/exit (HZA_PROC_xxx) with the frame of the proc, for
+ * tracers and probes (see hza_proc_hook()).
+ */
+typedef void (C41_CALL * hza_proc_hook_f)
+    (hza_context_t * hc, hza_frame_t const * f, uint_t event);
+
+/* hza_host_f ***************************************************************/
+/**
+ * Host function called by HZAO_HOST_CALL with the caller's register window
+ * and the ctx given to hza_host_register(); returns 0 to go on. A nonzero
+ * return stops hza_run() with HZA_RUN_HOST after the function has run; the
+ * run resumes with the insn after the call, so each call runs once.
+ */
+typedef uint_t (C41_CALL * hza_host_f)
+    (hza_context_t * hc, uint8_t * regs, void * ctx);
+
+/* hza_host_t ***************************************************************/
+/**
+ * Registered host function (see hza_host_register()).
+ */
+typedef struct hza_host_s                       hza_host_t;
+
+/* hza_world_stats_t ********************************************************/
+/**
+ * Memory and object counts of a world (see hza_world_stats()).
+ */
+typedef struct hza_world_stats_s                hza_world_stats_t;
+
 /* hza_mod00_hdr_t **********************************************************/
 typedef struct hza_mod00_hdr_s                  hza_mod00_hdr_t;
 
@@ -245,6 +486,12 @@ typedef struct hza_mod00_impmod_s               hza_mod00_impmod_t;
 /* hza_mod00_proc_t *********************************************************/
 typedef struct hza_mod00_proc_s                 hza_mod00_proc_t;
 
+/* hza_mod00_gen_t **********************************************************/
+/**
+ * Parameters of a synthetic module (see hza_mod00_gen()).
+ */
+typedef struct hza_mod00_gen_s                  hza_mod00_gen_t;
+
 struct hza_context_s /* hza_context_t {{{1 */
 {
     hza_world_t *               world;
@@ -255,6 +502,8 @@ struct hza_context_s /* hza_context_t {{{1 */
     uint_t                      smt_error;
     hza_error_t                 hza_error;
     hza_error_t                 hza_finish_error;
+    uint8_t                     run_stop;
+        /*< why hza_run() returned: HZA_RUN_xxx */
     union
     {
         uint_t                      context_count;
@@ -265,10 +514,125 @@ struct hza_context_s /* hza_context_t {{{1 */
             size_t                      item_size;
             size_t                      new_count;
             size_t                      old_count;
+            uint_t                      category;
+            uint_t                      node;
+                /*< home node of task memory; HZA_NODE_LIMIT = world memory */
         }                           realloc;
+        struct
+        {
+            c41_ma_t *                  ma;
+            uint_t                      index;
+        }                           node;
+        struct
+        {
+            void const *                data;
+            size_t                      size;
+            uint_t                      flags;
+        }                           load;
+        struct
+        {
+            uint8_t const *             a;
+            size_t                      n;
+            hza_module_t *              module;
+        }                           name;
         hza_task_t *                task;
         uint_t                  iter_count;
+        struct
+        {
+            hza_prof_t *                prof;
+            c41_io_t *                  io;
+        }                           prof;
+        c41_io_t *                  io;
+        hza_world_stats_t *         stats;
+        hza_clock_f                 clock;
+        struct
+        {
+            hza_frame_t const *         frame;
+            char *                      buf;
+            size_t                      size;
+        }                           label;
+        struct
+        {
+            hza_host_f                  func;
+            void *                      ctx;
+            uint_t                      window;
+            uint32_t                    index;
+        }                           host;
+        struct
+        {
+            uint32_t                    key[4];
+                /*< checksum, proc_count, insn_count, data_size */
+            hza_module_t *              module;
+        }                           image;
     }                           args;
+    hza_prof_t *                prof;
+        /*< profiling counters of this context, NULL when profiling is off;
+         *  only this context touches them (see hza_prof_enable()) */
+    uint_t                      sample_period;
+        /*< iterations between stack samples; 0 = sampling off */
+    uint_t                      sample_left;
+        /*< iterations left until the next sample */
+    hza_proc_hook_f             proc_hook;
+        /*< NULL = no proc enter/exit events */
+    void *                      proc_hook_ctx;
+        /*< host data for proc_hook */
+    uint_t                      node;
+        /*< NUMA node the host runs this context on; tasks created by this
+         *  context get it as home node (see hza_node_set()) */
+};
+
+struct hza_lock_stats_s /* hza_lock_stats_t {{{1 */
+{
+    uint64_t                    count;
+        /*< acquisitions */
+    uint64_t                    contended;
+        /*< acquisitions that found the mutex locked and had to wait */
+    uint64_t                    wait_total;
+        /*< ns spent waiting in contended acquisitions */
+    uint64_t                    wait_max;
+    uint64_t                    hold_total;
+        /*< ns the mutex was held */
+    uint64_t                    hold_max;
+};
+
+struct hza_host_s /* hza_host_t {{{1 */
+{
+    hza_host_f                  func;
+    void *                      ctx;
+    uint_t                      window;
+        /*< bytes of registers the function uses; calls must pass as many */
+};
+
+struct hza_world_stats_s /* hza_world_stats_t {{{1 */
+{
+    size_t                      mem_live[HZA_MEM_CATEGORIES];
+        /*< bytes allocated now, per HZA_MEM_xxx category */
+    size_t                      mem_peak[HZA_MEM_CATEGORIES];
+        /*< most bytes allocated at once, per category */
+    size_t                      mem_total;
+        /*< bytes allocated now from the world allocator, including sync
+         *  objects that have no category and arena space not yet handed
+         *  out to modules or name cells */
+    size_t                      mem_total_peak;
+        /*< high-water mark of mem_total, updated whenever the world
+         *  allocator grows, arena chunks included */
+    size_t                      mem_blocks;
+        /*< blocks allocated now from the world allocator */
+    uint_t                      task_count[HZA_TASK_STATES];
+        /*< tasks in each state queue */
+    uint_t                      module_count;
+        /*< loaded modules, including the core module */
+    uint_t                      context_count;
+        /*< contexts attached to the world */
+    hza_lock_stats_t            lock[HZA_MUTEXES];
+        /*< per HZA_MUTEX_xxx; zero unless hza_lock_stats_enable() was used */
+    size_t                      node_mem_live[HZA_NODE_LIMIT];
+        /*< bytes of reg spaces and frame tables homed on each node; with
+         *  a node allocator set these are not part of mem_total */
+    uint64_t                    migrate_count;
+        /*< tasks moved to another node by hza_task_migrate() */
+    uint64_t                    migrate_bytes;
+        /*< bytes copied by those moves */
 };
 
 struct hza_world_s /* hza_world_t {{{1 */
@@ -286,6 +650,19 @@ struct hza_world_s /* hza_world_t {{{1 */
     c41_rbtree_t                module_name_tree;
         /*< Mapping name->module.
          */
+    hza_arena_chunk_t *         arena_chunk_list;
+        /*< Chunks holding the modules and module name cells; these live
+         *  until hza_finish() which releases the chunks in bulk. Freed
+         *  space is reused only at the top of the first chunk, which is
+         *  where a failed module load leaves its block.
+         *  Objects are bumped from the first chunk in the list, big ones
+         *  get a chunk of their own.
+         *  Access with #module_mutex locked!
+         */
+    uint8_t *                   arena_pos;
+        /*< Next free byte in the first chunk of #arena_chunk_list. */
+    uint8_t *                   arena_end;
+        /*< End of the first chunk of #arena_chunk_list. */
 
     hza_module_t *              core_module;
 
@@ -318,6 +695,43 @@ struct hza_world_s /* hza_world_t {{{1 */
     c41_io_t *                  log_io;
         /*< Logging I/O stream.
          */
+    hza_prof_t *                prof;
+        /*< Profiling counters merged from contexts by hza_prof_merge().
+         *  Access with #world_mutex locked!
+         */
+    hza_sample_t * *            sample_table;
+        /*< Hash table of sampled stacks (chained through hza_sample_t.next).
+         *  Access with #world_mutex locked!
+         */
+    size_t                      sample_limit;
+        /*< Buckets in #sample_table (power of 2). */
+    size_t                      sample_count;
+        /*< Distinct stacks in #sample_table. */
+    uint64_t                    sample_lost;
+        /*< Samples dropped because memory ran out. */
+    hza_world_stats_t           stats;
+        /*< Running counters behind hza_world_stats(): memory fields are
+         *  guarded by #world_mutex, task counts by #task_mutex, the module
+         *  count and the HZA_MEM_MODULE and HZA_MEM_NAME memory fields by
+         *  #module_mutex and each lock entry by its own mutex; the
+         *  other fields are filled in only in the copy returned by
+         *  hza_world_stats().
+         */
+    hza_clock_f                 lock_clock;
+        /*< Clock used to time mutex waits and holds; NULL = not measured.
+         */
+    c41_ma_t *                  node_ma[HZA_NODE_LIMIT];
+        /*< Allocators for the reg spaces and frame tables of tasks homed on
+         *  each NUMA node (see hza_node_ma()); NULL = #mac.
+         *  Access with #world_mutex locked!
+         */
+    hza_host_t                  host_table[HZA_HOST_LIMIT];
+        /*< Host functions called by HZAO_HOST_CALL.
+         *  Entries are added with #world_mutex locked and never change
+         *  after; the interpreter reads them without locking.
+         */
+    uint_t                      host_count;
+        /*< Used entries in #host_table. */
     c41_ma_t *                  world_ma;
         /*< Memory allocator used to allocate this structure.
          *  This is the original allocator passed to hza_init().
@@ -342,14 +756,31 @@ struct hza_world_s /* hza_world_t {{{1 */
          */
 };
 
+struct hza_chan_s /* hza_chan_t {{{1 */
+{
+    uint8_t *                   data;
+    size_t                      size;
+        /*< input: bytes available in data; output: capacity of data */
+    size_t                      pos;
+        /*< input: bytes consumed; output: bytes produced */
+    uint8_t                     eof;
+        /*< input: no more data after this buffer */
+};
+
 struct hza_task_s /* hza_task_t {{{1 */
 {
-    c41_np_t                    links; /**<
-                                    entry for doubly-linked list corresponding
-                                    to task's state;
-                                    this should be accessed while holding the
-                                    task mutex.
+    /* tasks are aligned to HZA_CACHE_LINE; the channels come first and the
+     * fields used on each proc call/return follow so that each group sits
+     * in one cache line; bookkeeping comes after */
+    hza_chan_t                  in; /**<
+                                    input channel; the buffer belongs to the
+                                    host (see hza_task_input())
                                     */
+    hza_chan_t                  out; /**<
+                                    output channel; the buffer belongs to the
+                                    host (see hza_task_output())
+                                    */
+
     uint8_t *                   reg_space; /**<
                                     pointer to the register/local space;
                                     only the context owning the task should 
@@ -365,20 +796,30 @@ struct hza_task_s /* hza_task_t {{{1 */
     hza_modmap_t *              module_table; /**<
                                     table of imported modules;
                                     */
-    hza_context_t *             owner; /**<
-                                    the context manipulating the task_id
-                                    */
-    uint_t                      reg_limit; /**<
-                                    number of bytes allocated for reg_space */
     uint_t                      frame_index; /**<
                                     index of the frame executing current
                                     instruction */
     uint_t                      frame_limit; /**<
                                     number of frames allocated in frame_table;
                                     */
+    uint_t                      reg_limit; /**<
+                                    number of bytes allocated for reg_space */
     uint_t                      module_count; /**<
                                     number of modules imported
                                     */
+
+    c41_np_t                    links; /**<
+                                    entry for doubly-linked list corresponding
+                                    to task's state;
+                                    this should be accessed while holding the
+                                    task mutex.
+                                    */
+    hza_context_t *             owner; /**<
+                                    the context manipulating the task_id
+                                    */
+    void *                      alloc; /**<
+                                    start of the allocation holding the task
+                                    */
     uint_t                      module_limit; /**<
                                     number of items allocated in module_table
                                     */
@@ -403,13 +844,25 @@ struct hza_task_s /* hza_task_t {{{1 */
                                     linked list of contexts waiting to attach
                                     this task
                                     */
+    uint8_t *                   io_buf; /**<
+                                    task-owned channel buffers (input then
+                                    output), see hza_task_chan_alloc()
+                                    */
+    size_t                      io_in_size; /**<
+                                    size of the input part of io_buf */
+    size_t                      io_out_size; /**<
+                                    size of the output part of io_buf */
+    uint_t                      node; /**<
+                                    home NUMA node: reg_space and
+                                    frame_table come from its allocator;
+                                    changed only by hza_task_migrate()
+                                    */
 };
 
 struct hza_frame_s /* hza_frame_t {{{1 */
 {
     hza_proc_t *                proc;
-    hza_insn_t *                insn;
-    uint32_t                    module_index; // task-local mod mapping index
+    uint32_t                    insn_index; // next insn in proc->insn_table
     uint32_t                    reg_base;
         /*< Must store as offset, not pointer, because the reg_space can be
          *  reallocated; the offset is in bytes and is multiple of largest
@@ -424,9 +877,54 @@ struct hza_modmap_s /* hza_modmap_t {{{1 */
      *  task's memory space */
     hza_module_t *              module;
     hza_task_t *                task;
+    uint32_t *                  impmod_index;
+    /*< task module index for each module imported by #module
+     *  (module->import_module_count items) */
     //uint32_t index; // the index in task's module table
 };
 
+struct hza_prof_branch_s /* hza_prof_branch_t {{{1 */
+{
+    hza_insn_t const *          insn;
+        /*< the branch insn; NULL marks a free slot */
+    uint64_t                    taken;
+        /*< jumps to target c (zero reg, input byte read, ...) */
+    uint64_t                    not_taken;
+        /*< jumps to target c + 1 */
+};
+
+struct hza_prof_s /* hza_prof_t {{{1 */
+{
+    uint64_t                    opcode_count[0x10000];
+        /*< executions per opcode; aggregate by HZA_OPCODE_CLASS() and
+         *  HZA_OPCODE_PRI_SIZE() when reporting */
+    hza_prof_branch_t *         branch_table;
+        /*< open addressing hash table keyed by insn pointer */
+    size_t                      branch_limit;
+        /*< slots in branch_table (power of 2) */
+    size_t                      branch_count;
+        /*< used slots in branch_table */
+    uint64_t                    branch_lost;
+        /*< branch outcomes not recorded because the table could not grow */
+};
+
+struct hza_sample_s /* hza_sample_t {{{1 */
+{
+    hza_sample_t *              next;
+    uint64_t                    count;
+    uint32_t                    hash;
+    uint32_t                    depth;
+    hza_insn_t const *          insn_table[1];
+        /*< [depth] the insn of each frame, outermost first */
+};
+
+struct hza_arena_chunk_s /* hza_arena_chunk_t {{{1 */
+{
+    hza_arena_chunk_t *         next;
+    size_t                      size;
+        /*< bytes allocated for the chunk, header included */
+};
+
 struct hza_uint128_s /* hza_uint128_t {{{1 */
 {
     uint64_t low, high;
@@ -484,6 +982,29 @@ struct hza_mod00_impmod_s /* hza_mod00_impmod_t {{{1 */
     uint32_t    proc_start; // start index in import proc area 
 };
 
+struct hza_mod00_gen_s /* hza_mod00_gen_t {{{1 */
+{
+    uint64_t    seed;
+        /*< same parameters and seed give the same image */
+    uint32_t    proc_count;
+    uint32_t    insn_count;
+        /*< per proc, including the final ret */
+    uint32_t    const128_count;
+        /*< per proc, like the other const counts */
+    uint32_t    const64_count;
+    uint32_t    const32_count;
+    uint32_t    export_count;
+        /*< procs 0 .. export_count - 1 are exported as "pXXXXXXXX" (proc
+         *  index in 8 uppercase hex digits) */
+    uint32_t    data_block_count;
+        /*< data blocks besides the proc names */
+    uint32_t    data_block_size;
+        /*< size of those blocks; at least 0x10 */
+    uint32_t    mix[HZA_GEN_KINDS];
+        /*< relative weights of the HZA_GEN_xxx insn kinds used in proc
+         *  bodies; all 0 means the same weight for each */
+};
+
 struct hza_mod_name_cell_s /* hza_mod_name_cell_t {{{1 */
 {
     // c41_rbtree_node_t rbtn;
@@ -504,6 +1025,11 @@ struct hza_module_s /* hza_module_t {{{1 */
     uint8_t * data;
     uint32_t * data_block_start_table; // [data_block_count + 1]
     uint32_t * export_table; // table of proc indexes
+    hza_mod00_impmod_t * impmod_table; // [import_module_count + 1]
+    uint32_t * import_name_table; // data block index of each imported proc
+    hza_module_t * * impmod_link_table; // resolved import modules
+    hza_proc_t * * import_table; // resolved imported procs
+    uint32_t * import_impmod_table; // import module index of each import
     hza_context_t * owner;
 
     uint32_t const128_count;
@@ -515,8 +1041,11 @@ struct hza_module_s /* hza_module_t {{{1 */
     uint32_t data_block_count;
     uint32_t data_size;
     uint32_t export_count;
+    uint32_t import_module_count;
+    uint32_t import_count;
 
     uint32_t module_id;
+    uint32_t checksum; // from the mod00 header; identifies it in task images
     uint32_t module_count; // number of modules that import this module
     uint32_t task_count; // number of tasks that have imported this module
     uint32_t ctx_count; // number of contexts holding a pointer to this
@@ -535,6 +1064,7 @@ struct hza_proc_s /* hza_proc_t {{{1 */
     uint32_t const64_count;
     uint32_t const32_count;
     uint32_t target_count;
+    hza_module_t * module; // module owning the proc
     uint32_t name;
     uint16_t reg_size; // size of proc's register space (in bytes)
 };
@@ -551,6 +1081,9 @@ HAZNA_API char const * C41_CALL hza_lib_name ();
 /* hza_error_name **************************************************** {{{1 */
 HAZNA_API char const * C41_CALL hza_error_name (hza_error_t e);
 
+/* hza_opcode_name *************************************************** {{{1 */
+HAZNA_API char const * C41_CALL hza_opcode_name (uint16_t o);
+
 /* hza_init ********************************************************** {{{1 */
 /**
  * Initialises a context and the world.
@@ -595,6 +1128,7 @@ HAZNA_API hza_error_t C41_CALL hza_finish
 /**
  *  Creates a task and attaches it to current context.
  *  The task is created in suspended state and has context_count set to 1.
+ *  Its home NUMA node is the node of the context (see hza_node_set()).
  */
 HAZNA_API hza_error_t C41_CALL hza_task_create
 (
@@ -602,6 +1136,152 @@ HAZNA_API hza_error_t C41_CALL hza_task_create
     hza_task_t * * tp
 );
 
+/* hza_task_fork ***************************************************** {{{1 */
+/**
+ *  Creates a copy of task src and attaches it to current context, like
+ *  hza_task_create(): reg space, frames and module map are copied, the
+ *  channels start empty. Prepare a task once (imports, init procs) and fork
+ *  it for each request instead of repeating the setup.
+ *  src must not run during the call; it may be owned by another context.
+ *  The fork is homed on the node of the context (see hza_node_set()).
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_ALLOC
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_fork
+(
+    hza_context_t * hc,
+    hza_task_t * src,
+    hza_task_t * * tp
+);
+
+/* hza_task_save ***************************************************** {{{1 */
+/**
+ *  Writes an image of the active task (see HZA_IMAGE_xxx) through io.
+ *  Modules are recorded by checksum and size, frames by module, proc and
+ *  insn index, so the image does not depend on where things are in memory.
+ *  Channels are not saved. Registers are saved in host byte order, so the
+ *  image can move to other machines only if they have the same byte order.
+ *  Must not be called while the task runs.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_IMAGE_IO           io failed
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_save
+(
+    hza_context_t * hc,
+    hza_image_io_f io,
+    void * io_ctx
+);
+
+/* hza_task_restore ************************************************** {{{1 */
+/**
+ *  Creates a task from an image written by hza_task_save(), in this world
+ *  or another one, and attaches it to current context like
+ *  hza_task_create(). The modules of the task must be loaded already; they
+ *  are imported in the order of the saved module map.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_IMAGE_IO           io failed
+ *      HZAE_IMAGE_CORRUPT      bad magic, truncated or inconsistent image
+ *      HZAE_IMAGE_MODULE       a module of the task is not loaded
+ *      HZAE_ALLOC
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_restore
+(
+    hza_context_t * hc,
+    hza_image_io_f io,
+    void * io_ctx,
+    hza_task_t * * tp
+);
+
+/* hza_task_trim ***************************************************** {{{1 */
+/**
+ *  Shrinks the reg space and frame table of the active task, which
+ *  hza_enter() only grows, to twice the power of 2 above what its current
+ *  frames use (at least the initial sizes). A table is only shrunk when
+ *  that frees at least half of it, so a task that goes back to the same
+ *  depth after a trim does not realloc again.
+ *  Call it on idle tasks (e.g. after hza_run() returned to frame 0); must
+ *  not be called while the task runs. The number of bytes freed is stored
+ *  in *freed_p.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_ALLOC              the table is left as it was
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_trim
+(
+    hza_context_t * hc,
+    size_t * freed_p
+);
+
+/* hza_task_unwind *************************************************** {{{1 */
+/**
+ *  Drops the frames of the active task above frame_index without running
+ *  them, e.g. to reuse a task after hza_run() stopped with HZA_RUN_HALT.
+ *  The proc hook gets HZA_PROC_EXIT for each dropped frame, innermost
+ *  first. Must not be called while the task runs.
+ *  Returns:
+ *      0 = HZA_OK              success
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_unwind
+(
+    hza_context_t * hc,
+    uint_t frame_index
+);
+
+/* hza_node_ma ******************************************************* {{{1 */
+/**
+ *  Sets the allocator for the reg spaces and frame tables of tasks homed on
+ *  the given NUMA node (NULL = the world allocator). The engine knows
+ *  nothing about the topology: the host passes an allocator that places
+ *  memory on that node, or plain allocators to simulate nodes.
+ *  The allocator is called with the world mutex held and must stay valid
+ *  while the node has task memory.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_NODE               node >= HZA_NODE_LIMIT
+ *      HZAE_STATE              the node has task memory
+ */
+HAZNA_API hza_error_t C41_CALL hza_node_ma
+(
+    hza_context_t * hc,
+    uint_t node,
+    c41_ma_t * ma
+);
+
+/* hza_node_set ****************************************************** {{{1 */
+/**
+ *  Sets the NUMA node this context runs on; tasks it creates are homed
+ *  there. The host pins the thread running the context to that node.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_NODE               node >= HZA_NODE_LIMIT
+ */
+HAZNA_API hza_error_t C41_CALL hza_node_set
+(
+    hza_context_t * hc,
+    uint_t node
+);
+
+/* hza_task_migrate ************************************************** {{{1 */
+/**
+ *  Moves the reg space and frame table of the active task to the allocator
+ *  of the given node and makes it the task's home node. Tasks never move
+ *  on their own; the cost shows in hza_world_stats_t.migrate_xxx.
+ *  Must not be called while the task runs.
+ *  Returns:
+ *      0 = HZA_OK              success (also when already homed there)
+ *      HZAE_NODE               node >= HZA_NODE_LIMIT
+ *      HZAE_ALLOC              the task stays on its old node
+ *      HZAF_FREE
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_migrate
+(
+    hza_context_t * hc,
+    uint_t node
+);
+
 /* hza_task_ref ****************************************************** {{{1 */
 /**
  *  Adds a reference to the given task.
@@ -661,6 +1341,12 @@ HAZNA_API hza_error_t C41_CALL hza_task_detach
 );
 
 /* hza_module_by_name ************************************************ {{{1 */
+/**
+ * Finds a module by a name given to it with hza_module_map_name().
+ * Returns:
+ *  0 = HZA_OK                  success; module stored in *mp
+ *  HZAE_NOT_FOUND              no module mapped under that name
+ */
 HAZNA_API hza_error_t C41_CALL hza_module_by_name
 (
     hza_context_t * hc,
@@ -670,15 +1356,80 @@ HAZNA_API hza_error_t C41_CALL hza_module_by_name
 );
 
 /* hza_module_load *************************************************** {{{1 */
+/**
+ * Loads a mod00 image.
+ * Unless HZA_LOAD_NO_CHECKSUM is given in flags, the CRC32C checksum from the
+ * header is verified while the image is decoded.
+ * Modules cannot be unloaded: a loaded module holds its memory until
+ * hza_finish(), while a failed load gives its memory back, so loading the
+ * same bad image again and again does not grow the world.
+ * Returns:
+ *  0 = HZA_OK                  success; the module is stored in *mp
+ *  HZAE_MOD00_TRUNC            truncated image
+ *  HZAE_MOD00_MAGIC            bad magic
+ *  HZAE_MOD00_CHECKSUM         checksum mismatch
+ *  HZAE_MOD00_CORRUPT          structural check failed
+ */
 HAZNA_API hza_error_t C41_CALL hza_module_load
 (
     hza_context_t * hc,
     uint8_t const * data,
     size_t size,
+    uint_t flags,
     hza_module_t * * mp
 );
 
+/* hza_mod00_checksum ************************************************ {{{1 */
+/**
+ * Computes the checksum of a mod00 image.
+ * The checksum is CRC32C over the whole image (size bytes) except the 4 bytes
+ * of the checksum field itself.
+ */
+HAZNA_API uint32_t C41_CALL hza_mod00_checksum
+(
+    uint8_t const * data,
+    size_t size
+);
+
+/* hza_mod00_gen_size ************************************************ {{{1 */
+/**
+ * Returns the size of the image hza_mod00_gen() builds for the given
+ * parameters, or 0 if they are invalid or the image would exceed 4GB.
+ */
+HAZNA_API size_t C41_CALL hza_mod00_gen_size
+(
+    hza_mod00_gen_t const * g
+);
+
+/* hza_mod00_gen ***************************************************** {{{1 */
+/**
+ * Builds a valid mod00 image with pseudo-random contents, for scale and
+ * stress tests.
+ * Every proc runs forward only: its body is made of insn_count - 1 insns
+ * picked by the mix weights (branches only jump ahead) and it ends with ret,
+ * so entering any proc runs at most insn_count insns. Constants and extra
+ * data blocks are random filler that no insn uses.
+ * The image gets a valid checksum.
+ * Returns:
+ *  0                           success
+ *  HZAE_GEN_PARAMS             hza_mod00_gen_size() is 0 for these parameters
+ *  HZAE_MOD00_TRUNC            size is smaller than hza_mod00_gen_size()
+ */
+HAZNA_API hza_error_t C41_CALL hza_mod00_gen
+(
+    hza_mod00_gen_t const * g,
+    uint8_t * data,
+    size_t size
+);
+
 /* hza_module_map_name *********************************************** {{{1 */
+/**
+ * Makes a loaded module available by name. Modules loaded later can import
+ * it under this name.
+ * Returns:
+ *  0 = HZA_OK                  success
+ *  HZAE_NAME_TAKEN             the name is mapped to some other module
+ */
 HAZNA_API hza_error_t C41_CALL hza_module_map_name
 (
     hza_context_t * hc,
@@ -703,6 +1454,10 @@ HAZNA_API int32_t C41_CALL hza_export_by_name
 /**
  * Takes a loaded module and imports it into the task attached to current
  * context.
+ * Modules it imports are imported as well (with anchor 0) and their task
+ * indexes are stored in the module map, so imported procs can be reached
+ * without any name lookup. A module already imported in the task keeps its
+ * index and anchor.
  * On success it returns 0 and the index of the imported module is stored in
  * hc->args.module_index
  **/
@@ -731,6 +1486,54 @@ HAZNA_API hza_error_t C41_CALL hza_enter
     uint16_t reg_shift
 );
 
+/* hza_task_input **************************************************** {{{1 */
+/**
+ *  Hands a buffer of input data to the attached task. The task reads it in
+ *  place, so the buffer must stay valid until hza_run() stops with
+ *  HZA_RUN_INPUT (the whole buffer was consumed) or the task ends.
+ *  eof tells that no more data follows this buffer.
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_input
+(
+    hza_context_t * hc,
+    uint8_t * data,
+    size_t size,
+    int eof
+);
+
+/* hza_task_output *************************************************** {{{1 */
+/**
+ *  Sets the buffer where the attached task writes its output. The host
+ *  drains t->out.pos bytes when hza_run() stops with HZA_RUN_OUTPUT (or when
+ *  the task ends) and then calls this again, usually with the same buffer.
+ *  If data is NULL the current buffer is kept and just emptied.
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_output
+(
+    hza_context_t * hc,
+    uint8_t * data,
+    size_t size
+);
+
+/* hza_task_chan_alloc *********************************************** {{{1 */
+/**
+ *  Allocates task-owned buffers for the I/O channels of the attached task.
+ *  The output channel is set to write in its buffer; the host writes
+ *  t->out.data directly to its destination and empties it with
+ *  hza_task_output(hc, NULL, 0). The input buffer is returned in *in_data;
+ *  the host reads its source directly into it and passes it to
+ *  hza_task_input(). The input channel is left empty, so any input given
+ *  before this call is dropped and hza_task_input() must be called again.
+ *  The buffers are freed with the task.
+ */
+HAZNA_API hza_error_t C41_CALL hza_task_chan_alloc
+(
+    hza_context_t * hc,
+    size_t in_size,
+    size_t out_size,
+    uint8_t * * in_data
+);
+
 /* hza_run *********************************************************** {{{1 */
 /**
  *  Executes code in the attached task until the given frame is reached or
@@ -738,6 +1541,15 @@ HAZNA_API hza_error_t C41_CALL hza_enter
  *  The iteration count is updated only on certain instructions (usually
  *  those that change the flow) so execution will likely not stop after exactly 
  *  iter_count iterations.
+ *  Execution also stops on halt, when a host function asks for it and when
+ *  the task needs the host to service its I/O channels. The reason is stored
+ *  in hc->run_stop (HZA_RUN_xxx) and calling hza_run() again resumes from
+ *  where it stopped.
+ *  Returns:
+ *      0 = HZA_OK
+ *      HZAE_CHAN_SIZE          a block does not fit in the output channel
+ *      HZAE_HOST_CALL          a host call names an unregistered function or
+ *                              passes a smaller window than it registered
  */
 HAZNA_API hza_error_t C41_CALL hza_run
 (
@@ -745,6 +1557,184 @@ HAZNA_API hza_error_t C41_CALL hza_run
     uint_t frame_stop,
     uint_t iter_limit
 );
+
+/* hza_prof_enable *************************************************** {{{1 */
+/**
+ *  Starts counting opcode executions and branch outcomes in hza_run() calls
+ *  made by this context. The counters are private to the context so counting
+ *  needs no locking.
+ *  Returns:
+ *      0 = HZA_OK              success (also when already enabled)
+ *      HZAE_NOT_SUPPORTED      the library was built with HZA_PROFILE=0
+ *      HZAE_ALLOC
+ */
+HAZNA_API hza_error_t C41_CALL hza_prof_enable
+(
+    hza_context_t * hc
+);
+
+/* hza_prof_disable ************************************************** {{{1 */
+/**
+ *  Merges the counters of this context into the world and stops counting.
+ *  hza_finish() does this for contexts that still profile.
+ */
+HAZNA_API hza_error_t C41_CALL hza_prof_disable
+(
+    hza_context_t * hc
+);
+
+/* hza_prof_merge **************************************************** {{{1 */
+/**
+ *  Adds the counters of this context to the world totals and zeroes them.
+ *  Each context merges its own counters; nothing stops other contexts while
+ *  they run.
+ */
+HAZNA_API hza_error_t C41_CALL hza_prof_merge
+(
+    hza_context_t * hc
+);
+
+/* hza_prof_report *************************************************** {{{1 */
+/**
+ *  Merges the counters of this context and prints the world totals to io:
+ *  executions per opcode (named with hza_opcode_name()), totals per opcode
+ *  class and primary size, and taken/not taken counts per branch site
+ *  labelled as M<module_id>.P<proc>.I<insn>.
+ */
+HAZNA_API hza_error_t C41_CALL hza_prof_report
+(
+    hza_context_t * hc,
+    c41_io_t * io
+);
+
+/* hza_world_stats *************************************************** {{{1 */
+/**
+ *  Copies the memory usage and object counts of the world into *stats.
+ *  Each group of counters is copied under the mutex that guards it, so this
+ *  holds every mutex only for a few loads and never walks tasks or modules;
+ *  hza_run() takes none of those mutexes unless it allocates.
+ *  The groups are consistent on their own but not with each other.
+ */
+HAZNA_API hza_error_t C41_CALL hza_world_stats
+(
+    hza_context_t * hc,
+    hza_world_stats_t * stats
+);
+
+/* hza_lock_stats_enable ********************************************* {{{1 */
+/**
+ *  Starts (clock != NULL) or stops (clock == NULL) counting acquisitions of
+ *  the world mutexes and timing how long they are waited for and held; the
+ *  results show up in hza_world_stats_t.lock. The engine has no clock of its
+ *  own, so the host provides one.
+ *  Mutexes read the clock pointer without locking, so this must be called
+ *  while hc is the only context attached to the world (e.g. before other
+ *  threads attach). When off, taking a mutex costs one extra branch.
+ *  Returns:
+ *      0 = HZA_OK              success
+ *      HZAE_STATE              other contexts are attached to the world
+ */
+HAZNA_API hza_error_t C41_CALL hza_lock_stats_enable
+(
+    hza_context_t * hc,
+    hza_clock_f clock
+);
+
+/* hza_proc_hook ***************************************************** {{{1 */
+/**
+ *  Sets (or clears, with hook == NULL) the function called when procs are
+ *  entered by hza_enter() or call and left by ret while this context runs
+ *  them. A tail call reports the exit of the caller and then the entry of
+ *  the callee, on the same frame.
+ *  The hook runs on the interpreter's thread, in the middle of hza_run();
+ *  it must not change the task or call back into the engine, except for
+ *  hza_proc_label(). When no hook is set, ret costs one extra branch.
+ */
+HAZNA_API hza_error_t C41_CALL hza_proc_hook
+(
+    hza_context_t * hc,
+    hza_proc_hook_f hook,
+    void * ctx
+);
+
+/* hza_proc_label **************************************************** {{{1 */
+/**
+ *  Writes in buf the name of the frame's proc as "module.proc", the same
+ *  label used by the sampling profiler: the name the module is mapped
+ *  under (or Mxxxx) and the proc's export name (or Pxxxx).
+ *  The label is cut to fit and always zero-terminated (size > 0).
+ *  The frame must belong to the active task. Locks the module mutex.
+ */
+HAZNA_API hza_error_t C41_CALL hza_proc_label
+(
+    hza_context_t * hc,
+    hza_frame_t const * f,
+    char * buf,
+    size_t size
+);
+
+/* hza_host_register ************************************************* {{{1 */
+/**
+ *  Registers a host function that VM code calls with HZAO_HOST_CALL under
+ *  the index stored in *index. The function gets the address of the
+ *  caller's register window; the call insn must declare a window of at
+ *  least window_size bytes, which the module loader already checked to be
+ *  inside the caller's registers, so the call itself is just an index and
+ *  size check, with no locking, copying or allocation.
+ *  The function runs on the interpreter's thread, in the middle of
+ *  hza_run(); it must not change the task or call back into the engine.
+ *  hza_run() reads the table without locking, so functions can only be
+ *  registered while hc is the only context attached to the world.
+ *  Returns:
+ *      0 = HZA_OK
+ *      HZAE_STATE              other contexts are attached to the world
+ *      HZAE_HOST_LIMIT         HZA_HOST_LIMIT functions are registered
+ */
+HAZNA_API hza_error_t C41_CALL hza_host_register
+(
+    hza_context_t * hc,
+    hza_host_f func,
+    void * ctx,
+    uint_t window_size,
+    uint32_t * index
+);
+
+/* hza_sample_enable ************************************************* {{{1 */
+/**
+ *  Samples the VM call stack of the attached task every period iterations
+ *  of hza_run() called from this context (0 selects HZA_SAMPLE_PERIOD).
+ *  hza_run() executes in slices of period iterations and records the stack
+ *  between slices, so the interpreter loop itself is unchanged.
+ *  Samples from all contexts go into one table in the world.
+ */
+HAZNA_API hza_error_t C41_CALL hza_sample_enable
+(
+    hza_context_t * hc,
+    uint_t period
+);
+
+/* hza_sample_disable ************************************************ {{{1 */
+/**
+ *  Stops sampling in this context; the recorded samples are kept.
+ */
+HAZNA_API hza_error_t C41_CALL hza_sample_disable
+(
+    hza_context_t * hc
+);
+
+/* hza_sample_report ************************************************* {{{1 */
+/**
+ *  Prints the sampled stacks as folded stacks, one per line:
+ *      M.P.I;M.P.I count
+ *  outermost frame first. M is the name the module was mapped under with
+ *  hza_module_map_name() or M<module_id>, P is the proc name or P<index> and
+ *  I is I<insn_index>.
+ */
+HAZNA_API hza_error_t C41_CALL hza_sample_report
+(
+    hza_context_t * hc,
+    c41_io_t * io
+);
 /* }}}1 */
 
 #endif /* _HZA_H_ */
@@ -0,0 +1,1086 @@
+#include <stdlib.h>
+#include "cli.h"
+
+#define BENCH_TRIALS            15
+#define BENCH_WARMUP            2
+#define BENCH_MAX_TRIALS        0x100
+#define BENCH_BODY_LEN          16 /* insns in the body of a dispatch loop */
+#define BENCH_LOOP_COUNT        0x100 /* iterations of an 8-bit loop counter */
+#define BENCH_LOAD_SIZE         0x100000 /* size of the module for load */
+#define BENCH_MAX_THREADS       0x10
+#define BENCH_BIG_PROCS         0x2000 /* procs of the run.gen module */
+#define BENCH_CALL_DEPTH        0x100 /* frames pushed by call_rec */
+#define BENCH_DISPATCH_LIMIT    8 /* dispatch.* benches, first in the table */
+
+typedef struct bench_ctx_s                      bench_ctx_t;
+typedef struct bench_s                          bench_t;
+typedef struct bench_thread_s                   bench_thread_t;
+typedef struct bench_image_s                    bench_image_t;
+
+/* runs one trial: stores the time of the measured section and the number of
+ * operations performed in it */
+typedef uint8_t (* bench_f) (bench_ctx_t * bc, bench_t const * b,
+                             uint64_t * ns, uint64_t * ops);
+
+struct bench_s
+{
+    char const * name;
+    char const * unit;
+    bench_f func;
+    uint16_t body_opcode; // for dispatch loops; thread count for .mt
+    uint_t reps; // operations per trial (per thread for .mt)
+};
+
+struct bench_ctx_s
+{
+    c41_io_t * out;
+    c41_io_t * log;
+    c41_ma_t * ma;
+    c41_smt_t * smt;
+    hpma_t hp;
+    hza_context_t hcd;
+    hza_task_t * task;
+    uint8_t * mod_buf;
+    size_t mod_size;
+    uint32_t ret_mi; // task module index of the RET-only module
+    uint32_t rec_mi; // task module index of the call_rec module
+    uint32_t tail_mi; // task module index of the call_rec.tail module
+    uint32_t dispatch_mi[BENCH_DISPATCH_LIMIT]; // per dispatch.* bench
+    uint_t dispatch_count;
+    uint32_t big_mi; // task module index of the run.gen module (0: none)
+    uint32_t host_index; // host function called by dispatch.host
+    uint_t trials;
+    char json;
+    char locks;
+};
+
+/* in-memory stream for task images */
+struct bench_image_s
+{
+    uint8_t * data;
+    size_t limit;
+    size_t size;
+    size_t pos;
+};
+
+struct bench_thread_s
+{
+    bench_t const * b;
+    hza_context_t hcd;
+    c41_smt_tid_t tid;
+    uint8_t rc;
+};
+
+static uint8_t bench_dispatch (bench_ctx_t * bc, bench_t const * b,
+                               uint64_t * ns, uint64_t * ops);
+static uint8_t bench_enter (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops);
+static uint8_t bench_enter_tasks (bench_ctx_t * bc, bench_t const * b,
+                                  uint64_t * ns, uint64_t * ops);
+static uint8_t bench_call (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops);
+static uint8_t bench_task (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops);
+static uint8_t bench_task_mt (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops);
+static uint8_t bench_world (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops);
+static uint8_t bench_load (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops);
+static uint8_t bench_lookup (bench_ctx_t * bc, bench_t const * b,
+                             uint64_t * ns, uint64_t * ops);
+static uint8_t bench_run_gen (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops);
+static uint8_t bench_migrate (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops);
+static uint8_t bench_fork (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops);
+static uint8_t bench_image (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops);
+static uint8_t bench_trim (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops);
+
+static bench_t const bench_table[] =
+{
+    { "dispatch.nnn", "ns/insn", bench_dispatch, HZAO_NOP, 0x40 },
+    { "dispatch.rcn", "ns/insn", bench_dispatch, HZAO_INIT_16, 0x40 },
+    { "dispatch.rrc", "ns/insn", bench_dispatch, HZAO_WRAP_ADD_CONST_8, 0x40 },
+    { "dispatch.rnp", "ns/insn", bench_dispatch, HZAO_BRANCH_ZERO_8, 0x40 },
+    { "dispatch.host", "ns/insn", bench_dispatch, HZAO_HOST_CALL, 0x40 },
+    { "dispatch.vvv", "ns/insn", bench_dispatch, HZAO_VMIN_16, 0x40 },
+    { "enter_ret", "ns/call", bench_enter, 0, 0x2000 },
+    { "enter_ret.tasks", "ns/call", bench_enter_tasks, 4, 0x1000 },
+    { "call_rec", "ns/call", bench_call, 0, 0x40 },
+    { "call_rec.enter", "ns/call", bench_call, 1, 0x40 },
+    { "call_rec.tail", "ns/call", bench_call, 2, 0x40 },
+    { "task_create_deref", "ns/task", bench_task, 0, 0x400 },
+    { "task_create_deref.mt", "ns/task", bench_task_mt, 4, 0x400 },
+    { "task_fork_deref", "ns/task", bench_fork, 0, 0x400 },
+    { "task_save_restore", "ns/task", bench_image, 0, 0x400 },
+    { "task_trim", "ns/task", bench_trim, 0, 0x400 },
+    { "task_trim.peak", "B/task", bench_trim, 1, 0x400 },
+    { "task_trim.idle", "B/task", bench_trim, 2, 0x400 },
+    { "task_migrate", "ns/move", bench_migrate, 0, 0x400 },
+    { "world_init_finish", "ns/world", bench_world, 0, 0x40 },
+    { "world_init_finish.modules", "ns/world", bench_world, 0x100, 0x10 },
+    { "mod00_load", "ms/MB", bench_load, 0, 1 },
+    { "mod00_load.gen", "ms/MB", bench_load, 1, 1 },
+    { "module_by_name", "ns/lookup", bench_lookup, 0, 0x10000 },
+    { "export_by_name", "ns/lookup", bench_lookup, 1, 0x10000 },
+    { "run.gen", "ns/proc", bench_run_gen, 0, 0x1000 },
+};
+
+/* put_insn *****************************************************************/
+static uint8_t * put_insn (uint8_t * p, uint16_t opcode, uint16_t a,
+                           uint16_t b, uint16_t c)
+{
+    c41_write_u16be(p, opcode);
+    c41_write_u16be(p + 2, a);
+    c41_write_u16be(p + 4, b);
+    c41_write_u16be(p + 6, c);
+    return p + 8;
+}
+
+/* build_mod ****************************************************************/
+/**
+ *  Builds in bc->mod_buf a module with one unnamed proc made of insn_count
+ *  insns and target_count targets; the header, proc table and empty
+ *  data block and import tables are filled here, the caller fills the
+ *  targets and insns at the returned pointer (targets first).
+ */
+static uint8_t * build_mod (bench_ctx_t * bc, uint32_t target_count,
+                            uint32_t insn_count)
+{
+    size_t n = sizeof(hza_mod00_hdr_t) + 2 * sizeof(hza_mod00_proc_t) + 8
+        + sizeof(hza_mod00_impmod_t);
+    uint8_t * p;
+
+    bc->mod_size = n + target_count * 4 + insn_count * 8;
+    if (c41_ma_alloc(bc->ma, (void * *) &bc->mod_buf, bc->mod_size))
+    {
+        bc->mod_buf = NULL;
+        return NULL;
+    }
+    p = bc->mod_buf;
+    C41_MEM_ZERO(p, n);
+    C41_MEM_COPY(p, HZA_MOD00_MAGIC, HZA_MOD00_MAGIC_LEN);
+    c41_write_u32be(p + 0x08, (uint32_t) bc->mod_size);
+    c41_write_u32be(p + 0x20, 1); // proc_count
+    c41_write_u32be(p + 0x24, 1); // data_block_count
+    c41_write_u32be(p + 0x34, target_count);
+    c41_write_u32be(p + 0x38, insn_count);
+    /* proc 0 starts at 0; the end of the proc table holds the counts */
+    p += sizeof(hza_mod00_hdr_t) + sizeof(hza_mod00_proc_t);
+    c41_write_u32be(p, insn_count);
+    c41_write_u32be(p + 4, target_count);
+    return bc->mod_buf + n;
+}
+
+/* build_gen_mod ************************************************************/
+/**
+ *  Generates in bc->mod_buf a module of proc_count procs of 0x100 insns
+ *  (about BENCH_LOAD_SIZE bytes for 0x200 procs), a few constants per proc
+ *  and all procs exported.
+ */
+static uint8_t * build_gen_mod (bench_ctx_t * bc, uint32_t proc_count)
+{
+    hza_mod00_gen_t g;
+
+    C41_VAR_ZERO(g);
+    g.seed = 1;
+    g.proc_count = proc_count;
+    g.insn_count = 0x100;
+    g.const64_count = g.const32_count = 4;
+    g.export_count = g.proc_count;
+    bc->mod_size = hza_mod00_gen_size(&g);
+    if (!bc->mod_size
+        || c41_ma_alloc(bc->ma, (void * *) &bc->mod_buf, bc->mod_size))
+        return bc->mod_buf = NULL;
+    if (hza_mod00_gen(&g, bc->mod_buf, bc->mod_size))
+    {
+        c41_ma_free(bc->ma, bc->mod_buf, bc->mod_size);
+        return bc->mod_buf = NULL;
+    }
+    return bc->mod_buf;
+}
+
+/* load_mod *****************************************************************/
+/* loads the module from bc->mod_buf, imports it and frees the buffer */
+static uint8_t load_mod (bench_ctx_t * bc, uint32_t * module_index)
+{
+    hza_module_t * m;
+    hza_error_t e;
+
+    c41_write_u32be(bc->mod_buf + HZA_MOD00_CHECKSUM_OFS,
+                    hza_mod00_checksum(bc->mod_buf, bc->mod_size));
+    e = hza_module_load(&bc->hcd, bc->mod_buf, bc->mod_size, 0, &m);
+    if (!e) e = hza_import(&bc->hcd, m, 0);
+    c41_ma_free(bc->ma, bc->mod_buf, bc->mod_size);
+    bc->mod_buf = NULL;
+    if (e) return EC_INIT;
+    *module_index = bc->hcd.args.module_index;
+    return 0;
+}
+
+/* bench_host ***************************************************************/
+/* host function of dispatch.host: increments the 64-bit reg it gets */
+static uint_t C41_CALL bench_host (hza_context_t * hc, uint8_t * regs,
+                                   void * ctx)
+{
+    (void) hc;
+    (void) ctx;
+    *(uint64_t *) regs += 1;
+    return 0;
+}
+
+/* build_dispatch ***********************************************************/
+/**
+ *  Loads the module of a dispatch.* bench: a loop whose body is
+ *  BENCH_BODY_LEN insns with the bench's opcode; the loop runs
+ *  BENCH_LOOP_COUNT times per proc call.
+ */
+static uint8_t build_dispatch (bench_ctx_t * bc, bench_t const * b,
+                               uint32_t * module_index)
+{
+    uint8_t * p;
+    uint_t i, tc, ic;
+
+    /* 0: counter = 0; 1..n: body; n+1: counter -= 1; n+2: loop; n+3: ret */
+    tc = 2 + 2 * BENCH_BODY_LEN;
+    ic = BENCH_BODY_LEN + 4;
+    p = build_mod(bc, tc, ic);
+    if (!p) return EC_INIT;
+    for (i = 0; i < BENCH_BODY_LEN; ++i)
+    {
+        c41_write_u32be(p, i + 2);
+        c41_write_u32be(p + 4, i + 2);
+        p += 8;
+    }
+    c41_write_u32be(p, BENCH_BODY_LEN + 3);
+    c41_write_u32be(p + 4, 1);
+    p += 8;
+    p = put_insn(p, HZAO_INIT_8, 0x08, 0, 0);
+    for (i = 0; i < BENCH_BODY_LEN; ++i)
+    {
+        switch (b->body_opcode)
+        {
+        case HZAO_INIT_16:
+            p = put_insn(p, b->body_opcode, 0x10, (uint16_t) i, 0);
+            break;
+        case HZAO_WRAP_ADD_CONST_8:
+            p = put_insn(p, b->body_opcode, 0x20, 0x20, 1);
+            break;
+        case HZAO_BRANCH_ZERO_8:
+            p = put_insn(p, b->body_opcode, 0x20, 0, (uint16_t) (i * 2));
+            break;
+        case HZAO_HOST_CALL:
+            p = put_insn(p, b->body_opcode, 0x40, 8,
+                         (uint16_t) bc->host_index);
+            break;
+        case HZAO_VMIN_16:
+            p = put_insn(p, b->body_opcode, 0x80, 0x80, 0x100);
+            break;
+        default:
+            p = put_insn(p, b->body_opcode, 0, 0, 0);
+        }
+    }
+    p = put_insn(p, HZAO_WRAP_ADD_CONST_8, 0x08, 0x08, 0xFF);
+    p = put_insn(p, HZAO_BRANCH_ZERO_8, 0x08, 0, BENCH_BODY_LEN * 2);
+    put_insn(p, HZAO_RET, 0, 0, 0);
+    return load_mod(bc, module_index);
+}
+
+/* bench_dispatch ***********************************************************/
+/* runs the loop module built by build_dispatch() */
+static uint8_t bench_dispatch (bench_ctx_t * bc, bench_t const * b,
+                               uint64_t * ns, uint64_t * ops)
+{
+    uint32_t mi;
+    uint_t i;
+    uint64_t t0;
+    hza_error_t e;
+
+    i = (uint_t) (b - bench_table);
+    if (i >= bc->dispatch_count) return EC_INIT;
+    mi = bc->dispatch_mi[i];
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        e = hza_enter(&bc->hcd, mi, 0, 0);
+        if (!e) e = hza_run(&bc->hcd, 0, 0x40000000);
+        if (e) return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = (uint64_t) b->reps * BENCH_LOOP_COUNT * (BENCH_BODY_LEN + 2);
+    return 0;
+}
+
+/* bench_enter **************************************************************/
+static uint8_t bench_enter (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops)
+{
+    uint64_t t0;
+    uint_t i;
+    hza_error_t e;
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        e = hza_enter(&bc->hcd, bc->ret_mi, 0, 0);
+        if (!e) e = hza_run(&bc->hcd, 0, 0x100);
+        if (e) return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    return 0;
+}
+
+/* bench_call ***************************************************************/
+/**
+ *  Recurses BENCH_CALL_DEPTH frames deep and back, b->reps times: with
+ *  call insns in a proc that calls itself with its counter minus 1 in the
+ *  regs after its own or, for .enter, with hza_enter() from the host and
+ *  RET procs. For .tail the proc tail calls itself BENCH_CALL_DEPTH times
+ *  in one frame.
+ */
+static uint8_t bench_call (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * t = bc->task;
+    uint64_t t0;
+    uint_t i, d;
+    hza_error_t e;
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        if (b->body_opcode == 1)
+        {
+            for (e = 0, d = 0; d < BENCH_CALL_DEPTH && !e; ++d)
+                e = hza_enter(&bc->hcd, bc->ret_mi, 0, 0x80);
+        }
+        else
+        {
+            e = hza_enter(&bc->hcd, b->body_opcode ? bc->tail_mi : bc->rec_mi,
+                          0, 0);
+            if (!e)
+                t->reg_space[t->frame_table[t->frame_index].reg_base] =
+                    BENCH_CALL_DEPTH - 1;
+        }
+        if (!e) e = hza_run(&bc->hcd, 0, 0x40000000);
+        if (e || t->frame_index) return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = (uint64_t) b->reps * BENCH_CALL_DEPTH;
+    return 0;
+}
+
+/* bench_enter_tasks ********************************************************/
+/**
+ *  Calls the RET proc in each of b->reps tasks in turn, b->body_opcode
+ *  rounds; the tasks do not fit in the cache so this measures the cache
+ *  footprint of a call and return rather than the dispatch.
+ */
+static uint8_t bench_enter_tasks (bench_ctx_t * bc, bench_t const * b,
+                                  uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * * tt;
+    hza_module_t * m;
+    uint64_t t0;
+    uint32_t mi;
+    uint_t i, n, k;
+    uint8_t rc;
+    hza_error_t e;
+
+    if (c41_ma_alloc(bc->ma, (void * *) &tt, b->reps * sizeof(*tt)))
+        return EC_INIT;
+    m = bc->task->module_table[bc->ret_mi].module;
+    for (n = 0, mi = 0, rc = 0; n < b->reps; ++n)
+    {
+        if (hza_task_create(&bc->hcd, tt + n))
+        {
+            rc = EC_INIT;
+            break;
+        }
+        if (hza_import(&bc->hcd, m, 0)
+            || (n && mi != bc->hcd.args.module_index))
+        {
+            rc = EC_INIT;
+            ++n;
+            break;
+        }
+        mi = bc->hcd.args.module_index;
+    }
+
+    t0 = now_ns();
+    for (k = 0; k < b->body_opcode && !rc; ++k)
+        for (i = 0; i < n; ++i)
+        {
+            /* all tasks are owned by this context */
+            bc->hcd.active_task = tt[i];
+            e = hza_enter(&bc->hcd, mi, 0, 0);
+            if (!e) e = hza_run(&bc->hcd, 0, 0x100);
+            if (e)
+            {
+                rc = EC_PROC;
+                break;
+            }
+        }
+    *ns = now_ns() - t0;
+    *ops = (uint64_t) b->reps * b->body_opcode;
+
+    for (i = 0; i < n; ++i)
+        if (hza_task_deref(&bc->hcd, tt[i])) rc |= EC_FINISH;
+    bc->hcd.active_task = bc->task;
+    if (c41_ma_free(bc->ma, tt, b->reps * sizeof(*tt))) rc |= EC_FINISH;
+    return rc;
+}
+
+/* bench_migrate ************************************************************/
+/**
+ *  Moves the bench task back and forth between nodes 0 and 1; the bench
+ *  world has no node allocators so this times the copy of the reg space
+ *  and frame table plus the locking, not the remote memory.
+ */
+static uint8_t bench_migrate (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops)
+{
+    uint64_t t0;
+    uint_t i;
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+        if (hza_task_migrate(&bc->hcd, (i + 1) & 1)) return EC_PROC;
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    return 0;
+}
+
+/* bench_task ***************************************************************/
+static uint8_t bench_task (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * t;
+    uint64_t t0;
+    uint_t i;
+    hza_error_t e;
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        e = hza_task_create(&bc->hcd, &t);
+        if (!e) e = hza_task_deref(&bc->hcd, t);
+        if (e) return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    /* creating a task made it the active one */
+    bc->hcd.active_task = bc->task;
+    return 0;
+}
+
+/* bench_fork ***************************************************************/
+/* forks the bench task (which has the RET module imported) and drops it */
+static uint8_t bench_fork (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * t;
+    uint64_t t0;
+    uint_t i;
+    hza_error_t e;
+
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        e = hza_task_fork(&bc->hcd, bc->task, &t);
+        if (!e) e = hza_task_deref(&bc->hcd, t);
+        if (e) return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    bc->hcd.active_task = bc->task;
+    return 0;
+}
+
+/* bench_image_write ********************************************************/
+static uint_t C41_CALL bench_image_write (void * ctx, void * data, size_t size)
+{
+    bench_image_t * img = ctx;
+
+    if (size > img->limit - img->size) return 1;
+    C41_MEM_COPY(img->data + img->size, data, size);
+    img->size += size;
+    return 0;
+}
+
+/* bench_image_read *********************************************************/
+static uint_t C41_CALL bench_image_read (void * ctx, void * data, size_t size)
+{
+    bench_image_t * img = ctx;
+
+    if (size > img->size - img->pos) return 1;
+    C41_MEM_COPY(data, img->data + img->pos, size);
+    img->pos += size;
+    return 0;
+}
+
+/* bench_image **************************************************************/
+/* saves the bench task to memory, restores it and drops the restored task */
+static uint8_t bench_image (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * t = bc->task;
+    bench_image_t img;
+    uint64_t t0;
+    uint_t i;
+    uint8_t rc;
+    hza_error_t e;
+
+    /* upper bound: no page skipped */
+    img.limit = 0x18 * t->module_count + 0x10 * (t->frame_index + 1)
+        + t->reg_limit + 4 * (t->reg_limit / HZA_IMAGE_PAGE + 2);
+    if (c41_ma_alloc(bc->ma, (void * *) &img.data, img.limit))
+        return EC_INIT;
+    rc = 0;
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        img.size = img.pos = 0;
+        bc->hcd.active_task = bc->task;
+        e = hza_task_save(&bc->hcd, bench_image_write, &img);
+        if (!e) e = hza_task_restore(&bc->hcd, bench_image_read, &img, &t);
+        if (!e) e = hza_task_deref(&bc->hcd, t);
+        if (e)
+        {
+            rc = EC_PROC;
+            break;
+        }
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    bc->hcd.active_task = bc->task;
+    if (c41_ma_free(bc->ma, img.data, img.limit)) rc |= EC_FINISH;
+    return rc;
+}
+
+/* bench_trim ***************************************************************/
+/**
+ *  Builds b->reps idle tasks, task n having gone n % 0x40 + 1 calls deep
+ *  with 0x100 reg bytes per call, and trims them. b->body_opcode selects
+ *  the result: 0 = time per trim; 1, 2 = reg space and frame table bytes
+ *  per task before and after the trim.
+ */
+static uint8_t bench_trim (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops)
+{
+    hza_task_t * * tt;
+    hza_module_t * m;
+    hza_world_stats_t ws;
+    uint64_t t0, base, peak;
+    size_t freed;
+    uint32_t mi;
+    uint_t i, n, k;
+    uint8_t rc;
+    hza_error_t e;
+
+    if (c41_ma_alloc(bc->ma, (void * *) &tt, b->reps * sizeof(*tt)))
+        return EC_INIT;
+    rc = hza_world_stats(&bc->hcd, &ws) ? EC_PROC : 0;
+    base = ws.mem_live[HZA_MEM_REG] + ws.mem_live[HZA_MEM_FRAME];
+    m = bc->task->module_table[bc->ret_mi].module;
+    for (n = 0; n < b->reps && !rc; ++n)
+    {
+        if (hza_task_create(&bc->hcd, tt + n))
+        {
+            rc = EC_INIT;
+            break;
+        }
+        e = hza_import(&bc->hcd, m, 0);
+        mi = bc->hcd.args.module_index;
+        for (k = 0; !e && k <= n % 0x40; ++k)
+            e = hza_enter(&bc->hcd, mi, 0, 0x800);
+        if (!e) e = hza_run(&bc->hcd, 0, 0x100);
+        if (e) rc = EC_INIT;
+    }
+
+    if (!rc && hza_world_stats(&bc->hcd, &ws)) rc = EC_PROC;
+    peak = ws.mem_live[HZA_MEM_REG] + ws.mem_live[HZA_MEM_FRAME] - base;
+    t0 = now_ns();
+    for (i = 0; i < n && !rc; ++i)
+    {
+        bc->hcd.active_task = tt[i];
+        if (hza_task_trim(&bc->hcd, &freed)) rc = EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    if (!rc && hza_world_stats(&bc->hcd, &ws)) rc = EC_PROC;
+    if (b->body_opcode == 1) *ns = peak;
+    else if (b->body_opcode == 2)
+        *ns = ws.mem_live[HZA_MEM_REG] + ws.mem_live[HZA_MEM_FRAME] - base;
+
+    for (i = 0; i < n; ++i)
+        if (hza_task_deref(&bc->hcd, tt[i])) rc |= EC_FINISH;
+    bc->hcd.active_task = bc->task;
+    if (c41_ma_free(bc->ma, tt, b->reps * sizeof(*tt))) rc |= EC_FINISH;
+    return rc;
+}
+
+/* bench_task_thread ********************************************************/
+static uint8_t C41_CALL bench_task_thread (void * arg)
+{
+    bench_thread_t * bt = arg;
+    hza_task_t * t;
+    uint_t i;
+    hza_error_t e;
+
+    for (i = 0; i < bt->b->reps; ++i)
+    {
+        e = hza_task_create(&bt->hcd, &t);
+        if (!e) e = hza_task_deref(&bt->hcd, t);
+        if (e)
+        {
+            bt->rc = EC_PROC;
+            break;
+        }
+    }
+    return 0;
+}
+
+/* bench_task_mt ************************************************************/
+/**
+ *  Same as bench_task() but from b->body_opcode threads at once, each with
+ *  its own context in the bench world; measures contention on the world and
+ *  task mutexes.
+ */
+static uint8_t bench_task_mt (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops)
+{
+    bench_thread_t bt[BENCH_MAX_THREADS];
+    uint64_t t0;
+    uint_t i, n, started;
+    uint8_t rc;
+
+    n = b->body_opcode;
+    for (i = 0; i < n; ++i)
+    {
+        bt[i].b = b;
+        bt[i].rc = 0;
+        if (hza_attach(&bt[i].hcd, bc->hcd.world)) break;
+    }
+    rc = i < n ? EC_INIT : 0;
+    n = i;
+
+    t0 = now_ns();
+    for (started = 0; started < n && !rc; ++started)
+        if (c41_smt_thread_create(bc->smt, &bt[started].tid,
+                                  bench_task_thread, bt + started))
+            rc |= EC_INIT;
+    for (i = 0; i < started; ++i)
+    {
+        if (c41_smt_thread_join(bc->smt, bt[i].tid)) rc |= EC_FINISH;
+        rc |= bt[i].rc;
+    }
+    *ns = now_ns() - t0;
+    *ops = (uint64_t) b->reps * n;
+
+    for (i = 0; i < n; ++i)
+        if (hza_finish(&bt[i].hcd)) rc |= EC_FINISH;
+    return rc;
+}
+
+/* bench_world **************************************************************/
+/**
+ *  Creates and destroys b->reps worlds; each world loads and names
+ *  b->body_opcode one-insn modules before it is destroyed.
+ */
+static uint8_t bench_world (bench_ctx_t * bc, bench_t const * b,
+                            uint64_t * ns, uint64_t * ops)
+{
+    hza_context_t hcd;
+    hza_module_t * m;
+    uint8_t * p;
+    uint8_t name[4];
+    uint64_t t0;
+    uint_t i, j;
+    uint8_t rc;
+
+    if (b->body_opcode)
+    {
+        p = build_mod(bc, 0, 1);
+        if (!p) return EC_INIT;
+        put_insn(p, HZAO_RET, 0, 0, 0);
+    }
+    rc = 0;
+    t0 = now_ns();
+    for (i = 0; i < b->reps && !rc; ++i)
+    {
+        if (hza_init(&hcd, bc->ma, bc->smt, bc->log, 0))
+        {
+            rc = EC_PROC;
+            break;
+        }
+        for (j = 0; j < b->body_opcode && !rc; ++j)
+        {
+            c41_write_u32be(name, j);
+            if (hza_module_load(&hcd, bc->mod_buf, bc->mod_size,
+                                HZA_LOAD_NO_CHECKSUM, &m)
+                || hza_module_map_name(&hcd, m, name, sizeof(name)))
+                rc = EC_PROC;
+        }
+        if (hza_finish(&hcd)) rc = EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    if (bc->mod_buf)
+    {
+        c41_ma_free(bc->ma, bc->mod_buf, bc->mod_size);
+        bc->mod_buf = NULL;
+    }
+    return rc;
+}
+
+/* bench_load ***************************************************************/
+/**
+ *  Loads a BENCH_LOAD_SIZE module made of NOPs (or, for .gen, a generated
+ *  module of about that size with many procs, branches, constants and
+ *  exports) in a fresh world; only the load is timed. Reports ms per MB by
+ *  scaling ns per load.
+ */
+static uint8_t bench_load (bench_ctx_t * bc, bench_t const * b,
+                           uint64_t * ns, uint64_t * ops)
+{
+    hza_context_t hcd;
+    hza_module_t * m;
+    uint8_t * p;
+    uint64_t t0;
+    uint_t i, ic;
+    hza_error_t e;
+
+    if (b->body_opcode)
+    {
+        if (!build_gen_mod(bc, 0x200)) return EC_INIT;
+    }
+    else
+    {
+        ic = (BENCH_LOAD_SIZE - 0x80) / 8;
+        p = build_mod(bc, 0, ic);
+        if (!p) return EC_INIT;
+        for (i = 0; i < ic - 1; ++i) p = put_insn(p, HZAO_NOP, 0, 0, 0);
+        p = put_insn(p, HZAO_RET, 0, 0, 0);
+        c41_write_u32be(bc->mod_buf + HZA_MOD00_CHECKSUM_OFS,
+                        hza_mod00_checksum(bc->mod_buf, bc->mod_size));
+    }
+
+    e = hza_init(&hcd, bc->ma, bc->smt, bc->log, 0);
+    if (!e)
+    {
+        t0 = now_ns();
+        e = hza_module_load(&hcd, bc->mod_buf, bc->mod_size, 0, &m);
+        *ns = now_ns() - t0;
+        if (hza_finish(&hcd)) e = HZAE_WORLD_FINISH;
+    }
+    c41_ma_free(bc->ma, bc->mod_buf, bc->mod_size);
+    bc->mod_buf = NULL;
+    if (e) return EC_PROC;
+    /* ns per MB is ms per MB * 1e6; report in ms/MB */
+    *ns = *ns * 0x100000 / bc->mod_size;
+    *ops = 1000000;
+    return 0;
+}
+
+/* bench_lookup *************************************************************/
+static uint8_t bench_lookup (bench_ctx_t * bc, bench_t const * b,
+                             uint64_t * ns, uint64_t * ops)
+{
+    hza_module_t * m;
+    uint64_t t0;
+    uint_t i;
+
+    if (hza_module_by_name(&bc->hcd, (uint8_t const *) "core", 4, &m))
+        return EC_PROC;
+    t0 = now_ns();
+    if (b->body_opcode)
+    {
+        for (i = 0; i < b->reps; ++i)
+            if (hza_export_by_name(m, (uint8_t const *) "_test0", 6) < 0)
+                return EC_PROC;
+    }
+    else
+    {
+        for (i = 0; i < b->reps; ++i)
+            if (hza_module_by_name(&bc->hcd, (uint8_t const *) "core", 4, &m))
+                return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    return 0;
+}
+
+/* bench_run_gen ************************************************************/
+/**
+ *  Enters and runs procs picked at random from a generated module of
+ *  BENCH_BIG_PROCS procs (16MB of decoded insns) loaded on the first trial;
+ *  bound by TLB misses unless the module image sits in huge pages (--huge).
+ */
+static uint8_t bench_run_gen (bench_ctx_t * bc, bench_t const * b,
+                              uint64_t * ns, uint64_t * ops)
+{
+    uint64_t t0;
+    uint32_t x;
+    uint_t i;
+
+    if (!bc->big_mi)
+    {
+        if (!build_gen_mod(bc, BENCH_BIG_PROCS)) return EC_INIT;
+        if (load_mod(bc, &bc->big_mi)) return EC_INIT;
+    }
+    x = 1;
+    t0 = now_ns();
+    for (i = 0; i < b->reps; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        if (hza_enter(&bc->hcd, bc->big_mi, (x >> 8) & (BENCH_BIG_PROCS - 1),
+                      0)
+            || hza_run(&bc->hcd, 0, 0x101)
+            || bc->hcd.run_stop != HZA_RUN_FRAME)
+            return EC_PROC;
+    }
+    *ns = now_ns() - t0;
+    *ops = b->reps;
+    return 0;
+}
+
+/* bench_clock **************************************************************/
+static uint64_t C41_CALL bench_clock (void)
+{
+    return now_ns();
+}
+
+/* put_locks ****************************************************************/
+/* writes the lock stats of the bench world */
+static uint8_t put_locks (bench_ctx_t * bc)
+{
+    static char const * const mutex_name[HZA_MUTEXES] =
+        { "world", "log", "module", "task" };
+    hza_world_stats_t ws;
+    hza_lock_stats_t * ls;
+    uint_t i;
+    ssize_t z;
+
+    if (hza_world_stats(&bc->hcd, &ws)) return EC_PROC;
+    if (bc->json)
+        z = c41_io_fmt(bc->out, "\n], \"locks\": [\n");
+    else
+        z = c41_io_fmt(bc->out, "\nmutex         acquired    contended"
+                       "      wait_ns  max_wait_ns      hold_ns  max_hold_ns"
+                       "\n");
+    for (i = 0; i < HZA_MUTEXES && z >= 0; ++i)
+    {
+        ls = ws.lock + i;
+        if (bc->json)
+            z = c41_io_fmt(bc->out, "$s  { \"mutex\": \"$s\", "
+                           "\"count\": $Uq, \"contended\": $Uq, "
+                           "\"wait_ns\": $Uq, \"wait_max_ns\": $Uq, "
+                           "\"hold_ns\": $Uq, \"hold_max_ns\": $Uq }",
+                           i ? ",\n" : "", mutex_name[i], ls->count,
+                           ls->contended, ls->wait_total, ls->wait_max,
+                           ls->hold_total, ls->hold_max);
+        else
+        {
+            z = put_text(bc->out, mutex_name[i], 8);
+            if (z >= 0) z = put_int(bc->out, ls->count, 13);
+            if (z >= 0) z = put_int(bc->out, ls->contended, 13);
+            if (z >= 0) z = put_int(bc->out, ls->wait_total, 13);
+            if (z >= 0) z = put_int(bc->out, ls->wait_max, 13);
+            if (z >= 0) z = put_int(bc->out, ls->hold_total, 13);
+            if (z >= 0) z = put_int(bc->out, ls->hold_max, 13);
+            if (z >= 0) z = c41_io_fmt(bc->out, "\n");
+        }
+    }
+    return z < 0 ? EC_LOG : 0;
+}
+
+/* bench ********************************************************************/
+uint8_t bench (c41_cli_t * cli_p)
+{
+    bench_ctx_t bc;
+    bench_t const * b;
+    uint64_t r[BENCH_MAX_TRIALS]; // per-op time in 1/100 ns
+    uint64_t ns, ops, p50, p90;
+    char const * filter;
+    char * end;
+    ssize_t z;
+    uint_t ai, bi, ti, bn;
+    int hp_mode;
+    uint8_t * p;
+    uint8_t rc;
+    char first;
+
+    C41_VAR_ZERO(bc);
+    bc.out = cli_p->stdout_p;
+    bc.log = cli_p->stderr_p;
+    bc.smt = cli_p->smt_p;
+    bc.trials = BENCH_TRIALS;
+    hp_mode = HPMA_OFF;
+    filter = NULL;
+
+    for (ai = 1; ai < cli_p->arg_n; ++ai)
+    {
+        if (C41_STR_EQUAL(cli_p->arg_a[ai], "--json")) bc.json = 1;
+        else if (C41_STR_EQUAL(cli_p->arg_a[ai], "--locks")) bc.locks = 1;
+        else if (C41_STR_EQUAL(cli_p->arg_a[ai], "--trials")
+                 && ai + 1 < cli_p->arg_n)
+        {
+            bc.trials = (uint_t) strtoul(cli_p->arg_a[++ai], &end, 0);
+            if (*end || bc.trials < 1 || bc.trials > BENCH_MAX_TRIALS) break;
+        }
+        else if (C41_STR_EQUAL(cli_p->arg_a[ai], "--huge")
+                 && ai + 1 < cli_p->arg_n)
+        {
+            hp_mode = hpma_mode(cli_p->arg_a[++ai]);
+            if (hp_mode < 0) break;
+        }
+        else if (cli_p->arg_a[ai][0] != '-' && !filter)
+            filter = cli_p->arg_a[ai];
+        else break;
+    }
+    if (ai < cli_p->arg_n)
+    {
+        z = c41_io_fmt(bc.log, "Error: bad arguments for command 'bench' "
+                       "(see 'hazna help')\n");
+        return z < 0 ? EC_INVOKE | EC_LOG : EC_INVOKE;
+    }
+
+    hpma_init(&bc.hp, cli_p->ma_p, (uint_t) hp_mode, HPMA_PAGE);
+    bc.ma = &bc.hp.ma;
+    if (hza_init(&bc.hcd, bc.ma, bc.smt, bc.log, 0)) return EC_INIT;
+    rc = 0;
+    do
+    {
+        if (bc.locks) hza_lock_stats_enable(&bc.hcd, bench_clock);
+        if (hza_host_register(&bc.hcd, bench_host, NULL, 8, &bc.host_index)
+            || hza_task_create(&bc.hcd, &bc.task))
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        p = build_mod(&bc, 0, 1);
+        if (!p)
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        put_insn(p, HZAO_RET, 0, 0, 0);
+        rc |= load_mod(&bc, &bc.ret_mi);
+        if (rc) break;
+
+        /* call_rec: 0: counter is 0 ? 3 : 1; 1: callee counter = counter - 1;
+         * 2: call self; 3: ret */
+        p = build_mod(&bc, 2, 4);
+        if (!p)
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        c41_write_u32be(p, 3);
+        c41_write_u32be(p + 4, 1);
+        p += 8;
+        p = put_insn(p, HZAO_BRANCH_ZERO_8, 0x00, 0, 0);
+        p = put_insn(p, HZAO_WRAP_ADD_CONST_8, 0x80, 0x00, 0xFF);
+        p = put_insn(p, HZAO_CALL, 0x80, 0, 0);
+        put_insn(p, HZAO_RET, 0, 0, 0);
+        rc |= load_mod(&bc, &bc.rec_mi);
+        if (rc) break;
+
+        /* call_rec.tail: same, with 2: tail call self in place */
+        p = build_mod(&bc, 2, 4);
+        if (!p)
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        c41_write_u32be(p, 3);
+        c41_write_u32be(p + 4, 1);
+        p += 8;
+        p = put_insn(p, HZAO_BRANCH_ZERO_8, 0x00, 0, 0);
+        p = put_insn(p, HZAO_WRAP_ADD_CONST_8, 0x00, 0x00, 0xFF);
+        p = put_insn(p, HZAO_TAIL_CALL, 0x00, 0, 0);
+        put_insn(p, HZAO_RET, 0, 0, 0);
+        rc |= load_mod(&bc, &bc.tail_mi);
+        if (rc) break;
+
+        /* dispatch.*: one loop module per bench, reused by every trial */
+        for (bi = 0; !rc && bi < BENCH_DISPATCH_LIMIT
+             && bench_table[bi].func == bench_dispatch; ++bi)
+            rc |= build_dispatch(&bc, bench_table + bi, &bc.dispatch_mi[bi]);
+        bc.dispatch_count = bi;
+        if (rc) break;
+
+        if (bc.json)
+            z = c41_io_fmt(bc.out, "{ \"trials\": $Ui, \"warmup\": $Ui, "
+                           "\"bench\": [\n", bc.trials, BENCH_WARMUP);
+        else
+            z = c41_io_fmt(bc.out, "bench               unit      "
+                           "          min          p50          p90"
+                           "          max\n");
+        if (z < 0) rc |= EC_LOG;
+
+        first = 1;
+        bn = sizeof(bench_table) / sizeof(bench_table[0]);
+        for (bi = 0; bi < bn && !rc; ++bi)
+        {
+            b = bench_table + bi;
+            /* the filter selects benchmarks by name prefix */
+            if (filter && (C41_STR_LEN(filter) > C41_STR_LEN(b->name)
+                           || !C41_MEM_EQUAL(filter, b->name,
+                                             C41_STR_LEN(filter))))
+                continue;
+
+            for (ti = 0; ti < BENCH_WARMUP + bc.trials; ++ti)
+            {
+                rc |= b->func(&bc, b, &ns, &ops);
+                if (rc) break;
+                if (ti >= BENCH_WARMUP)
+                    r[ti - BENCH_WARMUP] = ns * 100 / ops;
+            }
+            if (rc)
+            {
+                z = c41_io_fmt(bc.log, "Error: benchmark $s failed\n",
+                               b->name);
+                if (z < 0) rc |= EC_LOG;
+                break;
+            }
+            qsort(r, bc.trials, sizeof(r[0]), u64_cmp);
+            p50 = r[(bc.trials - 1) / 2];
+            p90 = r[(bc.trials - 1) * 9 / 10];
+            if (bc.json)
+                z = c41_io_fmt(bc.out, "$s  { \"name\": \"$s\", "
+                               "\"unit\": \"$s\", \"min\": $Uq.$.2Uq, "
+                               "\"p50\": $Uq.$.2Uq, \"p90\": $Uq.$.2Uq, "
+                               "\"max\": $Uq.$.2Uq }",
+                               first ? "" : ",\n", b->name, b->unit,
+                               r[0] / 100, r[0] % 100, p50 / 100, p50 % 100,
+                               p90 / 100, p90 % 100,
+                               r[bc.trials - 1] / 100, r[bc.trials - 1] % 100);
+            else
+            {
+                z = put_text(bc.out, b->name, 20);
+                if (z >= 0) z = put_text(bc.out, b->unit, 10);
+                if (z >= 0) z = put_num(bc.out, r[0], 13);
+                if (z >= 0) z = put_num(bc.out, p50, 13);
+                if (z >= 0) z = put_num(bc.out, p90, 13);
+                if (z >= 0) z = put_num(bc.out, r[bc.trials - 1], 13);
+                if (z >= 0) z = c41_io_fmt(bc.out, "\n");
+            }
+            if (z < 0) rc |= EC_LOG;
+            first = 0;
+        }
+        if (bc.locks && !rc) rc |= put_locks(&bc);
+        if (bc.json && c41_io_fmt(bc.out, "\n] }\n") < 0) rc |= EC_LOG;
+    }
+    while (0);
+
+    if (hza_finish(&bc.hcd)) rc |= EC_FINISH;
+    return rc;
+}
@@ -0,0 +1,1222 @@
+#include <stdlib.h>
+#include "cli.h"
+
+#if _WIN32
+#   include <windows.h>
+#   define BSP_LOAD(_p) (MemoryBarrier(), *(_p))
+#   define BSP_STORE(_p, _v) \
+        InterlockedExchange((LONG volatile *) (_p), (LONG) (_v))
+#else
+#   define BSP_LOAD(_p) __atomic_load_n((_p), __ATOMIC_SEQ_CST)
+#   define BSP_STORE(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_SEQ_CST)
+#endif
+
+#define BSP_CHUNK_SIZE          0x100000
+#define BSP_CHUNK_SIZE_MAX      0x40000000
+#define BSP_ITER_LIMIT          0x40000000
+#define BSP_ENTRY               "bsp"
+#define BSP_MAX_JOBS            0x40
+#define BSP_WINDOW_PER_JOB      2 /* in-flight chunks per worker */
+#define BSP_IO_BUFS             4 /* recycled buffers per I/O thread */
+#define BSP_QUEUE_SIZE          8 /* power of 2, > BSP_IO_BUFS */
+
+/* the probe points must stay real calls for uprobes to hook them */
+#if defined(__GNUC__)
+#   define BSP_PROBE_POINT __attribute__((noinline, used))
+#   define BSP_PROBE_ARG(_x) __asm__ volatile ("" : : "r" (_x) : "memory")
+#elif defined(_MSC_VER)
+#   define BSP_PROBE_POINT __declspec(noinline)
+#   define BSP_PROBE_ARG(_x) ((void) (_x))
+#else
+#   define BSP_PROBE_POINT
+#   define BSP_PROBE_ARG(_x) ((void) (_x))
+#endif
+
+#define BSP_CHUNK_FREE          0 /* owned by the reader */
+#define BSP_CHUNK_QUEUED        1 /* waiting for a worker */
+#define BSP_CHUNK_BUSY          2 /* being processed */
+#define BSP_CHUNK_DONE          3 /* output ready for the writer */
+
+typedef struct bsp_ctx_s                        bsp_ctx_t;
+typedef struct bsp_chunk_s                      bsp_chunk_t;
+typedef struct bsp_worker_s                     bsp_worker_t;
+typedef struct bsp_buf_s                        bsp_buf_t;
+typedef struct bsp_queue_s                      bsp_queue_t;
+typedef struct bsp_probe_s                      bsp_probe_t;
+
+/* label of the last proc seen by the proc hook of one context */
+struct bsp_probe_s
+{
+    hza_proc_t const * proc;
+    char label[0x80];
+};
+
+struct bsp_chunk_s
+{
+    uint8_t * in_buf;
+    size_t in_size;
+    uint8_t * out_buf;
+    size_t out_size;
+    size_t out_limit;
+    uint8_t state;
+    uint8_t rc;
+};
+
+struct bsp_worker_s
+{
+    bsp_ctx_t * ctx;
+    hza_context_t hcd;
+    hza_task_t * task;
+    uint32_t module_index;
+    uint_t node; // home NUMA node of the task and the thread
+    bsp_probe_t probe;
+    c41_smt_tid_t tid;
+    uint64_t chunk_count;
+    char attached;
+    char started;
+};
+
+struct bsp_buf_s
+{
+    uint8_t * data;
+    size_t size; // 0 = end of stream
+    uint_t error; // I/O error code from the reader
+};
+
+/* single producer single consumer queue of buffers; it never holds more
+ * than BSP_IO_BUFS items plus a NULL stop marker so pushing never blocks;
+ * the consumer only takes the mutex to sleep when the queue is empty */
+struct bsp_queue_s
+{
+    bsp_buf_t * item_a[BSP_QUEUE_SIZE];
+    uint_t volatile head; // consumer side
+    uint_t volatile tail; // producer side
+    uint_t volatile waiting; // consumer sleeps on cond
+    c41_smt_mutex_t * mutex;
+    c41_smt_cond_t * cond;
+};
+
+struct bsp_ctx_s
+{
+    c41_io_t * in;
+    c41_io_t * out;
+    c41_io_t * log;
+    c41_ma_t * ma;
+    c41_smt_t * smt;
+    uint8_t * in_buf; // task-owned, see hza_task_chan_alloc()
+    uint8_t * out_buf; // task-owned
+    size_t chunk_size;
+    uint64_t in_total;
+    uint64_t out_total;
+
+    /* chunked mode (--jobs) */
+    hza_module_t * module;
+    int32_t entry;
+    uint_t job_count;
+    int delim; // record delimiter byte; -1 = fixed size chunks
+    bsp_worker_t * worker_table;
+    bsp_chunk_t * chunk_table;
+    uint_t window; // number of chunks in chunk_table
+    uint64_t write_seq; // next chunk to write
+    uint64_t dispatch_seq; // next chunk to hand to a worker
+    uint64_t fill_seq; // next chunk to read into
+    uint8_t * carry_buf; // partial record left after the last delimiter
+    size_t carry_size;
+    c41_smt_mutex_t * mutex;
+    c41_smt_cond_t * work_cond; // signalled when a chunk is queued
+    c41_smt_cond_t * done_cond; // signalled when a chunk is done
+    char quit;
+
+    /* streaming mode I/O threads */
+    char sync_io; // read, run and write on one thread (--sync-io)
+    char profile; // count opcodes and branches (--profile)
+    char sample; // sample VM stacks (--sample)
+    char stats; // print world stats at the end (--stats)
+    char probes; // call the proc enter/exit probe points (--probes)
+    numa_t * numa; // NULL unless --numa or --numa-sim
+    bsp_probe_t probe; // for the main context
+    uint_t sample_period; // 0 = default period
+    bsp_buf_t buf_a[2 * BSP_IO_BUFS];
+    bsp_queue_t in_free; // exec -> reader
+    bsp_queue_t in_full; // reader -> exec
+    bsp_queue_t out_free; // writer -> exec
+    bsp_queue_t out_full; // exec -> writer
+    uint_t write_error;
+};
+
+static uint_t write_all (c41_io_t * io, uint8_t const * data, size_t size);
+static uint_t read_full (c41_io_t * io, uint8_t * data, size_t size,
+                         size_t * rsize);
+static uint8_t bsp_stream (bsp_ctx_t * ctx, hza_context_t * hc,
+                           hza_module_t * module, int32_t entry);
+static uint8_t bsp_stream_async (bsp_ctx_t * ctx, hza_context_t * hc,
+                                 hza_module_t * module, int32_t entry);
+static uint_t queue_init (bsp_ctx_t * ctx, bsp_queue_t * q);
+static uint_t queue_finish (bsp_ctx_t * ctx, bsp_queue_t * q);
+static void queue_push (bsp_ctx_t * ctx, bsp_queue_t * q, bsp_buf_t * b);
+static bsp_buf_t * queue_pop (bsp_ctx_t * ctx, bsp_queue_t * q);
+static uint8_t C41_CALL bsp_reader (void * arg);
+static uint8_t C41_CALL bsp_writer (void * arg);
+static uint8_t bsp_jobs (bsp_ctx_t * ctx, hza_context_t * hc);
+static uint8_t C41_CALL bsp_worker (void * arg);
+static uint8_t bsp_run_chunk (bsp_worker_t * bw, bsp_chunk_t * c);
+static uint8_t bsp_fill_chunk (bsp_ctx_t * ctx, bsp_chunk_t * c, char * eof);
+static uint8_t bsp_stats (bsp_ctx_t * ctx, hza_context_t * hc);
+static void C41_CALL bsp_proc_hook (hza_context_t * hc,
+                                    hza_frame_t const * f, uint_t event);
+
+/* probe points for 'perf probe -x hazna hazna_probe_proc_enter label:string'
+ * (same for _exit); they do nothing themselves */
+void BSP_PROBE_POINT hazna_probe_proc_enter (char const * label);
+void BSP_PROBE_POINT hazna_probe_proc_exit (char const * label);
+
+/* hazna_probe_proc_enter ***************************************************/
+void BSP_PROBE_POINT hazna_probe_proc_enter (char const * label)
+{
+    BSP_PROBE_ARG(label);
+}
+
+/* hazna_probe_proc_exit ****************************************************/
+void BSP_PROBE_POINT hazna_probe_proc_exit (char const * label)
+{
+    BSP_PROBE_ARG(label);
+}
+
+/* bsp_proc_hook ************************************************************/
+static void C41_CALL bsp_proc_hook (hza_context_t * hc,
+                                    hza_frame_t const * f, uint_t event)
+{
+    bsp_probe_t * bp = hc->proc_hook_ctx;
+
+    if (bp->proc != f->proc)
+    {
+        if (hza_proc_label(hc, f, bp->label, sizeof(bp->label)))
+            bp->label[0] = 0;
+        bp->proc = f->proc;
+    }
+    if (event == HZA_PROC_ENTER) hazna_probe_proc_enter(bp->label);
+    else hazna_probe_proc_exit(bp->label);
+}
+
+/* write_all ****************************************************************/
+static uint_t write_all (c41_io_t * io, uint8_t const * data, size_t size)
+{
+    size_t wz;
+    uint_t ioe;
+
+    for (; size; data += wz, size -= wz)
+    {
+        ioe = c41_io_write(io, data, size, &wz);
+        if (ioe) return ioe;
+    }
+    return 0;
+}
+
+/* read_full ****************************************************************/
+/* reads until the buffer is full or end of input (*rsize < size) */
+static uint_t read_full (c41_io_t * io, uint8_t * data, size_t size,
+                         size_t * rsize)
+{
+    size_t rz, total;
+    uint_t ioe;
+
+    for (total = 0; total < size; total += rz)
+    {
+        ioe = c41_io_read(io, data + total, size - total, &rz);
+        if (ioe) return ioe;
+        if (!rz) break;
+    }
+    *rsize = total;
+    return 0;
+}
+
+/* bsp **********************************************************************/
+uint8_t bsp (c41_cli_t * cli_p)
+{
+    bsp_ctx_t ctx;
+    hza_context_t hcd;
+    hpma_t hp;
+    numa_t numa;
+    ssize_t z;
+    uint8_t rc;
+    uint_t fsie;
+    uint_t mae;
+    uint_t ai;
+    int hp_mode;
+    uint_t numa_sim;
+    unsigned long v;
+    char * a;
+    char * end;
+    hza_error_t hzae;
+    hza_module_t * module;
+    uint8_t const * module_path_utf8;
+    uint8_t * module_data;
+    size_t module_size;
+    int32_t entry;
+    uint64_t t0, dt, mbps;
+    char inited = 0;
+
+    C41_VAR_ZERO(ctx);
+    ctx.in = cli_p->stdin_p;
+    ctx.out = cli_p->stdout_p;
+    ctx.log = cli_p->stderr_p;
+    ctx.ma = cli_p->ma_p;
+    ctx.smt = cli_p->smt_p;
+    ctx.chunk_size = BSP_CHUNK_SIZE;
+    ctx.delim = -1;
+    hp_mode = HPMA_OFF;
+    numa_sim = 0;
+
+    module_path_utf8 = NULL;
+    for (ai = 1; ai < cli_p->arg_n; ++ai)
+    {
+        a = cli_p->arg_a[ai];
+        if (a[0] != '-')
+        {
+            if (module_path_utf8) break;
+            module_path_utf8 = (uint8_t const *) a;
+            continue;
+        }
+        if (C41_STR_EQUAL(a, "--sync-io"))
+        {
+            ctx.sync_io = 1;
+            continue;
+        }
+        if (C41_STR_EQUAL(a, "--profile"))
+        {
+            ctx.profile = 1;
+            continue;
+        }
+        if (C41_STR_EQUAL(a, "--stats"))
+        {
+            ctx.stats = 1;
+            continue;
+        }
+        if (C41_STR_EQUAL(a, "--probes"))
+        {
+            ctx.probes = 1;
+            continue;
+        }
+        if (C41_STR_EQUAL(a, "--numa"))
+        {
+            ctx.numa = &numa;
+            continue;
+        }
+        if (ai + 1 == cli_p->arg_n) break;
+        if (C41_STR_EQUAL(a, "--huge"))
+        {
+            hp_mode = hpma_mode(cli_p->arg_a[++ai]);
+            if (hp_mode < 0) break;
+            continue;
+        }
+        v = strtoul(cli_p->arg_a[++ai], &end, 0);
+        if (*end) break;
+        if (C41_STR_EQUAL(a, "--jobs"))
+        {
+            if (v < 1 || v > BSP_MAX_JOBS) break;
+            ctx.job_count = (uint_t) v;
+        }
+        else if (C41_STR_EQUAL(a, "--chunk"))
+        {
+            if (v < 1 || v > BSP_CHUNK_SIZE_MAX) break;
+            ctx.chunk_size = v;
+        }
+        else if (C41_STR_EQUAL(a, "--delim"))
+        {
+            if (v > 0xFF) break;
+            ctx.delim = (int) v;
+        }
+        else if (C41_STR_EQUAL(a, "--sample"))
+        {
+            if (v > 0x7FFFFFFF) break;
+            ctx.sample = 1;
+            ctx.sample_period = (uint_t) v;
+        }
+        else if (C41_STR_EQUAL(a, "--numa-sim"))
+        {
+            if (v < 1 || v > HZA_NODE_LIMIT) break;
+            ctx.numa = &numa;
+            numa_sim = (uint_t) v;
+        }
+        else break;
+    }
+    if (ai < cli_p->arg_n || !module_path_utf8)
+    {
+        z = c41_io_fmt(ctx.log, "Error: bad arguments for command 'bsp' "
+                       "(see 'hazna help')\n");
+        return z < 0 ? EC_INVOKE | EC_LOG : EC_INVOKE;
+    }
+
+    module_data = NULL;
+    rc = EC_NONE;
+    do
+    {
+        fsie = c41_file_load_u8p(module_path_utf8,
+                                 C41_STR_LEN(module_path_utf8),
+                                 cli_p->fspi_p, cli_p->fsi_p, cli_p->ma_p,
+                                 &module_data, &module_size);
+        if (fsie)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx.log,
+                           "Error: failed to load module $s (code $Ui)\n",
+                           module_path_utf8, fsie);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        /* module images and reg spaces above HPMA_PAGE get huge pages */
+        hpma_init(&hp, cli_p->ma_p, (uint_t) hp_mode, HPMA_PAGE);
+        hzae = hza_init(&hcd, &hp.ma, cli_p->smt_p, ctx.log, HZA_LL_DEBUG);
+        if (hzae)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx.log, "Error: failed to init hazna (code $Ui)\n",
+                           hzae);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+        inited = 1;
+
+        if (ctx.numa)
+        {
+            if (numa_init(&numa, &hp.ma, numa_sim))
+            {
+                rc |= EC_INIT;
+                z = c41_io_fmt(ctx.log, "Error: failed reading the NUMA "
+                               "topology from /sys/devices/system/node\n");
+                if (z < 0) rc |= EC_LOG;
+                break;
+            }
+            for (ai = 0; ai < numa.node_count; ++ai)
+            {
+                hzae = hza_node_ma(&hcd, ai, &numa.node_a[ai].ma);
+                if (hzae) break;
+            }
+            if (hzae)
+            {
+                rc |= EC_INIT;
+                z = c41_io_fmt(ctx.log, "Error: failed setting allocator "
+                               "for node $Ui (code $Ui: $s)\n", ai, hzae,
+                               hza_error_name(hzae));
+                if (z < 0) rc |= EC_LOG;
+                break;
+            }
+        }
+
+        if (ctx.profile && (hzae = hza_prof_enable(&hcd)))
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx.log, "Error: failed enabling profiling "
+                           "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+        if (ctx.sample) hza_sample_enable(&hcd, ctx.sample_period);
+        if (ctx.probes) hza_proc_hook(&hcd, bsp_proc_hook, &ctx.probe);
+
+        hzae = hza_module_load(&hcd, module_data, module_size, 0,
+                               &module);
+        if (hzae)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx.log, "Error: failed loading module (code $Ui: $s)\n",
+                           hzae, hza_error_name(hzae));
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        entry = hza_export_by_name(module, (uint8_t const *) BSP_ENTRY,
+                                   sizeof(BSP_ENTRY) - 1);
+        if (entry < 0)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx.log, "Error: module does not export '$s'\n",
+                           BSP_ENTRY);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        t0 = now_ns();
+        if (ctx.job_count)
+        {
+            ctx.module = module;
+            ctx.entry = entry;
+            rc |= bsp_jobs(&ctx, &hcd);
+        }
+        else if (ctx.sync_io) rc |= bsp_stream(&ctx, &hcd, module, entry);
+        else rc |= bsp_stream_async(&ctx, &hcd, module, entry);
+        if (rc) break;
+
+        dt = now_ns() - t0;
+        if (!dt) dt = 1;
+        mbps = ctx.in_total * 100000 / dt;
+        z = c41_io_fmt(ctx.log, "bsp: in $Uq bytes, out $Uq bytes, "
+                       "$Uq.$.3Uq s, $Uq.$.2Uq MB/s\n",
+                       ctx.in_total, ctx.out_total,
+                       dt / 1000000000, dt / 1000000 % 1000,
+                       mbps / 100, mbps % 100);
+        if (z < 0) rc |= EC_LOG;
+
+        /* workers merged their counters when they finished */
+        if (ctx.profile && hza_prof_report(&hcd, ctx.log)) rc |= EC_LOG;
+        if (ctx.sample && hza_sample_report(&hcd, ctx.log)) rc |= EC_LOG;
+        if (ctx.stats) rc |= bsp_stats(&ctx, &hcd);
+    }
+    while (0);
+
+    if (inited)
+    {
+        hzae = hza_finish(&hcd);
+        if (hzae) rc |= EC_FINISH;
+    }
+
+    if (module_data)
+    {
+        mae = c41_ma_free(cli_p->ma_p, module_data, module_size);
+        if (mae) rc |= EC_FINISH;
+    }
+
+    return rc;
+}
+
+/* bsp_stream ***************************************************************/
+/* runs one task over the whole input stream */
+static uint8_t bsp_stream (bsp_ctx_t * ctx, hza_context_t * hc,
+                           hza_module_t * module, int32_t entry)
+{
+    hza_task_t * task;
+    hza_error_t hzae;
+    ssize_t z;
+    size_t rz;
+    uint_t ioe;
+
+    hzae = hza_task_create(hc, &task);
+    if (!hzae) hzae = hza_import(hc, module, 0);
+    if (!hzae) hzae = hza_enter(hc, hc->args.module_index, entry, 0);
+    if (!hzae) hzae = hza_task_chan_alloc(hc, ctx->chunk_size,
+                                          ctx->chunk_size, &ctx->in_buf);
+    if (hzae)
+    {
+        z = c41_io_fmt(ctx->log, "Error: failed preparing task "
+                       "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+        return z < 0 ? EC_INIT | EC_LOG : EC_INIT;
+    }
+
+    /* stdin is read straight into the task's input buffer and output
+     * is drained from the task's output buffer; both are reused for the
+     * whole stream */
+    ctx->out_buf = task->out.data;
+    for (;;)
+    {
+        hzae = hza_run(hc, 0, BSP_ITER_LIMIT);
+        if (hzae)
+        {
+            z = c41_io_fmt(ctx->log, "Error: execution failed "
+                           "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+            return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+        }
+
+        if (hc->run_stop == HZA_RUN_INPUT)
+        {
+            ioe = c41_io_read(ctx->in, ctx->in_buf, ctx->chunk_size, &rz);
+            if (ioe)
+            {
+                z = c41_io_fmt(ctx->log, "Error: failed reading input "
+                               "(code $Ui)\n", ioe);
+                return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+            }
+            ctx->in_total += rz;
+            hza_task_input(hc, ctx->in_buf, rz, rz == 0);
+            continue;
+        }
+
+        if (task->out.pos)
+        {
+            ioe = write_all(ctx->out, ctx->out_buf, task->out.pos);
+            if (ioe)
+            {
+                z = c41_io_fmt(ctx->log, "Error: failed writing output "
+                               "(code $Ui)\n", ioe);
+                return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+            }
+            ctx->out_total += task->out.pos;
+            hza_task_output(hc, NULL, 0);
+        }
+
+        if (hc->run_stop == HZA_RUN_OUTPUT
+            || hc->run_stop == HZA_RUN_LIMIT) continue;
+        break;
+    }
+
+    return 0;
+}
+
+/* bsp_stream_async *********************************************************/
+/**
+ *  Like bsp_stream() but stdin is read by a reader thread and stdout is
+ *  written by a writer thread so that reading, running the task and writing
+ *  overlap. Buffers cycle between the threads through SPSC queues and the
+ *  task reads from and writes to them directly.
+ */
+static uint8_t bsp_stream_async (bsp_ctx_t * ctx, hza_context_t * hc,
+                                 hza_module_t * module, int32_t entry)
+{
+    hza_task_t * task;
+    hza_error_t hzae;
+    bsp_buf_t * ib;
+    bsp_buf_t * ob;
+    c41_smt_tid_t reader_tid, writer_tid;
+    ssize_t z;
+    uint_t i, mae, e;
+    uint8_t rc;
+    char reader_started, writer_started;
+
+    rc = 0;
+    ib = ob = NULL;
+    reader_started = writer_started = 0;
+    do
+    {
+        hzae = hza_task_create(hc, &task);
+        if (!hzae) hzae = hza_import(hc, module, 0);
+        if (!hzae) hzae = hza_enter(hc, hc->args.module_index, entry, 0);
+        if (hzae)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed preparing task "
+                           "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        e = queue_init(ctx, &ctx->in_free);
+        if (!e) e = queue_init(ctx, &ctx->in_full);
+        if (!e) e = queue_init(ctx, &ctx->out_free);
+        if (!e) e = queue_init(ctx, &ctx->out_full);
+        for (i = 0; !e && i < 2 * BSP_IO_BUFS; ++i)
+        {
+            mae = c41_ma_alloc(ctx->ma, (void * *) &ctx->buf_a[i].data,
+                               ctx->chunk_size);
+            if (mae)
+            {
+                e = mae;
+                break;
+            }
+            queue_push(ctx, i < BSP_IO_BUFS ? &ctx->in_free : &ctx->out_free,
+                       &ctx->buf_a[i]);
+        }
+        if (e)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed allocating I/O queues "
+                           "(code $Ui)\n", e);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        if (c41_smt_thread_create(ctx->smt, &reader_tid, bsp_reader, ctx))
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        reader_started = 1;
+        if (c41_smt_thread_create(ctx->smt, &writer_tid, bsp_writer, ctx))
+        {
+            rc |= EC_INIT;
+            break;
+        }
+        writer_started = 1;
+
+        ob = queue_pop(ctx, &ctx->out_free);
+        hza_task_output(hc, ob->data, ctx->chunk_size);
+        for (;;)
+        {
+            hzae = hza_run(hc, 0, BSP_ITER_LIMIT);
+            if (hzae)
+            {
+                rc |= EC_PROC;
+                z = c41_io_fmt(ctx->log, "Error: execution failed "
+                               "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+                if (z < 0) rc |= EC_LOG;
+                break;
+            }
+
+            if (hc->run_stop == HZA_RUN_INPUT)
+            {
+                if (ib) queue_push(ctx, &ctx->in_free, ib);
+                ib = queue_pop(ctx, &ctx->in_full);
+                if (ib->error)
+                {
+                    rc |= EC_PROC;
+                    z = c41_io_fmt(ctx->log, "Error: failed reading input "
+                                   "(code $Ui)\n", ib->error);
+                    if (z < 0) rc |= EC_LOG;
+                    break;
+                }
+                ctx->in_total += ib->size;
+                hza_task_input(hc, ib->data, ib->size, ib->size == 0);
+                continue;
+            }
+
+            if (task->out.pos)
+            {
+                if (BSP_LOAD(&ctx->write_error)) break;
+                ob->size = task->out.pos;
+                ctx->out_total += ob->size;
+                queue_push(ctx, &ctx->out_full, ob);
+                ob = queue_pop(ctx, &ctx->out_free);
+                hza_task_output(hc, ob->data, ctx->chunk_size);
+            }
+
+            if (hc->run_stop == HZA_RUN_OUTPUT
+                || hc->run_stop == HZA_RUN_LIMIT) continue;
+            break;
+        }
+    }
+    while (0);
+
+    /* stop the reader: it exits at end of input or at the stop marker; if
+     * it is blocked in a read the join waits for that read to return */
+    if (reader_started)
+    {
+        queue_push(ctx, &ctx->in_free, NULL);
+        if (c41_smt_thread_join(ctx->smt, reader_tid)) rc |= EC_FINISH;
+    }
+
+    /* stop the writer with an empty buffer */
+    if (writer_started)
+    {
+        ob->size = 0;
+        queue_push(ctx, &ctx->out_full, ob);
+        if (c41_smt_thread_join(ctx->smt, writer_tid)) rc |= EC_FINISH;
+    }
+    if (ctx->write_error)
+    {
+        rc |= EC_PROC;
+        z = c41_io_fmt(ctx->log, "Error: failed writing output (code $Ui)\n",
+                       ctx->write_error);
+        if (z < 0) rc |= EC_LOG;
+    }
+
+    for (i = 0; i < 2 * BSP_IO_BUFS; ++i)
+    {
+        if (ctx->buf_a[i].data
+            && c41_ma_free(ctx->ma, ctx->buf_a[i].data, ctx->chunk_size))
+            rc |= EC_FINISH;
+    }
+    if (queue_finish(ctx, &ctx->in_free)) rc |= EC_FINISH;
+    if (queue_finish(ctx, &ctx->in_full)) rc |= EC_FINISH;
+    if (queue_finish(ctx, &ctx->out_free)) rc |= EC_FINISH;
+    if (queue_finish(ctx, &ctx->out_full)) rc |= EC_FINISH;
+
+    return rc;
+}
+
+/* queue_init ***************************************************************/
+static uint_t queue_init (bsp_ctx_t * ctx, bsp_queue_t * q)
+{
+    uint_t e;
+
+    e = c41_ma_alloc(ctx->ma, (void * *) &q->mutex, ctx->smt->mutex_size);
+    if (e) return e;
+    e = c41_smt_mutex_init(ctx->smt, q->mutex);
+    if (e)
+    {
+        c41_ma_free(ctx->ma, q->mutex, ctx->smt->mutex_size);
+        q->mutex = NULL;
+        return e;
+    }
+    return c41_smt_cond_create(&q->cond, ctx->smt, ctx->ma);
+}
+
+/* queue_finish *************************************************************/
+static uint_t queue_finish (bsp_ctx_t * ctx, bsp_queue_t * q)
+{
+    uint_t e = 0;
+
+    if (q->cond && c41_smt_cond_destroy(q->cond, ctx->smt, ctx->ma)) e = 1;
+    if (q->mutex)
+    {
+        if (c41_smt_mutex_finish(ctx->smt, q->mutex)) e = 1;
+        if (c41_ma_free(ctx->ma, q->mutex, ctx->smt->mutex_size)) e = 1;
+    }
+    return e;
+}
+
+/* queue_push ***************************************************************/
+static void queue_push (bsp_ctx_t * ctx, bsp_queue_t * q, bsp_buf_t * b)
+{
+    uint_t t = q->tail;
+
+    q->item_a[t % BSP_QUEUE_SIZE] = b;
+    BSP_STORE(&q->tail, t + 1);
+    /* the consumer sets waiting under the mutex before re-checking tail, so
+     * either it sees the new tail or we see waiting set */
+    if (BSP_LOAD(&q->waiting))
+    {
+        c41_smt_mutex_lock(ctx->smt, q->mutex);
+        c41_smt_cond_signal(ctx->smt, q->cond);
+        c41_smt_mutex_unlock(ctx->smt, q->mutex);
+    }
+}
+
+/* queue_pop ****************************************************************/
+static bsp_buf_t * queue_pop (bsp_ctx_t * ctx, bsp_queue_t * q)
+{
+    uint_t h = q->head;
+    bsp_buf_t * b;
+
+    while (BSP_LOAD(&q->tail) == h)
+    {
+        c41_smt_mutex_lock(ctx->smt, q->mutex);
+        BSP_STORE(&q->waiting, 1);
+        if (BSP_LOAD(&q->tail) == h)
+            c41_smt_cond_wait(ctx->smt, q->cond, q->mutex);
+        BSP_STORE(&q->waiting, 0);
+        c41_smt_mutex_unlock(ctx->smt, q->mutex);
+    }
+    b = q->item_a[h % BSP_QUEUE_SIZE];
+    q->head = h + 1;
+    return b;
+}
+
+/* bsp_reader ***************************************************************/
+static uint8_t C41_CALL bsp_reader (void * arg)
+{
+    bsp_ctx_t * ctx = arg;
+    bsp_buf_t * b;
+
+    for (;;)
+    {
+        b = queue_pop(ctx, &ctx->in_free);
+        if (!b) break;
+        b->error = c41_io_read(ctx->in, b->data, ctx->chunk_size, &b->size);
+        if (b->error) b->size = 0;
+        queue_push(ctx, &ctx->in_full, b);
+        if (!b->size) break;
+    }
+    return 0;
+}
+
+/* bsp_writer ***************************************************************/
+/* after a write error it keeps recycling buffers until the end marker */
+static uint8_t C41_CALL bsp_writer (void * arg)
+{
+    bsp_ctx_t * ctx = arg;
+    bsp_buf_t * b;
+    uint_t ioe;
+
+    for (;;)
+    {
+        b = queue_pop(ctx, &ctx->out_full);
+        if (!b->size) break;
+        if (!ctx->write_error)
+        {
+            ioe = write_all(ctx->out, b->data, b->size);
+            if (ioe) BSP_STORE(&ctx->write_error, ioe);
+        }
+        queue_push(ctx, &ctx->out_free, b);
+    }
+    return 0;
+}
+
+/* bsp_jobs *****************************************************************/
+/**
+ *  Splits the input in chunks, runs each chunk to completion in a task on
+ *  one of ctx->job_count worker threads and writes the outputs in input
+ *  order. At most ctx->window chunks are in flight; the calling thread reads
+ *  and writes while the workers run the module.
+ */
+static uint8_t bsp_jobs (bsp_ctx_t * ctx, hza_context_t * hc)
+{
+    bsp_worker_t * bw;
+    bsp_chunk_t * c;
+    hza_error_t hzae;
+    ssize_t z;
+    uint_t wi, mae, ioe, smte;
+    uint8_t rc;
+    char eof;
+
+    rc = 0;
+    ctx->window = ctx->job_count * BSP_WINDOW_PER_JOB;
+
+    do
+    {
+        mae = c41_ma_alloc_zero_fill(ctx->ma, (void * *) &ctx->worker_table,
+                                     ctx->job_count * sizeof(bsp_worker_t));
+        if (!mae)
+            mae = c41_ma_alloc_zero_fill(ctx->ma,
+                                         (void * *) &ctx->chunk_table,
+                                         ctx->window * sizeof(bsp_chunk_t));
+        if (!mae) mae = c41_ma_alloc(ctx->ma, (void * *) &ctx->mutex,
+                                     ctx->smt->mutex_size);
+        for (wi = 0; !mae && wi < ctx->window; ++wi)
+        {
+            c = ctx->chunk_table + wi;
+            mae = c41_ma_alloc(ctx->ma, (void * *) &c->in_buf,
+                               ctx->chunk_size);
+            if (mae) break;
+            mae = c41_ma_alloc(ctx->ma, (void * *) &c->out_buf,
+                               ctx->chunk_size);
+            if (mae) break;
+            c->out_limit = ctx->chunk_size;
+        }
+        if (!mae && ctx->delim >= 0)
+            mae = c41_ma_alloc(ctx->ma, (void * *) &ctx->carry_buf,
+                               ctx->chunk_size);
+        if (mae)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed allocating chunk buffers "
+                           "(code $Ui)\n", mae);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        smte = c41_smt_mutex_init(ctx->smt, ctx->mutex);
+        if (smte)
+        {
+            c41_ma_free(ctx->ma, ctx->mutex, ctx->smt->mutex_size);
+            ctx->mutex = NULL;
+        }
+        if (!smte) smte = c41_smt_cond_create(&ctx->work_cond, ctx->smt,
+                                              ctx->ma);
+        if (!smte) smte = c41_smt_cond_create(&ctx->done_cond, ctx->smt,
+                                              ctx->ma);
+        if (smte)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed creating sync objects "
+                           "(code $Ui)\n", smte);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        /* each worker gets its own context and task in the same world */
+        for (wi = 0; wi < ctx->job_count; ++wi)
+        {
+            bw = ctx->worker_table + wi;
+            bw->ctx = ctx;
+            hzae = hza_attach(&bw->hcd, hc->world);
+            if (hzae) break;
+            bw->attached = 1;
+            if (ctx->profile && (hzae = hza_prof_enable(&bw->hcd))) break;
+            if (ctx->sample) hza_sample_enable(&bw->hcd, ctx->sample_period);
+            if (ctx->probes)
+                hza_proc_hook(&bw->hcd, bsp_proc_hook, &bw->probe);
+            /* workers are dealt round robin to the nodes; each task gets
+             * its memory on the node whose cpus run it */
+            if (ctx->numa)
+            {
+                bw->node = wi % ctx->numa->node_count;
+                hzae = hza_node_set(&bw->hcd, bw->node);
+                if (hzae) break;
+            }
+            hzae = hza_task_create(&bw->hcd, &bw->task);
+            if (!hzae) hzae = hza_import(&bw->hcd, ctx->module, 0);
+            if (hzae) break;
+            bw->module_index = bw->hcd.args.module_index;
+        }
+        if (wi < ctx->job_count)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed preparing worker $Ui "
+                           "(code $Ui: $s)\n", wi, hzae, hza_error_name(hzae));
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        for (wi = 0; wi < ctx->job_count; ++wi)
+        {
+            bw = ctx->worker_table + wi;
+            if (c41_smt_thread_create(ctx->smt, &bw->tid, bsp_worker, bw))
+                break;
+            bw->started = 1;
+        }
+        if (wi < ctx->job_count)
+        {
+            rc |= EC_INIT;
+            z = c41_io_fmt(ctx->log, "Error: failed starting worker $Ui\n",
+                           wi);
+            if (z < 0) rc |= EC_LOG;
+            break;
+        }
+
+        /* read chunks while the window has room, otherwise wait for the
+         * oldest chunk and write it out */
+        for (eof = 0;;)
+        {
+            if (!eof && ctx->fill_seq - ctx->write_seq < ctx->window)
+            {
+                c = ctx->chunk_table + ctx->fill_seq % ctx->window;
+                rc |= bsp_fill_chunk(ctx, c, &eof);
+                if (rc) break;
+                /* empty input still runs the module once */
+                if (!c->in_size && ctx->fill_seq) continue;
+                c41_smt_mutex_lock(ctx->smt, ctx->mutex);
+                c->state = BSP_CHUNK_QUEUED;
+                ctx->fill_seq += 1;
+                c41_smt_cond_signal(ctx->smt, ctx->work_cond);
+                c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+                continue;
+            }
+
+            if (ctx->write_seq == ctx->fill_seq) break;
+
+            c = ctx->chunk_table + ctx->write_seq % ctx->window;
+            c41_smt_mutex_lock(ctx->smt, ctx->mutex);
+            while (c->state != BSP_CHUNK_DONE)
+                c41_smt_cond_wait(ctx->smt, ctx->done_cond, ctx->mutex);
+            c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+
+            if (c->rc)
+            {
+                rc |= c->rc;
+                break;
+            }
+            ioe = write_all(ctx->out, c->out_buf, c->out_size);
+            if (ioe)
+            {
+                rc |= EC_PROC;
+                z = c41_io_fmt(ctx->log, "Error: failed writing output "
+                               "(code $Ui)\n", ioe);
+                if (z < 0) rc |= EC_LOG;
+                break;
+            }
+            ctx->out_total += c->out_size;
+            c->state = BSP_CHUNK_FREE;
+            ctx->write_seq += 1;
+        }
+    }
+    while (0);
+
+    /* stop workers; queued chunks are dropped if we bailed out early */
+    if (ctx->mutex)
+    {
+        c41_smt_mutex_lock(ctx->smt, ctx->mutex);
+        ctx->quit = 1;
+        for (wi = 0; wi < ctx->job_count; ++wi)
+            c41_smt_cond_signal(ctx->smt, ctx->work_cond);
+        c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+    }
+
+    for (wi = 0; ctx->worker_table && wi < ctx->job_count; ++wi)
+    {
+        bw = ctx->worker_table + wi;
+        if (bw->started && c41_smt_thread_join(ctx->smt, bw->tid))
+            rc |= EC_FINISH;
+        if (bw->attached && hza_finish(&bw->hcd)) rc |= EC_FINISH;
+    }
+
+    if (ctx->done_cond
+        && c41_smt_cond_destroy(ctx->done_cond, ctx->smt, ctx->ma))
+        rc |= EC_FINISH;
+    if (ctx->work_cond
+        && c41_smt_cond_destroy(ctx->work_cond, ctx->smt, ctx->ma))
+        rc |= EC_FINISH;
+    if (ctx->mutex)
+    {
+        if (c41_smt_mutex_finish(ctx->smt, ctx->mutex)) rc |= EC_FINISH;
+        if (c41_ma_free(ctx->ma, ctx->mutex, ctx->smt->mutex_size))
+            rc |= EC_FINISH;
+    }
+    if (ctx->carry_buf
+        && c41_ma_free(ctx->ma, ctx->carry_buf, ctx->chunk_size))
+        rc |= EC_FINISH;
+    for (wi = 0; ctx->chunk_table && wi < ctx->window; ++wi)
+    {
+        c = ctx->chunk_table + wi;
+        if (c->in_buf && c41_ma_free(ctx->ma, c->in_buf, ctx->chunk_size))
+            rc |= EC_FINISH;
+        if (c->out_buf && c41_ma_free(ctx->ma, c->out_buf, c->out_limit))
+            rc |= EC_FINISH;
+    }
+    if (ctx->chunk_table && c41_ma_free(ctx->ma, ctx->chunk_table,
+                                        ctx->window * sizeof(bsp_chunk_t)))
+        rc |= EC_FINISH;
+    if (ctx->worker_table && c41_ma_free(ctx->ma, ctx->worker_table,
+                                         ctx->job_count * sizeof(bsp_worker_t)))
+        rc |= EC_FINISH;
+
+    return rc;
+}
+
+/* bsp_fill_chunk ***********************************************************/
+/**
+ *  Reads the next chunk: the carried partial record followed by fresh input.
+ *  With a delimiter the chunk is cut after its last delimiter and the rest
+ *  is carried to the next chunk; a record longer than the chunk size is cut
+ *  at the chunk size.
+ */
+static uint8_t bsp_fill_chunk (bsp_ctx_t * ctx, bsp_chunk_t * c, char * eof)
+{
+    size_t rz, n;
+    uint_t ioe;
+    ssize_t z;
+
+    n = ctx->carry_size;
+    if (n) C41_MEM_COPY(c->in_buf, ctx->carry_buf, n);
+    ioe = read_full(ctx->in, c->in_buf + n, ctx->chunk_size - n, &rz);
+    if (ioe)
+    {
+        z = c41_io_fmt(ctx->log, "Error: failed reading input (code $Ui)\n",
+                       ioe);
+        return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+    }
+    ctx->in_total += rz;
+    n += rz;
+    *eof = (n < ctx->chunk_size);
+
+    ctx->carry_size = 0;
+    if (ctx->delim >= 0 && !*eof)
+    {
+        size_t p;
+        for (p = n; p && c->in_buf[p - 1] != ctx->delim; --p);
+        if (p)
+        {
+            ctx->carry_size = n - p;
+            C41_MEM_COPY(ctx->carry_buf, c->in_buf + p, n - p);
+            n = p;
+        }
+    }
+    c->in_size = n;
+    return 0;
+}
+
+/* bsp_worker ***************************************************************/
+static uint8_t C41_CALL bsp_worker (void * arg)
+{
+    bsp_worker_t * bw = arg;
+    bsp_ctx_t * ctx = bw->ctx;
+    bsp_chunk_t * c;
+    uint8_t rc;
+
+    /* failing to pin only costs remote accesses */
+    if (ctx->numa) numa_pin(ctx->numa, bw->node);
+
+    for (;;)
+    {
+        c41_smt_mutex_lock(ctx->smt, ctx->mutex);
+        while (!ctx->quit && ctx->dispatch_seq == ctx->fill_seq)
+            c41_smt_cond_wait(ctx->smt, ctx->work_cond, ctx->mutex);
+        if (ctx->quit)
+        {
+            c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+            break;
+        }
+        c = ctx->chunk_table + ctx->dispatch_seq % ctx->window;
+        ctx->dispatch_seq += 1;
+        c->state = BSP_CHUNK_BUSY;
+        c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+
+        rc = bsp_run_chunk(bw, c);
+        bw->chunk_count += 1;
+
+        c41_smt_mutex_lock(ctx->smt, ctx->mutex);
+        c->rc = rc;
+        c->state = BSP_CHUNK_DONE;
+        c41_smt_cond_signal(ctx->smt, ctx->done_cond);
+        c41_smt_mutex_unlock(ctx->smt, ctx->mutex);
+    }
+
+    return 0;
+}
+
+/* bsp_run_chunk ************************************************************/
+/* runs the entry proc over one chunk, growing the chunk output as needed */
+static uint8_t bsp_run_chunk (bsp_worker_t * bw, bsp_chunk_t * c)
+{
+    bsp_ctx_t * ctx = bw->ctx;
+    hza_context_t * hc = &bw->hcd;
+    hza_task_t * task = bw->task;
+    hza_error_t hzae;
+    uint_t mae;
+    ssize_t z;
+
+    c->out_size = 0;
+    hzae = hza_enter(hc, bw->module_index, ctx->entry, 0);
+    if (!hzae) hzae = hza_task_input(hc, c->in_buf, c->in_size, 1);
+    if (!hzae) hzae = hza_task_output(hc, c->out_buf, c->out_limit);
+    while (!hzae)
+    {
+        hzae = hza_run(hc, 0, BSP_ITER_LIMIT);
+        if (hzae) break;
+        if (hc->run_stop == HZA_RUN_LIMIT) continue;
+        c->out_size += task->out.pos;
+        if (hc->run_stop == HZA_RUN_FRAME) return 0;
+        if (hc->run_stop == HZA_RUN_HALT)
+        {
+            /* the chunk ends here; the task is reused for the next one */
+            hzae = hza_task_unwind(hc, 0);
+            if (!hzae) return 0;
+            break;
+        }
+        if (hc->run_stop != HZA_RUN_OUTPUT)
+        {
+            /* input is complete and bsp registers no host functions */
+            z = c41_io_fmt(ctx->log, "Error: chunk run stopped unexpectedly "
+                           "(stop $Ui)\n", hc->run_stop);
+            return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+        }
+
+        mae = c41_ma_realloc_array(ctx->ma, (void * *) &c->out_buf, 1,
+                                   c->out_limit << 1, c->out_limit);
+        if (mae)
+        {
+            z = c41_io_fmt(ctx->log, "Error: failed growing chunk output "
+                           "to $z bytes (code $Ui)\n", c->out_limit << 1, mae);
+            return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+        }
+        c->out_limit <<= 1;
+        hzae = hza_task_output(hc, c->out_buf + c->out_size,
+                               c->out_limit - c->out_size);
+    }
+
+    z = c41_io_fmt(ctx->log, "Error: execution failed (code $Ui: $s)\n",
+                   hzae, hza_error_name(hzae));
+    return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+}
+
+/* bsp_stats ****************************************************************/
+/* prints memory use (live/peak) and object counts of the world */
+static uint8_t bsp_stats (bsp_ctx_t * ctx, hza_context_t * hc)
+{
+    static char const * const cat_names[HZA_MEM_CATEGORIES] =
+    {
+        "modules", "tasks", "registers", "frames", "names", "other"
+    };
+    hza_world_stats_t ws;
+    hza_error_t hzae;
+    ssize_t z;
+    uint_t c;
+
+    hzae = hza_world_stats(hc, &ws);
+    if (hzae)
+    {
+        z = c41_io_fmt(ctx->log, "Error: failed reading world stats "
+                       "(code $Ui: $s)\n", hzae, hza_error_name(hzae));
+        return z < 0 ? EC_PROC | EC_LOG : EC_PROC;
+    }
+    z = c41_io_fmt(ctx->log, "stats: memory $z bytes in $z blocks "
+                   "(peak $z)\n", ws.mem_total, ws.mem_blocks,
+                   ws.mem_total_peak);
+    for (c = 0; z >= 0 && c < HZA_MEM_CATEGORIES; ++c)
+        z = c41_io_fmt(ctx->log, "stats:   $s: $z (peak $z)\n",
+                       cat_names[c], ws.mem_live[c], ws.mem_peak[c]);
+    if (z >= 0)
+        z = c41_io_fmt(ctx->log, "stats: tasks running $Ui, waiting $Ui, "
+                       "ready $Ui, suspended $Ui; modules $Ui; "
+                       "contexts $Ui\n",
+                       ws.task_count[HZA_TASK_RUNNING],
+                       ws.task_count[HZA_TASK_WAITING],
+                       ws.task_count[HZA_TASK_READY],
+                       ws.task_count[HZA_TASK_SUSPENDED],
+                       ws.module_count, ws.context_count);
+    for (c = 0; z >= 0 && ctx->numa && c < ctx->numa->node_count; ++c)
+        z = c41_io_fmt(ctx->log, "stats:   node $Ui: $z bytes, $Ui cpus\n",
+                       c, ws.node_mem_live[c], ctx->numa->node_a[c].cpu_count);
+    if (z >= 0 && ctx->numa)
+        z = c41_io_fmt(ctx->log, "stats: migrations $Uq ($Uq bytes)\n",
+                       ws.migrate_count, ws.migrate_bytes);
+    return z < 0 ? EC_LOG : EC_NONE;
+}
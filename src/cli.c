@@ -1,17 +1,10 @@
-#include <c41.h>
-#include <hbs1.h>
-#include <hazna.h>
+#include "cli.h"
 
-typedef struct bsp_ctx_s                        bsp_ctx_t;
-struct bsp_ctx_s
-{
-    c41_io_t * in;
-    c41_io_t * out;
-    c41_io_t * log;
-};
-
-uint8_t test (c41_io_t * log, c41_ma_t * ma, c41_smt_t * smt);
-uint8_t bsp (c41_cli_t * cli_p, uint8_t const * module_path_utf8);
+#if _WIN32
+#   include <windows.h>
+#else
+#   include <time.h>
+#endif
 
 enum cmd_enum
 {
@@ -21,15 +14,11 @@ enum cmd_enum
     CMD_HELP,
     CMD_TEST,
     CMD_BSP, // byte stream processor
+    CMD_BENCH,
+    CMD_GEN,
+    CMD_CORPUS,
 };
 
-#define EC_NONE                 0x00
-#define EC_PROC                 0x01
-#define EC_INIT                 0x02
-#define EC_FINISH               0x04
-#define EC_INVOKE               0x08
-#define EC_LOG                  0x10
-
 /* hmain ********************************************************************/
 uint8_t C41_CALL hmain (c41_cli_t * cli_p)
 {
@@ -47,6 +36,9 @@ uint8_t C41_CALL hmain (c41_cli_t * cli_p)
     else if (C41_STR_EQUAL(cli_p->arg_a[0], "--help")) cmd = CMD_HELP;
     else if (C41_STR_EQUAL(cli_p->arg_a[0], "test")) cmd = CMD_TEST;
     else if (C41_STR_EQUAL(cli_p->arg_a[0], "bsp")) cmd = CMD_BSP;
+    else if (C41_STR_EQUAL(cli_p->arg_a[0], "bench")) cmd = CMD_BENCH;
+    else if (C41_STR_EQUAL(cli_p->arg_a[0], "gen")) cmd = CMD_GEN;
+    else if (C41_STR_EQUAL(cli_p->arg_a[0], "corpus")) cmd = CMD_CORPUS;
     else cmd = CMD_BAD;
 
     switch (cmd)
@@ -80,7 +72,61 @@ uint8_t C41_CALL hmain (c41_cli_t * cli_p)
  "  version                     prints versions for this tool and the engine\n"
  "  help                        prints this text\n"
  "  test                        runs some tests\n"
- "  bsp MODULE                  byte stream processor\n"
+ "  bsp [OPTS] MODULE           byte stream processor: runs the module's\n"
+ "                              'bsp' export over stdin, output to stdout\n"
+ "    --jobs N                  split input in chunks and run each chunk on\n"
+ "                              one of N worker threads; output keeps the\n"
+ "                              input order\n"
+ "    --chunk SIZE              chunk/buffer size (default 0x100000)\n"
+ "    --delim BYTE              with --jobs, cut chunks after the last BYTE\n"
+ "                              (e.g. 10 for lines)\n"
+ "    --sync-io                 without --jobs, read/run/write on one thread\n"
+ "                              instead of using reader and writer threads\n"
+ "    --profile                 print opcode and branch counts to stderr\n"
+ "    --sample N                print folded VM stacks sampled every N\n"
+ "                              iterations to stderr (0: default period)\n"
+ "    --stats                   print world memory and object counts to\n"
+ "                              stderr at the end\n"
+ "    --huge MODE               back module images and reg spaces of 2MB\n"
+ "                              or more with huge pages; MODE is off\n"
+ "                              (default), thp or hugetlb (falls back to\n"
+ "                              thp when the hugetlb pool is empty)\n"
+ "    --probes                  call hazna_probe_proc_enter/_exit(label) on\n"
+ "                              each VM proc enter/exit, for perf uprobes:\n"
+ "                              perf probe -x hazna hazna_probe_proc_enter\n"
+ "                              label:string\n"
+ "    --numa                    with --jobs, put each worker's task memory on\n"
+ "                              a NUMA node and pin the worker to its cpus\n"
+ "    --numa-sim N              as --numa over N simulated nodes sharing the\n"
+ "                              memory (for testing on single node hosts)\n"
+ "  bench [OPTS] [PREFIX]       runs engine micro-benchmarks (those whose\n"
+ "                              name starts with PREFIX)\n"
+ "    --json                    machine-readable output\n"
+ "    --trials N                timed trials per benchmark (default 15)\n"
+ "    --locks                   also time the world mutexes and print their\n"
+ "                              acquisition and wait/hold stats\n"
+ "    --huge MODE               as for bsp, for the benchmark worlds\n"
+ "  gen [OPTS]                  writes a synthetic mod00 module to stdout;\n"
+ "                              procs 0..N-1 are exported as pXXXXXXXX\n"
+ "    --seed N                  same options and seed give the same module\n"
+ "    --procs N                 number of procs (default 1)\n"
+ "    --insns N                 insns per proc, ret included (default 256)\n"
+ "    --const128 N              128/64/32-bit constants per proc (filler)\n"
+ "    --const64 N\n"
+ "    --const32 N\n"
+ "    --exports N               exported procs (default 1)\n"
+ "    --blocks N                filler data blocks besides proc names\n"
+ "    --block-size N            size of filler data blocks (min/default 16)\n"
+ "    --mix N,N,N,N             weights of nop, init, add, forward branch\n"
+ "                              insns (default 1,1,1,1)\n"
+ "  corpus [OPTS] [PREFIX]      runs the bsp workload corpus (hexdump,\n"
+ "                              base64, crc32, rle, utf8, fold, upper) over\n"
+ "                              1MB generated inputs, checks the output\n"
+ "                              hashes and prints MB/s\n"
+ "    --json                    machine-readable output\n"
+ "    --trials N                timed runs per workload (default 5)\n"
+ "    --module NAME             writes the workload module to stdout\n"
+ "    --input NAME              writes the workload input to stdout\n"
  "Return code is a bitmask of:\n"
  "  1                           processing error\n"
  "  2                           init error\n"
@@ -92,15 +138,20 @@ uint8_t C41_CALL hmain (c41_cli_t * cli_p)
         break;
 
     case CMD_BSP:
-        if (cli_p->arg_n != 2)
-        {
-            rc |= EC_INVOKE;
-            z = c41_io_fmt(cli_p->stderr_p, 
-                "Error: expecting exactly 1 argument for command 'bsp'\n");
-            if (z < 0) rc |= EC_LOG;
-            break;
-        }
-        rc = bsp(cli_p, (uint8_t const *) cli_p->arg_a[1]);
+        rc = bsp(cli_p);
+        break;
+
+    case CMD_BENCH:
+        rc = bench(cli_p);
+        break;
+
+    case CMD_GEN:
+        rc = gen(cli_p);
+        break;
+
+    case CMD_CORPUS:
+        rc = corpus(cli_p);
+        break;
 
     default:
         break;
@@ -109,92 +160,59 @@ uint8_t C41_CALL hmain (c41_cli_t * cli_p)
     return rc;
 }
 
-/* bsp **********************************************************************/
-uint8_t bsp (c41_cli_t * cli_p, uint8_t const * module_path_utf8)
+/* now_ns *******************************************************************/
+uint64_t now_ns ()
 {
-    bsp_ctx_t ctx;
-    hza_context_t hcd;
-    ssize_t z;
-    uint8_t rc;
-    uint_t fsie;
-    uint_t mae;
-    hza_error_t hzae;
-    hza_task_t * task;
-    hza_module_t * module;
-    uint8_t * module_data;
-    size_t module_size;
-    c41_io_t * in = cli_p->stdin_p;
-    c41_io_t * out = cli_p->stdout_p;
-    c41_io_t * log = cli_p->stderr_p;
-    char inited;
-
-    C41_VAR_ZERO(ctx);
-
-    (void) in;
-    (void) out;
-
-    module_data = NULL;
-    task = NULL;
-    rc = EC_NONE;
-    do
-    {
-        fsie = c41_file_load_u8p(module_path_utf8, 
-                                 C41_STR_LEN(module_path_utf8),
-                                 cli_p->fspi_p, cli_p->fsi_p, cli_p->ma_p,
-                                 &module_data, &module_size);
-        if (fsie)
-        {
-            rc |= EC_INIT;
-            z = c41_io_fmt(log,
-                           "Error: failed to load module $s (code $Ui)\n",
-                           module_path_utf8, fsie);
-            if (z < 0) rc |= EC_LOG;
-            break;
-        }
-
-        hzae = hza_init(&hcd, cli_p->ma_p, cli_p->smt_p, log, HZA_LL_DEBUG);
-        if (hzae)
-        {
-            rc |= EC_INIT;
-            z = c41_io_fmt(log, "Error: failed to init hazna (code $Ui)\n",
-                           hzae);
-            if (z < 0) rc |= EC_LOG;
-            break;
-        }
-        inited = 1;
-
-        hzae = hza_task_create(&hcd, &task);
-        if (hzae)
-        {
-            rc |= EC_INIT;
-            break;
-        }
-
-        hzae = hza_module_load(&hcd, module_data, module_size, &module);
-        if (hzae)
-        {
-            rc |= EC_INIT;
-            z = c41_io_fmt(log, "Error: failed loading module (code $Ui: $s)\n",
-                           hzae, hza_error_name(hzae));
-            if (z < 0) rc |= EC_LOG;
-            break;
-        }
+#if _WIN32
+    LARGE_INTEGER c, f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t) ((double) c.QuadPart * 1e9 / (double) f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
 
-    }
-    while (0);
+/* put_text *****************************************************************/
+/* writes s left aligned in a field of given width followed by a space */
+ssize_t put_text (c41_io_t * io, char const * s, size_t width)
+{
+    static char const spaces[] = "                                ";
+    size_t n = C41_STR_LEN(s);
 
-    if (inited)
-    {
-        hzae = hza_finish(&hcd);
-        if (hzae) rc |= EC_FINISH;
-    }
+    return c41_io_fmt(io, "$s$s ", s, spaces + sizeof(spaces) - 1
+                      - (n < width ? width - n : 0));
+}
 
-    if (module_data)
-    {
-        mae = c41_ma_free(cli_p->ma_p, module_data, module_size);
-        if (mae) rc |= EC_FINISH;
-    }
+/* put_int ******************************************************************/
+/* writes an integer right aligned in width (< 32) chars */
+ssize_t put_int (c41_io_t * io, uint64_t v, size_t width)
+{
+    static char const spaces[] = "                                ";
+    uint64_t x;
+    size_t n;
 
-    return rc;
+    for (n = 1, x = v; x >= 10; x /= 10, ++n);
+    return c41_io_fmt(io, "$s$Uq", spaces + sizeof(spaces) - 1
+                      - (n < width ? width - n : 0), v);
+}
+
+/* put_num ******************************************************************/
+/* writes a value given in 1/100 units right aligned in width (< 32) chars */
+ssize_t put_num (c41_io_t * io, uint64_t v, size_t width)
+{
+    ssize_t z;
+
+    z = put_int(io, v / 100, width > 3 ? width - 3 : 0);
+    return z < 0 ? z : c41_io_fmt(io, ".$.2Uq", v % 100);
 }
 
+/* u64_cmp ******************************************************************/
+/* qsort comparator for uint64_t */
+int u64_cmp (void const * a, void const * b)
+{
+    uint64_t x = *(uint64_t const *) a, y = *(uint64_t const *) b;
+    return x < y ? -1 : x > y;
+}
@@ -0,0 +1,70 @@
+#ifndef _HZA_CLI_H_
+#define _HZA_CLI_H_
+
+#include <c41.h>
+#include <hbs1.h>
+#include <hazna.h>
+
+#define EC_NONE                 0x00
+#define EC_PROC                 0x01
+#define EC_INIT                 0x02
+#define EC_FINISH               0x04
+#define EC_INVOKE               0x08
+#define EC_LOG                  0x10
+
+#define HPMA_OFF                0 /* no huge pages */
+#define HPMA_THP                1 /* mmap + madvise(MADV_HUGEPAGE) */
+#define HPMA_HUGETLB            2 /* MAP_HUGETLB, falling back to THP */
+#define HPMA_PAGE               0x200000 /* huge page size */
+#define HPMA_UNMAP_ERROR        0x100 /* ma error: munmap failed */
+
+/* hpma_t: allocator backing blocks of at least min_size bytes with huge
+ * pages and passing smaller ones to worker_ma */
+typedef struct hpma_s                           hpma_t;
+struct hpma_s
+{
+    c41_ma_t ma;
+    c41_ma_t * worker_ma;
+    size_t min_size;
+    uint_t mode;
+};
+
+#define NUMA_CPU_LIMIT          0x400
+
+/* numa_t: NUMA topology (real or simulated); each node has an allocator
+ * that places blocks on it, for hza_node_ma() */
+typedef struct numa_s                           numa_t;
+typedef struct numa_node_s                      numa_node_t;
+struct numa_node_s
+{
+    c41_ma_t ma;
+    numa_t * numa;
+    uint_t index;
+    uint_t cpu_count;
+    uint64_t cpu_mask[NUMA_CPU_LIMIT / 64];
+};
+struct numa_s
+{
+    c41_ma_t * worker_ma;
+    uint_t node_count;
+    char simulated; // nodes share the memory; only the cpus are split
+    numa_node_t node_a[HZA_NODE_LIMIT];
+};
+
+uint8_t test (c41_io_t * log, c41_ma_t * ma, c41_smt_t * smt);
+uint8_t bsp (c41_cli_t * cli_p);
+uint8_t bench (c41_cli_t * cli_p);
+uint8_t gen (c41_cli_t * cli_p);
+uint8_t corpus (c41_cli_t * cli_p);
+uint64_t now_ns ();
+ssize_t put_text (c41_io_t * io, char const * s, size_t width);
+ssize_t put_int (c41_io_t * io, uint64_t v, size_t width);
+ssize_t put_num (c41_io_t * io, uint64_t v, size_t width);
+int u64_cmp (void const * a, void const * b);
+void hpma_init (hpma_t * hp, c41_ma_t * worker_ma, uint_t mode,
+                size_t min_size);
+int hpma_mode (char const * name);
+uint_t numa_init (numa_t * numa, c41_ma_t * worker_ma, uint_t sim_nodes);
+uint_t numa_pin (numa_t * numa, uint_t node);
+
+#endif /* _HZA_CLI_H_ */
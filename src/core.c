@@ -1,6 +1,27 @@
 #include <stdarg.h>
 #include "../include/hazna.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   include <cpuid.h>
+#   define CRC32C_SSE42 1
+#else
+#   define CRC32C_SSE42 0
+#endif
+
+/* lane ops compile to SSE2 through the vector extensions and gcc's
+ * builtins; pshufb needs SSSE3 so without it the shuffle stays scalar */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__SSE2__)
+#   define LANE_SSE2 1
+#   if defined(__SSSE3__)
+#       define LANE_SSSE3 1
+#   else
+#       define LANE_SSSE3 0
+#   endif
+#else
+#   define LANE_SSE2 0
+#   define LANE_SSSE3 0
+#endif
+
 /* internal configurable constants ******************************************/
 #define INIT_IMPORT_LIMIT       2
 #define INIT_REG_SIZE           0x100
@@ -10,6 +31,29 @@
 #define MAX_FRAME_LIMIT         0x10000
 #define MAX_REG_LIMIT           0x40000000
 
+/* TASK_OF_LINKS: task owning the given task list entry */
+#define TASK_OF_LINKS(_np) \
+    ((hza_task_t *) ((uint8_t *) (_np) \
+                     - (uintptr_t) &((hza_task_t *) 0)->links))
+/* FRAME_INSN: current insn of a frame */
+#define FRAME_INSN(_f) ((_f)->proc->insn_table + (_f)->insn_index)
+
+#define MOD00_DECODE_BLOCK      0x400
+    /*< bytes decoded per step; small enough to still be in L1 when the
+     *  checksum has been computed over them */
+
+#ifndef HZA_PROFILE
+#   define HZA_PROFILE          1
+    /*< build the counting variant of the interpreter loop; with 0
+     *  hza_prof_enable() fails with HZAE_NOT_SUPPORTED */
+#endif
+#define PROF_INIT_BRANCH_LIMIT  0x100
+#define INIT_SAMPLE_LIMIT       0x40
+#define ARENA_CHUNK_SIZE        0x10000
+    /*< bytes of a shared arena chunk; objects over a quarter of this get a
+     *  chunk of their own so that they do not strand the tail of one */
+#define ARENA_ALIGN             0x10
+
 /* macros *******************************************************************/
 #define L(_hc, _level, ...) \
     if ((_hc)->world->log_level >= (_level)) \
@@ -38,8 +82,50 @@
 #define EF(_e, ...) \
     L(hc, (_e) < HZA_FATAL ? HZA_LL_ERROR : HZA_LL_FATAL, __VA_ARGS__)
 
+#if defined(_MSC_VER)
+#   define ALWAYS_INLINE __forceinline
+#   define NO_INLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#   define ALWAYS_INLINE __attribute__((always_inline)) inline
+#   define NO_INLINE __attribute__((noinline))
+#else
+#   define ALWAYS_INLINE inline
+#   define NO_INLINE
+#endif
+
+#if LANE_SSE2
+/* 128-bit regs only need the 128-bit alignment relative to the frame */
+typedef uint8_t lane8_t __attribute__((vector_size(16), aligned(1)));
+typedef uint16_t lane16_t __attribute__((vector_size(16), aligned(1)));
+typedef uint32_t lane32_t __attribute__((vector_size(16), aligned(1)));
+typedef uint64_t lane64_t __attribute__((vector_size(16), aligned(1)));
+typedef char lanec_t __attribute__((vector_size(16))); // for the builtins
+#endif
+
+/* PROF_HASH: slot of a branch insn in a table with _mask + 1 slots: the
+ * insn address / 8 times an odd golden-ratio constant, low bits kept; the
+ * multiply spreads consecutive insns across the table, and since it is a
+ * bijection on the low bits, insns less than _mask + 1 apart never share
+ * a slot */
+#define PROF_HASH(_insn, _mask) \
+    ((((uintptr_t) (_insn) >> 3) * 0x9E3779B1u) & (_mask))
+
 #define WORLD_SIZE \
-    (sizeof(hza_world_t) + smt->mutex_size * 4)
+    (sizeof(hza_world_t) + smt->mutex_size * HZA_MUTEXES)
+
+/* ARENA_ROUND: space taken in an arena chunk by an object of _z bytes */
+#define ARENA_ROUND(_z) \
+    (((_z) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+#define ARENA_HDR ARENA_ROUND(sizeof(hza_arena_chunk_t))
+
+/* MEM_NONE: category for world memory that is not accounted to any
+ * HZA_MEM_xxx (arena chunks account their objects instead) */
+#define MEM_NONE                HZA_MEM_CATEGORIES
+
+/* crc modes for mod00_decode() */
+#define CRC_NONE                0
+#define CRC_TABLE               1
+#define CRC_SSE42               2
 
 /* static functions *********************************************************/
 
@@ -90,6 +176,55 @@ static hza_error_t run_locked
     c41_smt_mutex_t * mutex
 );
 
+/* run_locked_timed *********************************************************/
+/**
+ * Same as run_locked() but also updates the lock stats of the mutex.
+ **/
+static hza_error_t run_locked_timed
+(
+    hza_context_t * hc,
+    hza_error_t (C41_CALL * func) (hza_context_t * hc),
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock
+);
+
+/* mutex_lock_stats *********************************************************/
+/**
+ * Returns the lock stats entry of one of the world mutexes.
+ **/
+static hza_lock_stats_t * mutex_lock_stats
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex
+);
+
+/* mutex_lock_timed *********************************************************/
+/**
+ * Locks the mutex trying first without blocking; if that fails the
+ * acquisition is counted as contended and the wait is timed.
+ * On success stores the time the mutex was acquired in *acquired.
+ * Returns smt error.
+ **/
+static int mutex_lock_timed
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock,
+    uint64_t * acquired
+);
+
+/* mutex_hold_end ***********************************************************/
+/**
+ * Accounts the time the mutex was held; call right before unlocking.
+ **/
+static void mutex_hold_end
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock,
+    uint64_t acquired
+);
+
 /* realloc_table_locked *****************************************************/
 /**
  * Reallocates a given array.
@@ -109,14 +244,61 @@ static hza_error_t C41_CALL realloc_table_locked
     hza_context_t * hc
 );
 
+/* mem_account **************************************************************/
+/**
+ * Updates the live and peak size of a memory category (HZA_MEM_xxx) after
+ * a block changed from old_size to new_size bytes.
+ * Should be called while world mutex is locked!
+ */
+static void mem_account
+(
+    hza_world_t * w,
+    uint_t category,
+    size_t new_size,
+    size_t old_size
+);
+
+/* task_mem_realloc *********************************************************/
+/**
+ * Reallocates a table of task memory homed on node, with the node's
+ * allocator; the memory is accounted to category and to the node.
+ * Returns the ma error.
+ * Should be called while world mutex is locked!
+ */
+static uint_t task_mem_realloc
+(
+    hza_world_t * w,
+    uint_t node,
+    uint_t category,
+    void * ptr_p,
+    size_t item_size,
+    size_t new_count,
+    size_t old_count
+);
+
 /* safe_realloc_table *******************************************************/
 /**
- * locks world_mutex and reallocates.
+ * locks world_mutex and reallocates; the memory is accounted to category.
  * the new pointer is returned in hc->args.realloc.ptr
  */
 static hza_error_t C41_CALL safe_realloc_table
 (
     hza_context_t * hc,
+    uint_t category,
+    void * old_ptr,
+    size_t item_size,
+    size_t new_count,
+    size_t old_count
+);
+
+/* safe_realloc_task ********************************************************/
+/**
+ * safe_realloc_table() for memory homed on the node of the active task.
+ */
+static hza_error_t C41_CALL safe_realloc_task
+(
+    hza_context_t * hc,
+    uint_t category,
     void * old_ptr,
     size_t item_size,
     size_t new_count,
@@ -131,6 +313,7 @@ static hza_error_t C41_CALL safe_realloc_table
 static hza_error_t C41_CALL safe_alloc
 (
     hza_context_t * hc,
+    uint_t category,
     size_t size
 );
 
@@ -138,2013 +321,5641 @@ static hza_error_t C41_CALL safe_alloc
 static hza_error_t C41_CALL safe_free
 (
     hza_context_t * hc,
+    uint_t category,
     void * ptr,
     size_t size
 );
 
-/* insn_check ***************************************************************/
+/* arena_alloc **************************************************************/
 /**
- * Computes the minimum number of bits in the register space to allow running
- * the given instruction.
+ * Allocates an object that lives until hza_finish() from the world arena;
+ * the object is accounted to category.
+ * the new pointer is returned in hc->args.realloc.ptr
+ * Should be called while module mutex is locked!
  */
-static int32_t insn_check
+static hza_error_t C41_CALL arena_alloc
 (
     hza_context_t * hc,
-    hza_proc_t * proc,
-    hza_insn_t * insn
+    uint_t category,
+    size_t size
 );
 
-/* last_insn_check **********************************************************/
+/* arena_free ***************************************************************/
 /**
- * Checks if the given instruction is valid for the last instruction in the
- * proc. This means that the flow will not continue to the instruction after it.
+ * Gives back an arena object: the space is reused only if the object is the
+ * last one bumped or if it has a chunk of its own, otherwise it stays taken
+ * until hza_finish().
+ * Should be called while module mutex is locked!
  */
-static int last_insn_check
+static hza_error_t C41_CALL arena_free
 (
-    hza_insn_t * insn
+    hza_context_t * hc,
+    uint_t category,
+    void * ptr,
+    size_t size
 );
-/* find_mod_name_cell *******************************************************/
+
+/* arena_finish *************************************************************/
 /**
- * Builds the tree path in search of the given name.
- * The function should be called with module mutex locked.
- * returns: 0 - name found, 1 - name not found.
+ * Releases all arena chunks of the world.
  */
-static int C41_CALL find_mod_name_cell
+static hza_error_t C41_CALL arena_finish
 (
-    hza_context_t *             hc,
-    uint8_t const *             name,
-    uint_t                      len,
-    c41_rbtree_path_t *         path
+    hza_context_t * hc
 );
 
-/* alloc_mod_name_cell ******************************************************/
+/* prof_alloc_locked ********************************************************/
 /**
- * Allocate a module name cell.
- * Path has to be initialised previously by find_mod_name_cell().
- * The function should be called with module mutex locked and the lock should
- * not have been released in between find_mod_name_cell() and this call.
+ * Allocates zeroed profiling counters in hc->args.prof.prof.
+ * Should be called while world mutex is locked!
  */
-static hza_error_t C41_CALL alloc_mod_name_cell
+static hza_error_t C41_CALL prof_alloc_locked
 (
-    hza_context_t *             hc,
-    uint8_t const *             name,
-    uint_t                      len,
-    c41_rbtree_path_t *         path,
-    hza_mod_name_cell_t * *     mnc_p
+    hza_context_t * hc
 );
 
-/* get_mod_name_cell ********************************************************/
+/* prof_free_locked *********************************************************/
 /**
- * Searches for the given module name and if none is found it allocates a cell.
- * If len < 0 the function will replace it with the C-string length of name.
- * The function should be called with module mutex locked.
+ * Frees the profiling counters hc->args.prof.prof.
+ * Should be called while world mutex is locked!
  */
-static hza_error_t C41_CALL get_mod_name_cell
+static hza_error_t C41_CALL prof_free_locked
 (
-    hza_context_t *             hc,
-    void *                      name,
-    int                         len,
-    hza_mod_name_cell_t * *     mnc_p
+    hza_context_t * hc
 );
 
-/* detach_context ***********************************************************/
+/* prof_grow_locked *********************************************************/
 /**
- * Detaches context from the world.
- * Multithreading state: world_mutex must be locked.
- * Just decrements context_count in the world.
- * fills hc->args.context_count with the number of contexts left attached to
- * the world.
- **/
-static hza_error_t C41_CALL detach_context
+ * Doubles the branch table of hc->args.prof.prof.
+ * Should be called while world mutex is locked!
+ */
+static hza_error_t C41_CALL prof_grow_locked
 (
     hza_context_t * hc
 );
 
-/* mod_name_cmp *************************************************************/
-static uint_t C41_CALL mod_name_cmp
+/* prof_branch_find *********************************************************/
+/**
+ * Returns the slot of insn in the branch table of pf or the free slot where
+ * it would go. The table must have at least one free slot.
+ */
+static hza_prof_branch_t * prof_branch_find
 (
-    void * key,
-    void * node_payload,
-    void * context
+    hza_prof_t * pf,
+    hza_insn_t const * insn
 );
 
-/* destroy_mod_name_cells ***************************************************/
-static hza_error_t destroy_mod_name_cells
+/* prof_branch_slot *********************************************************/
+/**
+ * Finds or adds the branch table entry of insn, growing the table as needed.
+ * locked tells if the caller already holds world mutex.
+ * Returns NULL if the table could not grow.
+ */
+static hza_prof_branch_t * prof_branch_slot
 (
     hza_context_t * hc,
-    c41_rbtree_node_t * n
+    hza_prof_t * pf,
+    hza_insn_t const * insn,
+    int locked
 );
 
-/* mod00_load **************************************************************/
+/* prof_branch **************************************************************/
 /**
- * Loads a module.
- * Should be called with module mutex locked.
- * The allocated module is returned in hc->args.realloc.ptr
- **/
-static hza_error_t mod00_load
+ * Counts one outcome of the branch insn when it is not found in its home
+ * slot by the interpreter loop.
+ */
+static void prof_branch
 (
     hza_context_t * hc,
-    void const * data,
-    size_t len
+    hza_prof_t * pf,
+    hza_insn_t const * insn,
+    int not_taken
 );
 
-/* task_alloc ***************************************************************/
+/* prof_merge_locked ********************************************************/
 /**
- *  Allocates a task. This should be called with world mutex locked.
- *  The pointer to the new task is stored in hc->args.task.
+ * Adds the counters of hc to the world totals and zeroes them.
+ * Should be called while world mutex is locked!
  */
-static hza_error_t C41_CALL task_alloc
+static hza_error_t C41_CALL prof_merge_locked
 (
     hza_context_t * hc
 );
 
-/* task_free ****************************************************************/
+/* prof_disable_locked ******************************************************/
+static hza_error_t C41_CALL prof_disable_locked
+(
+    hza_context_t * hc
+);
+
+/* prof_report_locked *******************************************************/
 /**
- *  Frees task memory. This should be called with world mutex locked.
- *  The task is passed in hc->args.task.
- *  This is intended to be called from task_alloc() (with a partially allocated
- *  task), from hza_task_create() when task_init() fails and from
- *  hza_task_deref() when there are no refs left to the task.
+ * Prints the world totals to hc->args.prof.io.
+ * Should be called while module mutex and world mutex are locked!
  */
-static hza_error_t C41_CALL task_free
+static hza_error_t C41_CALL prof_report_locked
 (
     hza_context_t * hc
 );
 
-/* task_init ****************************************************************/
+/* prof_report_modules_locked ***********************************************/
 /**
- *  Inits a newly allocated task. This should be called with task mutex locked.
+ * Locks world mutex and runs prof_report_locked().
+ * Should be called while module mutex is locked!
  */
-static hza_error_t C41_CALL task_init
+static hza_error_t C41_CALL prof_report_modules_locked
 (
     hza_context_t * hc
 );
-/* mod00_core ***************************************************************/
-#define C32(_v) \
-    ((_v) >> 24), ((_v) >> 16) & 0xFF, ((_v) >> 8) & 0xFF, (_v) & 0xFF
-#define C16(_v) ((_v) >> 8), ((_v) & 0xFF)
-static uint8_t mod00_core[] =
-{
-    /* 0x0000: header */
-    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
-    C32(0x146),                 // size (in bytes)
-    C32(0x11223344),            // checksum
-    C32(1),                     // name
-    C32(0),                     // const128_count
-    C32(0),                     // const64_count
-    C32(0),                     // const32_count
-    C32(2),                     // proc_count
-    C32(3),                     // data_block_count
-    C32(0),                     // import_module_count
-    C32(0),                     // import_count
-    C32(1),                     // export_count
-    C32(2),                     // target_count
-    C32(0x12),                  // insn_count
-    C32(0x0A),                  // data_size
 
-    /* 0x0040: proc 00 */
-    C32(0),                     // insn start
-    C32(0),                     // target start
-    C32(0),                     // const128_start
-    C32(0),                     // const64_start
-    C32(0),                     // const32_start
-    C32(0),                     // name
+/* stats_mem_locked *********************************************************/
+/**
+ * Copies memory counters and context count to hc->args.stats.
+ * Should be called while world mutex is locked!
+ */
+static hza_error_t C41_CALL stats_mem_locked
+(
+    hza_context_t * hc
+);
 
-    /* 0x0058: proc 01 */
-    C32(1),                     // insn start
-    C32(0),                     // target start
-    C32(0),                     // const128_start
-    C32(0),                     // const64_start
-    C32(0),                     // const32_start
-    C32(2),                     // name
+/* stats_task_locked ********************************************************/
+/**
+ * Copies task counts to hc->args.stats.
+ * Should be called while task mutex is locked!
+ */
+static hza_error_t C41_CALL stats_task_locked
+(
+    hza_context_t * hc
+);
 
-    /* 0x0070: end of proc table (entry 02) */
-    C32(0x12),                  // insn start
-    C32(2),                     // target start
-    C32(0),                     // const128_start
-    C32(0),                     // const64_start
-    C32(0),                     // const32_start
-    C32(0),                     // name
+/* stats_module_locked ******************************************************/
+/**
+ * Copies the module count and the module and name memory counters to
+ * hc->args.stats.
+ * Should be called while module mutex is locked!
+ */
+static hza_error_t C41_CALL stats_module_locked
+(
+    hza_context_t * hc
+);
 
-    /* 0x0088: data block table */
-    C32(0),                     // data block offset #0 - ''
-    C32(0),                     // data block offset #1 - 'core'
-    C32(0x04),                  // data block offset #2 - '_test0'
-    C32(0x0A),                  // data block offset #3 - END
+/* stats_log_locked *********************************************************/
+/**
+ * Copies the log mutex stats to hc->args.stats.
+ * Should be called while log mutex is locked!
+ */
+static hza_error_t C41_CALL stats_log_locked
+(
+    hza_context_t * hc
+);
 
-    /* 0x0098: import modules */
-    C32(0),                     // END ENTRY: name
-    C32(0),                     // END ENTRY: proc_start
+/* run_sampled **************************************************************/
+/**
+ * Runs hza_run() in slices of at most hc->sample_left iterations and
+ * records the stack of the attached task between slices.
+ */
+static hza_error_t run_sampled
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+);
 
-    /* 0x00A0: import proc table - 0 items */
+/* sample_locked ************************************************************/
+/**
+ * Adds the current stack of the attached task to the world sample table.
+ * Should be called while world mutex is locked!
+ */
+static hza_error_t C41_CALL sample_locked
+(
+    hza_context_t * hc
+);
 
-    /* 0x00A0: export table */
-    C32(1),                     // proc 1 is exported
+/* sample_free_all **********************************************************/
+/**
+ * Frees the world sample table; used when the world ends.
+ */
+static hza_error_t sample_free_all
+(
+    hza_context_t * hc
+);
 
-    /* 0x00A4: target table */
+/* proc_label ***************************************************************/
+/**
+ * Writes the zero-terminated "module.proc" label of proc px of module m in
+ * buf, cut to fit; the separators of folded stacks are replaced in names.
+ * Should be called while module mutex is locked!
+ */
+static void proc_label
+(
+    hza_world_t * w,
+    hza_module_t * m,
+    uint32_t px,
+    char * buf,
+    size_t size
+);
+
+/* frame_module_index *******************************************************/
+/**
+ * Stores in *mx the index in the module table of t of the module owning the
+ * proc of frame f; frames do not store it so that they fit in 16 bytes.
+ */
+static hza_error_t frame_module_index
+(
+    hza_context_t * hc,
+    hza_task_t const * t,
+    hza_frame_t const * f,
+    uint32_t * mx
+);
+
+/* trim_limit ***************************************************************/
+/**
+ * Returns the size hza_task_trim() shrinks a table of limit items to when
+ * used items are in use, or limit if shrinking it is not worth it.
+ */
+static uint32_t trim_limit
+(
+    uint32_t limit,
+    uint32_t used,
+    uint32_t init
+);
+
+/* image_module_locked ******************************************************/
+/**
+ * Finds a loaded module matching hc->args.image.key that the active task
+ * has not imported yet; stores it (or NULL) in hc->args.image.module.
+ * Should be called while module mutex is locked!
+ */
+static hza_error_t C41_CALL image_module_locked
+(
+    hza_context_t * hc
+);
+
+/* image_io *****************************************************************/
+/**
+ * Calls the image io callback; logs and returns HZAE_IMAGE_IO on failure.
+ */
+static hza_error_t image_io
+(
+    hza_context_t * hc,
+    hza_image_io_f io,
+    void * io_ctx,
+    void * data,
+    size_t size
+);
+
+/* proc_label_locked ********************************************************/
+/**
+ * proc_label() for hc->args.label.
+ * Should be called while module mutex is locked!
+ */
+static hza_error_t C41_CALL proc_label_locked
+(
+    hza_context_t * hc
+);
+
+/* host_register_locked *****************************************************/
+/**
+ * Appends hc->args.host to the host function table of the world and stores
+ * its index in hc->args.host.index; fails with HZAE_STATE if other contexts
+ * are attached, as they may be running code that reads the table.
+ * Should be called while world mutex is locked!
+ */
+static hza_error_t C41_CALL host_register_locked
+(
+    hza_context_t * hc
+);
+
+/* sample_put_frame *********************************************************/
+/**
+ * Prints the M.P.I label of insn.
+ * Should be called while module mutex is locked!
+ */
+static void sample_put_frame
+(
+    hza_world_t * w,
+    c41_io_t * io,
+    hza_insn_t const * insn
+);
+
+/* sample_report_locked *****************************************************/
+/**
+ * Prints the folded stacks to hc->args.io.
+ * Should be called while module mutex and world mutex are locked!
+ */
+static hza_error_t C41_CALL sample_report_locked
+(
+    hza_context_t * hc
+);
+
+/* sample_report_modules_locked *********************************************/
+static hza_error_t C41_CALL sample_report_modules_locked
+(
+    hza_context_t * hc
+);
+
+/* insn_check ***************************************************************/
+/**
+ * Computes the minimum number of bits in the register space to allow running
+ * the given instruction.
+ */
+static int32_t insn_check
+(
+    hza_context_t * hc,
+    hza_module_t * m,
+    hza_proc_t * proc,
+    hza_insn_t * insn
+);
+
+/* last_insn_check **********************************************************/
+/**
+ * Checks if the given instruction is valid for the last instruction in the
+ * proc. This means that the flow will not continue to the instruction after it.
+ */
+static int last_insn_check
+(
+    hza_insn_t * insn
+);
+/* find_mod_name_cell *******************************************************/
+/**
+ * Builds the tree path in search of the given name.
+ * The function should be called with module mutex locked.
+ * returns: 0 - name found, 1 - name not found.
+ */
+static int C41_CALL find_mod_name_cell
+(
+    hza_context_t *             hc,
+    uint8_t const *             name,
+    uint_t                      len,
+    c41_rbtree_path_t *         path
+);
+
+/* alloc_mod_name_cell ******************************************************/
+/**
+ * Allocate a module name cell.
+ * Path has to be initialised previously by find_mod_name_cell().
+ * The function should be called with module mutex locked and the lock should
+ * not have been released in between find_mod_name_cell() and this call.
+ */
+static hza_error_t C41_CALL alloc_mod_name_cell
+(
+    hza_context_t *             hc,
+    uint8_t const *             name,
+    uint_t                      len,
+    c41_rbtree_path_t *         path,
+    hza_mod_name_cell_t * *     mnc_p
+);
+
+/* get_mod_name_cell ********************************************************/
+/**
+ * Searches for the given module name and if none is found it allocates a cell.
+ * If len < 0 the function will replace it with the C-string length of name.
+ * The function should be called with module mutex locked.
+ */
+static hza_error_t C41_CALL get_mod_name_cell
+(
+    hza_context_t *             hc,
+    void *                      name,
+    int                         len,
+    hza_mod_name_cell_t * *     mnc_p
+);
+
+/* attach_context ***********************************************************/
+/**
+ * Attaches context to the world.
+ * Multithreading state: world_mutex must be locked.
+ * Creates the context condition variable and increments context_count.
+ **/
+static hza_error_t C41_CALL attach_context
+(
+    hza_context_t * hc
+);
+
+/* detach_context ***********************************************************/
+/**
+ * Detaches context from the world.
+ * Multithreading state: world_mutex must be locked.
+ * Just decrements context_count in the world.
+ * fills hc->args.context_count with the number of contexts left attached to
+ * the world.
+ **/
+static hza_error_t C41_CALL detach_context
+(
+    hza_context_t * hc
+);
+
+/* mod_name_cmp *************************************************************/
+static uint_t C41_CALL mod_name_cmp
+(
+    void * key,
+    void * node_payload,
+    void * context
+);
+
+/* crc32c_mode *************************************************************/
+/**
+ * Picks the fastest CRC32C implementation available on the host cpu.
+ * Returns CRC_SSE42 or CRC_TABLE.
+ **/
+static uint_t crc32c_mode ();
+
+/* crc32c_update ***********************************************************/
+/**
+ * Updates a CRC32C state (not inverted) with the given bytes.
+ **/
+static uint32_t crc32c_update
+(
+    uint32_t crc,
+    uint8_t const * data,
+    size_t len,
+    uint_t mode
+);
+
+/* mod00_decode ************************************************************/
+/**
+ * Converts count big-endian items of item_size bytes (16, 8, 4, 2 or 1) from
+ * src to host order in dst. 16-byte items are stored as hza_uint128_t.
+ * When crc_mode is not CRC_NONE, the raw bytes are also fed to CRC32C block by
+ * block, right before each block is decoded, so the checksum does not need a
+ * separate pass over the image.
+ * Returns the updated crc state.
+ **/
+static uint32_t mod00_decode
+(
+    void * dst,
+    uint8_t const * src,
+    size_t count,
+    uint_t item_size,
+    uint32_t crc,
+    uint_t crc_mode
+);
+
+/* mod00_load **************************************************************/
+/**
+ * Loads a module.
+ * Should be called with module mutex locked.
+ * flags is a bitmask of HZA_LOAD_xxx.
+ * The allocated module is returned in hc->args.realloc.ptr
+ **/
+static hza_error_t mod00_load
+(
+    hza_context_t * hc,
+    void const * data,
+    size_t len,
+    uint_t flags
+);
+
+/* module_load_locked ******************************************************/
+/**
+ * Wrapper for mod00_load() to be run with module mutex locked.
+ * Parameters are passed in hc->args.load.
+ **/
+static hza_error_t C41_CALL module_load_locked
+(
+    hza_context_t * hc
+);
+
+/* task_alloc ***************************************************************/
+/**
+ *  Allocates a task. This should be called with world mutex locked.
+ *  hc->args.task is NULL for a new task or the task to fork; in the latter
+ *  case the tables are sized as in that task and the module map (with its
+ *  import index tables) is copied.
+ *  The pointer to the new task is stored in hc->args.task.
+ */
+static hza_error_t C41_CALL task_alloc
+(
+    hza_context_t * hc
+);
+
+/* task_free ****************************************************************/
+/**
+ *  Frees task memory. This should be called with world mutex locked.
+ *  The task is passed in hc->args.task.
+ *  This is intended to be called from task_alloc() (with a partially allocated
+ *  task), from hza_task_create() when task_init() fails and from
+ *  hza_task_deref() when there are no refs left to the task.
+ */
+static hza_error_t C41_CALL task_free
+(
+    hza_context_t * hc
+);
+
+/* node_ma_locked ***********************************************************/
+/**
+ *  Sets hc->args.node.ma as the allocator of node hc->args.node.index.
+ *  This should be called with world mutex locked.
+ */
+static hza_error_t C41_CALL node_ma_locked
+(
+    hza_context_t * hc
+);
+
+/* lock_stats_enable_locked *************************************************/
+/**
+ *  Sets hc->args.clock as the lock stats clock if hc is the only context of
+ *  the world. This should be called with world mutex locked.
+ */
+static hza_error_t C41_CALL lock_stats_enable_locked
+(
+    hza_context_t * hc
+);
+
+/* task_migrate_locked ******************************************************/
+/**
+ *  Moves the task memory of the active task to node hc->args.node.index.
+ *  This should be called with world mutex locked.
+ */
+static hza_error_t C41_CALL task_migrate_locked
+(
+    hza_context_t * hc
+);
+
+/* task_ref_locked **********************************************************/
+/**
+ *  Adds a reference to hc->args.task. This should be called with task mutex
+ *  locked.
+ */
+static hza_error_t C41_CALL task_ref_locked
+(
+    hza_context_t * hc
+);
+
+/* task_deref_locked ********************************************************/
+/**
+ *  Removes a reference from hc->args.task. If that was the last reference
+ *  the task is unlinked from its state queue and left in hc->args.task to be
+ *  freed, otherwise hc->args.task is set to NULL.
+ *  This should be called with task mutex locked.
+ */
+static hza_error_t C41_CALL task_deref_locked
+(
+    hza_context_t * hc
+);
+
+/* reg_reserve **************************************************************/
+/**
+ *  Grows the reg space of the active task to hold registers up to reg_limit.
+ *  This is the slow path of the tail call insns.
+ */
+static hza_error_t reg_reserve
+(
+    hza_context_t * hc,
+    uint32_t reg_limit
+);
+
+/* frame_reserve ************************************************************/
+/**
+ *  Makes room in the active task for a frame after t->frame_index and for
+ *  registers up to reg_limit by growing the frame table and the reg space.
+ *  This is the slow path of hza_enter() and of the call insns.
+ */
+static hza_error_t frame_reserve
+(
+    hza_context_t * hc,
+    uint32_t reg_limit
+);
+
+#if !LANE_SSSE3
+/* lane_op ******************************************************************/
+/**
+ *  Portable version of the lane insns (HZAOC_VVV and HZAO_VMOVEMASK_8) for
+ *  regs a, b, c; used where the host has no vector instruction for them.
+ */
+static void lane_op
+(
+    uint16_t opcode,
+    uint8_t * a,
+    uint8_t const * b,
+    uint8_t const * c
+);
+#endif
+
+/* task_init ****************************************************************/
+/**
+ *  Inits a newly allocated task. This should be called with task mutex locked.
+ */
+static hza_error_t C41_CALL task_init
+(
+    hza_context_t * hc
+);
+
+/* data_block_cstr **********************************************************/
+/**
+ * Copies a data block of a module into buf as a NUL-terminated string,
+ * truncating it if needed. Used to log names.
+ */
+static char const * data_block_cstr
+(
+    hza_module_t * m,
+    uint32_t dbi,
+    char * buf,
+    size_t size
+);
+
+/* module_by_name_locked ****************************************************/
+/**
+ *  Looks up hc->args.name.a/n; stores the module in hc->args.name.module.
+ *  Should be called with module mutex locked.
+ */
+static hza_error_t C41_CALL module_by_name_locked
+(
+    hza_context_t * hc
+);
+
+/* module_map_name_locked ***************************************************/
+/**
+ *  Maps hc->args.name.a/n to hc->args.name.module.
+ *  Should be called with module mutex locked.
+ */
+static hza_error_t C41_CALL module_map_name_locked
+(
+    hza_context_t * hc
+);
+
+/* mod00_core ***************************************************************/
+#define C32(_v) \
+    ((_v) >> 24), ((_v) >> 16) & 0xFF, ((_v) >> 8) & 0xFF, (_v) & 0xFF
+#define C16(_v) ((_v) >> 8), ((_v) & 0xFF)
+static uint8_t mod00_core[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0x146),                 // size (in bytes)
+    C32(0xC494B4CA),            // checksum (CRC32C)
+    C32(1),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(2),                     // proc_count
+    C32(3),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(1),                     // export_count
+    C32(2),                     // target_count
+    C32(0x12),                  // insn_count
+    C32(0x0A),                  // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0),                     // insn start
+    C32(0),                     // target start
+    C32(0),                     // const128_start
+    C32(0),                     // const64_start
+    C32(0),                     // const32_start
+    C32(0),                     // name
+
+    /* 0x0058: proc 01 */
+    C32(1),                     // insn start
+    C32(0),                     // target start
+    C32(0),                     // const128_start
+    C32(0),                     // const64_start
+    C32(0),                     // const32_start
+    C32(2),                     // name
+
+    /* 0x0070: end of proc table (entry 02) */
+    C32(0x12),                  // insn start
+    C32(2),                     // target start
+    C32(0),                     // const128_start
+    C32(0),                     // const64_start
+    C32(0),                     // const32_start
+    C32(0),                     // name
+
+    /* 0x0088: data block table */
+    C32(0),                     // data block offset #0 - ''
+    C32(0),                     // data block offset #1 - 'core'
+    C32(0x04),                  // data block offset #2 - '_test0'
+    C32(0x0A),                  // data block offset #3 - END
+
+    /* 0x0098: import modules */
+    C32(0),                     // END ENTRY: name
+    C32(0),                     // END ENTRY: proc_start
+
+    /* 0x00A0: import proc table - 0 items */
+
+    /* 0x00A0: export table */
+    C32(1),                     // proc 1 is exported
+
+    /* 0x00A4: target table */
     /* target table - proc 1 */
     C32(0x10),
     C32(0x01),
 
-    /* 0x00AC: insn table */
-    C16(HZAO_HALT), C16(0), C16(0), C16(0), // halt
-    C16(HZAO_INIT_8),  C16(0x90), C16(5),   C16(0),
-    C16(HZAO_INIT_16), C16(0x00), C16('h'), C16(0),
-    C16(HZAO_INIT_16), C16(0x10), C16('e'), C16(0),
-    C16(HZAO_INIT_16), C16(0x20), C16('l'), C16(0),
-    C16(HZAO_INIT_16), C16(0x30), C16('o'), C16(0),
-    C16(HZAO_INIT_16), C16(0x70), C16('!'), C16(0),
-    C16(HZAO_INIT_16), C16(0x80), C16(10),  C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x00), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x10), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x20), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x20), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x30), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x70), C16(0), C16(0),
-    C16(HZAO_DEBUG_OUT_16), C16(0x80), C16(0), C16(0),
-    C16(HZAO_WRAP_ADD_CONST_8), C16(0x90), C16(0x90), C16(0xFF),
-    C16(HZAO_BRANCH_ZERO_8), C16(0x90), C16(0), C16(0),
-    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x00AC: insn table */
+    C16(HZAO_HALT), C16(0), C16(0), C16(0), // halt
+    C16(HZAO_INIT_8),  C16(0x90), C16(5),   C16(0),
+    C16(HZAO_INIT_16), C16(0x00), C16('h'), C16(0),
+    C16(HZAO_INIT_16), C16(0x10), C16('e'), C16(0),
+    C16(HZAO_INIT_16), C16(0x20), C16('l'), C16(0),
+    C16(HZAO_INIT_16), C16(0x30), C16('o'), C16(0),
+    C16(HZAO_INIT_16), C16(0x70), C16('!'), C16(0),
+    C16(HZAO_INIT_16), C16(0x80), C16(10),  C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x00), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x10), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x20), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x20), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x30), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x70), C16(0), C16(0),
+    C16(HZAO_DEBUG_OUT_16), C16(0x80), C16(0), C16(0),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x90), C16(0x90), C16(0xFF),
+    C16(HZAO_BRANCH_ZERO_8), C16(0x90), C16(0), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+
+    /* 0x013C: data area */
+    /* data ofs 0x00: */ 'c', 'o', 'r', 'e',
+    /* data ofs 0x04: */ '_', 't', 'e', 's', 't', '0',
+    /* data size: 0x0A */
+
+    /* 0x0146: end */
+};
+#undef C16
+#undef C32
+
+/* crc32c_table *************************************************************/
+/* CRC32C (Castagnoli, reflected polynomial 0x82F63B78) */
+static uint32_t const crc32c_table[0x100] =
+{
+    0x00000000, 0xF26B8303, 0xE13B70F7, 0x1350F3F4,
+    0xC79A971F, 0x35F1141C, 0x26A1E7E8, 0xD4CA64EB,
+    0x8AD958CF, 0x78B2DBCC, 0x6BE22838, 0x9989AB3B,
+    0x4D43CFD0, 0xBF284CD3, 0xAC78BF27, 0x5E133C24,
+    0x105EC76F, 0xE235446C, 0xF165B798, 0x030E349B,
+    0xD7C45070, 0x25AFD373, 0x36FF2087, 0xC494A384,
+    0x9A879FA0, 0x68EC1CA3, 0x7BBCEF57, 0x89D76C54,
+    0x5D1D08BF, 0xAF768BBC, 0xBC267848, 0x4E4DFB4B,
+    0x20BD8EDE, 0xD2D60DDD, 0xC186FE29, 0x33ED7D2A,
+    0xE72719C1, 0x154C9AC2, 0x061C6936, 0xF477EA35,
+    0xAA64D611, 0x580F5512, 0x4B5FA6E6, 0xB93425E5,
+    0x6DFE410E, 0x9F95C20D, 0x8CC531F9, 0x7EAEB2FA,
+    0x30E349B1, 0xC288CAB2, 0xD1D83946, 0x23B3BA45,
+    0xF779DEAE, 0x05125DAD, 0x1642AE59, 0xE4292D5A,
+    0xBA3A117E, 0x4851927D, 0x5B016189, 0xA96AE28A,
+    0x7DA08661, 0x8FCB0562, 0x9C9BF696, 0x6EF07595,
+    0x417B1DBC, 0xB3109EBF, 0xA0406D4B, 0x522BEE48,
+    0x86E18AA3, 0x748A09A0, 0x67DAFA54, 0x95B17957,
+    0xCBA24573, 0x39C9C670, 0x2A993584, 0xD8F2B687,
+    0x0C38D26C, 0xFE53516F, 0xED03A29B, 0x1F682198,
+    0x5125DAD3, 0xA34E59D0, 0xB01EAA24, 0x42752927,
+    0x96BF4DCC, 0x64D4CECF, 0x77843D3B, 0x85EFBE38,
+    0xDBFC821C, 0x2997011F, 0x3AC7F2EB, 0xC8AC71E8,
+    0x1C661503, 0xEE0D9600, 0xFD5D65F4, 0x0F36E6F7,
+    0x61C69362, 0x93AD1061, 0x80FDE395, 0x72966096,
+    0xA65C047D, 0x5437877E, 0x4767748A, 0xB50CF789,
+    0xEB1FCBAD, 0x197448AE, 0x0A24BB5A, 0xF84F3859,
+    0x2C855CB2, 0xDEEEDFB1, 0xCDBE2C45, 0x3FD5AF46,
+    0x7198540D, 0x83F3D70E, 0x90A324FA, 0x62C8A7F9,
+    0xB602C312, 0x44694011, 0x5739B3E5, 0xA55230E6,
+    0xFB410CC2, 0x092A8FC1, 0x1A7A7C35, 0xE811FF36,
+    0x3CDB9BDD, 0xCEB018DE, 0xDDE0EB2A, 0x2F8B6829,
+    0x82F63B78, 0x709DB87B, 0x63CD4B8F, 0x91A6C88C,
+    0x456CAC67, 0xB7072F64, 0xA457DC90, 0x563C5F93,
+    0x082F63B7, 0xFA44E0B4, 0xE9141340, 0x1B7F9043,
+    0xCFB5F4A8, 0x3DDE77AB, 0x2E8E845F, 0xDCE5075C,
+    0x92A8FC17, 0x60C37F14, 0x73938CE0, 0x81F80FE3,
+    0x55326B08, 0xA759E80B, 0xB4091BFF, 0x466298FC,
+    0x1871A4D8, 0xEA1A27DB, 0xF94AD42F, 0x0B21572C,
+    0xDFEB33C7, 0x2D80B0C4, 0x3ED04330, 0xCCBBC033,
+    0xA24BB5A6, 0x502036A5, 0x4370C551, 0xB11B4652,
+    0x65D122B9, 0x97BAA1BA, 0x84EA524E, 0x7681D14D,
+    0x2892ED69, 0xDAF96E6A, 0xC9A99D9E, 0x3BC21E9D,
+    0xEF087A76, 0x1D63F975, 0x0E330A81, 0xFC588982,
+    0xB21572C9, 0x407EF1CA, 0x532E023E, 0xA145813D,
+    0x758FE5D6, 0x87E466D5, 0x94B49521, 0x66DF1622,
+    0x38CC2A06, 0xCAA7A905, 0xD9F75AF1, 0x2B9CD9F2,
+    0xFF56BD19, 0x0D3D3E1A, 0x1E6DCDEE, 0xEC064EED,
+    0xC38D26C4, 0x31E6A5C7, 0x22B65633, 0xD0DDD530,
+    0x0417B1DB, 0xF67C32D8, 0xE52CC12C, 0x1747422F,
+    0x49547E0B, 0xBB3FFD08, 0xA86F0EFC, 0x5A048DFF,
+    0x8ECEE914, 0x7CA56A17, 0x6FF599E3, 0x9D9E1AE0,
+    0xD3D3E1AB, 0x21B862A8, 0x32E8915C, 0xC083125F,
+    0x144976B4, 0xE622F5B7, 0xF5720643, 0x07198540,
+    0x590AB964, 0xAB613A67, 0xB831C993, 0x4A5A4A90,
+    0x9E902E7B, 0x6CFBAD78, 0x7FAB5E8C, 0x8DC0DD8F,
+    0xE330A81A, 0x115B2B19, 0x020BD8ED, 0xF0605BEE,
+    0x24AA3F05, 0xD6C1BC06, 0xC5914FF2, 0x37FACCF1,
+    0x69E9F0D5, 0x9B8273D6, 0x88D28022, 0x7AB90321,
+    0xAE7367CA, 0x5C18E4C9, 0x4F48173D, 0xBD23943E,
+    0xF36E6F75, 0x0105EC76, 0x12551F82, 0xE03E9C81,
+    0x34F4F86A, 0xC69F7B69, 0xD5CF889D, 0x27A40B9E,
+    0x79B737BA, 0x8BDCB4B9, 0x988C474D, 0x6AE7C44E,
+    0xBE2DA0A5, 0x4C4623A6, 0x5F16D052, 0xAD7D5351,
+};
+
+/****************************************************************************/
+/*                                                                          */
+/* Function bodies                                                          */
+/*                                                                          */
+/****************************************************************************/
+
+/* hza_lib_name *************************************************************/
+HAZNA_API char const * C41_CALL hza_lib_name ()
+{
+    return "hazna-engine-v00"
+#if _DEBUG
+        "-debug"
+#else
+        "-release"
+#endif
+        ;
+}
+
+/* hza_error_name ***********************************************************/
+HAZNA_API char const * C41_CALL hza_error_name (hza_error_t e)
+{
+#define X(_x) case _x: return #_x
+    switch (e)
+    {
+        X(HZAE_WORLD_ALLOC);
+        X(HZAE_WORLD_FINISH);
+        X(HZAE_LOG_MUTEX_INIT);
+        X(HZAE_ALLOC);
+        X(HZAE_STATE);
+        X(HZAE_STACK_LIMIT);
+        X(HZAE_REG_LIMIT);
+        X(HZAE_PROC_INDEX);
+        X(HZAE_MOD00_TRUNC);
+        X(HZAE_MOD00_MAGIC);
+        X(HZAE_MOD00_CORRUPT);
+        X(HZAE_COND_CREATE);
+        X(HZAE_MOD00_CHECKSUM);
+        X(HZAE_NAME_TAKEN);
+        X(HZAE_NOT_FOUND);
+        X(HZAE_IMPORT_MODULE);
+        X(HZAE_IMPORT_PROC);
+        X(HZAE_CHAN_SIZE);
+        X(HZAE_NOT_SUPPORTED);
+        X(HZAE_GEN_PARAMS);
+        X(HZAE_NODE);
+        X(HZAE_IMAGE_IO);
+        X(HZAE_IMAGE_CORRUPT);
+        X(HZAE_IMAGE_MODULE);
+        X(HZAE_HOST_LIMIT);
+        X(HZAE_HOST_CALL);
+
+        X(HZAF_BUG);
+        X(HZAF_NO_CODE);
+        X(HZAF_MUTEX_LOCK);
+        X(HZAF_MUTEX_UNLOCK);
+        X(HZAF_WORLD_FREE);
+    }
+
+    return e < HZA_FATAL ? "HZAE_UNKNOWN" : "HZAF_UNKNOWN";
+#undef X
+}
+
+/* hza_opcode_name **********************************************************/
+HAZNA_API char const * C41_CALL hza_opcode_name (uint16_t o)
+{
+#define X(_x) case _x: return #_x
+    switch (o)
+    {
+        X(HZAO_NOP);
+        X(HZAO_HALT);
+        X(HZAO_RET);
+        X(HZAO_DEBUG_OUT_16);
+        X(HZAO_DEBUG_OUT_32);
+        X(HZAO_OUT_8);
+        X(HZAO_IN_8);
+        X(HZAO_IN_BLOCK_8);
+        X(HZAO_OUT_BLOCK_8);
+        X(HZAO_HOST_CALL);
+        X(HZAO_CALL);
+        X(HZAO_CALL_IMPORT);
+        X(HZAO_TAIL_CALL);
+        X(HZAO_TAIL_CALL_IMPORT);
+        X(HZAO_VADD_8);
+        X(HZAO_VADD_16);
+        X(HZAO_VADD_32);
+        X(HZAO_VADD_64);
+        X(HZAO_VSUB_8);
+        X(HZAO_VSUB_16);
+        X(HZAO_VSUB_32);
+        X(HZAO_VSUB_64);
+        X(HZAO_VCMP_EQ_8);
+        X(HZAO_VCMP_EQ_16);
+        X(HZAO_VCMP_EQ_32);
+        X(HZAO_VCMP_EQ_64);
+        X(HZAO_VCMP_GT_8);
+        X(HZAO_VCMP_GT_16);
+        X(HZAO_VCMP_GT_32);
+        X(HZAO_VCMP_GT_64);
+        X(HZAO_VMIN_8);
+        X(HZAO_VMIN_16);
+        X(HZAO_VMIN_32);
+        X(HZAO_VMIN_64);
+        X(HZAO_VMAX_8);
+        X(HZAO_VMAX_16);
+        X(HZAO_VMAX_32);
+        X(HZAO_VMAX_64);
+        X(HZAO_VSHUFFLE_8);
+        X(HZAO_VAND_128);
+        X(HZAO_VOR_128);
+        X(HZAO_VXOR_128);
+        X(HZAO_VMOVEMASK_8);
+        X(HZAO_INIT_8);
+        X(HZAO_INIT_16);
+        X(HZAO_WRAP_ADD_CONST_8);
+        X(HZAO_BRANCH_ZERO_1);
+        X(HZAO_BRANCH_ZERO_2);
+        X(HZAO_BRANCH_ZERO_4);
+        X(HZAO_BRANCH_ZERO_8);
+        X(HZAO_BRANCH_ZERO_16);
+        X(HZAO_BRANCH_ZERO_32);
+        X(HZAO_BRANCH_ZERO_64);
+        X(HZAO_BRANCH_ZERO_128);
+    }
+    return "HZAO_UNKNOWN";
+#undef X
+}
+
+/* opcode_class_name ********************************************************/
+static char const * opcode_class_name (uint_t c)
+{
+    static char const * const names[0x20] =
+    {
+        "nnn", "rnn", "rrn", "rrr", "qrr", "rrc", "qrc", "srn",
+        "rrs", "qrs", "rr4", "qr4", "rcn", "rnp", "rrp", "rcp",
+        "rrg", "rcg", "rlt", "ran", "raa", "ra4", "ra5", "ra6",
+        "r4s", "r44", "w4n", "vvv", "x1c", "x1d", "x1e", "x1f"
+    };
+    return names[c & 0x1F];
+}
+
+/* log_msg *******************************************************************/
+#define LME(...) do { \
+    do { \
+        if (c41_io_fmt(w->log_io, "W[$s:$s:$Ui] logging error: ", \
+                       __FUNCTION__, __FILE__, __LINE__) < 0) break; \
+        if (c41_io_fmt(w->log_io, __VA_ARGS__) < 0) break; \
+        c41_io_fmt(w->log_io, "\n"); \
+    } while (0); \
+    w->log_level = HZA_LL_NONE; \
+    return; } while (0)
+
+static void log_msg
+(
+    hza_context_t * hc,
+    char const * func,
+    char const * src,
+    int line,
+    int level,
+    char const * fmt,
+    ...
+)
+{
+    va_list va;
+    hza_world_t * w = hc->world;
+    hza_clock_f clock = w->lock_clock;
+    uint64_t acquired;
+    int smte;
+
+    if (w->log_level == HZA_LL_NONE) return;
+    if (clock) smte = mutex_lock_timed(w, w->log_mutex, clock, &acquired);
+    else smte = c41_smt_mutex_lock(w->smt, w->log_mutex);
+    if (smte) LME("failed locking log mutex ($i)", smte);
+
+    va_start(va, fmt);
+    if (c41_io_fmt(w->log_io, "$c: ", "NFEWID"[level]) < 0
+        || c41_io_vfmt(w->log_io, fmt, va) < 0
+        || c41_io_fmt(w->log_io, "    [$s:$s:$Ui]\n", func, src, line) < 0)
+    {
+        va_end(va);
+        LME("failed writing log message");
+    }
+    va_end(va);
+
+    if (clock) mutex_hold_end(w, w->log_mutex, clock, acquired);
+    smte = c41_smt_mutex_unlock(w->smt, w->log_mutex);
+    if (smte) LME("failed unlocking log mutex ($i)", smte);
+}
+#undef LME
+
+/* init_logging *************************************************************/
+static hza_error_t init_logging
+(
+    hza_context_t * hc,
+    c41_io_t * log_io,
+    uint8_t log_level
+)
+{
+    hza_world_t * w = hc->world;
+    uint_t smte;
+
+#if NDEBUG
+    if (log_level == HZA_LL_DEBUG) log_level = HZA_LL_INFO;
+#endif
+    w->log_level = log_level;
+    w->log_io = log_io;
+    smte = c41_smt_mutex_init(w->smt, w->log_mutex);
+    if (smte)
+    {
+        hc->smt_error = smte;
+        return (hc->hza_error = HZAE_LOG_MUTEX_INIT);
+    }
+    w->init_state |= HZA_INIT_LOG_MUTEX;
+
+    return 0;
+}
+
+/* run_locked ***************************************************************/
+static hza_error_t run_locked
+(
+    hza_context_t * hc,
+    hza_error_t (C41_CALL * func) (hza_context_t * hc),
+    c41_smt_mutex_t * mutex
+)
+{
+    hza_world_t * w = hc->world;
+    hza_clock_f clock = w->lock_clock;
+    int smte;
+    hza_error_t e;
+
+    if (clock) return run_locked_timed(hc, func, mutex, clock);
+
+    smte = c41_smt_mutex_lock(w->smt, mutex);
+    if (smte)
+    {
+        F("failed locking mutex $#G4p (smt error: $i)", mutex, smte);
+        hc->smt_error = smte;
+        return (hc->hza_error = HZAF_MUTEX_LOCK);
+    }
+
+    e = func(hc);
+
+    smte = c41_smt_mutex_unlock(w->smt, mutex);
+    if (smte)
+    {
+        F("failed unlocking mutex $#G4p (smt error: $i)", mutex, smte);
+        hc->smt_error = smte;
+        return (hc->hza_error = HZAF_MUTEX_UNLOCK);
+    }
+
+    return e;
+}
+
+/* mutex_lock_stats *********************************************************/
+static hza_lock_stats_t * mutex_lock_stats
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex
+)
+{
+    size_t ofs = (uint8_t *) mutex - (uint8_t *) w->world_mutex;
+    return &w->stats.lock[ofs / w->smt->mutex_size];
+}
+
+/* mutex_lock_timed *********************************************************/
+static int mutex_lock_timed
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock,
+    uint64_t * acquired
+)
+{
+    hza_lock_stats_t * ls;
+    uint64_t start, wait;
+    int smte;
+
+    smte = c41_smt_mutex_trylock(w->smt, mutex);
+    if (!smte)
+    {
+        *acquired = clock();
+        ls = mutex_lock_stats(w, mutex);
+        ls->count += 1;
+        return 0;
+    }
+
+    start = clock();
+    smte = c41_smt_mutex_lock(w->smt, mutex);
+    if (smte) return smte;
+    *acquired = clock();
+    wait = *acquired - start;
+    ls = mutex_lock_stats(w, mutex);
+    ls->count += 1;
+    ls->contended += 1;
+    ls->wait_total += wait;
+    if (ls->wait_max < wait) ls->wait_max = wait;
+    return 0;
+}
+
+/* mutex_hold_end ***********************************************************/
+static void mutex_hold_end
+(
+    hza_world_t * w,
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock,
+    uint64_t acquired
+)
+{
+    hza_lock_stats_t * ls = mutex_lock_stats(w, mutex);
+    uint64_t hold = clock() - acquired;
+
+    ls->hold_total += hold;
+    if (ls->hold_max < hold) ls->hold_max = hold;
+}
+
+/* run_locked_timed *********************************************************/
+static hza_error_t run_locked_timed
+(
+    hza_context_t * hc,
+    hza_error_t (C41_CALL * func) (hza_context_t * hc),
+    c41_smt_mutex_t * mutex,
+    hza_clock_f clock
+)
+{
+    hza_world_t * w = hc->world;
+    uint64_t acquired;
+    int smte;
+    hza_error_t e;
+
+    smte = mutex_lock_timed(w, mutex, clock, &acquired);
+    if (smte)
+    {
+        F("failed locking mutex $#G4p (smt error: $i)", mutex, smte);
+        hc->smt_error = smte;
+        return (hc->hza_error = HZAF_MUTEX_LOCK);
+    }
+
+    e = func(hc);
+
+    mutex_hold_end(w, mutex, clock, acquired);
+    smte = c41_smt_mutex_unlock(w->smt, mutex);
+    if (smte)
+    {
+        F("failed unlocking mutex $#G4p (smt error: $i)", mutex, smte);
+        hc->smt_error = smte;
+        return (hc->hza_error = HZAF_MUTEX_UNLOCK);
+    }
+
+    return e;
+}
+
+/* mod_name_cmp *************************************************************/
+static uint_t C41_CALL mod_name_cmp
+(
+    void * key,
+    void * node_payload,
+    void * context
+)
+{
+    c41_u8an_t * k = key;
+    hza_mod_name_cell_t * mnc = node_payload;
+    int c;
+
+    (void) context;
+
+    if (k->n != mnc->len)
+        return k->n < mnc->len ? C41_RBTREE_SMALLER : C41_RBTREE_GREATER;
+    c = C41_MEM_COMPARE(k->a, mnc->name, k->n);
+    if (c) return c < 0 ? C41_RBTREE_SMALLER : C41_RBTREE_GREATER;
+    return C41_RBTREE_EQUAL;
+}
+
+/* hza_init *****************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_init
+(
+    hza_context_t * hc,
+    c41_ma_t * ma,
+    c41_smt_t * smt,
+    c41_io_t * log_io,
+    uint8_t log_level
+)
+{
+    hza_error_t e;
+    hza_world_t * w;
+    int mae, smte, qi;
+    hza_mod_name_cell_t * mnc;
+
+    /* clear the context struct */
+    C41_VAR_ZERO(*hc);
+
+    /* allocate space for the world and all needed mutexes */
+    mae = c41_ma_alloc_zero_fill(ma, (void * *) &w, WORLD_SIZE);
+    if (mae)
+    {
+        hc->ma_error = mae;
+        return (hc->hza_error = HZAE_WORLD_ALLOC);
+    }
+    /* link the world in the context */
+    hc->world = w;
+
+    /* init few basic fields in the world */
+    w->world_ma = ma;
+    w->smt = smt;
+    w->world_mutex = (c41_smt_mutex_t *) (w + 1);
+    w->log_mutex = C41_PTR_OFS(w->world_mutex, smt->mutex_size);
+    w->module_mutex = C41_PTR_OFS(w->log_mutex, smt->mutex_size);
+    w->task_mutex = C41_PTR_OFS(w->module_mutex, smt->mutex_size);
+    w->context_count = 1;
+    c41_dlist_init(&w->module_list);
+
+    for (qi = 0; qi < HZA_TASK_STATES; qi++)
+    {
+        c41_dlist_init(&w->task_list[qi]);
+    }
+
+    c41_rbtree_init(&w->module_name_tree, mod_name_cmp, NULL);
+
+    /* init allocator; count allocs to detect leaks */
+    c41_ma_counter_init(&w->mac, ma,
+                        C41_SSIZE_MAX, C41_SSIZE_MAX, C41_SSIZE_MAX);
+    do
+    {
+        /* init logging as early as possible */
+        if (log_level)
+        {
+            e = init_logging(hc, log_io, log_level);
+            if (e) break;
+        }
+        D("initing world $#G4p (log level $i)", w, w->log_level);
+
+        smte = c41_smt_mutex_init(smt, w->world_mutex);
+        if (smte)
+        {
+            E("failed initing world mutex ($i)", smte);
+            break;
+        }
+        w->init_state |= HZA_INIT_WORLD_MUTEX;
+
+        smte = c41_smt_mutex_init(smt, w->module_mutex);
+        if (smte)
+        {
+            E("failed initing module mutex ($i)", smte);
+            break;
+        }
+        w->init_state |= HZA_INIT_MODULE_MUTEX;
+
+        smte = c41_smt_mutex_init(smt, w->task_mutex);
+        if (smte)
+        {
+            E("failed initing task mutex ($i)", smte);
+            break;
+        }
+        w->init_state |= HZA_INIT_TASK_MUTEX;
+
+
+        e = get_mod_name_cell(hc, "core", -1, &mnc);
+        if (e)
+        {
+            E("failed creating module name cell for 'core': $s = $i",
+              hza_error_name(e), e);
+            break;
+        }
+
+        e = mod00_load(hc, mod00_core, sizeof(mod00_core),
+                       HZA_LOAD_NO_CHECKSUM);
+        if (e)
+        {
+            E("failed loading 'core' module: $s = $i", hza_error_name(e), e);
+            break;
+        }
+
+        w->core_module = hc->args.realloc.ptr;
+        mnc->module = hc->args.realloc.ptr;
+
+#if 0
+        if (hza_export_by_name(w->core_module, (uint8_t *) "_test0", 6) != 1)
+        {
+            E("export lookup failed!");
+            break;
+        }
+#endif
+
+        smte = c41_smt_cond_create(&hc->cond, smt, &w->mac.ma);
+        if (smte)
+        {
+            e = HZAE_COND_CREATE;
+            E("failed initing context condition variable ($i)", smte);
+            break;
+        }
+
+#if 0
+        {
+            uint32_t tmp;
+            e = get_mod_name_cell(hc, "core", -1, &mnc);
+            for (tmp = 0; tmp < 10000000; ++tmp)
+            {
+                e = get_mod_name_cell(hc, &tmp, 4, &mnc);
+                if (e)
+                {
+                    E("failed initing tmp cell $i", tmp);
+                    break;
+                }
+                mnc->module = (void *) ((intptr_t) tmp + 5);
+            }
+
+            for (tmp = 0; tmp < 10000000; ++tmp)
+            {
+                e = get_mod_name_cell(hc, &tmp, 4, &mnc);
+                if (e)
+                {
+                    E("failed retrieving tmp cell $i", tmp);
+                    break;
+                }
+                if ((intptr_t) mnc->module != ((intptr_t) tmp + 5))
+                {
+                    e = HZAF_BUG;
+                    E("meh tmp=$i, m=$p", tmp, mnc->module);
+                }
+
+            }
+        }
+#endif
+    }
+    while (0);
+
+    if (e)
+    {
+        /* failed initing the world */
+        hc->hza_error = e;
+        /* call finish unless something fatal happened */
+        if (e < HZA_FATAL) hza_finish(hc);
+        return e;
+    }
+    D("inited context $#G4p and world $#G4p", hc, w);
+    D("mutex size: $z", smt->mutex_size);
+
+    return 0;
+}
+
+/* attach_context ***********************************************************/
+static hza_error_t C41_CALL attach_context
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    int smte;
+
+    smte = c41_smt_cond_create(&hc->cond, w->smt, &w->mac.ma);
+    if (smte)
+    {
+        E("failed initing context condition variable ($i)", smte);
+        hc->smt_error = smte;
+        return hc->hza_error = HZAE_COND_CREATE;
+    }
+    hc->args.context_count = (w->context_count += 1);
+
+    return 0;
+}
+
+/* hza_attach ***************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_attach
+(
+    hza_context_t * hc,
+    hza_world_t * w
+)
+{
+    hza_error_t e;
+
+    C41_VAR_ZERO(*hc);
+    hc->world = w;
+
+    e = run_locked(hc, attach_context, w->world_mutex);
+    if (e) return e;
+    D("attached context $#G4p to world $#G4p (context count: $Ui)", hc, w,
+      hc->args.context_count);
+
+    return 0;
+}
+
+/* detach_context ***********************************************************/
+static hza_error_t C41_CALL detach_context
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    int smte;
+
+    hc->args.context_count = (w->context_count -= 1);
+    if (hc->cond)
+    {
+        smte = c41_smt_cond_destroy(hc->cond, w->smt, &w->mac.ma);
+        if (smte)
+        {
+            F("failed destroying context condition variable ($i)", smte);
+            hc->smt_error = smte;
+            return hc->hza_error = HZAF_COND_DESTROY;
+        }
+    }
+
+    return 0;
+}
+
+/* hza_finish ***************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_finish
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    c41_smt_t * smt = w->smt;
+    c41_np_t * np;
+    int mae, smte, dirty, ts;
+    hza_error_t e;
+
+    dirty = 0;
+
+    if (hc->prof)
+    {
+        e = hza_prof_disable(hc);
+        if (e)
+        {
+            F("failed merging profiling counters: $s = $i",
+              hza_error_name(e), e);
+            return e;
+        }
+    }
+
+    if ((w->init_state & HZA_INIT_WORLD_MUTEX))
+    {
+        e = run_locked(hc, detach_context, w->world_mutex);
+        if (e)
+        {
+            F("failed detaching context: $s = $i", hza_error_name(e), e);
+            return e;
+        }
+        /* if there are other contexts working with the world then exit */
+        D("finished context $#G4p, world context count: $Ui", hc,
+          hc->args.context_count);
+        if (hc->args.context_count > 0)
+            return (hc->hza_finish_error = 0);
+    }
+
+    /* destroy the world */
+    D("ending world $#G4p...", w);
+
+    /* destroy tasks */
+    for (ts = 0; ts < HZA_TASK_STATES; ++ts)
+    {
+        for (np = w->task_list[ts].next; np != &w->task_list[ts];)
+        {
+            hza_task_t * t;
+            t = TASK_OF_LINKS(np);
+            np = np->next;
+            hc->args.task = t;
+            e = task_free(hc);
+            if (e)
+            {
+                F("failed destroying task $i: $s = $i", t->task_id,
+                  hza_error_name(e), e);
+                return e;
+            }
+        }
+    }
+
+    /* destroy modules and the module name tree in one go */
+    e = arena_finish(hc);
+    if (e)
+    {
+        F("failed freeing module arena: $s = $i", hza_error_name(e), e);
+        return e;
+    }
+    c41_dlist_init(&w->module_list);
+    w->module_name_tree.root = NULL;
+
+    /* destroy sampled stacks */
+    e = sample_free_all(hc);
+    if (e) return e;
+
+    /* destroy merged profiling counters */
+    if (w->prof)
+    {
+        hc->args.prof.prof = w->prof;
+        e = prof_free_locked(hc);
+        if (e) return e;
+        w->prof = NULL;
+    }
+
+    if (w->mac.total_size || w->mac.count)
+    {
+        E("******** MEMORY LEAK: count = $z, size = $z = $Xz ********",
+          w->mac.count, w->mac.total_size, w->mac.total_size);
+    }
+
+    if ((w->init_state & HZA_INIT_WORLD_MUTEX))
+    {
+        smte = c41_smt_mutex_finish(smt, w->world_mutex);
+        if (smte)
+        {
+            E("failed finishing world mutex ($i)", smte);
+            hc->smt_error = smte;
+            dirty = 1;
+        }
+    }
+
+    if ((w->init_state & HZA_INIT_MODULE_MUTEX))
+    {
+        smte = c41_smt_mutex_finish(smt, w->module_mutex);
+        if (smte)
+        {
+            E("failed finishing module mutex ($i)", smte);
+            hc->smt_error = smte;
+            dirty = 1;
+        }
+    }
+
+    if ((w->init_state & HZA_INIT_TASK_MUTEX))
+    {
+        smte = c41_smt_mutex_finish(smt, w->task_mutex);
+        if (smte)
+        {
+            E("failed finishing task mutex ($i)", smte);
+            hc->smt_error = smte;
+            dirty = 1;
+        }
+    }
+
+    if ((w->init_state & HZA_INIT_LOG_MUTEX))
+    {
+        smte = c41_smt_mutex_finish(smt, w->log_mutex);
+        if (smte)
+        {
+            E("failed finishing logging mutex ($i)", smte);
+            hc->smt_error = smte;
+            dirty = 1;
+        }
+    }
+
+    mae = c41_ma_free(w->world_ma, w, WORLD_SIZE);
+    if (mae)
+    {
+        hc->ma_error = mae;
+        return HZAF_WORLD_FREE;
+    }
+
+    return (hc->hza_finish_error = dirty ? HZAE_WORLD_FINISH : 0);
+}
+
+/* find_mod_name_cell *******************************************************/
+static int C41_CALL find_mod_name_cell
+(
+    hza_context_t *             hc,
+    uint8_t const *             name,
+    uint_t                      len,
+    c41_rbtree_path_t *         path
+)
+{
+    c41_u8an_t k;
+    int c;
+
+    k.a = (uint8_t *) name;
+    k.n = len;
+    c = c41_rbtree_find(path, &hc->world->module_name_tree, &k);
+    return c;
+}
+
+/* alloc_mod_name_cell ******************************************************/
+static hza_error_t C41_CALL alloc_mod_name_cell
+(
+    hza_context_t *             hc,
+    uint8_t const *             name,
+    uint_t                      len,
+    c41_rbtree_path_t *         path,
+    hza_mod_name_cell_t * *     mnc_p
+)
+{
+    c41_rbtree_node_t * rbtn;
+    hza_mod_name_cell_t * mnc;
+    hza_error_t e;
+
+    e = arena_alloc(hc, HZA_MEM_NAME, sizeof(c41_rbtree_node_t)
+                    + sizeof(hza_mod_name_cell_t) + len);
+    if (e)
+    {
+        EF(e, "failed to allocate a module name cell: $s = $i",
+           hza_error_name(e), e);
+        return e;
+    }
+
+    rbtn = hc->args.realloc.ptr;
+    c41_rbtree_insert(path, rbtn);
+    mnc = (hza_mod_name_cell_t *) (rbtn + 1);
+    mnc->len = len;
+    C41_MEM_COPY(mnc->name, name, len);
+    mnc->name[len] = 0;
+    mnc->module = NULL;
+    *mnc_p = mnc;
+
+    return 0;
+}
+
+/* get_mod_name_cell ********************************************************/
+static hza_error_t C41_CALL get_mod_name_cell
+(
+    hza_context_t *             hc,
+    void *                      name,
+    int                         len,
+    hza_mod_name_cell_t * *     mnc_p
+)
+{
+    c41_rbtree_path_t rbpath;
+    int c;
+    hza_error_t e;
+
+    if (len < 0) len = C41_STR_LEN(name);
+    c = find_mod_name_cell(hc, name, len, &rbpath);
+    if (!c)
+    {
+        *mnc_p = c41_rbtree_last_payload(&rbpath);
+        return 0;
+    }
+
+    if (c)
+    {
+        e = alloc_mod_name_cell(hc, name, len, &rbpath, mnc_p);
+        if (e) return e;
+    }
+
+    return 0;
+}
+
+/* realloc_table_locked *****************************************************/
+static hza_error_t C41_CALL realloc_table_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    int mae;
+    D("realloc in: ptr=$p, item_size=$z, new_count=$z, old_count=$z",
+      hc->args.realloc.ptr,
+      hc->args.realloc.item_size,
+      hc->args.realloc.new_count,
+      hc->args.realloc.old_count);
+
+    if (hc->args.realloc.node < HZA_NODE_LIMIT)
+        mae = task_mem_realloc(w, hc->args.realloc.node,
+                               hc->args.realloc.category,
+                               &hc->args.realloc.ptr,
+                               hc->args.realloc.item_size,
+                               hc->args.realloc.new_count,
+                               hc->args.realloc.old_count);
+    else
+    {
+        mae = c41_ma_realloc_array(&w->mac.ma,
+                                   (void * *) &hc->args.realloc.ptr,
+                                   hc->args.realloc.item_size,
+                                   hc->args.realloc.new_count,
+                                   hc->args.realloc.old_count);
+        if (!mae)
+            mem_account(w, hc->args.realloc.category,
+                        hc->args.realloc.item_size * hc->args.realloc.new_count,
+                        hc->args.realloc.item_size
+                        * hc->args.realloc.old_count);
+    }
+    D("realloc out: mae=$Ui, ptr=$p", mae, hc->args.realloc.ptr);
+    if (mae)
+    {
+        E("failed reallocating table: ma error $Ui", mae);
+        return (hc->hza_error = HZAE_ALLOC);
+    }
+    return 0;
+}
+
+/* task_mem_realloc *********************************************************/
+static uint_t task_mem_realloc
+(
+    hza_world_t * w,
+    uint_t node,
+    uint_t category,
+    void * ptr_p,
+    size_t item_size,
+    size_t new_count,
+    size_t old_count
+)
+{
+    c41_ma_t * ma = w->node_ma[node] ? w->node_ma[node] : &w->mac.ma;
+    uint_t mae;
+
+    mae = c41_ma_realloc_array(ma, ptr_p, item_size, new_count, old_count);
+    if (mae) return mae;
+    mem_account(w, category, item_size * new_count, item_size * old_count);
+    w->stats.node_mem_live[node] += item_size * new_count;
+    w->stats.node_mem_live[node] -= item_size * old_count;
+    return 0;
+}
+
+/* mem_account **************************************************************/
+static void mem_account
+(
+    hza_world_t * w,
+    uint_t category,
+    size_t new_size,
+    size_t old_size
+)
+{
+    hza_world_stats_t * s = &w->stats;
+
+    if (category < HZA_MEM_CATEGORIES)
+    {
+        s->mem_live[category] += new_size;
+        s->mem_live[category] -= old_size;
+        if (s->mem_live[category] > s->mem_peak[category])
+            s->mem_peak[category] = s->mem_live[category];
+    }
+    if (w->mac.total_size > s->mem_total_peak)
+        s->mem_total_peak = w->mac.total_size;
+}
+
+/* safe_realloc_table *******************************************************/
+static hza_error_t C41_CALL safe_realloc_table
+(
+    hza_context_t * hc,
+    uint_t category,
+    void * old_ptr,
+    size_t item_size,
+    size_t new_count,
+    size_t old_count
+)
+{
+    hza_error_t e;
+    hc->args.realloc.category = category;
+    hc->args.realloc.ptr = old_ptr;
+    hc->args.realloc.item_size = item_size;
+    hc->args.realloc.new_count = new_count;
+    hc->args.realloc.old_count = old_count;
+    hc->args.realloc.node = HZA_NODE_LIMIT;
+    e = run_locked(hc, realloc_table_locked, hc->world->world_mutex);
+    return e;
+}
+
+/* safe_realloc_task ********************************************************/
+static hza_error_t C41_CALL safe_realloc_task
+(
+    hza_context_t * hc,
+    uint_t category,
+    void * old_ptr,
+    size_t item_size,
+    size_t new_count,
+    size_t old_count
+)
+{
+    hc->args.realloc.category = category;
+    hc->args.realloc.ptr = old_ptr;
+    hc->args.realloc.item_size = item_size;
+    hc->args.realloc.new_count = new_count;
+    hc->args.realloc.old_count = old_count;
+    hc->args.realloc.node = hc->active_task->node;
+    return run_locked(hc, realloc_table_locked, hc->world->world_mutex);
+}
+
+/* safe_alloc ***************************************************************/
+static hza_error_t C41_CALL safe_alloc
+(
+    hza_context_t * hc,
+    uint_t category,
+    size_t size
+)
+{
+    return safe_realloc_table(hc, category, NULL, 1, size, 0);
+}
+
+/* safe_free ****************************************************************/
+static hza_error_t C41_CALL safe_free
+(
+    hza_context_t * hc,
+    uint_t category,
+    void * ptr,
+    size_t size
+)
+{
+    return safe_realloc_table(hc, category, ptr, 1, 0, size);
+}
+
+/* arena_alloc **************************************************************/
+static hza_error_t C41_CALL arena_alloc
+(
+    hza_context_t * hc,
+    uint_t category,
+    size_t size
+)
+{
+    hza_world_t * w = hc->world;
+    hza_world_stats_t * s = &w->stats;
+    hza_arena_chunk_t * ac;
+    size_t z = ARENA_ROUND(size);
+    hza_error_t e;
+
+    if (z > ARENA_CHUNK_SIZE / 4)
+    {
+        e = safe_alloc(hc, MEM_NONE, ARENA_HDR + z);
+        if (e) return e;
+        ac = hc->args.realloc.ptr;
+        ac->size = ARENA_HDR + z;
+        /* keep the bump chunk first */
+        if (w->arena_pos)
+        {
+            ac->next = w->arena_chunk_list->next;
+            w->arena_chunk_list->next = ac;
+        }
+        else
+        {
+            ac->next = w->arena_chunk_list;
+            w->arena_chunk_list = ac;
+        }
+        hc->args.realloc.ptr = (uint8_t *) ac + ARENA_HDR;
+    }
+    else
+    {
+        if (z > (size_t) (w->arena_end - w->arena_pos))
+        {
+            /* carving does not change mem_total; the chunk allocation
+             * does and mem_account() raises mem_total_peak for it */
+            e = safe_alloc(hc, MEM_NONE, ARENA_CHUNK_SIZE);
+            if (e) return e;
+            ac = hc->args.realloc.ptr;
+            ac->size = ARENA_CHUNK_SIZE;
+            ac->next = w->arena_chunk_list;
+            w->arena_chunk_list = ac;
+            w->arena_pos = (uint8_t *) ac + ARENA_HDR;
+            w->arena_end = (uint8_t *) ac + ARENA_CHUNK_SIZE;
+        }
+        hc->args.realloc.ptr = w->arena_pos;
+        w->arena_pos += z;
+    }
+
+    s->mem_live[category] += size;
+    if (s->mem_live[category] > s->mem_peak[category])
+        s->mem_peak[category] = s->mem_live[category];
+    return 0;
+}
+
+/* arena_free ***************************************************************/
+static hza_error_t C41_CALL arena_free
+(
+    hza_context_t * hc,
+    uint_t category,
+    void * ptr,
+    size_t size
+)
+{
+    hza_world_t * w = hc->world;
+    hza_arena_chunk_t * ac;
+    hza_arena_chunk_t * * acp;
+    size_t z = ARENA_ROUND(size);
+
+    w->stats.mem_live[category] -= size;
+    if (z > ARENA_CHUNK_SIZE / 4)
+    {
+        ac = (void *) ((uint8_t *) ptr - ARENA_HDR);
+        for (acp = &w->arena_chunk_list; *acp != ac; acp = &(*acp)->next)
+            if (!*acp)
+            {
+                F("arena chunk $p not found", ac);
+                return hc->hza_error = HZAF_BUG;
+            }
+        *acp = ac->next;
+        return safe_free(hc, MEM_NONE, ac, ac->size);
+    }
+    if ((uint8_t *) ptr + z == w->arena_pos) w->arena_pos = ptr;
+    return 0;
+}
+
+/* arena_finish *************************************************************/
+static hza_error_t C41_CALL arena_finish
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_arena_chunk_t * ac;
+    hza_error_t e;
+
+    while ((ac = w->arena_chunk_list))
+    {
+        w->arena_chunk_list = ac->next;
+        e = safe_free(hc, MEM_NONE, ac, ac->size);
+        if (e) return e;
+    }
+    w->arena_pos = w->arena_end = NULL;
+    w->stats.mem_live[HZA_MEM_MODULE] = 0;
+    w->stats.mem_live[HZA_MEM_NAME] = 0;
+    return 0;
+}
+
+/* crc32c_mode **************************************************************/
+static uint_t crc32c_mode ()
+{
+#if CRC32C_SSE42
+    unsigned int a, b, c, d;
+
+    if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_2))
+        return CRC_SSE42;
+#endif
+    return CRC_TABLE;
+}
+
+#if CRC32C_SSE42
+/* crc32c_sse42 *************************************************************/
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42
+(
+    uint32_t crc,
+    uint8_t const * data,
+    size_t len
+)
+{
+#if defined(__x86_64__)
+    uint64_t c;
+
+    for (; len && ((uintptr_t) data & 7); --len, ++data)
+        crc = __builtin_ia32_crc32qi(crc, *data);
+    for (c = crc; len >= 8; len -= 8, data += 8)
+        c = __builtin_ia32_crc32di(c, *(uint64_t const *) data);
+    crc = (uint32_t) c;
+#else
+    for (; len && ((uintptr_t) data & 3); --len, ++data)
+        crc = __builtin_ia32_crc32qi(crc, *data);
+    for (; len >= 4; len -= 4, data += 4)
+        crc = __builtin_ia32_crc32si(crc, *(uint32_t const *) data);
+#endif
+    for (; len; --len, ++data)
+        crc = __builtin_ia32_crc32qi(crc, *data);
+    return crc;
+}
+#endif
+
+/* crc32c_update ************************************************************/
+static uint32_t crc32c_update
+(
+    uint32_t crc,
+    uint8_t const * data,
+    size_t len,
+    uint_t mode
+)
+{
+#if CRC32C_SSE42
+    if (mode == CRC_SSE42) return crc32c_sse42(crc, data, len);
+#else
+    (void) mode;
+#endif
+    for (; len; --len, ++data)
+        crc = crc32c_table[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+/* hza_mod00_checksum *******************************************************/
+HAZNA_API uint32_t C41_CALL hza_mod00_checksum
+(
+    uint8_t const * data,
+    size_t size
+)
+{
+    uint_t mode = crc32c_mode();
+    uint32_t crc;
+
+    crc = crc32c_update(0xFFFFFFFF, data, size < HZA_MOD00_CHECKSUM_OFS
+                        ? size : HZA_MOD00_CHECKSUM_OFS, mode);
+    if (size > HZA_MOD00_CHECKSUM_OFS + 4)
+        crc = crc32c_update(crc, data + HZA_MOD00_CHECKSUM_OFS + 4,
+                            size - HZA_MOD00_CHECKSUM_OFS - 4, mode);
+    return ~crc;
+}
+
+/* mod00_decode *************************************************************/
+static uint32_t mod00_decode
+(
+    void * dst,
+    uint8_t const * src,
+    size_t count,
+    uint_t item_size,
+    uint32_t crc,
+    uint_t crc_mode
+)
+{
+    uint8_t * d = dst;
+    size_t i, n, block_count;
+
+    block_count = MOD00_DECODE_BLOCK / item_size;
+    for (; count; count -= n, src += n * item_size, d += n * item_size)
+    {
+        n = count < block_count ? count : block_count;
+        if (crc_mode != CRC_NONE)
+            crc = crc32c_update(crc, src, n * item_size, crc_mode);
+        switch (item_size)
+        {
+        case 0x10:
+            for (i = 0; i < n; ++i)
+            {
+                ((hza_uint128_t *) d)[i].high = c41_read_u64be(src + i * 0x10);
+                ((hza_uint128_t *) d)[i].low =
+                    c41_read_u64be(src + i * 0x10 + 8);
+            }
+            break;
+        case 8:
+            for (i = 0; i < n; ++i)
+                ((uint64_t *) d)[i] = c41_read_u64be(src + i * 8);
+            break;
+        case 4:
+            c41_read_u32be_array((uint32_t *) d, src, n);
+            break;
+        case 2:
+            c41_read_u16be_array((uint16_t *) d, src, n);
+            break;
+        default:
+            C41_MEM_COPY(d, src, n);
+        }
+    }
+    return crc;
+}
+
+/* mod00_load ***************************************************************/
+static hza_error_t mod00_load
+(
+    hza_context_t * hc,
+    void const * data,
+    size_t len,
+    uint_t flags
+)
+{
+    hza_mod00_hdr_t lhdr;
+    hza_mod00_proc_t * pt;
+    hza_mod00_impmod_t * im;
+    uint32_t * ip; // pointer to import proc names
+    hza_module_t * m;
+    hza_world_t * w = hc->world;
+    uint8_t * p;
+    hza_error_t e, le;
+    uint32_t n, i, j, dblen, crc;
+    uint_t crc_mode;
+    size_t z;
+
+    D("len = $Xz", len);
+    n = sizeof(hza_mod00_hdr_t);
+    if (len < n)
+    {
+        E("not enough data ($Xz)", len);
+        return hc->hza_error = HZAE_MOD00_TRUNC;
+    }
+
+    if (!C41_MEM_EQUAL(data, HZA_MOD00_MAGIC, HZA_MOD00_MAGIC_LEN))
+    {
+        E("bad magic!");
+        return hc->hza_error = HZAE_MOD00_MAGIC;
+    }
+
+    c41_read_u32be_array((uint32_t *) &lhdr.size,
+                         C41_PTR_OFS(data, HZA_MOD00_MAGIC_LEN),
+                         (sizeof(hza_mod00_hdr_t) - HZA_MOD00_MAGIC_LEN) / 4);
+    D("size:                    $Xd", lhdr.size);
+    D("checksum:                $Xd", lhdr.checksum);
+    D("name:                    $Xd", lhdr.name);
+    D("const128 count:          $Xd", lhdr.const128_count);
+    D("const64 count:           $Xd", lhdr.const64_count);
+    D("const32 count:           $Xd", lhdr.const32_count);
+    D("proc count:              $Xd", lhdr.proc_count);
+    D("data block count:        $Xd", lhdr.data_block_count);
+    D("import module count:     $Xd", lhdr.import_module_count);
+    D("import proc count:       $Xd", lhdr.import_count);
+    D("export proc count:       $Xd", lhdr.export_count);
+    D("target count:            $Xd", lhdr.target_count);
+    D("insn count:              $Xd", lhdr.insn_count);
+    D("data size:               $Xd", lhdr.data_size);
+
+    if (lhdr.size > len)
+    {
+        E("not enough data: header size = $Xd, raw size = $Xz", lhdr.size, len);
+        return hc->hza_error = HZAE_MOD00_TRUNC;
+    }
+    len = lhdr.size;
+
+#define CHECK(_cond) \
+    if ((_cond)) ; else { E("not enough data"); \
+        return hc->hza_error = HZAE_MOD00_TRUNC; }
+
+    D("const128 offset:         $Xd", n);
+    CHECK(lhdr.const128_count <= ((len - n) >> 4));
+    n += lhdr.const128_count << 4;
+
+    D("const64 offset:          $Xd", n);
+    CHECK(lhdr.const64_count <= ((len - n) >> 3));
+    n += lhdr.const64_count << 3;
+
+    D("const32 offset:          $Xd", n);
+    CHECK(lhdr.const32_count <= ((len - n) >> 2));
+    n += lhdr.const32_count << 2;
+
+    D("proc offset:             $Xd", n);
+    CHECK(lhdr.proc_count < ((len - n) / sizeof(hza_mod00_proc_t)));
+    n += (lhdr.proc_count + 1) * sizeof(hza_mod00_proc_t);
+
+    D("data block offset:       $Xd", n);
+    CHECK(lhdr.data_block_count < ((len - n) >> 2));
+    n += (lhdr.data_block_count + 1) << 2;
+
+    D("import module offset:    $Xd", n);
+    CHECK(lhdr.import_module_count < ((len - n) / sizeof(hza_mod00_impmod_t)));
+    n += (lhdr.import_module_count + 1) * sizeof(hza_mod00_impmod_t);
+
+    D("import proc offset:      $Xd", n);
+    CHECK(lhdr.import_count <= ((len - n) >> 2));
+    n += lhdr.import_count << 2;
+
+    D("export proc offset:      $Xd", n);
+    CHECK(lhdr.export_count <= ((len - n) >> 2));
+    n += lhdr.export_count << 2;
+
+    D("target offset:           $Xd", n);
+    CHECK(lhdr.target_count < ((len - n) >> 2));
+    n += lhdr.target_count << 2;
+
+    D("insn offset:             $Xd", n);
+    CHECK(lhdr.insn_count <= ((len - n) >> 3));
+    n += lhdr.insn_count << 3;
+
+    D("data offset:             $Xd", n);
+    if (lhdr.data_size != len - n)
+    {
+        CHECK(lhdr.data_size <= len - n);
+        n += lhdr.data_size;
+        E("module size mismatch: declared: $Xd, computed: $Xd",
+          lhdr.size, n);
+        return hc->hza_error = HZAE_MOD00_TRUNC;
+    }
+    n += lhdr.data_size;
+
+    D("module data:             $Xd / $Xz", n, len);
+#undef CHECK
+
+    /* allocate module */
+    z = n - sizeof(hza_mod00_hdr_t) + sizeof(hza_module_t)
+        + lhdr.proc_count * sizeof(hza_proc_t)
+        + lhdr.import_count * sizeof(hza_proc_t *)
+        + lhdr.import_module_count * sizeof(hza_module_t *)
+        + ((lhdr.import_count + 1) & ~1) * sizeof(uint32_t);
+    D("allocating $Xz for module", z);
+    e = arena_alloc(hc, HZA_MEM_MODULE, z);
+    if (e)
+    {
+        E("failed allocating module storage $Xz", z);
+        return e;
+    }
+    m = hc->args.realloc.ptr;
+    m->size = z;
+
+    /* set table pointers */
+    m->proc_table = (void *) (m + 1);
+    m->proc_count = lhdr.proc_count;
+
+    m->import_table = (void *) (m->proc_table + lhdr.proc_count);
+    m->import_count = lhdr.import_count;
+    m->impmod_link_table = (void *) (m->import_table + lhdr.import_count);
+    m->import_module_count = lhdr.import_module_count;
+    m->import_impmod_table =
+        (void *) (m->impmod_link_table + lhdr.import_module_count);
+
+    /* keep 64-bit alignment for constants */
+    m->const128_table = (void *) (m->import_impmod_table
+                                  + ((lhdr.import_count + 1) & ~1));
+    m->const128_count = lhdr.const128_count;
+    m->const64_table = (void *) (m->const128_table + lhdr.const128_count);
+    m->const64_count = lhdr.const64_count;
+    m->const32_table = (void *) (m->const64_table + lhdr.const64_count);
+    m->const32_count = lhdr.const32_count;
+
+    pt = (void *) (m->const32_table + lhdr.const32_count);
+
+    m->data_block_start_table = (void *) (pt + lhdr.proc_count + 1);
+    m->data_block_count = lhdr.data_block_count;
+
+    m->impmod_table = im =
+        (void *) (m->data_block_start_table + lhdr.data_block_count + 1);
+    m->import_name_table = ip = (void *) (im + lhdr.import_module_count + 1);
+
+    m->export_table = (void *) (ip + lhdr.import_count);
+    m->export_count = lhdr.export_count;
+
+    m->target_table = (void *) (m->export_table + lhdr.export_count);
+    m->target_count = lhdr.target_count;
+
+    m->insn_table = (void *) (m->target_table + m->target_count);
+    m->insn_count = lhdr.insn_count;
+
+    m->data = (void *) (m->insn_table + m->insn_count);
+    m->data_size = lhdr.data_size;
+    D("m=$p, end=$p, end-m=$z, z=$z", m, m->data + m->data_size,
+      (size_t) C41_PTR_DIFF(m->data + m->data_size, m), z);
+
+    p = C41_PTR_OFS(data, sizeof(hza_mod00_hdr_t));
+
+    /* the checksum is computed while deserialising, block by block */
+    crc_mode = (flags & HZA_LOAD_NO_CHECKSUM) ? CRC_NONE : crc32c_mode();
+    crc = 0xFFFFFFFF;
+    if (crc_mode != CRC_NONE)
+    {
+        /* the header, except the checksum field */
+        crc = crc32c_update(crc, data, HZA_MOD00_CHECKSUM_OFS, crc_mode);
+        crc = crc32c_update(crc, C41_PTR_OFS(data, HZA_MOD00_CHECKSUM_OFS + 4),
+                            sizeof(hza_mod00_hdr_t)
+                            - HZA_MOD00_CHECKSUM_OFS - 4, crc_mode);
+    }
+
+    /* deserialising 128-bit constants */
+    crc = mod00_decode(m->const128_table, p, lhdr.const128_count, 0x10,
+                       crc, crc_mode);
+    p += lhdr.const128_count << 4;
+
+    /* deserialising 64-bit constants */
+    crc = mod00_decode(m->const64_table, p, lhdr.const64_count, 8,
+                       crc, crc_mode);
+    p += lhdr.const64_count << 3;
+
+    /* compute how many 32-bit ints are to be deserialised */
+    n = lhdr.const32_count
+        + (lhdr.proc_count + 1) * (sizeof(hza_mod00_proc_t) / 4)
+        + lhdr.data_block_count + 1
+        + (lhdr.import_module_count + 1) * (sizeof(hza_mod00_impmod_t) / 4)
+        + lhdr.import_count
+        + lhdr.export_count
+        + lhdr.target_count;
+
+    /* deserialising 32-bit ints */
+    crc = mod00_decode(m->const32_table, p, n, 4, crc, crc_mode);
+    p += n * 4;
+
+    /* deserialising 16-bit ints (instructions) */
+    crc = mod00_decode(m->insn_table, p, lhdr.insn_count * 4, 2,
+                       crc, crc_mode);
+    p += lhdr.insn_count * 8;
+
+    /* copy 8-bit data */
+    crc = mod00_decode(m->data, p, lhdr.data_size, 1, crc, crc_mode);
+
+    if (crc_mode != CRC_NONE && ~crc != lhdr.checksum)
+    {
+        E("checksum mismatch: declared $Xd, computed $Xd",
+          lhdr.checksum, ~crc);
+        le = HZAE_MOD00_CHECKSUM;
+        goto l_free;
+    }
+
+#define CHECK(_cond) \
+    if ((_cond)) ; else { E("corrupt data"); goto l_corrupted; }
+
+    CHECK(pt[0].insn_start == 0);
+    CHECK(pt[0].target_start == 0);
+    CHECK(pt[0].const128_start == 0);
+    CHECK(pt[0].const64_start == 0);
+    CHECK(pt[0].const32_start == 0);
+
+    /* check proc start indexes */
+    for (i = 0; i < lhdr.proc_count; ++i)
+    {
+        CHECK(pt[i].insn_start < pt[i + 1].insn_start);
+        CHECK(pt[i].target_start <= pt[i + 1].target_start);
+        CHECK(pt[i].const128_start <= pt[i + 1].const128_start);
+        CHECK(pt[i].const64_start <= pt[i + 1].const64_start);
+        CHECK(pt[i].const32_start <= pt[i + 1].const32_start);
+        CHECK(pt[i].name < lhdr.data_block_count);
+    }
+    CHECK(pt[i].insn_start == lhdr.insn_count);
+    CHECK(pt[i].target_start == lhdr.target_count);
+    CHECK(pt[i].const128_start == lhdr.const128_count);
+    CHECK(pt[i].const64_start == lhdr.const64_count);
+    CHECK(pt[i].const32_start == lhdr.const32_count);
+    CHECK(pt[i].name == 0);
+
+    /* check data block start indexes */
+    CHECK(lhdr.data_block_count >= 1);
+    CHECK(m->data_block_start_table[0] == 0);
+    CHECK(m->data_block_start_table[1] == 0);
+    /* blocks should be increasing in size */
+    for (dblen = 1, i = 1; i < m->data_block_count; ++i)
+    {
+        CHECK(m->data_block_start_table[i] + dblen
+              <= m->data_block_start_table[i + 1]);
+        dblen = m->data_block_start_table[i + 1] - m->data_block_start_table[i];
+    }
+    CHECK(m->data_block_start_table[i] == lhdr.data_size);
+
+    /* check import modules */
+    CHECK(im[0].proc_start == 0);
+    for (i = 0; i < lhdr.import_module_count; ++i)
+    {
+        CHECK(im[i].name > 0 && im[i].name < lhdr.data_block_count);
+        CHECK(im[i].proc_start <= im[i + 1].proc_start);
+    }
+    CHECK(im[i].proc_start == lhdr.import_count);
+    CHECK(im[i].name == 0);
+
+    /* check import procs */
+    for (i = 0; i < lhdr.import_count; ++i)
+    {
+        CHECK(ip[i] > 0 && ip[i] < lhdr.data_block_count);
+    }
+
+    /* check exports */
+    if (lhdr.export_count)
+    {
+        uint32_t dbi;
+        for (dbi = i = 0; i < lhdr.export_count; ++i)
+        {
+            CHECK(m->export_table[i] < lhdr.proc_count);
+            D("exp[0]: $Xd", m->export_table[i]);
+            D("proc[$Xd].name: $Xd", m->export_table[i], 
+              pt[m->export_table[i]].name);
+            CHECK(dbi < pt[m->export_table[i]].name);
+            dbi = pt[m->export_table[i]].name;
+        }
+    }
+
+    /* check proc targets & insns */
+    for (i = 0; i < lhdr.proc_count; ++i)
+    {
+        uint32_t rlen = 0;
+        hza_proc_t * proc = m->proc_table + i;
+
+        proc->insn_table = m->insn_table + pt[i].insn_start;
+        proc->insn_count = pt[i + 1].insn_start - pt[i].insn_start;
+
+        proc->const128_table = m->const128_table + pt[i].const128_start;
+        proc->const128_count = pt[i + 1].const128_start - pt[i].const128_start;
+
+        proc->const64_table = m->const64_table + pt[i].const64_start;
+        proc->const64_count = pt[i + 1].const64_start - pt[i].const64_start;
+
+        proc->const32_table = m->const32_table + pt[i].const32_start;
+        proc->const32_count = pt[i + 1].const32_start - pt[i].const32_start;
+
+        proc->target_table = m->target_table + pt[i].target_start;
+        proc->target_count = pt[i + 1].target_start - pt[i].target_start;
+
+        proc->name = pt[i].name;
+        proc->module = m;
+
+        /* validate all targets from all target blocks that belong to
+         * current proc */
+        for (j = 0; j < proc->target_count; ++j)
+        {
+            CHECK(proc->target_table[j] < proc->insn_count);
+        }
+
+        /* validate all instructions from current proc */
+        for (j = 0; j < proc->insn_count; ++j)
+        {
+            int32_t rl;
+            rl = insn_check(hc, m, proc, proc->insn_table + j);
+            D("check P$.4Hd.I$.4Hd: $s ($XUw) $XUw $XUw $XUw => reg_size = $.1Xd",
+              i, j, hza_opcode_name(proc->insn_table[j].opcode),
+              proc->insn_table[j].opcode,
+              proc->insn_table[j].a,
+              proc->insn_table[j].b,
+              proc->insn_table[j].c,
+              rl);
+            if (rl < 0)
+            {
+                E("invalid insn $Xd: $s ($XUw) $XUw $XUw $XUw",
+                  j, hza_opcode_name(proc->insn_table[j].opcode),
+                  proc->insn_table[j].opcode,
+                  proc->insn_table[j].a,
+                  proc->insn_table[j].b,
+                  proc->insn_table[j].c);
+                goto l_corrupted;
+            }
+            if (rlen < (uint32_t) rl) rlen = rl;
+        }
+        j--;
+        if (last_insn_check(proc->insn_table + j))
+        {
+            E("invalid last insn $Xd: $s ($XUw) $XUw $XUw $XUw",
+              j, hza_opcode_name(proc->insn_table[j].opcode),
+              proc->insn_table[j].opcode,
+              proc->insn_table[j].a,
+              proc->insn_table[j].b,
+              proc->insn_table[j].c);
+            goto l_corrupted;
+        }
+
+        proc->reg_size = rlen >> 3;
+        D("proc $.3Xd reg_size:    $.5Xd bytes", i, proc->reg_size);
+    }
+
+    /* check data blocks to be sorted (we checked already that they are
+     * increasing in size, now we check that consecutive blocks of same length
+     * are lexicographically increasing) */
+    for (dblen = 0, i = 1; i < m->data_block_count; ++i)
+    {
+        uint32_t l = m->data_block_start_table[i + 1] 
+            - m->data_block_start_table[i];
+        if (dblen != l) { dblen = l; continue; }
+        CHECK(C41_MEM_COMPARE(m->data + m->data_block_start_table[i - 1],
+                              m->data + m->data_block_start_table[i], l) < 0);
+    }
+#undef CHECK
+
+    /* link imports: each imported proc is resolved here, once per world,
+     * to a direct proc pointer; all misses are reported before failing */
+    le = 0;
+    for (i = 0; i < lhdr.import_module_count; ++i)
+    {
+        c41_rbtree_path_t rbpath;
+        hza_mod_name_cell_t * mnc;
+        hza_module_t * dm;
+        char mname[0x40], pname[0x40];
+
+        n = im[i].name;
+        dm = NULL;
+        if (!find_mod_name_cell(hc, m->data + m->data_block_start_table[n],
+                                m->data_block_start_table[n + 1]
+                                - m->data_block_start_table[n], &rbpath))
+        {
+            mnc = c41_rbtree_last_payload(&rbpath);
+            dm = mnc->module;
+        }
+        if (!dm)
+        {
+            E("import module #$Ud '$s' not found",
+              i, data_block_cstr(m, n, mname, sizeof(mname)));
+            if (!le) le = HZAE_IMPORT_MODULE;
+            continue;
+        }
+        m->impmod_link_table[i] = dm;
+
+        for (j = im[i].proc_start; j < im[i + 1].proc_start; ++j)
+        {
+            int32_t pi;
+
+            n = ip[j];
+            pi = hza_export_by_name(dm, m->data + m->data_block_start_table[n],
+                                    m->data_block_start_table[n + 1]
+                                    - m->data_block_start_table[n]);
+            if (pi < 0)
+            {
+                E("import #$Ud: proc '$s' not exported by module '$s'",
+                  j, data_block_cstr(m, n, pname, sizeof(pname)),
+                  data_block_cstr(m, im[i].name, mname, sizeof(mname)));
+                if (!le) le = HZAE_IMPORT_PROC;
+                continue;
+            }
+            m->import_table[j] = dm->proc_table + pi;
+            m->import_impmod_table[j] = i;
+        }
+    }
+    if (le) goto l_free;
+
+    for (i = 0; i < lhdr.import_module_count; ++i)
+        m->impmod_link_table[i]->module_count += 1;
+
+    /* valid module. init remaining fields. */
+    C41_DLIST_APPEND(w->module_list, m, links);
+    w->stats.module_count += 1;
+    m->module_id = w->module_id_seed++;
+    m->checksum = lhdr.checksum;
+    m->task_count = 0;
+    m->ctx_count = 1;
+    m->size = z;
+
+    return 0;
+
+l_corrupted:
+    le = HZAE_MOD00_CORRUPT;
+l_free:
+    e = arena_free(hc, HZA_MEM_MODULE, m, z);
+    if (e)
+    {
+        F("failed freeing module (load failed: $s): $s = $Ui",
+          hza_error_name(le), hza_error_name(e), e);
+        return e;
+    }
+    return hc->hza_error = le;
+}
+
+/* module_load_locked *******************************************************/
+static hza_error_t C41_CALL module_load_locked
+(
+    hza_context_t * hc
+)
+{
+    return mod00_load(hc, hc->args.load.data, hc->args.load.size,
+                      hc->args.load.flags);
+}
+
+/* hza_module_load **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_module_load
+(
+    hza_context_t * hc,
+    uint8_t const * data,
+    size_t size,
+    uint_t flags,
+    hza_module_t * * mp
+)
+{
+    hza_error_t e;
+
+    hc->args.load.data = data;
+    hc->args.load.size = size;
+    hc->args.load.flags = flags;
+    e = run_locked(hc, module_load_locked, hc->world->module_mutex);
+    if (e)
+    {
+        E("failed loading module: $s = $i", hza_error_name(e), e);
+        *mp = NULL;
+        return e;
+    }
+    *mp = hc->args.realloc.ptr;
+    D("loaded module m$.4Hd ($G4Xp)", (*mp)->module_id, *mp);
+
+    return 0;
+}
+
+/* insn_check ***************************************************************/
+static int32_t insn_check
+(
+    hza_context_t * hc,
+    hza_module_t * m,
+    hza_proc_t * proc,
+    hza_insn_t * insn
+)
+{
+    uint32_t a, b, c, ps, rs;
+    uint_t oc;
+
+    oc = HZA_OPCODE_CLASS(insn->opcode);
+
+    /* check operand a */
+    switch (oc)
+    {
+    case HZAOC_NNN:
+        rs = 0;
+        break;
+
+    case HZAOC_RNN:
+    case HZAOC_RRN:
+    case HZAOC_RRR:
+    case HZAOC_VVV:
+    case HZAOC_RRC:
+    case HZAOC_RRS:
+    case HZAOC_RR4:
+    case HZAOC_RCN:
+    case HZAOC_RNP:
+    case HZAOC_RRP:
+    case HZAOC_RCP:
+    case HZAOC_RRG:
+    case HZAOC_RCG:
+    case HZAOC_RLT:
+    case HZAOC_RAN:
+    case HZAOC_RAA:
+    case HZAOC_RA4:
+    case HZAOC_RA5:
+    case HZAOC_RA6:
+    case HZAOC_R4S:
+    case HZAOC_R44:
+        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
+    l_check_a_reg:
+        a = insn->a;
+        if ((a & (ps - 1)) != 0)
+        {
+            E("I$.4Hd: unaligned reg (a = $XUw)",
+              insn - proc->insn_table, insn->a);
+            return -1; // unaligned reg
+        }
+        rs = a + ps;
+        break;
+
+    case HZAOC_QRR:
+    case HZAOC_QRC:
+    case HZAOC_QRS:
+    case HZAOC_QR4:
+        ps = 2 << HZA_OPCODE_PRI_SIZE(insn->opcode);
+        goto l_check_a_reg;
+
+    case HZAOC_SRN:
+        ps = 1 << HZA_OPCODE_SEC_SIZE(insn->opcode);
+        goto l_check_a_reg;
+
+    case HZAOC_W4N:
+        /* a only places the callee's regs; the caller needs none of its
+         * own for the call */
+        if ((insn->a & 0x7F) != 0)
+        {
+            E("I$.4Hd: unaligned callee regs (a = $XUw)",
+              insn - proc->insn_table, insn->a);
+            return -1;
+        }
+        rs = 0;
+        break;
+
+    default:
+        return -1;
+    }
+
+    /* check operand b */
+    switch (oc)
+    {
+    case HZAOC_NNN:
+    case HZAOC_RNN:
+    case HZAOC_RNP:
+    case HZAOC_RLT: // this will be checked at arg c
+        break;
+
+    case HZAOC_R4S:
+        /* b counts items of primary size starting at a */
+        ps = a + ((uint32_t) insn->b << HZA_OPCODE_PRI_SIZE(insn->opcode));
+        if (ps > 0x7FFF8)
+        {
+            E("I$.4Hd: reg range too large (a = $XUw, b = $XUw)",
+              insn - proc->insn_table, insn->a, insn->b);
+            return -1;
+        }
+        if (rs < ps) rs = ps;
+        break;
+
+    case HZAOC_W4N:
+        switch (insn->opcode)
+        {
+        case HZAO_CALL:
+        case HZAO_TAIL_CALL:
+            c = m->proc_count;
+            break;
+        case HZAO_CALL_IMPORT:
+        case HZAO_TAIL_CALL_IMPORT:
+            c = m->import_count;
+            break;
+        default:
+            return -1;
+        }
+        if (insn->b >= c)
+        {
+            E("I$.4Hd: bad callee (b = $XUw)",
+              insn - proc->insn_table, insn->b);
+            return -1;
+        }
+        break;
+
+    case HZAOC_R44:
+        /* b is the byte size of the reg window starting at a */
+        ps = a + ((uint32_t) insn->b << 3);
+        if (ps > 0x7FFF8)
+        {
+            E("I$.4Hd: reg window too large (a = $XUw, b = $XUw)",
+              insn - proc->insn_table, insn->a, insn->b);
+            return -1;
+        }
+        if (rs < ps) rs = ps;
+        break;
+
+    case HZAOC_RRN:
+    case HZAOC_RRR:
+    case HZAOC_VVV:
+    case HZAOC_RRC:
+    case HZAOC_RRS:
+    case HZAOC_RR4:
+    case HZAOC_RRP:
+    case HZAOC_RRG:
+    case HZAOC_QRR:
+    case HZAOC_QRC:
+    case HZAOC_QRS:
+    case HZAOC_QR4:
+    case HZAOC_SRN:
+        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
+    l_check_b_reg:
+        b = insn->b;
+        if ((b & (ps - 1)) != 0)
+        {
+            E("I$.4Hd: unaligned reg (b = $XUw)",
+              insn - proc->insn_table, insn->b);
+            return -1; // unaligned reg
+        }
+        ps += b;
+        if (rs < ps) rs = ps;
+        break;
+
+    case HZAOC_RCP:
+    case HZAOC_RCG:
+    case HZAOC_RCN:
+        ps = HZA_OPCODE_PRI_SIZE(insn->opcode);
+        switch (ps)
+        {
+        case 0: case 1: case 2: case 3: case 4:
+            break;
+        case 5:
+            if (insn->b >= proc->const32_count)
+            {
+                E("I$.4Hd: bad 32-bit const index (b = $XUw)",
+                  insn - proc->insn_table, insn->b);
+                return -1;
+            }
+            break;
+        case 6:
+            if (insn->b >= proc->const64_count)
+            {
+                E("I$.4Hd: bad 64-bit const index (b = $XUw)",
+                  insn - proc->insn_table, insn->b);
+                return -1;
+            }
+            break;
+        case 7:
+            if (insn->b >= proc->const128_count)
+            {
+                E("I$.4Hd: bad 128-bit const index (b = $XUw)",
+                  insn - proc->insn_table, insn->b);
+                return -1;
+            }
+            break;
+        }
+        break;
+
+    case HZAOC_RAN:
+    case HZAOC_RAA:
+    case HZAOC_RA4:
+    case HZAOC_RA5:
+    case HZAOC_RA6:
+        ps = 6; // addresses are 2^6 bits
+        goto l_check_b_reg;
+
+    default:
+        return -1;
+    }
+
+    /* check operand c */
+    switch (oc)
+    {
+    case HZAOC_NNN:
+    case HZAOC_RNN:
+    case HZAOC_RRN:
+    case HZAOC_RAN:
+    case HZAOC_SRN:
+    case HZAOC_RCN:
+    case HZAOC_RR4:
+    case HZAOC_QR4:
+    case HZAOC_RA4:
+    case HZAOC_R44: // host functions are registered at run time
+    case HZAOC_W4N:
+        break;
+
+    case HZAOC_RRR:
+    case HZAOC_VVV:
+    case HZAOC_QRR:
+        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
+    l_check_c_reg:
+        c = insn->c;
+        if ((c & (ps - 1)) != 0)
+        {
+            E("I$.4Hd: unaligned reg (c = $XUw)",
+              insn - proc->insn_table, insn->c);
+            return -1; // unaligned reg
+        }
+        ps += c;
+        if (rs < ps) rs = ps;
+        break;
+        break;
+
+    case HZAOC_RRC:
+    case HZAOC_QRC:
+        ps = HZA_OPCODE_PRI_SIZE(insn->opcode);
+        switch (ps)
+        {
+        case 0: case 1: case 2: case 3: case 4:
+            break;
+        case 5:
+        l_check_c5:
+            if (insn->c >= proc->const32_count)
+            {
+                E("I$.4Hd: bad 32-bit const index (c = $XUw)",
+                  insn - proc->insn_table, insn->c);
+                return -1;
+            }
+            break;
+        case 6:
+        l_check_c6:
+            if (insn->c >= proc->const64_count)
+            {
+                E("I$.4Hd: bad 64-bit const index (c = $XUw)",
+                  insn - proc->insn_table, insn->c);
+                return -1;
+            }
+            break;
+        case 7:
+            if (insn->c >= proc->const128_count)
+            {
+                E("I$.4Hd: bad 128-bit const index (c = $XUw)",
+                  insn - proc->insn_table, insn->c);
+                return -1;
+            }
+            break;
+        }
+        break;
+
+    case HZAOC_RRS:
+    case HZAOC_QRS:
+    case HZAOC_R4S:
+        ps = 1 << HZA_OPCODE_SEC_SIZE(insn->opcode);
+        goto l_check_c_reg;
 
-    /* 0x013C: data area */
-    /* data ofs 0x00: */ 'c', 'o', 'r', 'e',
-    /* data ofs 0x04: */ '_', 't', 'e', 's', 't', '0',
-    /* data size: 0x0A */
+    case HZAOC_RNP:
+    case HZAOC_RRP:
+    case HZAOC_RCP:
+        c = insn->c;
+        b = 2;
+        goto l_check_tgt;
+        // if (c + 1 >= proc->target_count) return -1;
+        // break;
 
-    /* 0x0146: end */
-};
-#undef C16
-#undef C32
+    case HZAOC_RRG:
+    case HZAOC_RCG:
+        c = insn->c;
+        b = 3;
+        goto l_check_tgt;
+        // if (c + 2 >= proc->target_count) return -1;
+        // break;
 
-/****************************************************************************/
-/*                                                                          */
-/* Function bodies                                                          */
-/*                                                                          */
-/****************************************************************************/
+    case HZAOC_RLT:
+        b = insn->b;
+        c = insn->c;
+    l_check_tgt:
+        if (b + c > proc->target_count)
+        {
+            E("I$.4d: bad target table ref (b = $XUw, c = $XUw)",
+              insn - proc->insn_table, b, c);
+            return -1;
+        }
+        break;
 
-/* hza_lib_name *************************************************************/
-HAZNA_API char const * C41_CALL hza_lib_name ()
-{
-    return "hazna-engine-v00"
-#if _DEBUG
-        "-debug"
-#else
-        "-release"
-#endif
-        ;
-}
+    case HZAOC_RAA:
+        ps = 6;
+        goto l_check_c_reg;
 
-/* hza_error_name ***********************************************************/
-HAZNA_API char const * C41_CALL hza_error_name (hza_error_t e)
-{
-#define X(_x) case _x: return #_x
-    switch (e)
-    {
-        X(HZAE_WORLD_ALLOC);
-        X(HZAE_WORLD_FINISH);
-        X(HZAE_LOG_MUTEX_INIT);
-        X(HZAE_ALLOC);
-        X(HZAE_STATE);
-        X(HZAE_STACK_LIMIT);
-        X(HZAE_REG_LIMIT);
-        X(HZAE_PROC_INDEX);
-        X(HZAE_MOD00_TRUNC);
-        X(HZAE_MOD00_MAGIC);
-        X(HZAE_MOD00_CORRUPT);
+    case HZAOC_RA5:
+        goto l_check_c5;
 
-        X(HZAF_BUG);
-        X(HZAF_NO_CODE);
-        X(HZAF_MUTEX_LOCK);
-        X(HZAF_MUTEX_UNLOCK);
-        X(HZAF_WORLD_FREE);
+    case HZAOC_RA6:
+        goto l_check_c6;
+
+    default:
+        return -1;
     }
 
-    return e < HZA_FATAL ? "HZAE_UNKNOWN" : "HZAF_UNKNOWN";
-#undef X
+    return rs;
 }
 
-/* hza_opcode_name **********************************************************/
-HAZNA_API char const * C41_CALL hza_opcode_name (uint16_t o)
+/* last_insn_check **********************************************************/
+static int last_insn_check
+(
+    hza_insn_t * insn
+)
 {
-#define X(_x) case _x: return #_x
-    switch (o)
+    switch (HZA_OPCODE_CLASS(insn->opcode))
     {
-        X(HZAO_NOP);
-        X(HZAO_HALT);
-        X(HZAO_RET);
-        X(HZAO_DEBUG_OUT_16);
-        X(HZAO_DEBUG_OUT_32);
-        X(HZAO_INIT_8);
-        X(HZAO_INIT_16);
-        X(HZAO_WRAP_ADD_CONST_8);
-        X(HZAO_BRANCH_ZERO_1);
-        X(HZAO_BRANCH_ZERO_2);
-        X(HZAO_BRANCH_ZERO_4);
-        X(HZAO_BRANCH_ZERO_8);
-        X(HZAO_BRANCH_ZERO_16);
-        X(HZAO_BRANCH_ZERO_32);
-        X(HZAO_BRANCH_ZERO_64);
-        X(HZAO_BRANCH_ZERO_128);
+    case HZAOC_NNN:
+        switch (HZA_OPCODE_FNSZ(insn->opcode))
+        {
+        case HZA_OPCODE_FNSZ(HZAO_RET):
+        case HZA_OPCODE_FNSZ(HZAO_HALT):
+            return 0;
+        }
+        return 1;
+    case HZAOC_W4N:
+        switch (HZA_OPCODE_FNSZ(insn->opcode))
+        {
+        case HZA_OPCODE_FNSZ(HZAO_TAIL_CALL):
+        case HZA_OPCODE_FNSZ(HZAO_TAIL_CALL_IMPORT):
+            return 0;
+        }
+        return 1;
+    case HZAOC_RNP:
+    case HZAOC_RRP:
+    case HZAOC_RCP:
+    case HZAOC_RRG:
+    case HZAOC_RCG:
+    case HZAOC_RLT:
+        return 0;
     }
-    return "HZAO_UNKNOWN";
-#undef X
+    return 1;
 }
 
-/* log_msg *******************************************************************/
-#define LME(...) do { \
-    do { \
-        if (c41_io_fmt(w->log_io, "W[$s:$s:$Ui] logging error: ", \
-                       __FUNCTION__, __FILE__, __LINE__) < 0) break; \
-        if (c41_io_fmt(w->log_io, __VA_ARGS__) < 0) break; \
-        c41_io_fmt(w->log_io, "\n"); \
-    } while (0); \
-    w->log_level = HZA_LL_NONE; \
-    return; } while (0)
-
-static void log_msg
+/* data_block_cstr **********************************************************/
+static char const * data_block_cstr
 (
-    hza_context_t * hc,
-    char const * func,
-    char const * src,
-    int line,
-    int level,
-    char const * fmt,
-    ...
+    hza_module_t * m,
+    uint32_t dbi,
+    char * buf,
+    size_t size
 )
 {
-    va_list va;
-    hza_world_t * w = hc->world;
-    int smte;
-
-    if (w->log_level == HZA_LL_NONE) return;
-    smte = c41_smt_mutex_lock(w->smt, w->log_mutex);
-    if (smte) LME("failed locking log mutex ($i)", smte);
-
-    va_start(va, fmt);
-    if (c41_io_fmt(w->log_io, "$c: ", "NFEWID"[level]) < 0
-        || c41_io_vfmt(w->log_io, fmt, va) < 0
-        || c41_io_fmt(w->log_io, "    [$s:$s:$Ui]\n", func, src, line) < 0)
-    {
-        va_end(va);
-        LME("failed writing log message");
-    }
-    va_end(va);
+    size_t len;
 
-    smte = c41_smt_mutex_unlock(w->smt, w->log_mutex);
-    if (smte) LME("failed unlocking log mutex ($i)", smte);
+    len = m->data_block_start_table[dbi + 1] - m->data_block_start_table[dbi];
+    if (len >= size) len = size - 1;
+    C41_MEM_COPY(buf, m->data + m->data_block_start_table[dbi], len);
+    buf[len] = 0;
+    return buf;
 }
-#undef LME
 
-/* init_logging *************************************************************/
-static hza_error_t init_logging
+/* module_by_name_locked ****************************************************/
+static hza_error_t C41_CALL module_by_name_locked
 (
-    hza_context_t * hc,
-    c41_io_t * log_io,
-    uint8_t log_level
+    hza_context_t * hc
 )
 {
-    hza_world_t * w = hc->world;
-    uint_t smte;
-
-#if NDEBUG
-    if (log_level == HZA_LL_DEBUG) log_level = HZA_LL_INFO;
-#endif
-    w->log_level = log_level;
-    w->log_io = log_io;
-    smte = c41_smt_mutex_init(w->smt, w->log_mutex);
-    if (smte)
-    {
-        hc->smt_error = smte;
-        return (hc->hza_error = HZAE_LOG_MUTEX_INIT);
-    }
-    w->init_state |= HZA_INIT_LOG_MUTEX;
+    c41_rbtree_path_t rbpath;
+    hza_mod_name_cell_t * mnc;
 
+    if (find_mod_name_cell(hc, hc->args.name.a, hc->args.name.n, &rbpath))
+        return hc->hza_error = HZAE_NOT_FOUND;
+    mnc = c41_rbtree_last_payload(&rbpath);
+    if (!mnc->module) return hc->hza_error = HZAE_NOT_FOUND;
+    hc->args.name.module = mnc->module;
     return 0;
 }
 
-/* run_locked ***************************************************************/
-static hza_error_t run_locked
+/* module_map_name_locked ***************************************************/
+static hza_error_t C41_CALL module_map_name_locked
 (
-    hza_context_t * hc,
-    hza_error_t (C41_CALL * func) (hza_context_t * hc),
-    c41_smt_mutex_t * mutex
+    hza_context_t * hc
 )
 {
-    hza_world_t * w = hc->world;
-    int smte;
+    hza_module_t * m = hc->args.name.module;
+    hza_mod_name_cell_t * mnc;
     hza_error_t e;
 
-    smte = c41_smt_mutex_lock(w->smt, mutex);
-    if (smte)
+    e = get_mod_name_cell(hc, (void *) hc->args.name.a, (int) hc->args.name.n,
+                          &mnc);
+    if (e) return e;
+    if (mnc->module && mnc->module != m)
     {
-        F("failed locking mutex $#G4p (smt error: $i)", mutex, smte);
-        hc->smt_error = smte;
-        return (hc->hza_error = HZAF_MUTEX_LOCK);
+        E("module name '$s' is already mapped to m$.4Hd",
+          mnc->name, mnc->module->module_id);
+        return hc->hza_error = HZAE_NAME_TAKEN;
     }
+    mnc->module = m;
+    return 0;
+}
 
-    e = func(hc);
-
-    smte = c41_smt_mutex_unlock(w->smt, mutex);
-    if (smte)
-    {
-        F("failed unlocking mutex $#G4p (smt error: $i)", mutex, smte);
-        hc->smt_error = smte;
-        return (hc->hza_error = HZAF_MUTEX_UNLOCK);
-    }
+/* hza_module_by_name *******************************************************/
+HAZNA_API hza_error_t C41_CALL hza_module_by_name
+(
+    hza_context_t * hc,
+    uint8_t const * name,
+    size_t name_len,
+    hza_module_t * * mp
+)
+{
+    hza_error_t e;
 
+    hc->args.name.a = name;
+    hc->args.name.n = name_len;
+    e = run_locked(hc, module_by_name_locked, hc->world->module_mutex);
+    *mp = e ? NULL : hc->args.name.module;
     return e;
 }
 
-/* mod_name_cmp *************************************************************/
-static uint_t C41_CALL mod_name_cmp
+/* hza_module_map_name ******************************************************/
+HAZNA_API hza_error_t C41_CALL hza_module_map_name
 (
-    void * key,
-    void * node_payload,
-    void * context
+    hza_context_t * hc,
+    hza_module_t * m,
+    uint8_t const * name,
+    size_t name_len
 )
 {
-    c41_u8an_t * k = key;
-    hza_mod_name_cell_t * mnc = node_payload;
-    int c;
-
-    (void) context;
-
-    if (k->n != mnc->len)
-        return k->n < mnc->len ? C41_RBTREE_SMALLER : C41_RBTREE_GREATER;
-    c = C41_MEM_COMPARE(k->a, mnc->name, k->n);
-    if (c) return c < 0 ? C41_RBTREE_SMALLER : C41_RBTREE_GREATER;
-    return C41_RBTREE_EQUAL;
+    hc->args.name.a = name;
+    hc->args.name.n = name_len;
+    hc->args.name.module = m;
+    return run_locked(hc, module_map_name_locked, hc->world->module_mutex);
 }
 
-/* hza_init *****************************************************************/
-HAZNA_API hza_error_t C41_CALL hza_init
+/* hza_export_by_name *******************************************************/
+HAZNA_API int32_t C41_CALL hza_export_by_name
 (
-    hza_context_t * hc,
-    c41_ma_t * ma,
-    c41_smt_t * smt,
-    c41_io_t * log_io,
-    uint8_t log_level
+    hza_module_t * m,
+    uint8_t const * name,
+    size_t name_len
 )
 {
-    hza_error_t e;
-    hza_world_t * w;
-    int mae, smte, qi;
-    hza_mod_name_cell_t * mnc;
+    int32_t a, b, c;
+    uint32_t clen;
+    uint32_t n, pi;
+    int cmp;
+    for (a = 0, b = m->export_count - 1; a <= b; )
+    {
+        c = (a + b) >> 1;
+        n = m->proc_table[pi = m->export_table[c]].name;
+        clen = m->data_block_start_table[n + 1] 
+            - m->data_block_start_table[n];
+        if (name_len == clen)
+        {
+            cmp = c41_u8a_compare(name, 
+                                  m->data + m->data_block_start_table[n],
+                                  name_len);
+            if (!cmp) return pi;
+        }
+        else cmp = name_len < clen ? -1 : +1;
+        if (cmp < 0) b = c - 1;
+        else a = c + 1;
+    }
+    return -1;
+}
 
-    /* clear the context struct */
-    C41_VAR_ZERO(*hc);
+/* task_alloc ***************************************************************/
+static hza_error_t C41_CALL task_alloc
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * src = hc->args.task;
+    hza_task_t * t;
+    hza_modmap_t * mm;
+    void * a;
+    int mae, e;
+    uint_t mi, n;
 
-    /* allocate space for the world and all needed mutexes */
-    mae = c41_ma_alloc_zero_fill(ma, (void * *) &w, WORLD_SIZE);
+    mae = c41_ma_alloc_zero_fill(&w->mac.ma, &a, HZA_TASK_ALLOC_SIZE);
     if (mae)
     {
+        E("failed allocating memory for new task (ma error $i)", mae);
         hc->ma_error = mae;
-        return (hc->hza_error = HZAE_WORLD_ALLOC);
+        return hc->hza_error = HZAE_ALLOC;
+    }
+    t = (hza_task_t *) (((uintptr_t) a + HZA_CACHE_LINE - 1)
+                        & ~(uintptr_t) (HZA_CACHE_LINE - 1));
+    t->alloc = a;
+    t->node = hc->node;
+    hc->args.task = t;
+    mem_account(w, HZA_MEM_TASK, HZA_TASK_ALLOC_SIZE, 0);
+
+    t->reg_limit = src ? src->reg_limit : INIT_REG_SIZE;
+    mae = task_mem_realloc(w, t->node, HZA_MEM_REG, &t->reg_space,
+                           1, t->reg_limit, 0);
+    if (mae)
+    {
+        E("failed allocating register space for new task (ma error $i)", mae);
+        hc->ma_error = mae;
+        goto l_free;
     }
-    /* link the world in the context */
-    hc->world = w;
-
-    /* init few basic fields in the world */
-    w->world_ma = ma;
-    w->smt = smt;
-    w->world_mutex = (c41_smt_mutex_t *) (w + 1);
-    w->log_mutex = C41_PTR_OFS(w->world_mutex, smt->mutex_size);
-    w->module_mutex = C41_PTR_OFS(w->log_mutex, smt->mutex_size);
-    w->task_mutex = C41_PTR_OFS(w->module_mutex, smt->mutex_size);
-    w->context_count = 1;
-    c41_dlist_init(&w->module_list);
 
-    for (qi = 0; qi < HZA_TASK_STATES; qi++)
+    t->frame_limit = src ? src->frame_limit : INIT_FRAME_LIMIT;
+    mae = task_mem_realloc(w, t->node, HZA_MEM_FRAME, &t->frame_table,
+                           sizeof(hza_frame_t), t->frame_limit, 0);
+    if (mae)
     {
-        c41_dlist_init(&w->task_list[qi]);
+        E("failed allocating frame table for new task (ma error $i)", mae);
+        hc->ma_error = mae;
+        goto l_free;
     }
 
-    c41_rbtree_init(&w->module_name_tree, mod_name_cmp, NULL);
+    t->module_limit = src ? src->module_limit : INIT_MODMAP_LIMIT;
+    mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->module_table,
+                               sizeof(hza_modmap_t), t->module_limit, 0);
+    if (mae)
+    {
+        E("failed allocating module map table for new task (ma error $i)", mae);
+        hc->ma_error = mae;
+        goto l_free;
+    }
+    mem_account(w, HZA_MEM_OTHER, t->module_limit * sizeof(hza_modmap_t), 0);
 
-    /* init allocator; count allocs to detect leaks */
-    c41_ma_counter_init(&w->mac, ma,
-                        C41_SSIZE_MAX, C41_SSIZE_MAX, C41_SSIZE_MAX);
-    do
+    /* module_count grows with the copied entries so that task_free() sees
+     * the import index tables allocated so far */
+    for (mi = 0; src && mi < src->module_count; ++mi)
     {
-        /* init logging as early as possible */
-        if (log_level)
+        mm = t->module_table + mi;
+        *mm = src->module_table[mi];
+        mm->task = t;
+        mm->impmod_index = NULL;
+        t->module_count = mi + 1;
+        if (!src->module_table[mi].impmod_index) continue;
+        n = mm->module->import_module_count;
+        mae = c41_ma_alloc(&w->mac.ma, (void * *) &mm->impmod_index,
+                           n * sizeof(uint32_t));
+        if (mae)
         {
-            e = init_logging(hc, log_io, log_level);
-            if (e) break;
+            E("failed allocating import index table for forked task "
+              "(ma error $i)", mae);
+            hc->ma_error = mae;
+            goto l_free;
         }
-        D("initing world $#G4p (log level $i)", w, w->log_level);
+        mem_account(w, HZA_MEM_OTHER, n * sizeof(uint32_t), 0);
+        C41_MEM_COPY(mm->impmod_index, src->module_table[mi].impmod_index,
+                     n * sizeof(uint32_t));
+    }
 
-        smte = c41_smt_mutex_init(smt, w->world_mutex);
-        if (smte)
-        {
-            E("failed initing world mutex ($i)", smte);
-            break;
-        }
-        w->init_state |= HZA_INIT_WORLD_MUTEX;
+    return 0;
+l_free:
+    e = task_free(hc);
+    if (e) return e;
+    return hc->hza_error = HZAE_ALLOC;
+}
 
-        smte = c41_smt_mutex_init(smt, w->module_mutex);
-        if (smte)
-        {
-            E("failed initing module mutex ($i)", smte);
-            break;
-        }
-        w->init_state |= HZA_INIT_MODULE_MUTEX;
+/* task_free ****************************************************************/
+static hza_error_t C41_CALL task_free
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t = hc->args.task;
+    int mae;
+    uint_t mi;
 
-        smte = c41_smt_mutex_init(smt, w->task_mutex);
-        if (smte)
+    if (t->io_buf)
+    {
+        mae = c41_ma_free(&w->mac.ma, t->io_buf,
+                          t->io_in_size + t->io_out_size);
+        if (mae)
         {
-            E("failed initing task mutex ($i)", smte);
-            break;
+            F("error freeing channel buffers (ma error $i)", mae);
+            hc->ma_free_error = mae;
+            return hc->hza_error = HZAF_FREE;
         }
-        w->init_state |= HZA_INIT_TASK_MUTEX;
-
+        mem_account(w, HZA_MEM_OTHER, 0, t->io_in_size + t->io_out_size);
+    }
 
-        e = get_mod_name_cell(hc, "core", -1, &mnc);
-        if (e)
+    for (mi = 0; mi < t->module_count; ++mi)
+    {
+        hza_modmap_t * mm = t->module_table + mi;
+        if (!mm->impmod_index) continue;
+        mae = c41_ma_free(&w->mac.ma, mm->impmod_index,
+                          mm->module->import_module_count * sizeof(uint32_t));
+        if (mae)
         {
-            E("failed creating module name cell for 'core': $s = $i",
-              hza_error_name(e), e);
-            break;
+            F("error freeing import index table (ma error $i)", mae);
+            hc->ma_free_error = mae;
+            return hc->hza_error = HZAF_FREE;
         }
+        mem_account(w, HZA_MEM_OTHER, 0,
+                    mm->module->import_module_count * sizeof(uint32_t));
+    }
 
-        e = mod00_load(hc, mod00_core, sizeof(mod00_core));
-        if (e)
+    if (t->module_table)
+    {
+        mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->module_table,
+                                   sizeof(hza_modmap_t), 0, t->module_limit);
+        if (mae)
         {
-            E("failed loading 'core' module: $s = $i", hza_error_name(e), e);
-            break;
+            F("error freeing module map table for failed new task "
+              "(ma error $i)", mae);
+            hc->ma_free_error = mae;
+            return hc->hza_error = HZAF_FREE;
         }
+        mem_account(w, HZA_MEM_OTHER, 0,
+                    t->module_limit * sizeof(hza_modmap_t));
+    }
 
-        w->core_module = hc->args.realloc.ptr;
-        mnc->module = hc->args.realloc.ptr;
-
-#if 0
-        if (hza_export_by_name(w->core_module, (uint8_t *) "_test0", 6) != 1)
+    if (t->frame_table)
+    {
+        mae = task_mem_realloc(w, t->node, HZA_MEM_FRAME, &t->frame_table,
+                               sizeof(hza_frame_t), 0, t->frame_limit);
+        if (mae)
         {
-            E("export lookup failed!");
-            break;
+            F("error freeing frame table for failed new task (ma error $i)",
+              mae);
+            hc->ma_free_error = mae;
+            return hc->hza_error = HZAF_FREE;
         }
-#endif
+    }
 
-        smte = c41_smt_cond_create(&hc->cond, smt, &w->mac.ma);
-        if (smte)
+    if (t->reg_space)
+    {
+        mae = task_mem_realloc(w, t->node, HZA_MEM_REG, &t->reg_space,
+                               1, 0, t->reg_limit);
+        if (mae)
         {
-            e = HZAE_COND_CREATE;
-            E("failed initing context condition variable ($i)", smte);
-            break;
+            F("error freeing register space for failed new task (ma error $i)",
+              mae);
+            hc->ma_free_error = mae;
+            return hc->hza_error = HZAF_FREE;
         }
+    }
 
-#if 0
-        {
-            uint32_t tmp;
-            e = get_mod_name_cell(hc, "core", -1, &mnc);
-            for (tmp = 0; tmp < 10000000; ++tmp)
-            {
-                e = get_mod_name_cell(hc, &tmp, 4, &mnc);
-                if (e)
-                {
-                    E("failed initing tmp cell $i", tmp);
-                    break;
-                }
-                mnc->module = (void *) ((intptr_t) tmp + 5);
-            }
+    mae = c41_ma_free(&w->mac.ma, t->alloc, HZA_TASK_ALLOC_SIZE);
+    if (mae)
+    {
+        F("error freeing failed new task (ma error $i)", mae);
+        hc->ma_free_error = mae;
+        return hc->hza_error = HZAF_FREE;
+    }
+    mem_account(w, HZA_MEM_TASK, 0, HZA_TASK_ALLOC_SIZE);
+    return 0;
+}
+
+/* task_init ****************************************************************/
+static hza_error_t C41_CALL task_init
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t = hc->args.task;
+
+    t->task_id = w->task_id_seed++;
+    t->owner = hc;
+    t->context_count = 1;
+    t->state = HZA_TASK_SUSPENDED;
+    C41_DLIST_APPEND(w->task_list[t->state], t, links);
+    w->stats.task_count[t->state] += 1;
+    c41_dlist_init(&t->context_wait_queue);
+    hc->active_task = t;
 
-            for (tmp = 0; tmp < 10000000; ++tmp)
-            {
-                e = get_mod_name_cell(hc, &tmp, 4, &mnc);
-                if (e)
-                {
-                    E("failed retrieving tmp cell $i", tmp);
-                    break;
-                }
-                if ((intptr_t) mnc->module != ((intptr_t) tmp + 5))
-                {
-                    e = HZAF_BUG;
-                    E("meh tmp=$i, m=$p", tmp, mnc->module);
-                }
+    /* a fork arrives with the module map and frames of its source */
+    if (t->module_count) return 0;
 
-            }
-        }
-#endif
-    }
-    while (0);
+    t->module_table[0].anchor = 0;
+    t->module_table[0].module = w->core_module;
+    t->module_table[0].task = t;
+    t->module_table[0].impmod_index = NULL;
+    t->module_count = 1;
+
+    t->frame_table[0].proc = w->core_module->proc_table + 0;
+    t->frame_table[0].insn_index = 0;
+    t->frame_table[0].reg_base = 0;
+
+    return 0;
+}
+
+/* hza_task_create **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_create
+(
+    hza_context_t * hc,
+    hza_task_t * * tp
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t;
+    hza_error_t e;
 
+    hc->args.task = NULL;
+    e = run_locked(hc, task_alloc, w->world_mutex);
     if (e)
     {
-        /* failed initing the world */
-        hc->hza_error = e;
-        /* call finish unless something fatal happened */
-        if (e < HZA_FATAL) hza_finish(hc);
+        E("failed allocating memory for a new task ($s = $i)",
+          hza_error_name(e), e);
+        return e;
+    }
+    e = run_locked(hc, task_init, w->task_mutex);
+    if (e)
+    {
+        E("failed initing new task ($s = $i)", hza_error_name(e), e);
+        if (e >= HZA_FATAL) return e;
         return e;
     }
-    D("inited context $#G4p and world $#G4p", hc, w);
-    D("mutex size: $z", smt->mutex_size);
+
+    *tp = t = hc->args.task;
+    D("task t$.4Hd created ($G4Xp)", t->task_id, t);
 
     return 0;
 }
 
-/* detach_context ***********************************************************/
-static hza_error_t C41_CALL detach_context
+/* hza_task_fork ************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_fork
 (
-    hza_context_t * hc
+    hza_context_t * hc,
+    hza_task_t * src,
+    hza_task_t * * tp
 )
 {
     hza_world_t * w = hc->world;
-    int smte;
+    hza_task_t * t;
+    hza_error_t e;
 
-    hc->args.context_count = (w->context_count -= 1);
-    if (hc->cond)
+    hc->args.task = src;
+    e = run_locked(hc, task_alloc, w->world_mutex);
+    if (e)
     {
-        smte = c41_smt_cond_destroy(hc->cond, w->smt, &w->mac.ma);
-        if (smte)
-        {
-            F("failed destroying context condition variable ($i)", smte);
-            hc->smt_error = smte;
-            return hc->hza_error = HZAF_COND_DESTROY;
-        }
+        E("failed allocating memory for a fork of t$.4Hd ($s = $i)",
+          src->task_id, hza_error_name(e), e);
+        return e;
+    }
+
+    /* nobody else sees the fork yet and the source is not running so the
+     * copy needs no lock */
+    t = hc->args.task;
+    C41_MEM_COPY(t->reg_space, src->reg_space, src->reg_limit);
+    C41_MEM_COPY(t->frame_table, src->frame_table,
+                 (src->frame_index + 1) * sizeof(hza_frame_t));
+    t->frame_index = src->frame_index;
+
+    e = run_locked(hc, task_init, w->task_mutex);
+    if (e)
+    {
+        E("failed initing fork of t$.4Hd ($s = $i)", src->task_id,
+          hza_error_name(e), e);
+        return e;
     }
 
+    *tp = t;
+    D("task t$.4Hd forked from t$.4Hd ($G4Xp)", t->task_id, src->task_id, t);
     return 0;
 }
 
-/* destroy_mod_name_cells ***************************************************/
-static hza_error_t destroy_mod_name_cells
+/* hza_task_save ************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_save
 (
     hza_context_t * hc,
-    c41_rbtree_node_t * n
+    hza_image_io_f io,
+    void * io_ctx
 )
 {
-    hza_mod_name_cell_t * mnc;
+    hza_task_t * t = hc->active_task;
+    hza_module_t * m;
+    hza_frame_t * f;
+    uint64_t const * q;
+    uint8_t buf[0x18];
     hza_error_t e;
-    uint_t mae;
+    uint32_t mx, ofs, n;
+    uint_t i;
 
-    mnc = (void *) (n + 1);
-    if (n->left)
+    DEBUG_CHECK(t);
+    c41_write_u32be(buf, HZA_IMAGE_MAGIC);
+    c41_write_u32be(buf + 4, t->module_count);
+    c41_write_u32be(buf + 8, t->frame_index + 1);
+    c41_write_u32be(buf + 12, t->reg_limit);
+    e = image_io(hc, io, io_ctx, buf, 0x10);
+    if (e) return e;
+
+    for (i = 1; i < t->module_count; ++i)
     {
-        e = destroy_mod_name_cells(hc, n->left);
+        m = t->module_table[i].module;
+        c41_write_u32be(buf, m->checksum);
+        c41_write_u32be(buf + 4, m->proc_count);
+        c41_write_u32be(buf + 8, m->insn_count);
+        c41_write_u32be(buf + 12, m->data_size);
+        c41_write_u64be(buf + 16, t->module_table[i].anchor);
+        e = image_io(hc, io, io_ctx, buf, 0x18);
         if (e) return e;
     }
 
-    if (n->right)
+    for (i = 0; i <= t->frame_index; ++i)
     {
-        e = destroy_mod_name_cells(hc, n->right);
+        f = t->frame_table + i;
+        e = frame_module_index(hc, t, f, &mx);
+        if (e) return e;
+        m = t->module_table[mx].module;
+        c41_write_u32be(buf, mx);
+        c41_write_u32be(buf + 4, (uint32_t) (f->proc - m->proc_table));
+        c41_write_u32be(buf + 8, f->insn_index);
+        c41_write_u32be(buf + 12, f->reg_base);
+        e = image_io(hc, io, io_ctx, buf, 0x10);
         if (e) return e;
     }
 
-    mae = c41_ma_free(&hc->world->mac.ma, n,
-                      sizeof(c41_rbtree_node_t) + sizeof(hza_mod_name_cell_t)
-                      + mnc->len);
-    if (mae)
+    /* reg_limit is a power of 2 >= INIT_REG_SIZE so pages hold whole
+     * uint64_t items */
+    for (ofs = 0; ofs < t->reg_limit; ofs += HZA_IMAGE_PAGE)
     {
-        F("failed freeing mod name cell: $i", mae);
-        return hc->hza_error = HZAF_FREE;
+        n = t->reg_limit - ofs;
+        if (n > HZA_IMAGE_PAGE) n = HZA_IMAGE_PAGE;
+        q = (uint64_t const *) (t->reg_space + ofs);
+        for (i = 0; i < n / 8 && !q[i]; ++i);
+        if (i == n / 8) continue;
+        c41_write_u32be(buf, ofs / HZA_IMAGE_PAGE);
+        e = image_io(hc, io, io_ctx, buf, 4);
+        if (!e) e = image_io(hc, io, io_ctx, t->reg_space + ofs, n);
+        if (e) return e;
     }
+    c41_write_u32be(buf, HZA_IMAGE_END);
+    e = image_io(hc, io, io_ctx, buf, 4);
+    if (e) return e;
+
+    D("saved t$.4Hd: $Ui modules, $Ui frames, $Ui reg bytes", t->task_id,
+      t->module_count, t->frame_index + 1, t->reg_limit);
     return 0;
 }
 
-/* hza_finish ***************************************************************/
-HAZNA_API hza_error_t C41_CALL hza_finish
+/* hza_task_restore *********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_restore
 (
-    hza_context_t * hc
+    hza_context_t * hc,
+    hza_image_io_f io,
+    void * io_ctx,
+    hza_task_t * * tp
 )
 {
-    hza_world_t * w = hc->world;
-    c41_smt_t * smt = w->smt;
+    hza_task_t * t;
     hza_module_t * m;
-    c41_np_t * np;
-    int mae, smte, dirty, ts;
-    hza_error_t e;
+    hza_proc_t * p;
+    hza_frame_t * f;
+    uint8_t buf[0x18];
+    hza_error_t e, de;
+    uint32_t module_count, frame_count, reg_limit, frame_limit;
+    uint32_t ofs, n, page, next_page;
+    uint_t i;
 
-    if ((w->init_state & HZA_INIT_WORLD_MUTEX))
+    e = image_io(hc, io, io_ctx, buf, 0x10);
+    if (e) return e;
+    module_count = c41_read_u32be(buf + 4);
+    frame_count = c41_read_u32be(buf + 8);
+    reg_limit = c41_read_u32be(buf + 12);
+    if (c41_read_u32be(buf) != HZA_IMAGE_MAGIC || !module_count
+        || !frame_count || frame_count > MAX_FRAME_LIMIT
+        || reg_limit < INIT_REG_SIZE || reg_limit > MAX_REG_LIMIT
+        || (reg_limit & (reg_limit - 1)))
     {
-        e = run_locked(hc, detach_context, w->world_mutex);
-        if (e)
-        {
-            F("failed detaching context: $s = $i", hza_error_name(e), e);
-            return e;
-        }
-        /* if there are other contexts working with the world then exit */
-        D("finished context $#G4p, world context count: $Ui", hc,
-          hc->args.context_count);
-        if (hc->args.context_count > 0)
-            return (hc->hza_finish_error = 0);
+        E("bad task image header");
+        return hc->hza_error = HZAE_IMAGE_CORRUPT;
     }
 
-    /* destroy the world */
-    D("ending world $#G4p...", w);
+    e = hza_task_create(hc, &t);
+    if (e) return e;
 
-    /* destroy tasks */
-    for (ts = 0; ts < HZA_TASK_STATES; ++ts)
+    /* importing in saved order gives the saved indexes back since each
+     * module comes after the modules it imports */
+    for (i = 1; i < module_count; ++i)
     {
-        for (np = w->task_list[ts].next; np != &w->task_list[ts];)
+        e = image_io(hc, io, io_ctx, buf, 0x18);
+        if (e) goto l_fail;
+        c41_read_u32be_array(hc->args.image.key, buf, 4);
+        e = run_locked(hc, image_module_locked, hc->world->module_mutex);
+        if (e) goto l_fail;
+        m = hc->args.image.module;
+        if (!m)
         {
-            hza_task_t * t;
-            t = (void *) np;
-            np = np->next;
-            hc->args.task = t;
-            e = task_free(hc);
-            if (e)
-            {
-                F("failed destroying task $i: $s = $i", t->task_id,
-                  hza_error_name(e), e);
-                return e;
-            }
+            E("task image needs a module with checksum $Xd and $Ui procs "
+              "that is not loaded", c41_read_u32be(buf),
+              c41_read_u32be(buf + 4));
+            e = hc->hza_error = HZAE_IMAGE_MODULE;
+            goto l_fail;
         }
-    }
-
-    /* destroy module name tree */
-    if (w->module_name_tree.root)
-    {
-        e = destroy_mod_name_cells(hc, w->module_name_tree.root);
-        if (e)
+        e = hza_import(hc, m, c41_read_u64be(buf + 16));
+        if (e) goto l_fail;
+        if (hc->args.module_index != i)
         {
-            F("failed destroying mod name cell tree: $s = $i",
-              hza_error_name(e), e);
-            return e;
+            E("task image module $Ui maps to $Ui", i, hc->args.module_index);
+            e = hc->hza_error = HZAE_IMAGE_CORRUPT;
+            goto l_fail;
         }
     }
 
-    /* destroy modules */
-    for (np = w->module_list.next; np != &w->module_list;)
+    if (reg_limit > t->reg_limit)
     {
-        m = (void *) np;
-        np = np->next;
-        e = safe_free(hc, m, m->size);
-        if (e)
-        {
-            F("failed freeing module at $Xp: $s = $i", m, hza_error_name(e), e);
-            return e;
-        }
+        e = safe_realloc_task(hc, HZA_MEM_REG, t->reg_space, 1,
+                              reg_limit, t->reg_limit);
+        if (e) goto l_fail;
+        t->reg_space = hc->args.realloc.ptr;
+        t->reg_limit = reg_limit;
     }
+    C41_MEM_ZERO(t->reg_space, t->reg_limit);
 
-    if (w->mac.total_size || w->mac.count)
+    for (frame_limit = t->frame_limit; frame_limit < frame_count;
+         frame_limit <<= 1);
+    if (frame_limit > t->frame_limit)
     {
-        E("******** MEMORY LEAK: count = $z, size = $z = $Xz ********",
-          w->mac.count, w->mac.total_size, w->mac.total_size);
+        e = safe_realloc_task(hc, HZA_MEM_FRAME, t->frame_table,
+                              sizeof(hza_frame_t), frame_limit,
+                              t->frame_limit);
+        if (e) goto l_fail;
+        t->frame_table = hc->args.realloc.ptr;
+        t->frame_limit = frame_limit;
     }
 
-    if ((w->init_state & HZA_INIT_WORLD_MUTEX))
+    for (i = 0; i < frame_count; ++i)
     {
-        smte = c41_smt_mutex_finish(smt, w->world_mutex);
-        if (smte)
-        {
-            E("failed finishing world mutex ($i)", smte);
-            hc->smt_error = smte;
-            dirty = 1;
-        }
+        e = image_io(hc, io, io_ctx, buf, 0x10);
+        if (e) goto l_fail;
+        f = t->frame_table + i;
+        n = c41_read_u32be(buf);
+        if (n >= t->module_count
+            || c41_read_u32be(buf + 4)
+                >= t->module_table[n].module->proc_count)
+            goto l_corrupt;
+        p = t->module_table[n].module->proc_table + c41_read_u32be(buf + 4);
+        f->proc = p;
+        f->insn_index = c41_read_u32be(buf + 8);
+        f->reg_base = c41_read_u32be(buf + 12);
+        if (f->insn_index >= p->insn_count || (f->reg_base & 15)
+            || (uint64_t) f->reg_base + p->reg_size > reg_limit)
+            goto l_corrupt;
     }
+    t->frame_index = frame_count - 1;
 
-    if ((w->init_state & HZA_INIT_MODULE_MUTEX))
+    for (next_page = 0;; next_page = page + 1)
     {
-        smte = c41_smt_mutex_finish(smt, w->world_mutex);
-        if (smte)
-        {
-            E("failed finishing world mutex ($i)", smte);
-            hc->smt_error = smte;
-            dirty = 1;
-        }
+        e = image_io(hc, io, io_ctx, buf, 4);
+        if (e) goto l_fail;
+        page = c41_read_u32be(buf);
+        if (page == HZA_IMAGE_END) break;
+        if (page < next_page || page >= reg_limit / HZA_IMAGE_PAGE
+            + (reg_limit % HZA_IMAGE_PAGE != 0))
+            goto l_corrupt;
+        ofs = page * HZA_IMAGE_PAGE;
+        n = reg_limit - ofs;
+        if (n > HZA_IMAGE_PAGE) n = HZA_IMAGE_PAGE;
+        e = image_io(hc, io, io_ctx, t->reg_space + ofs, n);
+        if (e) goto l_fail;
     }
 
-    if ((w->init_state & HZA_INIT_TASK_MUTEX))
+    *tp = t;
+    D("restored t$.4Hd: $Ui modules, $Ui frames, $Ui reg bytes", t->task_id,
+      module_count, frame_count, reg_limit);
+    return 0;
+
+l_corrupt:
+    E("bad frame or page in task image");
+    e = hc->hza_error = HZAE_IMAGE_CORRUPT;
+l_fail:
+    de = hza_task_deref(hc, t);
+    if (de) return de;
+    return hc->hza_error = e;
+}
+
+/* hza_task_trim ************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_trim
+(
+    hza_context_t * hc,
+    size_t * freed_p
+)
+{
+    hza_task_t * t = hc->active_task;
+    hza_frame_t * f;
+    hza_error_t e;
+    uint32_t used, n;
+    uint_t i;
+
+    DEBUG_CHECK(t);
+    *freed_p = 0;
+    for (used = 0, i = 0; i <= t->frame_index; ++i)
     {
-        smte = c41_smt_mutex_finish(smt, w->world_mutex);
-        if (smte)
-        {
-            E("failed finishing world mutex ($i)", smte);
-            hc->smt_error = smte;
-            dirty = 1;
-        }
+        f = t->frame_table + i;
+        if (used < f->reg_base + f->proc->reg_size)
+            used = f->reg_base + f->proc->reg_size;
     }
 
-    if ((w->init_state & HZA_INIT_LOG_MUTEX))
+    n = trim_limit(t->reg_limit, used, INIT_REG_SIZE);
+    if (n < t->reg_limit)
     {
-        smte = c41_smt_mutex_finish(smt, w->log_mutex);
-        if (smte)
-        {
-            E("failed finishing logging mutex ($i)", smte);
-            hc->smt_error = smte;
-            dirty = 1;
-        }
+        e = safe_realloc_task(hc, HZA_MEM_REG, t->reg_space, 1,
+                              n, t->reg_limit);
+        if (e) return e;
+        *freed_p += t->reg_limit - n;
+        t->reg_space = hc->args.realloc.ptr;
+        t->reg_limit = n;
     }
 
-    mae = c41_ma_free(w->world_ma, w, WORLD_SIZE);
-    if (mae)
+    /* hza_enter() needs a free frame after frame_index */
+    n = trim_limit(t->frame_limit, t->frame_index + 2, INIT_FRAME_LIMIT);
+    if (n < t->frame_limit)
     {
-        hc->ma_error = mae;
-        return HZAF_WORLD_FREE;
+        e = safe_realloc_task(hc, HZA_MEM_FRAME, t->frame_table,
+                              sizeof(hza_frame_t), n, t->frame_limit);
+        if (e) return e;
+        *freed_p += (t->frame_limit - n) * sizeof(hza_frame_t);
+        t->frame_table = hc->args.realloc.ptr;
+        t->frame_limit = n;
     }
 
-    return (hc->hza_finish_error = dirty ? HZAE_WORLD_FINISH : 0);
+    if (*freed_p)
+    {
+        D("trimmed t$.4Hd by $z bytes: $Ui reg bytes, $Ui frames",
+          t->task_id, *freed_p, t->reg_limit, t->frame_limit);
+    }
+    return 0;
 }
 
-/* find_mod_name_cell *******************************************************/
-static int C41_CALL find_mod_name_cell
+/* hza_task_unwind **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_unwind
 (
-    hza_context_t *             hc,
-    uint8_t const *             name,
-    uint_t                      len,
-    c41_rbtree_path_t *         path
+    hza_context_t * hc,
+    uint_t frame_index
 )
 {
-    c41_u8an_t k;
-    int c;
+    hza_task_t * t = hc->active_task;
 
-    k.a = (uint8_t *) name;
-    k.n = len;
-    c = c41_rbtree_find(path, &hc->world->module_name_tree, &k);
-    return c;
+    DEBUG_CHECK(t);
+    DEBUG_CHECK(frame_index <= t->frame_index);
+    for (; t->frame_index > frame_index; --t->frame_index)
+        if (hc->proc_hook)
+            hc->proc_hook(hc, t->frame_table + t->frame_index,
+                          HZA_PROC_EXIT);
+    return 0;
 }
 
-/* alloc_mod_name_cell ******************************************************/
-static hza_error_t C41_CALL alloc_mod_name_cell
+/* hza_node_ma **************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_node_ma
 (
-    hza_context_t *             hc,
-    uint8_t const *             name,
-    uint_t                      len,
-    c41_rbtree_path_t *         path,
-    hza_mod_name_cell_t * *     mnc_p
+    hza_context_t * hc,
+    uint_t node,
+    c41_ma_t * ma
+)
+{
+    if (node >= HZA_NODE_LIMIT) return hc->hza_error = HZAE_NODE;
+    hc->args.node.ma = ma;
+    hc->args.node.index = node;
+    return run_locked(hc, node_ma_locked, hc->world->world_mutex);
+}
+
+/* node_ma_locked ***********************************************************/
+static hza_error_t C41_CALL node_ma_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    uint_t node = hc->args.node.index;
+
+    if (w->stats.node_mem_live[node])
+    {
+        E("node $Ui still has $Xz bytes of task memory", node,
+          w->stats.node_mem_live[node]);
+        return hc->hza_error = HZAE_STATE;
+    }
+    w->node_ma[node] = hc->args.node.ma;
+    return 0;
+}
+
+/* lock_stats_enable_locked *************************************************/
+static hza_error_t C41_CALL lock_stats_enable_locked
+(
+    hza_context_t * hc
 )
 {
-    c41_rbtree_node_t * rbtn;
-    hza_mod_name_cell_t * mnc;
-    hza_error_t e;
+    hza_world_t * w = hc->world;
 
-    e = safe_alloc(hc, sizeof(c41_rbtree_node_t) + sizeof(hza_mod_name_cell_t)
-                        + len);
-    if (e)
+    if (w->context_count != 1)
     {
-        EF(e, "failed to allocate a module name cell: $s = $i",
-           hza_error_name(e), e);
-        return 0;
+        E("cannot switch lock stats with $Ui contexts attached",
+          w->context_count);
+        return hc->hza_error = HZAE_STATE;
     }
+    w->lock_clock = hc->args.clock;
+    return 0;
+}
 
-    rbtn = hc->args.realloc.ptr;
-    c41_rbtree_insert(path, rbtn);
-    mnc = (hza_mod_name_cell_t *) (rbtn + 1);
-    mnc->len = len;
-    C41_MEM_COPY(mnc->name, name, len);
-    mnc->name[len] = 0;
-    mnc->module = NULL;
-    *mnc_p = mnc;
-
+/* hza_node_set *************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_node_set
+(
+    hza_context_t * hc,
+    uint_t node
+)
+{
+    if (node >= HZA_NODE_LIMIT) return hc->hza_error = HZAE_NODE;
+    hc->node = node;
     return 0;
 }
 
-/* get_mod_name_cell ********************************************************/
-static hza_error_t C41_CALL get_mod_name_cell
+/* hza_task_migrate *********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_migrate
 (
-    hza_context_t *             hc,
-    void *                      name,
-    int                         len,
-    hza_mod_name_cell_t * *     mnc_p
+    hza_context_t * hc,
+    uint_t node
 )
 {
-    c41_rbtree_path_t rbpath;
-    int c;
-    hza_error_t e;
+    DEBUG_CHECK(hc->active_task);
+    if (node >= HZA_NODE_LIMIT) return hc->hza_error = HZAE_NODE;
+    if (hc->active_task->node == node) return 0;
+    hc->args.node.index = node;
+    return run_locked(hc, task_migrate_locked, hc->world->world_mutex);
+}
 
-    if (len < 0) len = C41_STR_LEN(name);
-    c = find_mod_name_cell(hc, name, len, &rbpath);
-    if (!c)
+/* task_migrate_locked ******************************************************/
+static hza_error_t C41_CALL task_migrate_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t = hc->active_task;
+    uint_t node = hc->args.node.index;
+    uint8_t * r = NULL;
+    hza_frame_t * f = NULL;
+    size_t fz = t->frame_limit * sizeof(hza_frame_t);
+    uint_t mae;
+
+    mae = task_mem_realloc(w, node, HZA_MEM_REG, &r, 1, t->reg_limit, 0);
+    if (!mae)
     {
-        *mnc_p = c41_rbtree_last_payload(&rbpath);
-        return 0;
+        mae = task_mem_realloc(w, node, HZA_MEM_FRAME, &f,
+                               sizeof(hza_frame_t), t->frame_limit, 0);
+        if (mae && task_mem_realloc(w, node, HZA_MEM_REG, &r,
+                                    1, 0, t->reg_limit))
+        {
+            F("failed freeing reg space after failed migration");
+            return hc->hza_error = HZAF_FREE;
+        }
+    }
+    if (mae)
+    {
+        E("failed allocating memory to move t$.4Hd to node $Ui (ma error $i)",
+          t->task_id, node, mae);
+        hc->ma_error = mae;
+        return hc->hza_error = HZAE_ALLOC;
     }
 
-    if (c)
+    C41_MEM_COPY(r, t->reg_space, t->reg_limit);
+    C41_MEM_COPY(f, t->frame_table, fz);
+    mae = task_mem_realloc(w, t->node, HZA_MEM_REG, &t->reg_space,
+                           1, 0, t->reg_limit);
+    if (!mae)
+        mae = task_mem_realloc(w, t->node, HZA_MEM_FRAME, &t->frame_table,
+                               sizeof(hza_frame_t), 0, t->frame_limit);
+    if (mae)
     {
-        e = alloc_mod_name_cell(hc, name, len, &rbpath, mnc_p);
-        if (e) return e;
+        F("failed freeing task memory on node $Ui (ma error $i)", t->node,
+          mae);
+        hc->ma_free_error = mae;
+        return hc->hza_error = HZAF_FREE;
     }
+    D("moved t$.4Hd from node $Ui to node $Ui", t->task_id, t->node, node);
+    t->reg_space = r;
+    t->frame_table = f;
+    t->node = node;
+    w->stats.migrate_count += 1;
+    w->stats.migrate_bytes += t->reg_limit + fz;
+    return 0;
+}
+
+/* task_ref_locked **********************************************************/
+static hza_error_t C41_CALL task_ref_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_task_t * t = hc->args.task;
 
+    t->context_count += 1;
+    DEBUG_CHECK(t->context_count != 0);
     return 0;
 }
 
-/* realloc_table_locked *****************************************************/
-static hza_error_t C41_CALL realloc_table_locked
+/* task_deref_locked ********************************************************/
+static hza_error_t C41_CALL task_deref_locked
 (
     hza_context_t * hc
 )
 {
-    hza_world_t * w = hc->world;
-    int mae;
-    D("realloc in: ptr=$p, item_size=$z, new_count=$z, old_count=$z",
-      hc->args.realloc.ptr,
-      hc->args.realloc.item_size,
-      hc->args.realloc.new_count,
-      hc->args.realloc.old_count);
+    hza_task_t * t = hc->args.task;
 
-    mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &hc->args.realloc.ptr,
-                               hc->args.realloc.item_size,
-                               hc->args.realloc.new_count,
-                               hc->args.realloc.old_count);
-    D("realloc out: mae=$Ui, ptr=$p", mae, hc->args.realloc.ptr);
-    if (mae)
+    DEBUG_CHECK(t->context_count != 0);
+    t->context_count -= 1;
+    if (t->context_count) hc->args.task = NULL;
+    else
     {
-        E("failed reallocating table: ma error $Ui", mae);
-        return (hc->hza_error = HZAE_ALLOC);
+        c41_dlist_del(&t->links);
+        hc->world->stats.task_count[t->state] -= 1;
     }
     return 0;
 }
 
-/* safe_realloc_table *******************************************************/
-static hza_error_t C41_CALL safe_realloc_table
+/* hza_task_ref *************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_ref
 (
     hza_context_t * hc,
-    void * old_ptr,
-    size_t item_size,
-    size_t new_count,
-    size_t old_count
+    hza_task_t * t
 )
 {
-    hza_error_t e;
-    hc->args.realloc.ptr = old_ptr;
-    hc->args.realloc.item_size = item_size;
-    hc->args.realloc.new_count = new_count;
-    hc->args.realloc.old_count = old_count;
-    e = run_locked(hc, realloc_table_locked, hc->world->world_mutex);
-    return e;
+    hc->args.task = t;
+    return run_locked(hc, task_ref_locked, hc->world->task_mutex);
 }
 
-/* safe_alloc ***************************************************************/
-static hza_error_t C41_CALL safe_alloc
+/* hza_task_deref ***********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_deref
 (
     hza_context_t * hc,
-    size_t size
+    hza_task_t * t
 )
 {
-    return safe_realloc_table(hc, NULL, 1, size, 0);
+    hza_error_t e;
+    uint32_t task_id = t->task_id;
+
+    hc->args.task = t;
+    e = run_locked(hc, task_deref_locked, hc->world->task_mutex);
+    if (e || !hc->args.task) return e;
+
+    if (hc->active_task == t) hc->active_task = NULL;
+    e = run_locked(hc, task_free, hc->world->world_mutex);
+    if (e)
+    {
+        E("failed freeing task t$.4Hd ($s = $i)", task_id,
+          hza_error_name(e), e);
+        return e;
+    }
+    D("task t$.4Hd freed", task_id);
+    return 0;
 }
 
-/* safe_free ****************************************************************/
-static hza_error_t C41_CALL safe_free
+/* hza_import ***************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_import
 (
     hza_context_t * hc,
-    void * ptr,
-    size_t size
+    hza_module_t * m,
+    uint64_t anchor
 )
 {
-    return safe_realloc_table(hc, ptr, 1, 0, size);
+    hza_task_t * t = hc->active_task;
+    hza_modmap_t * mm;
+    uint32_t * impmod_index;
+    hza_error_t e, fe;
+    uint_t mi, i;
+
+    DEBUG_CHECK(t);
+    for (mi = 0; mi < t->module_count; ++mi)
+    {
+        if (t->module_table[mi].module == m)
+        {
+            hc->args.module_index = mi;
+            return 0;
+        }
+    }
+
+    /* modules are linked at load time only against modules loaded before
+     * them, so there are no cycles and dependencies can go first */
+    impmod_index = NULL;
+    if (m->import_module_count)
+    {
+        e = safe_alloc(hc, HZA_MEM_OTHER,
+                       m->import_module_count * sizeof(uint32_t));
+        if (e)
+        {
+            E("failed allocating import index table for m$.4Hd",
+              m->module_id);
+            return e;
+        }
+        impmod_index = hc->args.realloc.ptr;
+        for (i = 0; i < m->import_module_count; ++i)
+        {
+            e = hza_import(hc, m->impmod_link_table[i], 0);
+            if (e) goto l_fail;
+            impmod_index[i] = hc->args.module_index;
+        }
+    }
+
+    if (t->module_count == t->module_limit)
+    {
+        e = safe_realloc_table(hc, HZA_MEM_OTHER, t->module_table,
+                               sizeof(hza_modmap_t),
+                               t->module_limit << 1, t->module_limit);
+        if (e)
+        {
+            E("failed extending module table in task t$.4Hd", t->task_id);
+            goto l_fail;
+        }
+        t->module_table = hc->args.realloc.ptr;
+        t->module_limit <<= 1;
+    }
+
+    mi = t->module_count++;
+    mm = t->module_table + mi;
+    mm->anchor = anchor;
+    mm->module = m;
+    mm->task = t;
+    mm->impmod_index = impmod_index;
+    hc->args.module_index = mi;
+    D("imported m$.4Hd in t$.4Hd as module $Ui", m->module_id, t->task_id, mi);
+
+    return 0;
+
+l_fail:
+    if (impmod_index)
+    {
+        fe = safe_free(hc, HZA_MEM_OTHER, impmod_index,
+                       m->import_module_count * sizeof(uint32_t));
+        if (fe) return fe;
+    }
+    return hc->hza_error = e;
 }
 
-/* mod00_load ***************************************************************/
-static hza_error_t mod00_load
+/* reg_reserve **************************************************************/
+static hza_error_t reg_reserve
 (
     hza_context_t * hc,
-    void const * data,
-    size_t len
+    uint32_t reg_limit
 )
 {
-    hza_mod00_hdr_t lhdr;
-    hza_mod00_proc_t * pt;
-    hza_mod00_impmod_t * im;
-    uint32_t * ip; // pointer to import proc names
-    hza_module_t * m;
-    hza_world_t * w = hc->world;
-    uint8_t * p;
+    hza_task_t * t = hc->active_task;
     hza_error_t e;
-    uint32_t n, i, j, dblen;
-    size_t z;
 
-    D("len = $Xz", len);
-    n = sizeof(hza_mod00_hdr_t);
-    if (len < n)
+    if (reg_limit > t->reg_limit)
     {
-        E("not enough data ($Xz)", len);
-        return hc->hza_error = HZAE_MOD00_TRUNC;
-    }
+        // extend reg space
+        uint_t new_reg_limit;
 
-    if (!C41_MEM_EQUAL(data, HZA_MOD00_MAGIC, HZA_MOD00_MAGIC_LEN))
-    {
-        E("bad magic!");
-        return hc->hza_error = HZAE_MOD00_MAGIC;
+        if (reg_limit > MAX_REG_LIMIT)
+        {
+            E("t$.4Hd reached its reg space limit! enter proc failed!",
+              t->task_id);
+            return (hc->hza_error = HZAE_REG_LIMIT);
+        }
+
+        for (new_reg_limit = t->reg_limit;
+             new_reg_limit < reg_limit;
+             new_reg_limit <<= 1);
+        e = safe_realloc_task(hc, HZA_MEM_REG, t->reg_space, 1,
+                              new_reg_limit, t->reg_limit);
+        if (e)
+        {
+            E("failed reallocating reg space in task t$H.4d to $Ui bytes",
+              t->task_id, new_reg_limit);
+            return e;
+        }
+        t->reg_space = hc->args.realloc.ptr;
+        t->reg_limit = new_reg_limit;
+        D("reallocated reg space for t$.4Hd to $.1Xd bytes", t->task_id,
+          new_reg_limit);
     }
 
-    c41_read_u32be_array((uint32_t *) &lhdr.size,
-                         C41_PTR_OFS(data, HZA_MOD00_MAGIC_LEN),
-                         (sizeof(hza_mod00_hdr_t) - HZA_MOD00_MAGIC_LEN) / 4);
-    D("size:                    $Xd", lhdr.size);
-    D("checksum:                $Xd", lhdr.checksum);
-    D("name:                    $Xd", lhdr.name);
-    D("const128 count:          $Xd", lhdr.const128_count);
-    D("const64 count:           $Xd", lhdr.const64_count);
-    D("const32 count:           $Xd", lhdr.const32_count);
-    D("proc count:              $Xd", lhdr.proc_count);
-    D("data block count:        $Xd", lhdr.data_block_count);
-    D("import module count:     $Xd", lhdr.import_module_count);
-    D("import proc count:       $Xd", lhdr.import_count);
-    D("export proc count:       $Xd", lhdr.export_count);
-    D("target count:            $Xd", lhdr.target_count);
-    D("insn count:              $Xd", lhdr.insn_count);
-    D("data size:               $Xd", lhdr.data_size);
+    return 0;
+}
 
-    if (lhdr.size > len)
+/* frame_reserve ************************************************************/
+static hza_error_t frame_reserve
+(
+    hza_context_t * hc,
+    uint32_t reg_limit
+)
+{
+    hza_task_t * t = hc->active_task;
+    hza_error_t e;
+    uint_t fx;
+
+    e = reg_reserve(hc, reg_limit);
+    if (e) return e;
+
+    fx = t->frame_index + 1;
+    if (fx == t->frame_limit)
     {
-        E("not enough data: header size = $Xd, raw size = $Xz", lhdr.size, len);
-        return hc->hza_error = HZAE_MOD00_TRUNC;
-    }
-    len = lhdr.size;
+        // extend frame table
+        if (fx > MAX_FRAME_LIMIT)
+        {
+            E("t$H.4d reached its limit of frames! enter proc failed!",
+              t->task_id);
+            return hc->hza_error = HZAE_STACK_LIMIT;
+        }
 
-#define CHECK(_cond) \
-    if ((_cond)) ; else { E("not enough data"); \
-        return hc->hza_error = HZAE_MOD00_TRUNC; }
+        e = safe_realloc_task(hc, HZA_MEM_FRAME, t->frame_table,
+                              sizeof(hza_frame_t), fx << 1, fx);
+        if (e)
+        {
+            E("failed reallocating frame table in task t$H.4d to $Ui items",
+              t->task_id, fx << 1);
+            return e;
+        }
 
-    D("const128 offset:         $Xd", n);
-    CHECK(lhdr.const128_count <= ((len - n) >> 4));
-    n += lhdr.const128_count << 4;
+        t->frame_table = hc->args.realloc.ptr;
+        t->frame_limit = fx << 1;
+        D("reallocated frame table for t$.4Hd to $Ui items", t->task_id,
+          t->frame_limit);
+    }
 
-    D("const64 offset:          $Xd", n);
-    CHECK(lhdr.const64_count <= ((len - n) >> 3));
-    n += lhdr.const64_count << 3;
+    return 0;
+}
 
-    D("const32 offset:          $Xd", n);
-    CHECK(lhdr.const32_count <= ((len - n) >> 2));
-    n += lhdr.const32_count << 2;
+/* hza_enter ****************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_enter
+(
+    hza_context_t * hc,
+    uint32_t module_index,
+    uint32_t proc_index,
+    uint16_t reg_shift
+)
+{
+    hza_task_t * t = hc->active_task;
+    hza_module_t * m;
+    hza_proc_t * p;
+    hza_error_t e;
+    uint_t fx;
+    uint32_t reg_base, reg_limit;
 
-    D("proc offset:             $Xd", n);
-    CHECK(lhdr.proc_count < ((len - n) / sizeof(hza_mod00_proc_t)));
-    n += (lhdr.proc_count + 1) * sizeof(hza_mod00_proc_t);
+    DEBUG_CHECK(t);
+    DEBUG_CHECK(module_index < t->module_count);
+    m = t->module_table[module_index].module;
+    DEBUG_CHECK(proc_index < m->proc_count);
+    p = &m->proc_table[proc_index];
+    reg_base = t->frame_table[t->frame_index].reg_base + (reg_shift >> 3);
 
-    D("data block offset:       $Xd", n);
-    CHECK(lhdr.data_block_count < ((len - n) >> 2));
-    n += (lhdr.data_block_count + 1) << 2;
+    reg_limit = reg_base + p->reg_size;
+    fx = t->frame_index + 1;
+    if (reg_limit > t->reg_limit || fx == t->frame_limit)
+    {
+        e = frame_reserve(hc, reg_limit);
+        if (e) return e;
+    }
+    t->frame_table[fx].proc = p;
+    t->frame_table[fx].insn_index = 0;
+    t->frame_table[fx].reg_base = reg_base;
+    t->frame_index = fx;
+    if (hc->proc_hook) hc->proc_hook(hc, t->frame_table + fx, HZA_PROC_ENTER);
 
-    D("import module offset:    $Xd", n);
-    CHECK(lhdr.import_module_count < ((len - n) / sizeof(hza_mod00_impmod_t)));
-    n += (lhdr.import_module_count + 1) * sizeof(hza_mod00_impmod_t);
+    return 0;
+}
 
-    D("import proc offset:      $Xd", n);
-    CHECK(lhdr.import_count <= ((len - n) >> 2));
-    n += lhdr.import_count << 2;
+/* hza_task_input ***********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_input
+(
+    hza_context_t * hc,
+    uint8_t * data,
+    size_t size,
+    int eof
+)
+{
+    hza_task_t * t = hc->active_task;
 
-    D("export proc offset:      $Xd", n);
-    CHECK(lhdr.export_count <= ((len - n) >> 2));
-    n += lhdr.export_count << 2;
+    DEBUG_CHECK(t);
+    DEBUG_CHECK(t->in.pos == t->in.size);
+    t->in.data = data;
+    t->in.size = size;
+    t->in.pos = 0;
+    t->in.eof = (uint8_t) (eof != 0);
 
-    D("target offset:           $Xd", n);
-    CHECK(lhdr.target_count < ((len - n) >> 2));
-    n += lhdr.target_count << 2;
+    return 0;
+}
 
-    D("insn offset:             $Xd", n);
-    CHECK(lhdr.insn_count <= ((len - n) >> 3));
-    n += lhdr.insn_count << 3;
+/* hza_task_output **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_output
+(
+    hza_context_t * hc,
+    uint8_t * data,
+    size_t size
+)
+{
+    hza_task_t * t = hc->active_task;
 
-    D("data offset:             $Xd", n);
-    if (lhdr.data_size != len - n)
+    DEBUG_CHECK(t);
+    if (data)
     {
-        CHECK(lhdr.data_size <= len - n);
-        n += lhdr.data_size;
-        E("module size mismatch: declared: $Xd, computed: $Xd",
-          lhdr.size, n);
-        return hc->hza_error = HZAE_MOD00_TRUNC;
+        t->out.data = data;
+        t->out.size = size;
     }
-    n += lhdr.data_size;
+    t->out.pos = 0;
+    t->out.eof = 0;
 
-    D("module data:             $Xd / $Xz", n, len);
-#undef CHECK
+    return 0;
+}
 
-    /* allocate module */
-    z = n - sizeof(hza_mod00_hdr_t) + sizeof(hza_module_t)
-        + lhdr.proc_count * sizeof(hza_proc_t);
-    D("allocating $Xz for module", z);
-    e = safe_alloc(hc, z);
+/* hza_task_chan_alloc ******************************************************/
+HAZNA_API hza_error_t C41_CALL hza_task_chan_alloc
+(
+    hza_context_t * hc,
+    size_t in_size,
+    size_t out_size,
+    uint8_t * * in_data
+)
+{
+    hza_task_t * t = hc->active_task;
+    hza_error_t e;
+
+    DEBUG_CHECK(t);
+    e = safe_realloc_table(hc, HZA_MEM_OTHER, t->io_buf, 1, in_size + out_size,
+                           t->io_in_size + t->io_out_size);
     if (e)
     {
-        E("failed allocating module storage $Xz", z);
+        E("failed allocating $z bytes of channel buffers for t$.4Hd",
+          in_size + out_size, t->task_id);
         return e;
     }
-    m = hc->args.realloc.ptr;
-    m->size = z;
-
-    /* set table pointers */
-    m->proc_table = (void *) (m + 1);
-    m->proc_count = lhdr.proc_count;
-
-    m->const128_table = (void *) (m->proc_table + lhdr.proc_count);
-    m->const128_count = lhdr.const128_count;
-    m->const64_table = (void *) (m->const128_table + lhdr.const128_count);
-    m->const64_count = lhdr.const64_count;
-    m->const32_table = (void *) (m->const64_table + lhdr.const64_count);
-    m->const32_count = lhdr.const32_count;
+    t->io_buf = hc->args.realloc.ptr;
+    t->io_in_size = in_size;
+    t->io_out_size = out_size;
+
+    /* the input may point into the old buffer; leave it empty */
+    t->in.data = t->io_buf;
+    t->in.size = 0;
+    t->in.pos = 0;
+    t->in.eof = 0;
+    t->out.data = t->io_buf + in_size;
+    t->out.size = out_size;
+    t->out.pos = 0;
+    *in_data = t->io_buf;
 
-    pt = (void *) (m->const32_table + lhdr.const32_count);
-
-    m->data_block_start_table = (void *) (pt + lhdr.proc_count + 1);
-    m->data_block_count = lhdr.data_block_count;
-
-    im = (void *) (m->data_block_start_table + lhdr.data_block_count + 1);
-    ip = (void *) (im + lhdr.import_module_count + 1);
+    return 0;
+}
 
-    m->export_table = (void *) (ip + lhdr.import_count);
-    m->export_count = lhdr.export_count;
+#if !LANE_SSSE3
+/* lane_op ******************************************************************/
+static void lane_op
+(
+    uint16_t opcode,
+    uint8_t * a,
+    uint8_t const * b,
+    uint8_t const * c
+)
+{
+    union
+    {
+        uint8_t u8[16];
+        uint16_t u16[8];
+        uint32_t u32[4];
+        uint64_t u64[2];
+    } x, y, z;
+    uint_t k;
+
+/* one statement per lane size; _expr is given the lane field */
+#define LANE_MAP(_fn, _expr) \
+    case _fn##_8: for (k = 0; k < 16; ++k) z.u8[k] = _expr(u8); break; \
+    case _fn##_16: for (k = 0; k < 8; ++k) z.u16[k] = _expr(u16); break; \
+    case _fn##_32: for (k = 0; k < 4; ++k) z.u32[k] = _expr(u32); break; \
+    case _fn##_64: for (k = 0; k < 2; ++k) z.u64[k] = _expr(u64); break
+#define LANE_ADD(_f) (x._f[k] + y._f[k])
+#define LANE_SUB(_f) (x._f[k] - y._f[k])
+#define LANE_EQ(_f) (x._f[k] == y._f[k] ? ~0 : 0)
+#define LANE_GT(_f) (x._f[k] > y._f[k] ? ~0 : 0)
+#define LANE_MIN(_f) (x._f[k] < y._f[k] ? x._f[k] : y._f[k])
+#define LANE_MAX(_f) (x._f[k] > y._f[k] ? x._f[k] : y._f[k])
+
+    C41_MEM_COPY(x.u8, b, 16);
+    if (opcode != HZAO_VMOVEMASK_8) C41_MEM_COPY(y.u8, c, 16);
+    switch (opcode)
+    {
+    LANE_MAP(HZAO_VADD, LANE_ADD);
+    LANE_MAP(HZAO_VSUB, LANE_SUB);
+    LANE_MAP(HZAO_VCMP_EQ, LANE_EQ);
+    LANE_MAP(HZAO_VCMP_GT, LANE_GT);
+    LANE_MAP(HZAO_VMIN, LANE_MIN);
+    LANE_MAP(HZAO_VMAX, LANE_MAX);
+    case HZAO_VSHUFFLE_8:
+        for (k = 0; k < 16; ++k)
+            z.u8[k] = y.u8[k] & 0x80 ? 0 : x.u8[y.u8[k] & 15];
+        break;
+    case HZAO_VAND_128:
+        for (k = 0; k < 2; ++k) z.u64[k] = x.u64[k] & y.u64[k];
+        break;
+    case HZAO_VOR_128:
+        for (k = 0; k < 2; ++k) z.u64[k] = x.u64[k] | y.u64[k];
+        break;
+    case HZAO_VXOR_128:
+        for (k = 0; k < 2; ++k) z.u64[k] = x.u64[k] ^ y.u64[k];
+        break;
+    case HZAO_VMOVEMASK_8:
+        for (z.u16[0] = 0, k = 0; k < 16; ++k)
+            z.u16[0] |= (uint16_t) ((x.u8[k] >> 7) << k);
+        C41_MEM_COPY(a, z.u8, 2);
+        return;
+    }
+    C41_MEM_COPY(a, z.u8, 16);
+#undef LANE_MAP
+#undef LANE_ADD
+#undef LANE_SUB
+#undef LANE_EQ
+#undef LANE_GT
+#undef LANE_MIN
+#undef LANE_MAX
+}
+#endif
 
-    m->target_table = (void *) (m->export_table + lhdr.export_count);
-    m->target_count = lhdr.target_count;
+/* run_loop *****************************************************************/
+/**
+ * The interpreter loop behind hza_run().
+ * It is expanded in run_plain() and run_prof() with a constant profile so
+ * the variant that does not profile has no trace of the counting code and
+ * gets its registers allocated as if profiling did not exist.
+ */
+static ALWAYS_INLINE hza_error_t run_loop
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit,
+    int profile
+)
+{
+    hza_world_t * w = hc->world;
+    hza_prof_t * pf = hc->prof;
+    hza_task_t * t;
+    hza_proc_t * p;
+    hza_proc_t * cp;
+    hza_insn_t * i;
+    hza_insn_t * li;
+    hza_frame_t * f;
+    uint8_t * r;
+    uint32_t fx;
+    uint32_t reg_base;
+    uint_t iter_count;
+    uint_t target_index;
+    size_t n;
+    hza_error_t e;
+#if _DEBUG
+    uint32_t dmx;
+#endif
 
-    m->insn_table = (void *) (m->target_table + m->target_count);
-    m->insn_count = lhdr.insn_count;
+/* li is the first insn executed since the last jump; the count is updated
+ * only on flow insns and execution stops before the flow insn that would
+ * reach the limit, so that it is the first one run on resume */
+#define CHECK_ITER_COUNT() \
+    if (iter_count + (i - li) >= iter_limit) \
+    { hc->run_stop = HZA_RUN_LIMIT; goto l_stop; } \
+    else iter_count += i - li + 1
+#define JUMP(_insn) { li = i = (_insn); continue; }
+#define STOP(_reason) { hc->run_stop = (_reason); goto l_stop; }
+#define FAIL(_e) { e = (_e); goto l_fail; }
+#define VU8(_bit_ofs) (*(uint8_t *) (r + ((_bit_ofs) >> 3)))
+#define VU16(_bit_ofs) (*(uint16_t *) (r + ((_bit_ofs) >> 3)))
+#define VU32(_bit_ofs) (*(uint32_t *) (r + ((_bit_ofs) >> 3)))
+#define VU64(_bit_ofs) (*(uint64_t *) (r + ((_bit_ofs) >> 3)))
+#if LANE_SSE2
+#define VL8(_bit_ofs) (*(lane8_t *) (r + ((_bit_ofs) >> 3)))
+#define VL16(_bit_ofs) (*(lane16_t *) (r + ((_bit_ofs) >> 3)))
+#define VL32(_bit_ofs) (*(lane32_t *) (r + ((_bit_ofs) >> 3)))
+#define VL64(_bit_ofs) (*(lane64_t *) (r + ((_bit_ofs) >> 3)))
+/* unsigned min (_gt = <) or max (_gt = >) as a compare and a blend */
+#define VMINMAX(_vl, _type, _gt) \
+    { \
+        _type x_ = _vl(i->b), y_ = _vl(i->c), m_ = (_type) (x_ _gt y_); \
+        _vl(i->a) = (y_ & m_) | (x_ & ~m_); \
+    }
+#endif
+/* sub-byte fields: bit 0 is the least significant bit of the byte */
+#define VBITS(_bit_ofs, _mask) \
+    ((r[(_bit_ofs) >> 3] >> ((_bit_ofs) & 7)) & (_mask))
+/* the slot of a known site is found inline; new sites go out of line */
+#define PROF_BRANCH(_not_taken) \
+    if (profile) \
+    { \
+        hza_prof_branch_t * pb = NULL; \
+        if (pf->branch_limit) \
+            pb = pf->branch_table + PROF_HASH(i, pf->branch_limit - 1); \
+        if (pb && pb->insn == i) \
+            *((_not_taken) ? &pb->not_taken : &pb->taken) += 1; \
+        else prof_branch(hc, pf, i, (_not_taken)); \
+    } \
+    else ((void) 0)
 
-    m->data = (void *) (m->insn_table + m->insn_count);
-    m->data_size = lhdr.data_size;
-    D("m=$p, end=$p, end-m=$z, z=$z", m, m->data + m->data_size,
-      (size_t) C41_PTR_DIFF(m->data + m->data_size, m), z);
+    t = hc->active_task;
+    DEBUG_CHECK(t);
 
-    p = C41_PTR_OFS(data, sizeof(hza_mod00_hdr_t));
+    fx = t->frame_index;
+    if (fx <= frame_stop)
+    {
+        hc->args.iter_count = 0;
+        hc->run_stop = HZA_RUN_FRAME;
+        return 0;
+    }
+    f = t->frame_table + fx;
+    p = f->proc;
+    li = i = p->insn_table + f->insn_index;
+    r = t->reg_space + f->reg_base;
 
-    /* deserialising 128-bit constants */
-    for (i = 0; i < lhdr.const128_count; ++i, p += 0x10)
+    for (iter_count = 0;;)
     {
-        m->const128_table[i].high = c41_read_u64be(p);
-        m->const128_table[i].low = c41_read_u64be(p + 8);
+        if (profile) pf->opcode_count[i->opcode] += 1;
+#if _DEBUG
+        e = frame_module_index(hc, t, f, &dmx);
+        if (e) return e;
+        D("t$.4Hd M$.4Hd.P$.4Hd.I$.4Hd: $s ($XUw) $XUw $XUw $XUw",
+          t->task_id, dmx, p - p->module->proc_table, i - p->insn_table,
+          hza_opcode_name(i->opcode), i->opcode, i->a, i->b, i->c);
+#endif
+        switch (i->opcode)
+        {
+        case HZAO_NOP:
+            break;
+        case HZAO_HALT:
+            STOP(HZA_RUN_HALT);
+        case HZAO_RET:
+            CHECK_ITER_COUNT();
+            if (hc->proc_hook) hc->proc_hook(hc, f, HZA_PROC_EXIT);
+            if (--fx == frame_stop)
+            {
+                t->frame_index = fx;
+                hc->run_stop = HZA_RUN_FRAME;
+                goto l_done;
+            }
+            --f;
+            p = f->proc;
+            r = t->reg_space + f->reg_base;
+            JUMP(p->insn_table + f->insn_index);
+        case HZAO_CALL:
+            cp = p->module->proc_table + i->b;
+            goto l_call;
+        case HZAO_CALL_IMPORT:
+            cp = p->module->import_table[i->b];
+        l_call:
+            CHECK_ITER_COUNT();
+            reg_base = f->reg_base + (i->a >> 3);
+            if (reg_base + cp->reg_size > t->reg_limit
+                || fx + 1 == t->frame_limit)
+            {
+                /* slow path: grow the task; on failure the call is the
+                 * next insn to run */
+                f->insn_index = (uint32_t) (i - p->insn_table);
+                t->frame_index = fx;
+                e = frame_reserve(hc, reg_base + cp->reg_size);
+                if (e) return e;
+                f = t->frame_table + fx;
+            }
+            f->insn_index = (uint32_t) (i + 1 - p->insn_table);
+            ++f;
+            ++fx;
+            f->proc = p = cp;
+            f->insn_index = 0;
+            f->reg_base = reg_base;
+            r = t->reg_space + reg_base;
+            if (hc->proc_hook) hc->proc_hook(hc, f, HZA_PROC_ENTER);
+            JUMP(p->insn_table);
+        case HZAO_TAIL_CALL:
+            cp = p->module->proc_table + i->b;
+            goto l_tail_call;
+        case HZAO_TAIL_CALL_IMPORT:
+            cp = p->module->import_table[i->b];
+        l_tail_call:
+            CHECK_ITER_COUNT();
+            reg_base = f->reg_base + (i->a >> 3);
+            if (reg_base + cp->reg_size > t->reg_limit)
+            {
+                /* the frame stays; only the regs may need to grow */
+                f->insn_index = (uint32_t) (i - p->insn_table);
+                t->frame_index = fx;
+                e = reg_reserve(hc, reg_base + cp->reg_size);
+                if (e) return e;
+            }
+            if (hc->proc_hook) hc->proc_hook(hc, f, HZA_PROC_EXIT);
+            f->proc = p = cp;
+            f->insn_index = 0;
+            f->reg_base = reg_base;
+            r = t->reg_space + reg_base;
+            if (hc->proc_hook) hc->proc_hook(hc, f, HZA_PROC_ENTER);
+            JUMP(p->insn_table);
+#if LANE_SSE2
+        case HZAO_VADD_8: VL8(i->a) = VL8(i->b) + VL8(i->c); break;
+        case HZAO_VADD_16: VL16(i->a) = VL16(i->b) + VL16(i->c); break;
+        case HZAO_VADD_32: VL32(i->a) = VL32(i->b) + VL32(i->c); break;
+        case HZAO_VADD_64: VL64(i->a) = VL64(i->b) + VL64(i->c); break;
+        case HZAO_VSUB_8: VL8(i->a) = VL8(i->b) - VL8(i->c); break;
+        case HZAO_VSUB_16: VL16(i->a) = VL16(i->b) - VL16(i->c); break;
+        case HZAO_VSUB_32: VL32(i->a) = VL32(i->b) - VL32(i->c); break;
+        case HZAO_VSUB_64: VL64(i->a) = VL64(i->b) - VL64(i->c); break;
+        case HZAO_VCMP_EQ_8:
+            VL8(i->a) = (lane8_t) (VL8(i->b) == VL8(i->c));
+            break;
+        case HZAO_VCMP_EQ_16:
+            VL16(i->a) = (lane16_t) (VL16(i->b) == VL16(i->c));
+            break;
+        case HZAO_VCMP_EQ_32:
+            VL32(i->a) = (lane32_t) (VL32(i->b) == VL32(i->c));
+            break;
+        case HZAO_VCMP_EQ_64:
+            VL64(i->a) = (lane64_t) (VL64(i->b) == VL64(i->c));
+            break;
+        case HZAO_VCMP_GT_8:
+            VL8(i->a) = (lane8_t) (VL8(i->b) > VL8(i->c));
+            break;
+        case HZAO_VCMP_GT_16:
+            VL16(i->a) = (lane16_t) (VL16(i->b) > VL16(i->c));
+            break;
+        case HZAO_VCMP_GT_32:
+            VL32(i->a) = (lane32_t) (VL32(i->b) > VL32(i->c));
+            break;
+        case HZAO_VCMP_GT_64:
+            VL64(i->a) = (lane64_t) (VL64(i->b) > VL64(i->c));
+            break;
+        case HZAO_VMIN_8:
+            VL8(i->a) = (lane8_t) __builtin_ia32_pminub128(
+                (lanec_t) VL8(i->b), (lanec_t) VL8(i->c));
+            break;
+        case HZAO_VMIN_16: VMINMAX(VL16, lane16_t, >); break;
+        case HZAO_VMIN_32: VMINMAX(VL32, lane32_t, >); break;
+        case HZAO_VMIN_64: VMINMAX(VL64, lane64_t, >); break;
+        case HZAO_VMAX_8:
+            VL8(i->a) = (lane8_t) __builtin_ia32_pmaxub128(
+                (lanec_t) VL8(i->b), (lanec_t) VL8(i->c));
+            break;
+        case HZAO_VMAX_16: VMINMAX(VL16, lane16_t, <); break;
+        case HZAO_VMAX_32: VMINMAX(VL32, lane32_t, <); break;
+        case HZAO_VMAX_64: VMINMAX(VL64, lane64_t, <); break;
+        case HZAO_VSHUFFLE_8:
+#if LANE_SSSE3
+            VL8(i->a) = (lane8_t) __builtin_ia32_pshufb128(
+                (lanec_t) VL8(i->b), (lanec_t) VL8(i->c));
+#else
+            lane_op(i->opcode, &VU8(i->a), &VU8(i->b), &VU8(i->c));
+#endif
+            break;
+        case HZAO_VAND_128: VL64(i->a) = VL64(i->b) & VL64(i->c); break;
+        case HZAO_VOR_128: VL64(i->a) = VL64(i->b) | VL64(i->c); break;
+        case HZAO_VXOR_128: VL64(i->a) = VL64(i->b) ^ VL64(i->c); break;
+        case HZAO_VMOVEMASK_8:
+            VU16(i->a) = (uint16_t) __builtin_ia32_pmovmskb128(
+                (lanec_t) VL8(i->b));
+            break;
+#else
+        case HZAO_VADD_8: case HZAO_VADD_16:
+        case HZAO_VADD_32: case HZAO_VADD_64:
+        case HZAO_VSUB_8: case HZAO_VSUB_16:
+        case HZAO_VSUB_32: case HZAO_VSUB_64:
+        case HZAO_VCMP_EQ_8: case HZAO_VCMP_EQ_16:
+        case HZAO_VCMP_EQ_32: case HZAO_VCMP_EQ_64:
+        case HZAO_VCMP_GT_8: case HZAO_VCMP_GT_16:
+        case HZAO_VCMP_GT_32: case HZAO_VCMP_GT_64:
+        case HZAO_VMIN_8: case HZAO_VMIN_16:
+        case HZAO_VMIN_32: case HZAO_VMIN_64:
+        case HZAO_VMAX_8: case HZAO_VMAX_16:
+        case HZAO_VMAX_32: case HZAO_VMAX_64:
+        case HZAO_VSHUFFLE_8:
+        case HZAO_VAND_128:
+        case HZAO_VOR_128:
+        case HZAO_VXOR_128:
+        case HZAO_VMOVEMASK_8:
+            lane_op(i->opcode, &VU8(i->a), &VU8(i->b), &VU8(i->c));
+            break;
+#endif
+        case HZAO_INIT_8:
+            VU8(i->a) = i->b;
+            break;
+        case HZAO_INIT_16:
+            VU16(i->a) = i->b;
+            break;
+        case HZAO_DEBUG_OUT_16:
+            D("DEBUG_OUT: $c", VU16(i->a));
+            if (w->log_level == HZA_LL_INFO && w->log_io)
+            {
+                c41_io_fmt(w->log_io, "$c", VU16(i->a));
+            }
+            break;
+        case HZAO_OUT_8:
+            if (t->out.pos == t->out.size) STOP(HZA_RUN_OUTPUT);
+            t->out.data[t->out.pos++] = VU8(i->a);
+            break;
+        case HZAO_IN_8:
+            if (t->in.pos < t->in.size) target_index = i->c;
+            else if (t->in.eof) target_index = i->c + 1;
+            else STOP(HZA_RUN_INPUT);
+            CHECK_ITER_COUNT();
+            PROF_BRANCH(target_index != i->c);
+            if (target_index == i->c) VU8(i->a) = t->in.data[t->in.pos++];
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_IN_BLOCK_8:
+            n = t->in.size - t->in.pos;
+            if (!n && !t->in.eof) STOP(HZA_RUN_INPUT);
+            if (n > i->b) n = i->b;
+            C41_MEM_COPY(&VU8(i->a), t->in.data + t->in.pos, n);
+            t->in.pos += n;
+            VU16(i->c) = (uint16_t) n;
+            break;
+        case HZAO_OUT_BLOCK_8:
+            n = VU16(i->c);
+            if (n > i->b) n = i->b;
+            if (t->out.size - t->out.pos < n)
+            {
+                if (t->out.size < n)
+                {
+                    E("t$.4Hd: output channel ($z bytes) is smaller than "
+                      "a $z byte block", t->task_id, t->out.size, n);
+                    FAIL(HZAE_CHAN_SIZE);
+                }
+                STOP(HZA_RUN_OUTPUT);
+            }
+            C41_MEM_COPY(t->out.data + t->out.pos, &VU8(i->a), n);
+            t->out.pos += n;
+            break;
+        case HZAO_HOST_CALL:
+            if (i->c >= w->host_count || w->host_table[i->c].window > i->b)
+            {
+                E("t$.4Hd: host call $XUw with a $XUw byte window does not "
+                  "match a registered function", t->task_id, i->c, i->b);
+                FAIL(HZAE_HOST_CALL);
+            }
+            if (w->host_table[i->c].func(hc, &VU8(i->a),
+                                         w->host_table[i->c].ctx))
+            {
+                /* the call is done: resume after it */
+                hc->run_stop = HZA_RUN_HOST;
+                i++;
+                goto l_stop_next;
+            }
+            break;
+        case HZAO_WRAP_ADD_CONST_8:
+            VU8(i->a) = VU8(i->b) + i->c;
+            D("wrap add: $Xb", VU8(i->a));
+            break;
+        case HZAO_BRANCH_ZERO_1:
+            CHECK_ITER_COUNT();
+            target_index = i->c + VBITS(i->a, 1);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_2:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VBITS(i->a, 3) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_4:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VBITS(i->a, 15) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_8:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VU8(i->a) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            D("tgt_idx: $i => $Xd", target_index, p->target_table[target_index]);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_16:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VU16(i->a) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_32:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VU32(i->a) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        case HZAO_BRANCH_ZERO_64:
+            CHECK_ITER_COUNT();
+            target_index = i->c + (VU64(i->a) ? 1 : 0);
+            PROF_BRANCH(target_index != i->c);
+            JUMP(p->insn_table + p->target_table[target_index]);
+        default:
+            F("opcode $s ($XUw) is not implemented!",
+              hza_opcode_name(i->opcode), i->opcode);
+            return hc->hza_error = HZAF_NO_CODE;
+        }
+        i++;
     }
+l_stop:
+    /* save the position; *i has not been executed so it is counted again
+     * when resumed; l_stop_next is reached with i past a finished insn */
+    if (profile) pf->opcode_count[i->opcode] -= 1;
+l_stop_next:
+    iter_count += i - li;
+    f->insn_index = (uint32_t) (i - p->insn_table);
+    t->frame_index = fx;
+l_done:
+    hc->args.iter_count = iter_count;
 
-    /* deserialising 64-bit constants */
-    for (i = 0; i < lhdr.const64_count; ++i, p += 8)
-        m->const64_table[i] = c41_read_u64be(p);
+    return 0;
 
-    /* compute how many 32-bit ints are to be deserialised */
-    n = lhdr.const32_count
-        + (lhdr.proc_count + 1) * (sizeof(hza_mod00_proc_t) / 4)
-        + lhdr.data_block_count + 1
-        + (lhdr.import_module_count + 1) * (sizeof(hza_mod00_impmod_t) / 4)
-        + lhdr.import_count
-        + lhdr.export_count
-        + lhdr.target_count;
+l_fail:
+    /* save the position like l_stop so the task can be unwound or
+     * resumed at the failing insn */
+    if (profile) pf->opcode_count[i->opcode] -= 1;
+    f->insn_index = (uint32_t) (i - p->insn_table);
+    t->frame_index = fx;
+    return hc->hza_error = e;
+#undef CHECK_ITER_COUNT
+#undef JUMP
+#undef STOP
+#undef FAIL
+#undef VU8
+#undef VU16
+#undef VU32
+#undef VU64
+#if LANE_SSE2
+#undef VL8
+#undef VL16
+#undef VL32
+#undef VL64
+#undef VMINMAX
+#endif
+#undef VBITS
+#undef PROF_BRANCH
+}
 
-    /* deserialising 32-bit ints */
-    c41_read_u32be_array(m->const32_table, p, n);
-    p += n * 4;
+/* run_plain ****************************************************************/
+static NO_INLINE hza_error_t run_plain
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+)
+{
+    return run_loop(hc, frame_stop, iter_limit, 0);
+}
 
-    /* deserialising 16-bit ints (instructions) */
-    c41_read_u16be_array((uint16_t *) m->insn_table, p, lhdr.insn_count * 4);
-    p += lhdr.insn_count * 8;
+#if HZA_PROFILE
+/* run_prof *****************************************************************/
+static NO_INLINE hza_error_t run_prof
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+)
+{
+    return run_loop(hc, frame_stop, iter_limit, 1);
+}
+#endif
 
-    /* copy 8-bit data */
-    C41_MEM_COPY(m->data, p, lhdr.data_size);
+/* run_once *****************************************************************/
+static ALWAYS_INLINE hza_error_t run_once
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+)
+{
+#if HZA_PROFILE
+    if (hc->prof) return run_prof(hc, frame_stop, iter_limit);
+#endif
+    return run_plain(hc, frame_stop, iter_limit);
+}
 
-#define CHECK(_cond) \
-    if ((_cond)) ; else { E("corrupt data"); goto l_corrupted; }
+/* hza_run ******************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_run
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+)
+{
+    if (hc->sample_period) return run_sampled(hc, frame_stop, iter_limit);
+    return run_once(hc, frame_stop, iter_limit);
+}
 
-    CHECK(pt[0].insn_start == 0);
-    CHECK(pt[0].target_start == 0);
-    CHECK(pt[0].const128_start == 0);
-    CHECK(pt[0].const64_start == 0);
-    CHECK(pt[0].const32_start == 0);
+/* run_sampled **************************************************************/
+static hza_error_t run_sampled
+(
+    hza_context_t * hc,
+    uint_t frame_stop,
+    uint_t iter_limit
+)
+{
+    hza_error_t e;
+    uint_t done, n, slice;
 
-    /* check proc start indexes */
-    for (i = 0; i < lhdr.proc_count; ++i)
+    for (done = 0;;)
     {
-        CHECK(pt[i].insn_start < pt[i + 1].insn_start);
-        CHECK(pt[i].target_start <= pt[i + 1].target_start);
-        CHECK(pt[i].const128_start <= pt[i + 1].const128_start);
-        CHECK(pt[i].const64_start <= pt[i + 1].const64_start);
-        CHECK(pt[i].const32_start <= pt[i + 1].const32_start);
-        CHECK(pt[i].name < lhdr.data_block_count);
+        slice = iter_limit - done;
+        if (slice > hc->sample_left) slice = hc->sample_left;
+        e = run_once(hc, frame_stop, slice);
+        if (e) return e;
+        n = hc->args.iter_count;
+        done += n;
+        if (n < hc->sample_left) hc->sample_left -= n;
+        else
+        {
+            hc->sample_left = hc->sample_period;
+            if (hc->active_task->frame_index)
+            {
+                e = run_locked(hc, sample_locked, hc->world->world_mutex);
+                if (e) return e;
+            }
+        }
+        if (hc->run_stop != HZA_RUN_LIMIT || done >= iter_limit) break;
     }
-    CHECK(pt[i].insn_start == lhdr.insn_count);
-    CHECK(pt[i].target_start == lhdr.target_count);
-    CHECK(pt[i].const128_start == lhdr.const128_count);
-    CHECK(pt[i].const64_start == lhdr.const64_count);
-    CHECK(pt[i].const32_start == lhdr.const32_count);
-    CHECK(pt[i].name == 0);
+    hc->args.iter_count = done;
 
-    /* check data block start indexes */
-    CHECK(lhdr.data_block_count >= 1);
-    CHECK(m->data_block_start_table[0] == 0);
-    CHECK(m->data_block_start_table[1] == 0);
-    /* blocks should be increasing in size */
-    for (dblen = 1, i = 1; i < m->data_block_count; ++i)
-    {
-        CHECK(m->data_block_start_table[i] + dblen
-              <= m->data_block_start_table[i + 1]);
-        dblen = m->data_block_start_table[i + 1] - m->data_block_start_table[i];
-    }
-    CHECK(m->data_block_start_table[i] == lhdr.data_size);
+    return 0;
+}
+
+/* sample_locked ************************************************************/
+static hza_error_t C41_CALL sample_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t = hc->active_task;
+    hza_sample_t * * nt;
+    hza_sample_t * s;
+    hza_sample_t * sn;
+    uint32_t h, depth, fx;
+    size_t limit, j, z;
+    uint_t mae;
 
-    /* TODO: check import modules */
-    /* TODO: check import procs */
+    depth = t->frame_index;
+    for (h = 0x811C9DC5, fx = 1; fx <= depth; ++fx)
+        h = (h ^ (uint32_t) ((uintptr_t) FRAME_INSN(t->frame_table + fx) >> 3))
+            * 0x01000193;
 
-    /* check exports */
-    if (lhdr.export_count)
+    if (w->sample_limit)
     {
-        uint32_t dbi;
-        for (dbi = i = 0; i < lhdr.export_count; ++i)
+        for (s = w->sample_table[h & (w->sample_limit - 1)]; s; s = s->next)
         {
-            CHECK(m->export_table[i] < lhdr.proc_count);
-            D("exp[0]: $Xd", m->export_table[i]);
-            D("proc[$Xd].name: $Xd", m->export_table[i], 
-              pt[m->export_table[i]].name);
-            CHECK(dbi < pt[m->export_table[i]].name);
-            dbi = pt[m->export_table[i]].name;
+            if (s->hash != h || s->depth != depth) continue;
+            for (fx = 0; fx < depth; ++fx)
+                if (s->insn_table[fx] != FRAME_INSN(t->frame_table + fx + 1))
+                    break;
+            if (fx == depth)
+            {
+                s->count += 1;
+                return 0;
+            }
         }
     }
 
-    /* check proc targets & insns */
-    for (i = 0; i < lhdr.proc_count; ++i)
+    /* grow the table to keep chains short */
+    if (w->sample_count >= w->sample_limit)
     {
-        uint32_t rlen = 0;
-        hza_proc_t * proc = m->proc_table + i;
-
-        proc->insn_table = m->insn_table + pt[i].insn_start;
-        proc->insn_count = pt[i + 1].insn_start - pt[i].insn_start;
-
-        proc->const128_table = m->const128_table + pt[i].const128_start;
-        proc->const128_count = pt[i + 1].const128_start - pt[i].const128_start;
-
-        proc->const64_table = m->const64_table + pt[i].const64_start;
-        proc->const64_count = pt[i + 1].const64_start - pt[i].const64_start;
-
-        proc->const32_table = m->const32_table + pt[i].const32_start;
-        proc->const32_count = pt[i + 1].const32_start - pt[i].const32_start;
+        limit = w->sample_limit ? w->sample_limit * 2 : INIT_SAMPLE_LIMIT;
+        nt = NULL;
+        mae = c41_ma_alloc_zero_fill(&w->mac.ma, (void * *) &nt,
+                                     limit * sizeof(hza_sample_t *));
+        if (mae)
+        {
+            w->sample_lost += 1;
+            return 0;
+        }
+        mem_account(w, HZA_MEM_OTHER, limit * sizeof(hza_sample_t *), 0);
+        for (j = 0; j < w->sample_limit; ++j)
+            for (s = w->sample_table[j]; s; s = sn)
+            {
+                sn = s->next;
+                s->next = nt[s->hash & (limit - 1)];
+                nt[s->hash & (limit - 1)] = s;
+            }
+        if (w->sample_limit)
+        {
+            mae = c41_ma_free(&w->mac.ma, w->sample_table,
+                              w->sample_limit * sizeof(hza_sample_t *));
+            if (mae)
+            {
+                F("failed freeing sample table: ma error $Ui", mae);
+                hc->ma_free_error = mae;
+                return (hc->hza_error = HZAF_FREE);
+            }
+            mem_account(w, HZA_MEM_OTHER, 0,
+                        w->sample_limit * sizeof(hza_sample_t *));
+        }
+        w->sample_table = nt;
+        w->sample_limit = limit;
+    }
 
-        proc->target_table = m->target_table + pt[i].target_start;
-        proc->target_count = pt[i + 1].target_start - pt[i].target_start;
+    s = NULL;
+    z = sizeof(hza_sample_t) + (depth - 1) * sizeof(hza_insn_t const *);
+    mae = c41_ma_alloc(&w->mac.ma, (void * *) &s, z);
+    if (mae)
+    {
+        w->sample_lost += 1;
+        return 0;
+    }
+    mem_account(w, HZA_MEM_OTHER, z, 0);
+    s->count = 1;
+    s->hash = h;
+    s->depth = depth;
+    for (fx = 0; fx < depth; ++fx)
+        s->insn_table[fx] = FRAME_INSN(t->frame_table + fx + 1);
+    s->next = w->sample_table[h & (w->sample_limit - 1)];
+    w->sample_table[h & (w->sample_limit - 1)] = s;
+    w->sample_count += 1;
 
-        proc->name = pt[i].name;
+    return 0;
+}
 
-        /* validate all targets from all target blocks that belong to
-         * current proc */
-        for (j = 0; j < proc->target_count; ++j)
-        {
-            CHECK(proc->target_table[j] < proc->insn_count);
-        }
+/* sample_free_all **********************************************************/
+static hza_error_t sample_free_all
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_sample_t * s;
+    hza_sample_t * sn;
+    size_t j, z;
+    uint_t mae;
 
-        /* validate all instructions from current proc */
-        for (j = 0; j < proc->insn_count; ++j)
+    for (j = 0; j < w->sample_limit; ++j)
+        for (s = w->sample_table[j]; s; s = sn)
         {
-            int32_t rl;
-            rl = insn_check(hc, proc, proc->insn_table + j);
-            D("check P$.4Hd.I$.4Hd: $s ($XUw) $XUw $XUw $XUw => reg_size = $.1Xd",
-              i, j, hza_opcode_name(proc->insn_table[j].opcode),
-              proc->insn_table[j].opcode,
-              proc->insn_table[j].a,
-              proc->insn_table[j].b,
-              proc->insn_table[j].c,
-              rl);
-            if (rl < 0)
+            sn = s->next;
+            z = sizeof(hza_sample_t)
+                + (s->depth - 1) * sizeof(hza_insn_t const *);
+            mae = c41_ma_free(&w->mac.ma, s, z);
+            if (mae)
             {
-                E("invalid insn $Xd: $s ($XUw) $XUw $XUw $XUw",
-                  j, hza_opcode_name(proc->insn_table[j].opcode),
-                  proc->insn_table[j].opcode,
-                  proc->insn_table[j].a,
-                  proc->insn_table[j].b,
-                  proc->insn_table[j].c);
-                goto l_corrupted;
+                F("failed freeing sample: ma error $Ui", mae);
+                hc->ma_free_error = mae;
+                return (hc->hza_error = HZAF_FREE);
             }
-            if (rlen < (uint32_t) rl) rlen = rl;
+            mem_account(w, HZA_MEM_OTHER, 0, z);
         }
-        j--;
-        if (last_insn_check(proc->insn_table + j))
+    if (w->sample_limit)
+    {
+        mae = c41_ma_free(&w->mac.ma, w->sample_table,
+                          w->sample_limit * sizeof(hza_sample_t *));
+        if (mae)
         {
-            E("invalid last insn $Xd: $s ($XUw) $XUw $XUw $XUw",
-              j, hza_opcode_name(proc->insn_table[j].opcode),
-              proc->insn_table[j].opcode,
-              proc->insn_table[j].a,
-              proc->insn_table[j].b,
-              proc->insn_table[j].c);
-            goto l_corrupted;
+            F("failed freeing sample table: ma error $Ui", mae);
+            hc->ma_free_error = mae;
+            return (hc->hza_error = HZAF_FREE);
         }
-
-        proc->reg_size = rlen >> 3;
-        D("proc $.3Xd reg_size:    $.5Xd bytes", i, proc->reg_size);
+        mem_account(w, HZA_MEM_OTHER, 0,
+                    w->sample_limit * sizeof(hza_sample_t *));
     }
+    w->sample_table = NULL;
+    w->sample_limit = 0;
+    w->sample_count = 0;
 
-    /* check data blocks to be sorted (we checked already that they are
-     * increasing in size, now we check that consecutive blocks of same length
-     * are lexicographically increasing) */
-    for (dblen = 0, i = 1; i < m->data_block_count; ++i)
-    {
-        uint32_t l = m->data_block_start_table[i + 1] 
-            - m->data_block_start_table[i];
-        if (dblen != l) { dblen = l; continue; }
-        CHECK(C41_MEM_COMPARE(m->data + m->data_block_start_table[i - 1],
-                              m->data + m->data_block_start_table[i], l) < 0);
-    }
-#undef CHECK
+    return 0;
+}
 
-    /* valid module. init remaining fields. */
-    C41_DLIST_APPEND(w->module_list, m, links);
-    m->module_id = w->module_id_seed++;
-    m->task_count = 0;
-    m->ctx_count = 1;
-    m->size = z;
+/* mod_name_cell_of *********************************************************/
+static hza_mod_name_cell_t * mod_name_cell_of
+(
+    c41_rbtree_node_t * n,
+    hza_module_t * m
+)
+{
+    hza_mod_name_cell_t * mnc;
 
-    return 0;
+    if (!n) return NULL;
+    mnc = (void *) (n + 1);
+    if (mnc->module == m) return mnc;
+    mnc = mod_name_cell_of(n->left, m);
+    return mnc ? mnc : mod_name_cell_of(n->right, m);
+}
 
-l_corrupted:
-    e = safe_free(hc, m, z);
-    if (e)
+/* label_put ****************************************************************/
+/* appends a name with the separators of folded stacks replaced, or the
+ * given letter and 4 hex digits of id if the name is empty */
+static size_t label_put
+(
+    char * buf,
+    size_t pos,
+    size_t size,
+    uint8_t const * name,
+    size_t len,
+    char letter,
+    uint32_t id
+)
+{
+    size_t j;
+
+    if (!len)
     {
-        F("failed freeing module (load failed due to corrupt data): $s = $Ui",
-          hza_error_name(e), e);
-        return e;
+        if (pos + 1 < size) buf[pos++] = letter;
+        for (j = 4; j && pos + 1 < size; --j)
+            buf[pos++] = "0123456789ABCDEF"[(id >> (j * 4 - 4)) & 15];
+        return pos;
     }
-    return hc->hza_error = HZAE_MOD00_CORRUPT;
+    for (j = 0; j < len && pos + 1 < size; ++j)
+        buf[pos++] = name[j] <= ' ' || name[j] == ';' || name[j] == '.'
+            ? '_' : (char) name[j];
+    return pos;
+}
+
+/* proc_label ***************************************************************/
+static void proc_label
+(
+    hza_world_t * w,
+    hza_module_t * m,
+    uint32_t px,
+    char * buf,
+    size_t size
+)
+{
+    hza_mod_name_cell_t * mnc;
+    uint32_t dbi;
+    size_t pos;
+
+    mnc = mod_name_cell_of(w->module_name_tree.root, m);
+    pos = mnc ? label_put(buf, 0, size, mnc->name, mnc->len, 0, 0)
+        : label_put(buf, 0, size, NULL, 0, 'M', m->module_id);
+    if (pos + 1 < size) buf[pos++] = '.';
+    dbi = m->proc_table[px].name;
+    pos = label_put(buf, pos, size, m->data + m->data_block_start_table[dbi],
+                    m->data_block_start_table[dbi + 1]
+                    - m->data_block_start_table[dbi], 'P', px);
+    buf[pos] = 0;
 }
 
-/* hza_module_load **********************************************************/
-HAZNA_API hza_error_t C41_CALL hza_module_load
+/* frame_module_index *******************************************************/
+static hza_error_t frame_module_index
 (
     hza_context_t * hc,
-    uint8_t const * data,
-    size_t size,
-    hza_module_t * * mp
+    hza_task_t const * t,
+    hza_frame_t const * f,
+    uint32_t * mx
 )
 {
+    uint32_t x;
+
     (void) hc;
-    (void) data;
-    (void) size;
-    *mp = NULL;
-    return hc->hza_error = HZAF_NO_CODE;
+    for (x = 0; x < t->module_count
+         && t->module_table[x].module != f->proc->module; ++x);
+    DEBUG_CHECK(x < t->module_count);
+    *mx = x;
+    return 0;
 }
 
-/* insn_check ***************************************************************/
-static int32_t insn_check
+/* trim_limit ***************************************************************/
+static uint32_t trim_limit
 (
-    hza_context_t * hc,
-    hza_proc_t * proc,
-    hza_insn_t * insn
+    uint32_t limit,
+    uint32_t used,
+    uint32_t init
 )
 {
-    uint32_t a, b, c, ps, rs;
-    uint_t oc;
+    uint32_t n;
 
-    oc = HZA_OPCODE_CLASS(insn->opcode);
+    for (n = init; n < used; n <<= 1);
+    if (n > init) n <<= 1;
+    return limit >= n << 1 ? n : limit;
+}
 
-    /* check operand a */
-    switch (oc)
+/* image_module_locked ******************************************************/
+static hza_error_t C41_CALL image_module_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_task_t * t = hc->active_task;
+    uint32_t const * key = hc->args.image.key;
+    hza_module_t * m;
+    c41_np_t * np;
+    uint_t mi;
+
+    hc->args.image.module = NULL;
+    for (np = w->module_list.next; np != &w->module_list; np = np->next)
     {
-    case HZAOC_NNN:
-        rs = 0;
+        m = (void *) np;
+        if (m->checksum != key[0] || m->proc_count != key[1]
+            || m->insn_count != key[2] || m->data_size != key[3])
+            continue;
+        /* a module loaded twice is imported twice by the saved task; the
+         * second saved entry must map to the second copy */
+        for (mi = 0; mi < t->module_count && t->module_table[mi].module != m;
+             ++mi);
+        if (mi < t->module_count) continue;
+        hc->args.image.module = m;
         break;
+    }
+    return 0;
+}
 
-    case HZAOC_RNN:
-    case HZAOC_RRN:
-    case HZAOC_RRR:
-    case HZAOC_RRC:
-    case HZAOC_RRS:
-    case HZAOC_RR4:
-    case HZAOC_RCN:
-    case HZAOC_RNP:
-    case HZAOC_RRP:
-    case HZAOC_RCP:
-    case HZAOC_RRG:
-    case HZAOC_RCG:
-    case HZAOC_RLT:
-    case HZAOC_RAN:
-    case HZAOC_RAA:
-    case HZAOC_RA4:
-    case HZAOC_RA5:
-    case HZAOC_RA6:
-        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
-    l_check_a_reg:
-        a = insn->a;
-        if ((a & (ps - 1)) != 0)
-        {
-            E("I$.4Hd: unaligned reg (a = $XUw)",
-              insn - proc->insn_table, insn->a);
-            return -1; // unaligned reg
-        }
-        rs = a + ps;
-        break;
+/* image_io *****************************************************************/
+static hza_error_t image_io
+(
+    hza_context_t * hc,
+    hza_image_io_f io,
+    void * io_ctx,
+    void * data,
+    size_t size
+)
+{
+    if (!io(io_ctx, data, size)) return 0;
+    E("task image i/o failed ($z bytes)", size);
+    return hc->hza_error = HZAE_IMAGE_IO;
+}
 
-    case HZAOC_QRR:
-    case HZAOC_QRC:
-    case HZAOC_QRS:
-    case HZAOC_QR4:
-        ps = 2 << HZA_OPCODE_PRI_SIZE(insn->opcode);
-        goto l_check_a_reg;
+/* proc_label_locked ********************************************************/
+static hza_error_t C41_CALL proc_label_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_frame_t const * f = hc->args.label.frame;
+    hza_module_t * m = f->proc->module;
 
-    case HZAOC_SRN:
-        ps = 1 << HZA_OPCODE_SEC_SIZE(insn->opcode);
-        goto l_check_a_reg;
+    proc_label(hc->world, m, (uint32_t) (f->proc - m->proc_table),
+               hc->args.label.buf, hc->args.label.size);
+    return 0;
+}
 
-    default:
-        return -1;
-    }
+/* sample_put_frame *********************************************************/
+static void sample_put_frame
+(
+    hza_world_t * w,
+    c41_io_t * io,
+    hza_insn_t const * insn
+)
+{
+    hza_module_t * m;
+    c41_np_t * np;
+    uint32_t px;
+    char buf[0x80];
 
-    /* check operand b */
-    switch (oc)
+    for (np = w->module_list.next; np != &w->module_list; np = np->next)
     {
-    case HZAOC_NNN:
-    case HZAOC_RNN:
-    case HZAOC_RNP:
-    case HZAOC_RLT: // this will be checked at arg c
-        break;
+        m = (void *) np;
+        if (insn >= m->insn_table && insn < m->insn_table + m->insn_count)
+            break;
+    }
+    if (np == &w->module_list)
+    {
+        c41_io_fmt(io, "?");
+        return;
+    }
+    for (px = 0; px + 1 < m->proc_count
+         && insn >= m->proc_table[px + 1].insn_table; ++px);
 
-    case HZAOC_RRN:
-    case HZAOC_RRR:
-    case HZAOC_RRC:
-    case HZAOC_RRS:
-    case HZAOC_RR4:
-    case HZAOC_RRP:
-    case HZAOC_RRG:
-    case HZAOC_QRR:
-    case HZAOC_QRC:
-    case HZAOC_QRS:
-    case HZAOC_QR4:
-    case HZAOC_SRN:
-        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
-    l_check_b_reg:
-        b = insn->b;
-        if ((b & (ps - 1)) != 0)
-        {
-            E("I$.4Hd: unaligned reg (b = $XUw)",
-              insn - proc->insn_table, insn->b);
-            return -1; // unaligned reg
-        }
-        ps += b;
-        if (rs < ps) rs = ps;
-        break;
+    proc_label(w, m, px, buf, sizeof(buf));
+    c41_io_fmt(io, "$s.I$.4Hd", buf,
+               (uint32_t) (insn - m->proc_table[px].insn_table));
+}
 
-    case HZAOC_RCP:
-    case HZAOC_RCG:
-    case HZAOC_RCN:
-        ps = HZA_OPCODE_PRI_SIZE(insn->opcode);
-        switch (ps)
+/* sample_report_locked *****************************************************/
+static hza_error_t C41_CALL sample_report_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    c41_io_t * io = hc->args.io;
+    hza_sample_t * s;
+    size_t j;
+    uint32_t fx;
+
+    for (j = 0; j < w->sample_limit; ++j)
+        for (s = w->sample_table[j]; s; s = s->next)
         {
-        case 0: case 1: case 2: case 3: case 4:
-            break;
-        case 5:
-            if (insn->b >= proc->const32_count)
-            {
-                E("I$.4Hd: bad 32-bit const index (b = $XUw)",
-                  insn - proc->insn_table, insn->b);
-                return -1;
-            }
-            break;
-        case 6:
-            if (insn->b >= proc->const64_count)
-            {
-                E("I$.4Hd: bad 64-bit const index (b = $XUw)",
-                  insn - proc->insn_table, insn->b);
-                return -1;
-            }
-            break;
-        case 7:
-            if (insn->b >= proc->const128_count)
+            for (fx = 0; fx < s->depth; ++fx)
             {
-                E("I$.4Hd: bad 128-bit const index (b = $XUw)",
-                  insn - proc->insn_table, insn->b);
-                return -1;
+                if (fx) c41_io_fmt(io, ";");
+                sample_put_frame(w, io, s->insn_table[fx]);
             }
-            break;
+            c41_io_fmt(io, " $Uq\n", s->count);
         }
-        break;
-
-    case HZAOC_RAN:
-    case HZAOC_RAA:
-    case HZAOC_RA4:
-    case HZAOC_RA5:
-    case HZAOC_RA6:
-        ps = 6; // addresses are 2^6 bits
-        goto l_check_b_reg;
-
-    default:
-        return -1;
+    if (w->sample_lost)
+    {
+        W("$Uq stack samples lost for lack of memory", w->sample_lost);
     }
 
-    /* check operand c */
-    switch (oc)
-    {
-    case HZAOC_NNN:
-    case HZAOC_RNN:
-    case HZAOC_RRN:
-    case HZAOC_RAN:
-    case HZAOC_SRN:
-    case HZAOC_RCN:
-    case HZAOC_RR4:
-    case HZAOC_QR4:
-    case HZAOC_RA4:
-        break;
+    return 0;
+}
 
-    case HZAOC_RRR:
-    case HZAOC_QRR:
-        ps = 1 << HZA_OPCODE_PRI_SIZE(insn->opcode);
-    l_check_c_reg:
-        c = insn->c;
-        if ((c & (ps - 1)) != 0)
-        {
-            E("I$.4Hd: unaligned reg (c = $XUw)",
-              insn - proc->insn_table, insn->c);
-            return -1; // unaligned reg
-        }
-        ps += c;
-        if (rs < ps) rs = ps;
-        break;
-        break;
+/* sample_report_modules_locked *********************************************/
+static hza_error_t C41_CALL sample_report_modules_locked
+(
+    hza_context_t * hc
+)
+{
+    return run_locked(hc, sample_report_locked, hc->world->world_mutex);
+}
 
-    case HZAOC_RRC:
-    case HZAOC_QRC:
-        ps = HZA_OPCODE_PRI_SIZE(insn->opcode);
-        switch (ps)
-        {
-        case 0: case 1: case 2: case 3: case 4:
-            break;
-        case 5:
-        l_check_c5:
-            if (insn->c >= proc->const32_count)
-            {
-                E("I$.4Hd: bad 32-bit const index (c = $XUw)",
-                  insn - proc->insn_table, insn->c);
-                return -1;
-            }
-            break;
-        case 6:
-        l_check_c6:
-            if (insn->c >= proc->const64_count)
-            {
-                E("I$.4Hd: bad 64-bit const index (c = $XUw)",
-                  insn - proc->insn_table, insn->c);
-                return -1;
-            }
-            break;
-        case 7:
-            if (insn->c >= proc->const128_count)
-            {
-                E("I$.4Hd: bad 128-bit const index (c = $XUw)",
-                  insn - proc->insn_table, insn->c);
-                return -1;
-            }
-            break;
-        }
-        break;
+/* hza_sample_enable ********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_sample_enable
+(
+    hza_context_t * hc,
+    uint_t period
+)
+{
+    hc->sample_period = period ? period : HZA_SAMPLE_PERIOD;
+    hc->sample_left = hc->sample_period;
+    return 0;
+}
+
+/* hza_sample_disable *******************************************************/
+HAZNA_API hza_error_t C41_CALL hza_sample_disable
+(
+    hza_context_t * hc
+)
+{
+    hc->sample_period = 0;
+    return 0;
+}
 
-    case HZAOC_RRS:
-    case HZAOC_QRS:
-        ps = 1 << HZA_OPCODE_SEC_SIZE(insn->opcode);
-        goto l_check_c_reg;
+/* hza_sample_report ********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_sample_report
+(
+    hza_context_t * hc,
+    c41_io_t * io
+)
+{
+    hc->args.io = io;
+    /* module mutex first: loading modules allocates under it */
+    return run_locked(hc, sample_report_modules_locked,
+                      hc->world->module_mutex);
+}
 
-    case HZAOC_RNP:
-    case HZAOC_RRP:
-    case HZAOC_RCP:
-        c = insn->c;
-        b = 2;
-        goto l_check_tgt;
-        // if (c + 1 >= proc->target_count) return -1;
-        // break;
+/* prof_alloc_locked ********************************************************/
+static hza_error_t C41_CALL prof_alloc_locked
+(
+    hza_context_t * hc
+)
+{
+    uint_t mae;
 
-    case HZAOC_RRG:
-    case HZAOC_RCG:
-        c = insn->c;
-        b = 3;
-        goto l_check_tgt;
-        // if (c + 2 >= proc->target_count) return -1;
-        // break;
+    hc->args.prof.prof = NULL;
+    mae = c41_ma_alloc_zero_fill(&hc->world->mac.ma,
+                                 (void * *) &hc->args.prof.prof,
+                                 sizeof(hza_prof_t));
+    if (mae)
+    {
+        E("failed allocating profiling counters: ma error $Ui", mae);
+        hc->ma_error = mae;
+        return (hc->hza_error = HZAE_ALLOC);
+    }
+    mem_account(hc->world, HZA_MEM_OTHER, sizeof(hza_prof_t), 0);
+    return 0;
+}
 
-    case HZAOC_RLT:
-        b = insn->b;
-        c = insn->c;
-    l_check_tgt:
-        if (b + c > proc->target_count)
+/* prof_free_locked *********************************************************/
+static hza_error_t C41_CALL prof_free_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_prof_t * pf = hc->args.prof.prof;
+    c41_ma_t * ma = &hc->world->mac.ma;
+    uint_t mae;
+
+    if (pf->branch_limit)
+    {
+        mae = c41_ma_free(ma, pf->branch_table,
+                          pf->branch_limit * sizeof(hza_prof_branch_t));
+        if (mae)
         {
-            E("I$.4d: bad target table ref (b = $XUw, c = $XUw)",
-              insn - proc->insn_table, b, c);
-            return -1;
+            F("failed freeing branch table: ma error $Ui", mae);
+            hc->ma_free_error = mae;
+            return (hc->hza_error = HZAF_FREE);
         }
-        break;
+        mem_account(hc->world, HZA_MEM_OTHER, 0,
+                    pf->branch_limit * sizeof(hza_prof_branch_t));
+    }
+    mae = c41_ma_free(ma, pf, sizeof(hza_prof_t));
+    if (mae)
+    {
+        F("failed freeing profiling counters: ma error $Ui", mae);
+        hc->ma_free_error = mae;
+        return (hc->hza_error = HZAF_FREE);
+    }
+    mem_account(hc->world, HZA_MEM_OTHER, 0, sizeof(hza_prof_t));
+    return 0;
+}
 
-    case HZAOC_RAA:
-        ps = 6;
-        goto l_check_c_reg;
+/* prof_grow_locked *********************************************************/
+static hza_error_t C41_CALL prof_grow_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_prof_t * pf = hc->args.prof.prof;
+    c41_ma_t * ma = &hc->world->mac.ma;
+    hza_prof_branch_t * nt;
+    hza_prof_branch_t * ob;
+    size_t limit, mask, j, h;
+    uint_t mae;
 
-    case HZAOC_RA5:
-        goto l_check_c5;
+    limit = pf->branch_limit ? pf->branch_limit * 2 : PROF_INIT_BRANCH_LIMIT;
+    nt = NULL;
+    mae = c41_ma_alloc_zero_fill(ma, (void * *) &nt,
+                                 limit * sizeof(hza_prof_branch_t));
+    if (mae)
+    {
+        E("failed allocating branch table of $z entries: ma error $Ui",
+          limit, mae);
+        hc->ma_error = mae;
+        return (hc->hza_error = HZAE_ALLOC);
+    }
+    mem_account(hc->world, HZA_MEM_OTHER,
+                limit * sizeof(hza_prof_branch_t), 0);
 
-    case HZAOC_RA6:
-        goto l_check_c6;
+    mask = limit - 1;
+    for (j = 0; j < pf->branch_limit; ++j)
+    {
+        ob = pf->branch_table + j;
+        if (!ob->insn) continue;
+        for (h = PROF_HASH(ob->insn, mask); nt[h].insn; h = (h + 1) & mask);
+        nt[h] = *ob;
+    }
 
-    default:
-        return -1;
+    if (pf->branch_limit)
+    {
+        mae = c41_ma_free(ma, pf->branch_table,
+                          pf->branch_limit * sizeof(hza_prof_branch_t));
+        if (mae)
+        {
+            F("failed freeing branch table: ma error $Ui", mae);
+            hc->ma_free_error = mae;
+            return (hc->hza_error = HZAF_FREE);
+        }
+        mem_account(hc->world, HZA_MEM_OTHER, 0,
+                    pf->branch_limit * sizeof(hza_prof_branch_t));
     }
+    pf->branch_table = nt;
+    pf->branch_limit = limit;
+    return 0;
+}
 
-    return rs;
+/* prof_branch_find *********************************************************/
+static hza_prof_branch_t * prof_branch_find
+(
+    hza_prof_t * pf,
+    hza_insn_t const * insn
+)
+{
+    hza_prof_branch_t * b;
+    size_t mask, h;
+
+    mask = pf->branch_limit - 1;
+    for (h = PROF_HASH(insn, mask);; h = (h + 1) & mask)
+    {
+        b = pf->branch_table + h;
+        if (b->insn == insn || !b->insn) return b;
+    }
 }
 
-/* last_insn_check **********************************************************/
-static int last_insn_check
+/* prof_branch_slot *********************************************************/
+static hza_prof_branch_t * prof_branch_slot
 (
-    hza_insn_t * insn
+    hza_context_t * hc,
+    hza_prof_t * pf,
+    hza_insn_t const * insn,
+    int locked
 )
 {
-    switch (HZA_OPCODE_CLASS(insn->opcode))
+    hza_prof_branch_t * b;
+    hza_error_t e;
+
+    for (;;)
     {
-    case HZAOC_NNN:
-        switch (HZA_OPCODE_FNSZ(insn->opcode))
+        if (pf->branch_limit)
         {
-        case HZA_OPCODE_FNSZ(HZAO_RET):
-        case HZA_OPCODE_FNSZ(HZAO_HALT):
-            return 0;
+            b = prof_branch_find(pf, insn);
+            if (b->insn) return b;
+            /* keep the load under 1/2 */
+            if ((pf->branch_count + 1) * 2 <= pf->branch_limit)
+            {
+                b->insn = insn;
+                pf->branch_count += 1;
+                return b;
+            }
         }
-        return 1;
-    case HZAOC_RNP:
-    case HZAOC_RRP:
-    case HZAOC_RCP:
-    case HZAOC_RRG:
-    case HZAOC_RCG:
-    case HZAOC_RLT:
-        return 0;
+        hc->args.prof.prof = pf;
+        e = locked ? prof_grow_locked(hc)
+            : run_locked(hc, prof_grow_locked, hc->world->world_mutex);
+        if (e) return NULL;
     }
-    return 1;
 }
 
-/* hza_export_by_name *******************************************************/
-HAZNA_API int32_t C41_CALL hza_export_by_name
+/* prof_branch **************************************************************/
+static void prof_branch
 (
-    hza_module_t * m,
-    uint8_t const * name,
-    size_t name_len
+    hza_context_t * hc,
+    hza_prof_t * pf,
+    hza_insn_t const * insn,
+    int not_taken
 )
 {
-    int32_t a, b, c;
-    uint32_t clen;
-    uint32_t n, pi;
-    int cmp;
-    for (a = 0, b = m->export_count - 1; a <= b; )
+    hza_prof_branch_t * b;
+
+    b = prof_branch_slot(hc, pf, insn, 0);
+    if (!b) pf->branch_lost += 1;
+    else if (not_taken) b->not_taken += 1;
+    else b->taken += 1;
+}
+
+/* prof_merge_locked ********************************************************/
+static hza_error_t C41_CALL prof_merge_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_prof_t * src = hc->prof;
+    hza_prof_t * dst;
+    hza_prof_branch_t * sb;
+    hza_prof_branch_t * db;
+    hza_error_t e;
+    size_t j;
+
+    if (!w->prof)
     {
-        c = (a + b) >> 1;
-        n = m->proc_table[pi = m->export_table[c]].name;
-        clen = m->data_block_start_table[n + 1] 
-            - m->data_block_start_table[n];
-        if (name_len == clen)
+        e = prof_alloc_locked(hc);
+        if (e) return e;
+        w->prof = hc->args.prof.prof;
+    }
+    dst = w->prof;
+
+    for (j = 0; j < 0x10000; ++j)
+        dst->opcode_count[j] += src->opcode_count[j];
+    C41_VAR_ZERO(src->opcode_count);
+
+    dst->branch_lost += src->branch_lost;
+    for (j = 0; j < src->branch_limit; ++j)
+    {
+        sb = src->branch_table + j;
+        if (!sb->insn) continue;
+        db = prof_branch_slot(hc, dst, sb->insn, 1);
+        if (db)
         {
-            cmp = c41_u8a_compare(name, 
-                                  m->data + m->data_block_start_table[n],
-                                  name_len);
-            if (!cmp) return pi;
+            db->taken += sb->taken;
+            db->not_taken += sb->not_taken;
         }
-        else cmp = name_len < clen ? -1 : +1;
-        if (cmp < 0) b = c - 1;
-        else a = c + 1;
+        else dst->branch_lost += sb->taken + sb->not_taken;
+        sb->insn = NULL;
+        sb->taken = 0;
+        sb->not_taken = 0;
     }
-    return -1;
+    src->branch_count = 0;
+    src->branch_lost = 0;
+
+    return 0;
 }
 
-/* task_alloc ***************************************************************/
-static hza_error_t C41_CALL task_alloc
+/* prof_disable_locked ******************************************************/
+static hza_error_t C41_CALL prof_disable_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_error_t e;
+
+    e = prof_merge_locked(hc);
+    if (e) return e;
+    hc->args.prof.prof = hc->prof;
+    e = prof_free_locked(hc);
+    if (e) return e;
+    hc->prof = NULL;
+    return 0;
+}
+
+/* prof_report_locked *******************************************************/
+static hza_error_t C41_CALL prof_report_locked
 (
     hza_context_t * hc
 )
 {
     hza_world_t * w = hc->world;
-    hza_task_t * t;
-    int mae, e;
+    hza_prof_t * pf = w->prof;
+    c41_io_t * io = hc->args.prof.io;
+    hza_prof_branch_t * b;
+    hza_module_t * m;
+    hza_proc_t * p;
+    hza_insn_t * i;
+    c41_np_t * np;
+    uint64_t class_count[0x20][8];
+    uint64_t total, n, pct;
+    uint_t o, c, z;
+    uint32_t px;
 
-    mae = c41_ma_alloc_zero_fill(&w->mac.ma, (void * *) &hc->args.task,
-                                 sizeof(hza_task_t));
-    if (mae)
+    if (!pf)
     {
-        E("failed allocating memory for new task (ma error $i)", mae);
-        hc->ma_error = mae;
-        return hc->hza_error = HZAE_ALLOC;
+        c41_io_fmt(io, "no profiling data\n");
+        return 0;
     }
-    t = hc->args.task;
 
-    t->reg_limit = INIT_REG_SIZE;
-    mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->reg_space,
-                               1, t->reg_limit, 0);
-    if (mae)
+    C41_VAR_ZERO(class_count);
+    for (total = 0, o = 0; o < 0x10000; ++o)
     {
-        E("failed allocating register space for new task (ma error $i)", mae);
-        hc->ma_error = mae;
-        goto l_free;
+        n = pf->opcode_count[o];
+        total += n;
+        class_count[HZA_OPCODE_CLASS(o)][HZA_OPCODE_PRI_SIZE(o)] += n;
     }
+    if (!total) total = 1;
 
-    t->frame_limit = INIT_FRAME_LIMIT;
-    mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->frame_table,
-                               sizeof(hza_frame_t), t->frame_limit, 0);
-    if (mae)
+    c41_io_fmt(io, "opcodes:\n");
+    for (o = 0; o < 0x10000; ++o)
     {
-        E("failed allocating frame table for new task (ma error $i)", mae);
-        hc->ma_error = mae;
-        goto l_free;
+        n = pf->opcode_count[o];
+        if (!n) continue;
+        pct = n * 10000 / total;
+        c41_io_fmt(io, "  $s ($.4XUw): $Uq ($Uq.$.2Uq%)\n",
+                   hza_opcode_name(o), o, n, pct / 100, pct % 100);
     }
 
-    t->module_limit = INIT_MODMAP_LIMIT;
-    mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->module_table,
-                               sizeof(hza_modmap_t), t->module_limit, 0);
-    if (mae)
+    c41_io_fmt(io, "classes:\n");
+    for (c = 0; c < 0x20; ++c)
+        for (z = 0; z < 8; ++z)
+        {
+            n = class_count[c][z];
+            if (!n) continue;
+            pct = n * 10000 / total;
+            c41_io_fmt(io, "  $s/$Ui: $Uq ($Uq.$.2Uq%)\n",
+                       opcode_class_name(c), 1 << z, n, pct / 100, pct % 100);
+        }
+
+    /* walk the code so that sites come out in module/proc/insn order */
+    c41_io_fmt(io, "branches:\n");
+    for (np = w->module_list.next; pf->branch_count && np != &w->module_list;
+         np = np->next)
     {
-        E("failed allocating module map table for new task (ma error $i)", mae);
-        hc->ma_error = mae;
-        goto l_free;
+        m = (void *) np;
+        for (px = 0; px < m->proc_count; ++px)
+        {
+            p = m->proc_table + px;
+            for (i = p->insn_table; i < p->insn_table + p->insn_count; ++i)
+            {
+                c = HZA_OPCODE_CLASS(i->opcode);
+                if (c != HZAOC_RNP && c != HZAOC_RRP && c != HZAOC_RCP)
+                    continue;
+                b = prof_branch_find(pf, i);
+                if (!b->insn) continue;
+                c41_io_fmt(io, "  M$.4Hd.P$.4Hd.I$.4Hd $s: taken $Uq, "
+                           "not taken $Uq\n", m->module_id, px,
+                           (uint32_t) (i - p->insn_table),
+                           hza_opcode_name(i->opcode),
+                           b->taken, b->not_taken);
+            }
+        }
     }
+    if (pf->branch_lost)
+        c41_io_fmt(io, "  (lost: $Uq)\n", pf->branch_lost);
 
     return 0;
-l_free:
-    e = task_free(hc);
+}
+
+/* prof_report_modules_locked ***********************************************/
+static hza_error_t C41_CALL prof_report_modules_locked
+(
+    hza_context_t * hc
+)
+{
+    return run_locked(hc, prof_report_locked, hc->world->world_mutex);
+}
+
+/* hza_prof_enable **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_prof_enable
+(
+    hza_context_t * hc
+)
+{
+#if HZA_PROFILE
+    hza_error_t e;
+
+    if (hc->prof) return 0;
+    e = run_locked(hc, prof_alloc_locked, hc->world->world_mutex);
     if (e) return e;
-    return hc->hza_error = HZAE_ALLOC;
+    hc->prof = hc->args.prof.prof;
+    return 0;
+#else
+    E("profiling is not supported by this build");
+    return (hc->hza_error = HZAE_NOT_SUPPORTED);
+#endif
 }
 
-/* task_free ****************************************************************/
-static hza_error_t C41_CALL task_free
+/* hza_prof_disable *********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_prof_disable
+(
+    hza_context_t * hc
+)
+{
+    if (!hc->prof) return 0;
+    return run_locked(hc, prof_disable_locked, hc->world->world_mutex);
+}
+
+/* hza_prof_merge ***********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_prof_merge
+(
+    hza_context_t * hc
+)
+{
+    if (!hc->prof) return 0;
+    return run_locked(hc, prof_merge_locked, hc->world->world_mutex);
+}
+
+/* hza_prof_report **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_prof_report
+(
+    hza_context_t * hc,
+    c41_io_t * io
+)
+{
+    hza_error_t e;
+
+    e = hza_prof_merge(hc);
+    if (e) return e;
+    hc->args.prof.io = io;
+    /* module mutex first: loading modules allocates under it */
+    return run_locked(hc, prof_report_modules_locked, hc->world->module_mutex);
+}
+
+/* stats_mem_locked *********************************************************/
+static hza_error_t C41_CALL stats_mem_locked
 (
     hza_context_t * hc
 )
 {
     hza_world_t * w = hc->world;
-    hza_task_t * t = hc->args.task;
-    int mae;
-
-    if (t->module_table)
-    {
-        mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->module_table,
-                                   sizeof(hza_modmap_t), 0, t->module_limit);
-        if (mae)
-        {
-            F("error freeing module map table for failed new task "
-              "(ma error $i)", mae);
-            hc->ma_free_error = mae;
-            return hc->hza_error = HZAF_FREE;
-        }
-    }
-
-    if (t->frame_table)
-    {
-        mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->frame_table,
-                                   sizeof(hza_frame_t), 0, t->frame_limit);
-        if (mae)
-        {
-            F("error freeing frame table for failed new task (ma error $i)",
-              mae);
-            hc->ma_free_error = mae;
-            return hc->hza_error = HZAF_FREE;
-        }
-    }
-
-    if (t->reg_space)
-    {
-        mae = c41_ma_realloc_array(&w->mac.ma, (void * *) &t->reg_space,
-                                   1, 0, t->reg_limit);
-        if (mae)
-        {
-            F("error freeing register space for failed new task (ma error $i)",
-              mae);
-            hc->ma_free_error = mae;
-            return hc->hza_error = HZAF_FREE;
-        }
-    }
+    hza_world_stats_t * s = hc->args.stats;
+    uint_t c;
 
-    mae = c41_ma_free(&w->mac.ma, t, sizeof(hza_task_t));
-    if (mae)
+    for (c = 0; c < HZA_MEM_CATEGORIES; ++c)
     {
-        F("error freeing failed new task (ma error $i)", mae);
-        hc->ma_free_error = mae;
-        return hc->hza_error = HZAF_FREE;
+        /* module and name memory is copied by stats_module_locked() */
+        if (c == HZA_MEM_MODULE || c == HZA_MEM_NAME) continue;
+        s->mem_live[c] = w->stats.mem_live[c];
+        s->mem_peak[c] = w->stats.mem_peak[c];
     }
+    s->mem_total = w->mac.total_size;
+    s->mem_total_peak = w->stats.mem_total_peak;
+    if (s->mem_total > s->mem_total_peak) s->mem_total_peak = s->mem_total;
+    s->mem_blocks = w->mac.count;
+    s->context_count = w->context_count;
+    s->lock[HZA_MUTEX_WORLD] = w->stats.lock[HZA_MUTEX_WORLD];
+    for (c = 0; c < HZA_NODE_LIMIT; ++c)
+        s->node_mem_live[c] = w->stats.node_mem_live[c];
+    s->migrate_count = w->stats.migrate_count;
+    s->migrate_bytes = w->stats.migrate_bytes;
     return 0;
 }
 
-/* task_init ****************************************************************/
-static hza_error_t C41_CALL task_init
+/* stats_task_locked ********************************************************/
+static hza_error_t C41_CALL stats_task_locked
 (
     hza_context_t * hc
 )
 {
     hza_world_t * w = hc->world;
-    hza_task_t * t = hc->args.task;
-
-    t->task_id = w->task_id_seed++;
-    t->owner = hc;
-    t->context_count = 1;
-    t->state = HZA_TASK_SUSPENDED;
-    C41_DLIST_APPEND(w->task_list[t->state], t, links);
+    uint_t ts;
 
-    t->module_table[0].anchor = 0;
-    t->module_table[0].module = w->core_module;
-    t->module_table[0].task = t;
-    t->module_count = 1;
+    for (ts = 0; ts < HZA_TASK_STATES; ++ts)
+        hc->args.stats->task_count[ts] = w->stats.task_count[ts];
+    hc->args.stats->lock[HZA_MUTEX_TASK] = w->stats.lock[HZA_MUTEX_TASK];
+    return 0;
+}
 
-    t->frame_table[0].proc = w->core_module->proc_table + 0;
-    t->frame_table[0].insn = w->core_module->proc_table[0].insn_table + 0;
-    t->frame_table[0].reg_base = 0;
+/* stats_module_locked ******************************************************/
+static hza_error_t C41_CALL stats_module_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
 
-    c41_dlist_init(&t->context_wait_queue);
+    hc->args.stats->module_count = w->stats.module_count;
+    hc->args.stats->mem_live[HZA_MEM_MODULE] =
+        w->stats.mem_live[HZA_MEM_MODULE];
+    hc->args.stats->mem_peak[HZA_MEM_MODULE] =
+        w->stats.mem_peak[HZA_MEM_MODULE];
+    hc->args.stats->mem_live[HZA_MEM_NAME] = w->stats.mem_live[HZA_MEM_NAME];
+    hc->args.stats->mem_peak[HZA_MEM_NAME] = w->stats.mem_peak[HZA_MEM_NAME];
+    hc->args.stats->lock[HZA_MUTEX_MODULE] = w->stats.lock[HZA_MUTEX_MODULE];
+    return 0;
+}
 
-    hc->active_task = t;
+/* stats_log_locked *********************************************************/
+static hza_error_t C41_CALL stats_log_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
 
+    hc->args.stats->lock[HZA_MUTEX_LOG] = w->stats.lock[HZA_MUTEX_LOG];
     return 0;
 }
 
-/* hza_task_create **********************************************************/
-HAZNA_API hza_error_t C41_CALL hza_task_create
+/* hza_world_stats **********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_world_stats
 (
     hza_context_t * hc,
-    hza_task_t * * tp
+    hza_world_stats_t * stats
 )
 {
     hza_world_t * w = hc->world;
-    hza_task_t * t;
     hza_error_t e;
 
-    e = run_locked(hc, task_alloc, w->world_mutex);
-    if (e)
-    {
-        E("failed allocating memory for a new task ($s = $i)",
-          hza_error_name(e), e);
-        return e;
-    }
-    e = run_locked(hc, task_init, w->task_mutex);
-    if (e)
-    {
-        E("failed initing new task ($s = $i)", hza_error_name(e), e);
-        if (e >= HZA_FATAL) return e;
-        return e;
-    }
-
-    *tp = t = hc->args.task;
-    D("task t$.4Hd created ($G4Xp)", t->task_id, t);
+    hc->args.stats = stats;
+    e = run_locked(hc, stats_mem_locked, w->world_mutex);
+    if (!e) e = run_locked(hc, stats_task_locked, w->task_mutex);
+    if (!e) e = run_locked(hc, stats_module_locked, w->module_mutex);
+    if (!e) e = run_locked(hc, stats_log_locked, w->log_mutex);
+    return e;
+}
 
+/* hza_proc_hook ************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_proc_hook
+(
+    hza_context_t * hc,
+    hza_proc_hook_f hook,
+    void * ctx
+)
+{
+    hc->proc_hook = hook;
+    hc->proc_hook_ctx = ctx;
     return 0;
 }
 
-/* hza_enter ****************************************************************/
-HAZNA_API hza_error_t C41_CALL hza_enter
+/* hza_proc_label ***********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_proc_label
 (
     hza_context_t * hc,
-    uint32_t module_index,
-    uint32_t proc_index,
-    uint16_t reg_shift
+    hza_frame_t const * f,
+    char * buf,
+    size_t size
 )
 {
-    hza_task_t * t = hc->active_task;
-    hza_module_t * m;
-    hza_proc_t * p;
-    hza_error_t e;
-    uint_t fx;
-    uint32_t reg_base, reg_limit;
-
-    DEBUG_CHECK(t);
-    DEBUG_CHECK(module_index < t->module_count);
-    m = t->module_table[module_index].module;
-    DEBUG_CHECK(proc_index < m->proc_count);
-    p = &m->proc_table[proc_index];
-    reg_base = t->frame_table[t->frame_index].reg_base + (reg_shift >> 3);
+    hc->args.label.frame = f;
+    hc->args.label.buf = buf;
+    hc->args.label.size = size;
+    return run_locked(hc, proc_label_locked, hc->world->module_mutex);
+}
 
-    reg_limit = reg_base + p->reg_size;
+/* host_register_locked *****************************************************/
+static hza_error_t C41_CALL host_register_locked
+(
+    hza_context_t * hc
+)
+{
+    hza_world_t * w = hc->world;
+    hza_host_t * hh;
 
-    if (reg_limit > t->reg_limit)
+    if (w->context_count != 1)
     {
-        // extend reg space
-        uint_t new_reg_limit;
-
-        if (reg_limit > MAX_REG_LIMIT)
-        {
-            E("t$.4Hd reached its reg space limit! enter proc failed!",
-              t->task_id);
-            return (hc->hza_error = HZAE_REG_LIMIT);
-        }
-
-        for (new_reg_limit = t->reg_limit;
-             new_reg_limit < reg_limit;
-             new_reg_limit <<= 1);
-        e = safe_realloc_table(hc, t->reg_space, 1,
-                               new_reg_limit, t->reg_limit);
-        if (e)
-        {
-            E("failed reallocating reg space in task t$H.4d to $Ui bytes",
-              t->task_id, new_reg_limit);
-            return e;
-        }
-        t->reg_space = hc->args.realloc.ptr;
-        t->reg_limit = new_reg_limit;
-        D("reallocated reg space for t$.4Hd to $.1Xd bytes", t->task_id,
-          new_reg_limit);
+        E("cannot register host functions with $Ui contexts attached",
+          w->context_count);
+        return hc->hza_error = HZAE_STATE;
     }
-
-    fx = t->frame_index + 1;
-    if (fx == t->frame_limit)
+    if (w->host_count == HZA_HOST_LIMIT)
     {
-        // extend frame table
-        if (fx > MAX_FRAME_LIMIT)
-        {
-            E("t$H.4d reached its limit of frames! enter proc failed!",
-              t->task_id);
-            return hc->hza_error = HZAE_STACK_LIMIT;
-        }
-
-        e = safe_realloc_table(hc, t->frame_table, sizeof(hza_frame_t),
-                               fx << 1, fx);
-        if (e)
-        {
-            E("failed reallocating frame table in task t$H.4d to $Ui items",
-              t->task_id, fx << 1);
-            return e;
-        }
-
-        t->frame_table = hc->args.realloc.ptr;
-        t->frame_limit = fx << 1;
-        D("reallocated frame table for t$.4Hd to $Ui items", t->task_id,
-          t->frame_limit);
+        E("no room for another host function ($Ui registered)",
+          w->host_count);
+        return hc->hza_error = HZAE_HOST_LIMIT;
     }
-    t->frame_table[fx].proc = p;
-    t->frame_table[fx].insn = p->insn_table;
-    t->frame_table[fx].module_index = module_index;
-    t->frame_table[fx].reg_base = reg_base;
-    t->frame_index = fx;
-
+    hh = w->host_table + w->host_count;
+    hh->func = hc->args.host.func;
+    hh->ctx = hc->args.host.ctx;
+    hh->window = hc->args.host.window;
+    hc->args.host.index = w->host_count++;
     return 0;
 }
 
-/* hza_run ******************************************************************/
-HAZNA_API hza_error_t C41_CALL hza_run
+/* hza_host_register ********************************************************/
+HAZNA_API hza_error_t C41_CALL hza_host_register
 (
     hza_context_t * hc,
-    uint_t frame_stop,
-    uint_t iter_limit
+    hza_host_f func,
+    void * ctx,
+    uint_t window_size,
+    uint32_t * index
 )
 {
-    hza_world_t * w = hc->world;
-    hza_task_t * t;
-    hza_proc_t * p;
-    hza_insn_t * i;
-    hza_insn_t * li;
-    hza_frame_t * f;
-    uint8_t * r;
-    uint32_t fx, reg_base;
-    uint_t iter_count;
-    uint_t target_index;
-
-#define UPDATE_ITER_COUNT() (iter_count += i - li)
-#define CHECK_ITER_COUNT() if (UPDATE_ITER_COUNT() >= iter_limit) goto l_done
-#define VU8(_bit_ofs) (*(uint8_t *) (r + ((_bit_ofs) >> 3)))
-#define VU16(_bit_ofs) (*(uint16_t *) (r + ((_bit_ofs) >> 3)))
-
-    t = hc->active_task;
-    DEBUG_CHECK(t);
-
-    fx = t->frame_index;
-    if (fx <= frame_stop) { hc->args.iter_count = 0; return 0; }
-    f = t->frame_table + fx;
-    p = f->proc;
-    li = i = f->insn;
-    reg_base = f->reg_base;
-    r = t->reg_space + reg_base;
-
-    (void) iter_limit;
-    (void) p;
-    for (iter_count = 0;;)
-    {
-        D("t$.4Hd M$.4Hd.P$.4Hd.I$.4Hd: $s ($XUw) $XUw $XUw $XUw",
-          t->task_id, f->module_index,
-          p - t->module_table[f->module_index].module->proc_table,
-          i - p->insn_table,
-          hza_opcode_name(i->opcode), i->opcode, i->a, i->b, i->c);
-        switch (i->opcode)
-        {
-        case HZAO_NOP:
-            break;
-        case HZAO_RET:
-            UPDATE_ITER_COUNT();
-            if (--fx == frame_stop)
-            {
-                t->frame_index = fx;
-                goto l_done;
-            }
-            --f;
-            li = i = f->insn;
-            reg_base = f->reg_base;
-            r = t->reg_space + reg_base;
-            if (iter_count >= iter_limit) goto l_done;
-            break;
-        case HZAO_INIT_8:
-            VU8(i->a) = i->b;
-            break;
-        case HZAO_INIT_16:
-            VU16(i->a) = i->b;
-            break;
-        case HZAO_DEBUG_OUT_16:
-            D("DEBUG_OUT: $c", VU16(i->a));
-            if (w->log_level == HZA_LL_INFO && w->log_io)
-            {
-                c41_io_fmt(w->log_io, "$c", VU16(i->a));
-            }
-            break;
-        case HZAO_WRAP_ADD_CONST_8:
-            VU8(i->a) = VU8(i->b) + i->c;
-            D("wrap add: $Xb", VU8(i->a));
-            break;
-        case HZAO_BRANCH_ZERO_8:
-            // D("tgt_idx");
-            // UPDATE_ITER_COUNT();
-            // D("iter_count: $Xi", iter_count);
-            if (iter_count >= iter_limit) goto l_done;
-            CHECK_ITER_COUNT();
-            target_index = i->c + (VU8(i->a) ? 1 : 0);
-            D("tgt_idx: $i => $Xd", target_index, p->target_table[target_index]);
-            i = p->insn_table + p->target_table[target_index];
-            continue;
-        default:
-            F("opcode $s ($XUw) is not implemented!",
-              hza_opcode_name(i->opcode), i->opcode);
-            return hc->hza_error = HZAF_NO_CODE;
-        }
-        i++;
-    }
-l_done:
-    hc->args.iter_count = iter_count;
+    hza_error_t e;
 
+    hc->args.host.func = func;
+    hc->args.host.ctx = ctx;
+    hc->args.host.window = window_size;
+    e = run_locked(hc, host_register_locked, hc->world->world_mutex);
+    if (e) return e;
+    *index = hc->args.host.index;
     return 0;
-#undef UPDATE_ITER_COUNT
 }
 
+/* hza_lock_stats_enable ****************************************************/
+HAZNA_API hza_error_t C41_CALL hza_lock_stats_enable
+(
+    hza_context_t * hc,
+    hza_clock_f clock
+)
+{
+    hc->args.clock = clock;
+    return run_locked(hc, lock_stats_enable_locked, hc->world->world_mutex);
+}
@@ -0,0 +1,1462 @@
+#include <stdlib.h>
+#include "cli.h"
+
+#define CORPUS_TRIALS           5
+#define CORPUS_MAX_TRIALS       0x40
+#define CORPUS_INPUT_SIZE       0x100000 /* generated input per workload */
+#define CORPUS_OUT_SIZE         0x10000 /* output channel */
+#define CORPUS_ITER_LIMIT       0x10000000
+#define CORPUS_ENTRY            "bsp"
+
+#define HEX_LINE                30 /* input bytes per hexdump line */
+#define FOLD_WIDTH              72
+#define B64_LINE                76
+
+#define LABEL_NONE              0xFFFFFFFF
+
+/* registers (byte index) used by all programs */
+#define RZ                      0 /* always 0; jumps branch on it */
+#define RO                      1 /* constant output bytes */
+#define RX                      2 /* input byte */
+#define B(_reg, _bit)           ((uint16_t) ((_reg) * 8 + (_bit)))
+
+typedef struct asm_s                            asm_t;
+typedef struct asm_char_s                       asm_char_t;
+typedef struct corpus_s                         corpus_t;
+typedef struct corpus_ctx_s                     corpus_ctx_t;
+
+/* emits the code for one leaf of a bit decision tree */
+typedef void (* asm_leaf_f) (asm_t * a, void * ctx, uint_t value);
+
+/* fills the input buffer, returns the used size */
+typedef size_t (* corpus_input_f) (uint8_t * data, size_t size,
+                                   uint64_t seed);
+
+/* asm_t ********************************************************************/
+/**
+ *  Single proc assembler: branch targets are label ids until the module is
+ *  built. Failures are sticky and reported by asm_module().
+ */
+struct asm_s
+{
+    c41_ma_t * ma;
+    uint16_t * insn; // 4 words per insn
+    uint32_t * target;
+    uint32_t * label; // insn index, LABEL_NONE while unbound
+    uint32_t insn_count, insn_limit;
+    uint32_t target_count, target_limit;
+    uint32_t label_count, label_limit;
+    int fail;
+};
+
+/* leaf that outputs table[(value << shift) ^ flip] then jumps to next */
+struct asm_char_s
+{
+    char const * table;
+    uint_t shift;
+    uint_t flip;
+    uint32_t next;
+};
+
+struct corpus_s
+{
+    char const * name;
+    void (* build) (asm_t * a);
+    corpus_input_f input;
+    uint64_t seed;
+    uint64_t out_size; // expected output for CORPUS_INPUT_SIZE input
+    uint64_t out_hash; // FNV-1a 64 of the expected output
+};
+
+struct corpus_ctx_s
+{
+    c41_io_t * out;
+    c41_io_t * log;
+    c41_ma_t * ma;
+    hza_context_t hcd;
+    uint8_t * in_buf;
+    size_t in_size;
+    uint8_t * out_buf;
+    uint8_t * mod_buf;
+    size_t mod_size;
+    uint_t trials;
+    char json;
+};
+
+static void build_hexdump (asm_t * a);
+static void build_b64_encode (asm_t * a);
+static void build_b64_decode (asm_t * a);
+static void build_crc32 (asm_t * a);
+static void build_rle (asm_t * a);
+static void build_utf8 (asm_t * a);
+static void build_fold (asm_t * a);
+static void build_upper (asm_t * a);
+static void build_upper_lanes (asm_t * a);
+static size_t text_input (uint8_t * data, size_t size, uint64_t seed);
+static size_t bytes_input (uint8_t * data, size_t size, uint64_t seed);
+static size_t b64_input (uint8_t * data, size_t size, uint64_t seed);
+static size_t runs_input (uint8_t * data, size_t size, uint64_t seed);
+static size_t utf8_input (uint8_t * data, size_t size, uint64_t seed);
+
+static corpus_t const corpus_table[] =
+{
+    { "hexdump", build_hexdump, text_input, 1,
+        0x208889, 0x74EE6CC246E1DC70ULL },
+    { "base64_encode", build_b64_encode, bytes_input, 2,
+        0x155558, 0x3EB9AFB1CE0901A1ULL },
+    { "base64_decode", build_b64_decode, b64_input, 3,
+        0xBD7E8, 0xEE998882A125A8DEULL },
+    { "crc32", build_crc32, bytes_input, 4,
+        0x9, 0x2157BE6ECA7A4BA1ULL },
+    { "rle", build_rle, runs_input, 5,
+        0x77AC, 0x9A450D01B3E473DFULL },
+    { "utf8_validate", build_utf8, utf8_input, 6,
+        0xFE020, 0x12BE754BEFE5614FULL },
+    { "fold", build_fold, text_input, 7,
+        0x10206E, 0x73CA5A26CFF4BF2CULL },
+    { "upper", build_upper, text_input, 8,
+        0x100000, 0xDFC1EC6EDBDB77ABULL },
+    { "upper.lanes", build_upper_lanes, text_input, 8,
+        0x100000, 0xDFC1EC6EDBDB77ABULL },
+};
+
+static char const hex_digits[] = "0123456789abcdef";
+static char const b64_digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* asm_grow *****************************************************************/
+static int asm_grow (asm_t * a, void * * p, size_t item_size,
+                     uint32_t * limit)
+{
+    uint32_t n = *limit ? *limit * 2 : 0x100;
+
+    if (a->fail) return -1;
+    if (c41_ma_realloc_array(a->ma, p, item_size, n, *limit))
+    {
+        a->fail = 1;
+        return -1;
+    }
+    *limit = n;
+    return 0;
+}
+
+/* asm_label ****************************************************************/
+/* creates an unbound label */
+static uint32_t asm_label (asm_t * a)
+{
+    if (a->label_count == a->label_limit
+        && asm_grow(a, (void * *) &a->label, 4, &a->label_limit))
+        return 0;
+    a->label[a->label_count] = LABEL_NONE;
+    return a->label_count++;
+}
+
+/* asm_bind *****************************************************************/
+/* binds the label to the next insn */
+static void asm_bind (asm_t * a, uint32_t l)
+{
+    if (!a->fail) a->label[l] = a->insn_count;
+}
+
+/* asm_insn *****************************************************************/
+static void asm_insn (asm_t * a, uint16_t opcode, uint16_t x, uint16_t y,
+                      uint16_t z)
+{
+    uint16_t * w;
+
+    if (a->insn_count == a->insn_limit
+        && asm_grow(a, (void * *) &a->insn, 8, &a->insn_limit))
+        return;
+    w = a->insn + a->insn_count++ * 4;
+    w[0] = opcode; w[1] = x; w[2] = y; w[3] = z;
+}
+
+/* asm_branch ***************************************************************/
+/* emits a RNP insn with the targets of its 2 outcomes */
+static void asm_branch (asm_t * a, uint16_t opcode, uint16_t reg,
+                        uint32_t l0, uint32_t l1)
+{
+    if (a->target_count + 2 > a->target_limit
+        && asm_grow(a, (void * *) &a->target, 4, &a->target_limit))
+        return;
+    if (a->target_count > 0xFFFE)
+    {
+        a->fail = 1;
+        return;
+    }
+    asm_insn(a, opcode, reg, 0, (uint16_t) a->target_count);
+    a->target[a->target_count++] = l0;
+    a->target[a->target_count++] = l1;
+}
+
+/* asm_bit ******************************************************************/
+/* branches to l0 if the bit is clear, to l1 if set */
+static void asm_bit (asm_t * a, uint_t reg, uint_t bit, uint32_t l0,
+                     uint32_t l1)
+{
+    asm_branch(a, HZAO_BRANCH_ZERO_1, B(reg, bit), l0, l1);
+}
+
+/* asm_jump *****************************************************************/
+static void asm_jump (asm_t * a, uint32_t l)
+{
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RZ, 0), l, l);
+}
+
+/* asm_out_char *************************************************************/
+static void asm_out_char (asm_t * a, uint8_t ch)
+{
+    asm_insn(a, HZAO_INIT_8, B(RO, 0), ch, 0);
+    asm_insn(a, HZAO_OUT_8, B(RO, 0), 0, 0);
+}
+
+/* asm_tree *****************************************************************/
+/**
+ *  Emits a decision tree over n bits (bit offsets, most significant first)
+ *  and calls leaf() for each of the 2^n values.
+ */
+static void asm_tree (asm_t * a, uint16_t const * bits, uint_t n,
+                      uint_t value, asm_leaf_f leaf, void * ctx)
+{
+    uint32_t l0, l1;
+
+    if (!n)
+    {
+        leaf(a, ctx, value);
+        return;
+    }
+    l0 = asm_label(a);
+    l1 = asm_label(a);
+    asm_branch(a, HZAO_BRANCH_ZERO_1, bits[0], l0, l1);
+    asm_bind(a, l0);
+    asm_tree(a, bits + 1, n - 1, value << 1, leaf, ctx);
+    asm_bind(a, l1);
+    asm_tree(a, bits + 1, n - 1, (value << 1) | 1, leaf, ctx);
+}
+
+/* leaf_char ****************************************************************/
+static void leaf_char (asm_t * a, void * ctx, uint_t value)
+{
+    asm_char_t * c = ctx;
+
+    asm_out_char(a, (uint8_t) c->table[(value << c->shift) ^ c->flip]);
+    asm_jump(a, c->next);
+}
+
+/* asm_equal ****************************************************************/
+/* jumps to leq if the byte regs are equal, to lne otherwise */
+static void asm_equal (asm_t * a, uint_t p, uint_t q, uint32_t leq,
+                       uint32_t lne)
+{
+    uint32_t l0, l1, ln;
+    uint_t k;
+
+    for (k = 0; k < 8; ++k)
+    {
+        l0 = asm_label(a);
+        l1 = asm_label(a);
+        ln = asm_label(a);
+        asm_bit(a, p, k, l0, l1);
+        asm_bind(a, l0);
+        asm_bit(a, q, k, ln, lne);
+        asm_bind(a, l1);
+        asm_bit(a, q, k, lne, ln);
+        asm_bind(a, ln);
+    }
+    asm_jump(a, leq);
+}
+
+/* asm_module ***************************************************************/
+/**
+ *  Resolves the labels and writes a mod00 module with the code as its only
+ *  proc, exported as CORPUS_ENTRY. Returns 0 or -1 (bad program or no
+ *  memory).
+ */
+static int asm_module (asm_t * a, uint8_t * * data, size_t * size)
+{
+    uint8_t * p;
+    uint8_t * pt;
+    uint32_t i, l, n;
+
+    for (i = 0; !a->fail && i < a->target_count; ++i)
+    {
+        l = a->target[i];
+        if (l >= a->label_count || a->label[l] == LABEL_NONE) a->fail = 1;
+        else a->target[i] = a->label[l];
+    }
+    if (a->fail) return -1;
+
+    n = sizeof(hza_mod00_hdr_t) + 2 * sizeof(hza_mod00_proc_t) + 3 * 4
+        + sizeof(hza_mod00_impmod_t) + 4 + a->target_count * 4
+        + a->insn_count * 8 + sizeof(CORPUS_ENTRY) - 1;
+    if (c41_ma_alloc(a->ma, (void * *) data, n)) return -1;
+    *size = n;
+    p = *data;
+
+    C41_MEM_COPY(p, HZA_MOD00_MAGIC, HZA_MOD00_MAGIC_LEN);
+    c41_write_u32be(p + 0x08, n);
+    for (i = 0x0C; i < 0x20; i += 4) c41_write_u32be(p + i, 0);
+    c41_write_u32be(p + 0x20, 1); // proc_count
+    c41_write_u32be(p + 0x24, 2); // data_block_count
+    c41_write_u32be(p + 0x28, 0); // import_module_count
+    c41_write_u32be(p + 0x2C, 0); // import_count
+    c41_write_u32be(p + 0x30, 1); // export_count
+    c41_write_u32be(p + 0x34, a->target_count);
+    c41_write_u32be(p + 0x38, a->insn_count);
+    c41_write_u32be(p + 0x3C, sizeof(CORPUS_ENTRY) - 1);
+    p += sizeof(hza_mod00_hdr_t);
+
+    /* proc 0 named by block 1, then the end of the proc table */
+    pt = p;
+    for (i = 0; i < 12; ++i) c41_write_u32be(pt + i * 4, 0);
+    c41_write_u32be(pt + 0x14, 1);
+    c41_write_u32be(pt + 0x18, a->insn_count);
+    c41_write_u32be(pt + 0x1C, a->target_count);
+    p += 2 * sizeof(hza_mod00_proc_t);
+
+    /* data blocks: empty block 0, the entry name */
+    c41_write_u32be(p, 0);
+    c41_write_u32be(p + 4, 0);
+    c41_write_u32be(p + 8, sizeof(CORPUS_ENTRY) - 1);
+    p += 12;
+    c41_write_u32be(p, 0); // import module table terminator
+    c41_write_u32be(p + 4, 0);
+    p += sizeof(hza_mod00_impmod_t);
+    c41_write_u32be(p, 0); // export proc 0
+    p += 4;
+
+    for (i = 0; i < a->target_count; ++i, p += 4)
+        c41_write_u32be(p, a->target[i]);
+    for (i = 0; i < a->insn_count * 4; ++i, p += 2)
+        c41_write_u16be(p, a->insn[i]);
+    C41_MEM_COPY(p, CORPUS_ENTRY, sizeof(CORPUS_ENTRY) - 1);
+
+    c41_write_u32be(*data + HZA_MOD00_CHECKSUM_OFS,
+                    hza_mod00_checksum(*data, n));
+    return 0;
+}
+
+/* asm_free *****************************************************************/
+static void asm_free (asm_t * a)
+{
+    if (a->insn) c41_ma_free(a->ma, a->insn, a->insn_limit * 8);
+    if (a->target) c41_ma_free(a->ma, a->target, a->target_limit * 4);
+    if (a->label) c41_ma_free(a->ma, a->label, a->label_limit * 4);
+}
+
+/* build_hexdump ************************************************************/
+/* like xxd -p: 2 lowercase hex digits per byte, HEX_LINE bytes per line */
+static void build_hexdump (asm_t * a)
+{
+    enum { RC = 3, RT = 4 }; /* RC counts up to 0 at the end of a line */
+    uint16_t hi[4], lo[4];
+    asm_char_t ch;
+    uint32_t loop, ok, low, cnt, nl, eof, last, done;
+    uint_t k;
+
+    for (k = 0; k < 4; ++k)
+    {
+        hi[k] = B(RX, 7 - k);
+        lo[k] = B(RX, 3 - k);
+    }
+    loop = asm_label(a); ok = asm_label(a); low = asm_label(a);
+    cnt = asm_label(a); nl = asm_label(a); eof = asm_label(a);
+    last = asm_label(a); done = asm_label(a);
+
+    asm_insn(a, HZAO_INIT_8, B(RC, 0), 0x100 - HEX_LINE, 0);
+    asm_bind(a, loop);
+    asm_branch(a, HZAO_IN_8, B(RX, 0), ok, eof);
+    asm_bind(a, ok);
+    ch.table = hex_digits;
+    ch.shift = ch.flip = 0;
+    ch.next = low;
+    asm_tree(a, hi, 4, 0, leaf_char, &ch);
+    asm_bind(a, low);
+    ch.next = cnt;
+    asm_tree(a, lo, 4, 0, leaf_char, &ch);
+    asm_bind(a, cnt);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RC, 0), B(RC, 0), 1);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RC, 0), nl, loop);
+    asm_bind(a, nl);
+    asm_out_char(a, '\n');
+    asm_insn(a, HZAO_INIT_8, B(RC, 0), 0x100 - HEX_LINE, 0);
+    asm_jump(a, loop);
+
+    /* a partial line also ends with a newline */
+    asm_bind(a, eof);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RT, 0), B(RC, 0), HEX_LINE);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RT, 0), done, last);
+    asm_bind(a, last);
+    asm_out_char(a, '\n');
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* build_b64_encode *********************************************************/
+/* base64 with '=' padding, no line breaks */
+static void build_b64_encode (asm_t * a)
+{
+    enum { RA = RX, RB = 3, RC = 4 };
+    uint16_t bits[24];
+    asm_char_t ch;
+    uint32_t l[10];
+    uint_t k;
+
+    /* the 3 input bytes as one 24-bit big endian number */
+    for (k = 0; k < 8; ++k)
+    {
+        bits[k] = B(RA, 7 - k);
+        bits[8 + k] = B(RB, 7 - k);
+        bits[16 + k] = B(RC, 7 - k);
+    }
+    for (k = 0; k < 10; ++k) l[k] = asm_label(a);
+    ch.table = b64_digits;
+    ch.shift = ch.flip = 0;
+
+    /* l0: loop, l1/l2/l9: got 1/2/3 bytes, l3..l5: digits 2..4,
+     * l6: 1-byte tail, l7: 2-byte tail, l8: done */
+    asm_bind(a, l[0]);
+    asm_branch(a, HZAO_IN_8, B(RA, 0), l[1], l[8]);
+    asm_bind(a, l[1]);
+    asm_branch(a, HZAO_IN_8, B(RB, 0), l[2], l[6]);
+    asm_bind(a, l[2]);
+    asm_branch(a, HZAO_IN_8, B(RC, 0), l[9], l[7]);
+    asm_bind(a, l[9]);
+    for (k = 0; k < 4; ++k)
+    {
+        ch.next = k < 3 ? l[3 + k] : l[0];
+        asm_tree(a, bits + k * 6, 6, 0, leaf_char, &ch);
+        if (k < 3) asm_bind(a, l[3 + k]);
+    }
+
+    asm_bind(a, l[6]);
+    ch.next = asm_label(a);
+    asm_tree(a, bits, 6, 0, leaf_char, &ch);
+    asm_bind(a, ch.next);
+    ch.next = asm_label(a);
+    ch.shift = 4;
+    asm_tree(a, bits + 6, 2, 0, leaf_char, &ch);
+    asm_bind(a, ch.next);
+    asm_out_char(a, '=');
+    asm_out_char(a, '=');
+    asm_jump(a, l[8]);
+
+    asm_bind(a, l[7]);
+    ch.next = asm_label(a);
+    ch.shift = 0;
+    asm_tree(a, bits, 6, 0, leaf_char, &ch);
+    asm_bind(a, ch.next);
+    ch.next = asm_label(a);
+    asm_tree(a, bits + 6, 6, 0, leaf_char, &ch);
+    asm_bind(a, ch.next);
+    ch.next = asm_label(a);
+    ch.shift = 2;
+    asm_tree(a, bits + 12, 4, 0, leaf_char, &ch);
+    asm_bind(a, ch.next);
+    asm_out_char(a, '=');
+
+    asm_bind(a, l[8]);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* b64_leaf *****************************************************************/
+/**
+ *  Leaf of the base64 decoder for input char 'value' in sextet position
+ *  stage[0]; stage[1..4] are the labels of the 4 positions and stage[5..8]
+ *  the labels for the end of input ('=' or eof) at each position.
+ *  Other chars (line breaks) are skipped.
+ */
+static void b64_leaf (asm_t * a, void * ctx, uint_t value)
+{
+    enum { R1 = 3, R2 = 4, R3 = 5 };
+    uint32_t * stage = ctx;
+    uint_t k = stage[0];
+    uint8_t s;
+
+    if (value == '=')
+    {
+        asm_jump(a, stage[5 + k]);
+        return;
+    }
+    for (s = 0; s < 64 && (uint8_t) b64_digits[s] != value; ++s);
+    if (s == 64)
+    {
+        asm_jump(a, stage[1 + k]);
+        return;
+    }
+    switch (k)
+    {
+    case 0:
+        asm_insn(a, HZAO_INIT_8, B(R1, 0), (uint8_t) (s << 2), 0);
+        break;
+    case 1:
+        if (s >> 4)
+            asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(R1, 0), B(R1, 0), s >> 4);
+        asm_insn(a, HZAO_INIT_8, B(R2, 0), (uint8_t) (s << 4), 0);
+        break;
+    case 2:
+        if (s >> 2)
+            asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(R2, 0), B(R2, 0), s >> 2);
+        asm_insn(a, HZAO_INIT_8, B(R3, 0), (uint8_t) (s << 6), 0);
+        break;
+    default:
+        if (s) asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(R3, 0), B(R3, 0), s);
+        asm_insn(a, HZAO_OUT_8, B(R1, 0), 0, 0);
+        asm_insn(a, HZAO_OUT_8, B(R2, 0), 0, 0);
+        asm_insn(a, HZAO_OUT_8, B(R3, 0), 0, 0);
+    }
+    asm_jump(a, stage[1 + ((k + 1) & 3)]);
+}
+
+/* build_b64_decode *********************************************************/
+/**
+ *  base64 decoder: skips chars outside the alphabet; the rest of the input
+ *  after '=' is read and ignored.
+ */
+static void build_b64_decode (asm_t * a)
+{
+    enum { R1 = 3, R2 = 4 };
+    uint16_t bits[8];
+    uint32_t stage[9];
+    uint32_t ok, drain, done;
+    uint_t k;
+
+    for (k = 0; k < 8; ++k) bits[k] = B(RX, 7 - k);
+    for (k = 1; k < 9; ++k) stage[k] = asm_label(a);
+    for (k = 0; k < 4; ++k)
+    {
+        ok = asm_label(a);
+        asm_bind(a, stage[1 + k]);
+        asm_branch(a, HZAO_IN_8, B(RX, 0), ok, stage[5 + k]);
+        asm_bind(a, ok);
+        stage[0] = k;
+        asm_tree(a, bits, 8, 0, b64_leaf, stage);
+    }
+    /* flush the bytes completed before the end */
+    asm_bind(a, stage[8]);
+    asm_insn(a, HZAO_OUT_8, B(R1, 0), 0, 0);
+    asm_insn(a, HZAO_OUT_8, B(R2, 0), 0, 0);
+    asm_jump(a, stage[5]);
+    asm_bind(a, stage[7]);
+    asm_insn(a, HZAO_OUT_8, B(R1, 0), 0, 0);
+    asm_bind(a, stage[5]);
+    asm_bind(a, stage[6]);
+    drain = asm_label(a);
+    done = asm_label(a);
+    asm_bind(a, drain);
+    asm_branch(a, HZAO_IN_8, B(RX, 0), drain, done);
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* crc32 ********************************************************************/
+/**
+ *  The crc (IEEE, reflected) is kept as 32 byte regs holding one bit each
+ *  in their bit 0, in a ring: crc bit k is in reg CRC_REG + (base + k) % 32.
+ *  Each input byte is xor-ed in by adding 1 to the regs of its set bits,
+ *  the low 8 crc bits select a leaf which applies the table value and the
+ *  shift by 8 is done by moving the base, so the loop is unrolled 4 times.
+ */
+#define CRC_REG                 8
+#define CRC_BIT(_base, _k)      (CRC_REG + ((_base) + (_k)) % 32)
+
+typedef struct crc_leaf_s
+{
+    uint32_t table[0x100];
+    uint_t base;
+    uint32_t next;
+} crc_leaf_t;
+
+/* crc_leaf *****************************************************************/
+static void crc_leaf (asm_t * a, void * ctx, uint_t value)
+{
+    crc_leaf_t * c = ctx;
+    uint32_t t = c->table[value];
+    uint_t k;
+
+    /* the 8 regs shifted out become crc bits 24..31 */
+    for (k = 0; k < 8; ++k)
+        asm_insn(a, HZAO_INIT_8, B(CRC_BIT(c->base, k), 0),
+                 (t >> (24 + k)) & 1, 0);
+    for (k = 0; k < 24; ++k)
+        if ((t >> k) & 1)
+            asm_insn(a, HZAO_WRAP_ADD_CONST_8,
+                     B(CRC_BIT(c->base + 8, k), 0),
+                     B(CRC_BIT(c->base + 8, k), 0), 1);
+    asm_jump(a, c->next);
+}
+
+/* build_crc32 **************************************************************/
+/* outputs the crc32 of the input as 8 lowercase hex digits and a newline */
+static void build_crc32 (asm_t * a)
+{
+    crc_leaf_t c;
+    asm_char_t ch;
+    uint16_t bits[8];
+    uint32_t stage[4], eof[4];
+    uint32_t t, skip, ok;
+    uint_t s, k, n;
+
+    for (k = 0; k < 0x100; ++k)
+    {
+        for (t = k, n = 0; n < 8; ++n)
+            t = (t >> 1) ^ (t & 1 ? 0xEDB88320 : 0);
+        c.table[k] = t;
+    }
+    for (k = 0; k < 32; ++k)
+        asm_insn(a, HZAO_INIT_8, B(CRC_REG + k, 0), 1, 0);
+    for (s = 0; s < 4; ++s)
+    {
+        stage[s] = asm_label(a);
+        eof[s] = asm_label(a);
+    }
+
+    for (s = 0; s < 4; ++s)
+    {
+        c.base = s * 8;
+        c.next = stage[(s + 1) & 3];
+        ok = asm_label(a);
+        asm_bind(a, stage[s]);
+        asm_branch(a, HZAO_IN_8, B(RX, 0), ok, eof[s]);
+        asm_bind(a, ok);
+        for (k = 0; k < 8; ++k)
+        {
+            skip = asm_label(a);
+            t = asm_label(a);
+            asm_bit(a, RX, k, skip, t);
+            asm_bind(a, t);
+            asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(CRC_BIT(c.base, k), 0),
+                     B(CRC_BIT(c.base, k), 0), 1);
+            asm_bind(a, skip);
+        }
+        for (k = 0; k < 8; ++k) bits[k] = B(CRC_BIT(c.base, 7 - k), 0);
+        asm_tree(a, bits, 8, 0, crc_leaf, &c);
+    }
+
+    /* final xor with 0xFFFFFFFF is done by flipping the digit */
+    ch.table = hex_digits;
+    ch.shift = 0;
+    ch.flip = 15;
+    for (s = 0; s < 4; ++s)
+    {
+        asm_bind(a, eof[s]);
+        for (n = 8; n--;)
+        {
+            for (k = 0; k < 4; ++k)
+                bits[k] = B(CRC_BIT(s * 8, n * 4 + 3 - k), 0);
+            ch.next = asm_label(a);
+            asm_tree(a, bits, 4, 0, leaf_char, &ch);
+            asm_bind(a, ch.next);
+        }
+        asm_out_char(a, '\n');
+        asm_insn(a, HZAO_RET, 0, 0, 0);
+    }
+}
+
+/* rle_half *****************************************************************/
+/**
+ *  Code for the state where the current run byte is in reg p: reads the
+ *  next byte in q, extends the run or flushes it and goes to the state with
+ *  the run byte in q (label lq). Runs are (count, byte) pairs with count
+ *  up to 255.
+ */
+static void rle_half (asm_t * a, uint_t p, uint_t q, uint32_t lp,
+                      uint32_t lq, uint32_t done)
+{
+    enum { RC = 4, RL = 5 }; /* run length and length left up to 255 */
+    uint32_t cmp, same, full, diff, flush, fresh, fin, last;
+
+    cmp = asm_label(a); same = asm_label(a); full = asm_label(a);
+    diff = asm_label(a); flush = asm_label(a); fresh = asm_label(a);
+    fin = asm_label(a); last = asm_label(a);
+
+    asm_bind(a, lp);
+    asm_branch(a, HZAO_IN_8, B(q, 0), cmp, fin);
+    asm_bind(a, cmp);
+    asm_equal(a, p, q, same, diff);
+
+    asm_bind(a, same);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RC, 0), B(RC, 0), 1);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RL, 0), B(RL, 0), 0xFF);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RL, 0), full, lp);
+    asm_bind(a, full);
+    asm_insn(a, HZAO_OUT_8, B(RC, 0), 0, 0);
+    asm_insn(a, HZAO_OUT_8, B(p, 0), 0, 0);
+    asm_insn(a, HZAO_INIT_8, B(RC, 0), 0, 0);
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), 0xFF, 0);
+    asm_jump(a, lp);
+
+    /* a full run was already flushed if the count is 0 */
+    asm_bind(a, diff);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RC, 0), fresh, flush);
+    asm_bind(a, flush);
+    asm_insn(a, HZAO_OUT_8, B(RC, 0), 0, 0);
+    asm_insn(a, HZAO_OUT_8, B(p, 0), 0, 0);
+    asm_bind(a, fresh);
+    asm_insn(a, HZAO_INIT_8, B(RC, 0), 1, 0);
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), 0xFE, 0);
+    asm_jump(a, lq);
+
+    asm_bind(a, fin);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RC, 0), done, last);
+    asm_bind(a, last);
+    asm_insn(a, HZAO_OUT_8, B(RC, 0), 0, 0);
+    asm_insn(a, HZAO_OUT_8, B(p, 0), 0, 0);
+    asm_jump(a, done);
+}
+
+/* build_rle ****************************************************************/
+static void build_rle (asm_t * a)
+{
+    enum { RA = RX, RB = 3, RC = 4, RL = 5 };
+    uint32_t la, lb, start, done;
+
+    la = asm_label(a); lb = asm_label(a);
+    start = asm_label(a); done = asm_label(a);
+
+    asm_branch(a, HZAO_IN_8, B(RA, 0), start, done);
+    asm_bind(a, start);
+    asm_insn(a, HZAO_INIT_8, B(RC, 0), 1, 0);
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), 0xFE, 0);
+    rle_half(a, RA, RB, la, lb, done);
+    rle_half(a, RB, RA, lb, la, done);
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* utf8 *********************************************************************/
+/**
+ *  UTF-8 sanitizer: copies valid sequences and outputs '?' for each maximal
+ *  invalid subpart (overlongs, surrogates, > U+10FFFF, truncated sequences
+ *  and stray bytes), like a replacing decoder. A byte that breaks a
+ *  sequence is processed again as a lead byte; since it is in the next reg
+ *  of the ring of 4 regs UTF8_REG..UTF8_REG+3, the code is generated once
+ *  for each lead reg.
+ */
+#define UTF8_REG                2
+#define UTF8_REGS               4
+
+enum utf8_cont_enum
+{
+    UTF8_CONT = 0,      /* 80..BF */
+    UTF8_CONT_E0,       /* A0..BF */
+    UTF8_CONT_ED,       /* 80..9F */
+    UTF8_CONT_F0,       /* 90..BF */
+    UTF8_CONT_F4,       /* 80..8F */
+};
+
+/* utf8_cont ****************************************************************/
+static void utf8_cont (asm_t * a, uint_t c, uint_t cls, uint32_t lok,
+                       uint32_t lbad)
+{
+    uint32_t l6, l5, l4;
+
+    l6 = asm_label(a);
+    asm_bit(a, c, 7, lbad, l6);
+    asm_bind(a, l6);
+    if (cls == UTF8_CONT)
+    {
+        asm_bit(a, c, 6, lok, lbad);
+        return;
+    }
+    l5 = asm_label(a);
+    asm_bit(a, c, 6, l5, lbad);
+    asm_bind(a, l5);
+    switch (cls)
+    {
+    case UTF8_CONT_E0:
+        asm_bit(a, c, 5, lbad, lok);
+        break;
+    case UTF8_CONT_ED:
+        asm_bit(a, c, 5, lok, lbad);
+        break;
+    case UTF8_CONT_F0:
+        l4 = asm_label(a);
+        asm_bit(a, c, 5, l4, lok);
+        asm_bind(a, l4);
+        asm_bit(a, c, 4, lbad, lok);
+        break;
+    default:
+        l4 = asm_label(a);
+        asm_bit(a, c, 5, l4, lbad);
+        asm_bind(a, l4);
+        asm_bit(a, c, 4, lok, lbad);
+    }
+}
+
+/* utf8_seq *****************************************************************/
+/* reads n continuation bytes after the lead in reg r and copies the seq */
+static void utf8_seq (asm_t * a, uint_t r, uint_t n, uint_t cls,
+                      uint32_t const * rd, uint32_t const * lead,
+                      uint32_t done)
+{
+    uint32_t got, ok, bad, eof;
+    uint_t j, c;
+
+    for (j = 1; j <= n; ++j)
+    {
+        c = (r + j) % UTF8_REGS;
+        got = asm_label(a); ok = asm_label(a);
+        bad = asm_label(a); eof = asm_label(a);
+        asm_branch(a, HZAO_IN_8, B(UTF8_REG + c, 0), got, eof);
+        asm_bind(a, got);
+        utf8_cont(a, UTF8_REG + c, j == 1 ? cls : UTF8_CONT, ok, bad);
+        asm_bind(a, bad);
+        asm_out_char(a, '?');
+        asm_jump(a, lead[c]);
+        asm_bind(a, eof);
+        asm_out_char(a, '?');
+        asm_jump(a, done);
+        asm_bind(a, ok);
+    }
+    for (j = 0; j <= n; ++j)
+        asm_insn(a, HZAO_OUT_8, B(UTF8_REG + (r + j) % UTF8_REGS, 0), 0, 0);
+    asm_jump(a, rd[r]);
+}
+
+/* build_utf8 ***************************************************************/
+static void build_utf8 (asm_t * a)
+{
+    uint32_t rd[UTF8_REGS], lead[UTF8_REGS];
+    uint32_t done, ascii, hi, h2, h3, h4, two, ok2, three, e0, ne0, ed;
+    uint32_t n3, f, flo, flo2, fhi, fhi2, n4, bad, l[4];
+    uint_t r, x, k;
+
+    for (r = 0; r < UTF8_REGS; ++r)
+    {
+        rd[r] = asm_label(a);
+        lead[r] = asm_label(a);
+    }
+    done = asm_label(a);
+
+    for (r = 0; r < UTF8_REGS; ++r)
+    {
+        x = UTF8_REG + r;
+        ascii = asm_label(a); hi = asm_label(a); h2 = asm_label(a);
+        h3 = asm_label(a); h4 = asm_label(a); bad = asm_label(a);
+
+        asm_bind(a, rd[r]);
+        asm_branch(a, HZAO_IN_8, B(x, 0), lead[r], done);
+        asm_bind(a, lead[r]);
+        asm_bit(a, x, 7, ascii, hi);
+        asm_bind(a, ascii);
+        asm_insn(a, HZAO_OUT_8, B(x, 0), 0, 0);
+        asm_jump(a, rd[r]);
+        asm_bind(a, hi);
+        asm_bit(a, x, 6, bad, h2);
+        asm_bind(a, h2);
+        two = asm_label(a);
+        asm_bit(a, x, 5, two, h3);
+
+        /* 110xxxxx: C0 and C1 are overlong */
+        asm_bind(a, two);
+        ok2 = asm_label(a);
+        for (k = 4; k >= 1; --k)
+        {
+            l[k - 1] = k > 1 ? asm_label(a) : bad;
+            asm_bit(a, x, k, l[k - 1], ok2);
+            if (k > 1) asm_bind(a, l[k - 1]);
+        }
+        asm_bind(a, ok2);
+        utf8_seq(a, r, 1, UTF8_CONT, rd, lead, done);
+
+        /* 1110xxxx: E0 and ED restrict the second byte */
+        asm_bind(a, h3);
+        three = asm_label(a);
+        asm_bit(a, x, 4, three, h4);
+        asm_bind(a, three);
+        e0 = asm_label(a); ne0 = asm_label(a); ed = asm_label(a);
+        n3 = asm_label(a);
+        asm_branch(a, HZAO_BRANCH_ZERO_4, B(x, 0), e0, ne0);
+        asm_bind(a, e0);
+        utf8_seq(a, r, 2, UTF8_CONT_E0, rd, lead, done);
+        asm_bind(a, ne0);
+        for (k = 0; k < 4; ++k) l[k] = asm_label(a);
+        asm_bit(a, x, 3, n3, l[2]);
+        asm_bind(a, l[2]);
+        asm_bit(a, x, 2, n3, l[1]);
+        asm_bind(a, l[1]);
+        asm_bit(a, x, 1, l[0], n3);
+        asm_bind(a, l[0]);
+        asm_bit(a, x, 0, n3, ed);
+        asm_bind(a, ed);
+        utf8_seq(a, r, 2, UTF8_CONT_ED, rd, lead, done);
+        asm_bind(a, n3);
+        utf8_seq(a, r, 2, UTF8_CONT, rd, lead, done);
+
+        /* 11110xxx: F0 and F4 restrict the second byte, F5..F7 are bad */
+        asm_bind(a, h4);
+        f = asm_label(a);
+        asm_bit(a, x, 3, f, bad);
+        asm_bind(a, f);
+        flo = asm_label(a); flo2 = asm_label(a); fhi = asm_label(a);
+        fhi2 = asm_label(a); n4 = asm_label(a);
+        l[0] = asm_label(a); l[1] = asm_label(a);
+        asm_bit(a, x, 2, flo, fhi);
+        asm_bind(a, flo);
+        asm_bit(a, x, 1, flo2, n4);
+        asm_bind(a, flo2);
+        asm_bit(a, x, 0, l[0], n4);
+        asm_bind(a, l[0]);
+        utf8_seq(a, r, 3, UTF8_CONT_F0, rd, lead, done);
+        asm_bind(a, n4);
+        utf8_seq(a, r, 3, UTF8_CONT, rd, lead, done);
+        asm_bind(a, fhi);
+        asm_bit(a, x, 1, fhi2, bad);
+        asm_bind(a, fhi2);
+        asm_bit(a, x, 0, l[1], bad);
+        asm_bind(a, l[1]);
+        utf8_seq(a, r, 3, UTF8_CONT_F4, rd, lead, done);
+
+        asm_bind(a, bad);
+        asm_out_char(a, '?');
+        asm_jump(a, rd[r]);
+    }
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* build_fold ***************************************************************/
+/* like fold -b -w FOLD_WIDTH: breaks lines longer than FOLD_WIDTH bytes */
+static void build_fold (asm_t * a)
+{
+    enum { RT = 3, RL = 4, RN = 5 }; /* RL: bytes left on the line */
+    uint32_t rd, ok, nl, other, brk, put, done;
+
+    rd = asm_label(a); ok = asm_label(a); nl = asm_label(a);
+    other = asm_label(a); brk = asm_label(a); put = asm_label(a);
+    done = asm_label(a);
+
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), FOLD_WIDTH, 0);
+    asm_insn(a, HZAO_INIT_8, B(RN, 0), '\n', 0);
+    asm_bind(a, rd);
+    asm_branch(a, HZAO_IN_8, B(RX, 0), ok, done);
+    asm_bind(a, ok);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RT, 0), B(RX, 0), 0x100 - '\n');
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RT, 0), nl, other);
+    asm_bind(a, nl);
+    asm_insn(a, HZAO_OUT_8, B(RX, 0), 0, 0);
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), FOLD_WIDTH, 0);
+    asm_jump(a, rd);
+    asm_bind(a, other);
+    asm_branch(a, HZAO_BRANCH_ZERO_8, B(RL, 0), brk, put);
+    asm_bind(a, brk);
+    asm_insn(a, HZAO_OUT_8, B(RN, 0), 0, 0);
+    asm_insn(a, HZAO_INIT_8, B(RL, 0), FOLD_WIDTH, 0);
+    asm_bind(a, put);
+    asm_insn(a, HZAO_OUT_8, B(RX, 0), 0, 0);
+    asm_insn(a, HZAO_WRAP_ADD_CONST_8, B(RL, 0), B(RL, 0), 0xFF);
+    asm_jump(a, rd);
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* leaf_upper ***************************************************************/
+static void leaf_upper (asm_t * a, void * ctx, uint_t value)
+{
+    uint32_t const * next = ctx;
+
+    asm_out_char(a, (uint8_t) (value >= 'a' && value <= 'z'
+                               ? value - 0x20 : value));
+    asm_jump(a, *next);
+}
+
+/* build_upper **************************************************************/
+/* like tr a-z A-Z, one byte at a time */
+static void build_upper (asm_t * a)
+{
+    uint16_t bits[8];
+    uint32_t rd, ok, done;
+    uint_t k;
+
+    for (k = 0; k < 8; ++k) bits[k] = B(RX, 7 - k);
+    rd = asm_label(a); ok = asm_label(a); done = asm_label(a);
+
+    asm_bind(a, rd);
+    asm_branch(a, HZAO_IN_8, B(RX, 0), ok, done);
+    asm_bind(a, ok);
+    asm_tree(a, bits, 8, 0, leaf_upper, &rd);
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* build_upper_lanes ********************************************************/
+/**
+ *  Same output as build_upper, 16 bytes at a time with the lane opcodes:
+ *  the bytes in 'a'..'z' get a mask of 0xFF and lose 0x20; blocks without
+ *  lowercase letters skip the fix.
+ */
+static void build_upper_lanes (asm_t * a)
+{
+    enum { RN = 4, RM = 6, V0 = 0x10, VA = 0x20, VZ = 0x30, VD = 0x40,
+        VT = 0x50, VU = 0x60, VI = 0x70 }; /* V*: 128-bit regs */
+    uint32_t rd, ok, fix, put, done;
+
+    rd = asm_label(a); ok = asm_label(a); fix = asm_label(a);
+    put = asm_label(a); done = asm_label(a);
+
+    /* broadcast the constants with an all-zero shuffle index */
+    asm_insn(a, HZAO_VXOR_128, B(VI, 0), B(VI, 0), B(VI, 0));
+    asm_insn(a, HZAO_INIT_8, B(VA, 0), 'a', 0);
+    asm_insn(a, HZAO_VSHUFFLE_8, B(VA, 0), B(VA, 0), B(VI, 0));
+    asm_insn(a, HZAO_INIT_8, B(VZ, 0), 'z', 0);
+    asm_insn(a, HZAO_VSHUFFLE_8, B(VZ, 0), B(VZ, 0), B(VI, 0));
+    asm_insn(a, HZAO_INIT_8, B(VD, 0), 0x20, 0);
+    asm_insn(a, HZAO_VSHUFFLE_8, B(VD, 0), B(VD, 0), B(VI, 0));
+
+    asm_bind(a, rd);
+    asm_insn(a, HZAO_IN_BLOCK_8, B(V0, 0), 16, B(RN, 0));
+    asm_branch(a, HZAO_BRANCH_ZERO_16, B(RN, 0), done, ok);
+    asm_bind(a, ok);
+    asm_insn(a, HZAO_VMAX_8, B(VT, 0), B(V0, 0), B(VA, 0));
+    asm_insn(a, HZAO_VCMP_EQ_8, B(VT, 0), B(VT, 0), B(V0, 0));
+    asm_insn(a, HZAO_VMIN_8, B(VU, 0), B(V0, 0), B(VZ, 0));
+    asm_insn(a, HZAO_VCMP_EQ_8, B(VU, 0), B(VU, 0), B(V0, 0));
+    asm_insn(a, HZAO_VAND_128, B(VT, 0), B(VT, 0), B(VU, 0));
+    asm_insn(a, HZAO_VMOVEMASK_8, B(RM, 0), B(VT, 0), 0);
+    asm_branch(a, HZAO_BRANCH_ZERO_16, B(RM, 0), put, fix);
+    asm_bind(a, fix);
+    asm_insn(a, HZAO_VAND_128, B(VT, 0), B(VT, 0), B(VD, 0));
+    asm_insn(a, HZAO_VSUB_8, B(V0, 0), B(V0, 0), B(VT, 0));
+    asm_bind(a, put);
+    asm_insn(a, HZAO_OUT_BLOCK_8, B(V0, 0), 16, B(RN, 0));
+    asm_jump(a, rd);
+    asm_bind(a, done);
+    asm_insn(a, HZAO_RET, 0, 0, 0);
+}
+
+/* corpus_rand **************************************************************/
+/* splitmix64 */
+static uint64_t corpus_rand (uint64_t * state)
+{
+    uint64_t z;
+
+    z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* text_input ***************************************************************/
+/* lowercase words, lines of 0 to 159 bytes */
+static size_t text_input (uint8_t * data, size_t size, uint64_t seed)
+{
+    uint64_t r;
+    size_t n;
+    uint_t col, len;
+
+    for (n = col = len = 0; n < size; ++n)
+    {
+        r = corpus_rand(&seed);
+        if (col == len)
+        {
+            data[n] = '\n';
+            col = 0;
+            len = (uint_t) (r % 160);
+        }
+        else
+        {
+            data[n] = (uint8_t) (r % 6 ? 'a' + (r >> 8) % 26 : ' ');
+            ++col;
+        }
+    }
+    return size;
+}
+
+/* bytes_input **************************************************************/
+static size_t bytes_input (uint8_t * data, size_t size, uint64_t seed)
+{
+    size_t n;
+
+    for (n = 0; n < size; ++n) data[n] = (uint8_t) corpus_rand(&seed);
+    return size;
+}
+
+/* b64_input ****************************************************************/
+/**
+ *  Base64 of random bytes in lines of B64_LINE chars; the byte count is not
+ *  a multiple of 3 so the text ends with padding.
+ */
+static size_t b64_input (uint8_t * data, size_t size, uint64_t seed)
+{
+    uint8_t s[3];
+    size_t n, m, i;
+    uint_t k, col;
+
+    m = size / (B64_LINE + 1) * (B64_LINE / 4 * 3) - 1;
+    for (n = i = col = 0; i < m; i += 3)
+    {
+        for (k = 0; k < 3; ++k)
+            s[k] = (uint8_t) (i + k < m ? corpus_rand(&seed) : 0);
+        data[n++] = (uint8_t) b64_digits[s[0] >> 2];
+        data[n++] = (uint8_t) b64_digits[((s[0] & 3) << 4) | (s[1] >> 4)];
+        data[n++] = (uint8_t) (i + 1 < m
+            ? b64_digits[((s[1] & 15) << 2) | (s[2] >> 6)] : '=');
+        data[n++] = (uint8_t) (i + 2 < m ? b64_digits[s[2] & 63] : '=');
+        col += 4;
+        if (col == B64_LINE || i + 3 >= m)
+        {
+            data[n++] = '\n';
+            col = 0;
+        }
+    }
+    return n;
+}
+
+/* runs_input ***************************************************************/
+/* runs of 16 byte values: mostly short, some up to 600 bytes */
+static size_t runs_input (uint8_t * data, size_t size, uint64_t seed)
+{
+    uint64_t r;
+    size_t n, len;
+
+    for (n = 0; n < size; n += len)
+    {
+        r = corpus_rand(&seed);
+        len = r % 4 ? 1 + (r >> 8) % 4 : 1 + (r >> 8) % 600;
+        if (len > size - n) len = size - n;
+        C41_MEM_FILL(data + n, len, (uint8_t) (((r >> 20) & 15) * 0x11));
+    }
+    return size;
+}
+
+/* utf8_input ***************************************************************/
+/* mostly ascii text with 2/3/4-byte chars and a few invalid sequences */
+static size_t utf8_input (uint8_t * data, size_t size, uint64_t seed)
+{
+    static char const * const bad[] =
+    {
+        "\xFF", "\xC0\xAF", "\xED\xA0\x80", "\xE2\x82", "\xF4\x90\x80\x80",
+        "\x80", "\xF0\x9F\x98", "\xC3", "\xE0\x80\x80", "\xF8\x88\x80\x80",
+    };
+    uint64_t r;
+    uint32_t cp;
+    size_t n, k;
+
+    for (n = 0; n + 4 <= size;)
+    {
+        r = corpus_rand(&seed);
+        k = r % 100;
+        r >>= 8;
+        if (k < 70)
+        {
+            data[n++] = (uint8_t) (r % 8 == 0 ? ' ' : r % 40 == 1 ? '\n'
+                                   : 'a' + (r >> 8) % 26);
+        }
+        else if (k < 80)
+        {
+            cp = 0x80 + (uint32_t) (r % 0x780);
+            data[n++] = (uint8_t) (0xC0 | (cp >> 6));
+            data[n++] = (uint8_t) (0x80 | (cp & 0x3F));
+        }
+        else if (k < 90)
+        {
+            cp = 0x800 + (uint32_t) (r % 0xF800);
+            if ((cp >= 0xD800 && cp < 0xE000) || cp == 0xFFFD) cp = 0x20AC;
+            data[n++] = (uint8_t) (0xE0 | (cp >> 12));
+            data[n++] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+            data[n++] = (uint8_t) (0x80 | (cp & 0x3F));
+        }
+        else if (k < 96)
+        {
+            cp = 0x10000 + (uint32_t) (r % 0x100000);
+            data[n++] = (uint8_t) (0xF0 | (cp >> 18));
+            data[n++] = (uint8_t) (0x80 | ((cp >> 12) & 0x3F));
+            data[n++] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+            data[n++] = (uint8_t) (0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            k = r % (sizeof(bad) / sizeof(bad[0]));
+            C41_MEM_COPY(data + n, bad[k], C41_STR_LEN(bad[k]));
+            n += C41_STR_LEN(bad[k]);
+        }
+    }
+    for (; n < size; ++n) data[n] = 'x';
+    return size;
+}
+
+/* fnv1a ********************************************************************/
+static uint64_t fnv1a (uint64_t h, uint8_t const * data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; ++i) h = (h ^ data[i]) * 0x100000001B3ULL;
+    return h;
+}
+
+/* corpus_module ************************************************************/
+/* assembles the workload's module in ctx->mod_buf */
+static uint8_t corpus_module (corpus_ctx_t * ctx, corpus_t const * c)
+{
+    asm_t a;
+    int r;
+
+    C41_VAR_ZERO(a);
+    a.ma = ctx->ma;
+    asm_insn(&a, HZAO_INIT_8, B(RZ, 0), 0, 0);
+    c->build(&a);
+    r = asm_module(&a, &ctx->mod_buf, &ctx->mod_size);
+    asm_free(&a);
+    if (r)
+    {
+        ctx->mod_buf = NULL;
+        return EC_INIT;
+    }
+    return 0;
+}
+
+/* corpus_run ***************************************************************/
+/**
+ *  Runs the entry proc over the whole input; the output is hashed when
+ *  hash is not NULL, else discarded.
+ */
+static uint8_t corpus_run (corpus_ctx_t * ctx, uint32_t module_index,
+                           int32_t entry, uint64_t * out_size,
+                           uint64_t * hash)
+{
+    hza_context_t * hc = &ctx->hcd;
+    hza_task_t * t = hc->active_task;
+    hza_error_t e;
+
+    *out_size = 0;
+    e = hza_enter(hc, module_index, entry, 0);
+    if (!e) e = hza_task_input(hc, ctx->in_buf, ctx->in_size, 1);
+    if (!e) e = hza_task_output(hc, ctx->out_buf, CORPUS_OUT_SIZE);
+    while (!e)
+    {
+        e = hza_run(hc, 0, CORPUS_ITER_LIMIT);
+        if (e) break;
+        if (hc->run_stop == HZA_RUN_LIMIT) continue;
+        *out_size += t->out.pos;
+        if (hash) *hash = fnv1a(*hash, ctx->out_buf, t->out.pos);
+        if (hc->run_stop == HZA_RUN_FRAME) return 0;
+        if (hc->run_stop != HZA_RUN_OUTPUT) return EC_PROC;
+        e = hza_task_output(hc, ctx->out_buf, CORPUS_OUT_SIZE);
+    }
+    return EC_PROC;
+}
+
+/* corpus_workload **********************************************************/
+/**
+ *  Loads the workload module, checks the output of a first run and times
+ *  the following ones; writes a report line.
+ */
+static uint8_t corpus_workload (corpus_ctx_t * ctx, corpus_t const * c,
+                                char first)
+{
+    hza_context_t * hc = &ctx->hcd;
+    hza_module_t * m;
+    hza_task_t * t;
+    uint64_t r[CORPUS_MAX_TRIALS]; // MB/s in 1/100 units
+    uint64_t out_size, hash, t0, dt;
+    uint32_t mi;
+    int32_t entry;
+    uint_t ti;
+    ssize_t z;
+    uint8_t rc;
+    char ok;
+
+    ctx->in_size = c->input(ctx->in_buf, CORPUS_INPUT_SIZE, c->seed);
+    rc = corpus_module(ctx, c);
+    if (!rc)
+    {
+        if (hza_module_load(hc, ctx->mod_buf, ctx->mod_size, 0, &m))
+            rc = EC_INIT;
+        c41_ma_free(ctx->ma, ctx->mod_buf, ctx->mod_size);
+        ctx->mod_buf = NULL;
+    }
+    if (rc || hza_task_create(hc, &t))
+    {
+        z = c41_io_fmt(ctx->log, "Error: failed preparing workload $s\n",
+                       c->name);
+        return z < 0 ? EC_INIT | EC_LOG : EC_INIT;
+    }
+    entry = hza_export_by_name(m, (uint8_t const *) CORPUS_ENTRY,
+                               sizeof(CORPUS_ENTRY) - 1);
+    if (entry < 0 || hza_import(hc, m, 0)) rc = EC_INIT;
+    mi = hc->args.module_index;
+
+    hash = 0xCBF29CE484222325ULL;
+    out_size = 0;
+    if (!rc) rc = corpus_run(ctx, mi, entry, &out_size, &hash);
+    ok = out_size == c->out_size && hash == c->out_hash;
+    for (ti = 0; ti < ctx->trials && !rc; ++ti)
+    {
+        t0 = now_ns();
+        rc = corpus_run(ctx, mi, entry, &out_size, NULL);
+        dt = now_ns() - t0;
+        r[ti] = ctx->in_size * 100000 / (dt ? dt : 1);
+    }
+    if (hza_task_deref(hc, t)) rc |= EC_FINISH;
+    if (rc)
+    {
+        z = c41_io_fmt(ctx->log, "Error: workload $s failed\n", c->name);
+        return z < 0 ? rc | EC_LOG : rc;
+    }
+
+    qsort(r, ctx->trials, sizeof(r[0]), u64_cmp);
+    if (ctx->json)
+        z = c41_io_fmt(ctx->out, "$s  { \"name\": \"$s\", \"in\": $z, "
+                       "\"out\": $Uq, \"hash\": \"$.16XUq\", "
+                       "\"ok\": $s, \"mbps_min\": $Uq.$.2Uq, "
+                       "\"mbps_p50\": $Uq.$.2Uq, \"mbps_max\": $Uq.$.2Uq }",
+                       first ? "" : ",\n", c->name, ctx->in_size, out_size,
+                       hash, ok ? "true" : "false",
+                       r[0] / 100, r[0] % 100,
+                       r[(ctx->trials - 1) / 2] / 100,
+                       r[(ctx->trials - 1) / 2] % 100,
+                       r[ctx->trials - 1] / 100, r[ctx->trials - 1] % 100);
+    else
+    {
+        z = put_text(ctx->out, c->name, 16);
+        if (z >= 0) z = put_num(ctx->out, r[0], 10);
+        if (z >= 0) z = put_num(ctx->out, r[(ctx->trials - 1) / 2], 10);
+        if (z >= 0) z = put_num(ctx->out, r[ctx->trials - 1], 10);
+        if (z >= 0) z = c41_io_fmt(ctx->out, "  $s\n", ok ? "ok" : "BAD");
+    }
+    if (z < 0) rc |= EC_LOG;
+    if (!ok)
+    {
+        rc |= EC_PROC;
+        z = c41_io_fmt(ctx->log, "Error: $s output mismatch: $Uq bytes, "
+                       "hash $.16XUq\n", c->name, out_size, hash);
+        if (z < 0) rc |= EC_LOG;
+    }
+    return rc;
+}
+
+/* corpus_dump **************************************************************/
+/* writes the module or the input of the named workload to stdout */
+static uint8_t corpus_dump (corpus_ctx_t * ctx, c41_io_t * io,
+                            corpus_t const * c, char module)
+{
+    uint8_t * data;
+    size_t size, ofs, wz;
+    uint8_t rc;
+
+    rc = 0;
+    if (module)
+    {
+        rc = corpus_module(ctx, c);
+        if (rc) return rc;
+        data = ctx->mod_buf;
+        size = ctx->mod_size;
+    }
+    else
+    {
+        data = ctx->in_buf;
+        size = c->input(data, CORPUS_INPUT_SIZE, c->seed);
+    }
+    for (ofs = 0; !rc && ofs < size; ofs += wz)
+        if (c41_io_write(io, data + ofs, size - ofs, &wz)) rc = EC_PROC;
+    if (module) c41_ma_free(ctx->ma, ctx->mod_buf, ctx->mod_size);
+    return rc;
+}
+
+/* corpus *******************************************************************/
+uint8_t corpus (c41_cli_t * cli_p)
+{
+    corpus_ctx_t ctx;
+    corpus_t const * c;
+    char const * filter;
+    char const * dump;
+    char * end;
+    ssize_t z;
+    uint_t ai, ci, cn;
+    uint8_t rc;
+    char dump_module, first;
+
+    C41_VAR_ZERO(ctx);
+    ctx.out = cli_p->stdout_p;
+    ctx.log = cli_p->stderr_p;
+    ctx.ma = cli_p->ma_p;
+    ctx.trials = CORPUS_TRIALS;
+    filter = dump = NULL;
+    dump_module = 0;
+
+    for (ai = 1; ai < cli_p->arg_n; ++ai)
+    {
+        if (C41_STR_EQUAL(cli_p->arg_a[ai], "--json")) ctx.json = 1;
+        else if (C41_STR_EQUAL(cli_p->arg_a[ai], "--trials")
+                 && ai + 1 < cli_p->arg_n)
+        {
+            ctx.trials = (uint_t) strtoul(cli_p->arg_a[++ai], &end, 0);
+            if (*end || ctx.trials < 1 || ctx.trials > CORPUS_MAX_TRIALS)
+                break;
+        }
+        else if ((C41_STR_EQUAL(cli_p->arg_a[ai], "--module")
+                  || C41_STR_EQUAL(cli_p->arg_a[ai], "--input"))
+                 && ai + 1 < cli_p->arg_n && !dump)
+        {
+            dump_module = cli_p->arg_a[ai][2] == 'm';
+            dump = cli_p->arg_a[++ai];
+        }
+        else if (cli_p->arg_a[ai][0] != '-' && !filter)
+            filter = cli_p->arg_a[ai];
+        else break;
+    }
+    cn = sizeof(corpus_table) / sizeof(corpus_table[0]);
+    for (ci = 0; dump && ci < cn; ++ci)
+        if (C41_STR_EQUAL(dump, corpus_table[ci].name)) break;
+    if (ai < cli_p->arg_n || (dump && (ci == cn || filter)))
+    {
+        z = c41_io_fmt(ctx.log, "Error: bad arguments for command 'corpus' "
+                       "(see 'hazna help')\n");
+        return z < 0 ? EC_INVOKE | EC_LOG : EC_INVOKE;
+    }
+
+    if (c41_ma_alloc(ctx.ma, (void * *) &ctx.in_buf, CORPUS_INPUT_SIZE))
+        return EC_INIT;
+    if (c41_ma_alloc(ctx.ma, (void * *) &ctx.out_buf, CORPUS_OUT_SIZE))
+    {
+        c41_ma_free(ctx.ma, ctx.in_buf, CORPUS_INPUT_SIZE);
+        return EC_INIT;
+    }
+
+    rc = 0;
+    do
+    {
+        if (dump)
+        {
+            rc |= corpus_dump(&ctx, cli_p->stdout_p, corpus_table + ci,
+                              dump_module);
+            break;
+        }
+        if (hza_init(&ctx.hcd, ctx.ma, cli_p->smt_p, ctx.log, 0))
+        {
+            rc |= EC_INIT;
+            break;
+        }
+
+        if (ctx.json)
+            z = c41_io_fmt(ctx.out, "{ \"trials\": $Ui, \"input_size\": $Ui, "
+                           "\"workloads\": [\n", ctx.trials,
+                           CORPUS_INPUT_SIZE);
+        else
+            z = c41_io_fmt(ctx.out, "workload         "
+                           "min MB/s   p50 MB/s   max MB/s  output\n");
+        if (z < 0) rc |= EC_LOG;
+
+        first = 1;
+        /* an output mismatch does not stop the other workloads */
+        for (ci = 0; ci < cn && !(rc & ~(EC_PROC | EC_LOG)); ++ci)
+        {
+            c = corpus_table + ci;
+            /* the filter selects workloads by name prefix */
+            if (filter && (C41_STR_LEN(filter) > C41_STR_LEN(c->name)
+                           || !C41_MEM_EQUAL(filter, c->name,
+                                             C41_STR_LEN(filter))))
+                continue;
+            rc |= corpus_workload(&ctx, c, first);
+            first = 0;
+        }
+        if (ctx.json && c41_io_fmt(ctx.out, "\n] }\n") < 0) rc |= EC_LOG;
+        if (hza_finish(&ctx.hcd)) rc |= EC_FINISH;
+    }
+    while (0);
+
+    c41_ma_free(ctx.ma, ctx.out_buf, CORPUS_OUT_SIZE);
+    c41_ma_free(ctx.ma, ctx.in_buf, CORPUS_INPUT_SIZE);
+    return rc;
+}
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include "cli.h"
+
+#define GEN_INSNS               0x100 /* default insns per proc */
+
+/* gen_mix ******************************************************************/
+/* parses "NOP,INIT,ADD,BRANCH" weights */
+static int gen_mix (hza_mod00_gen_t * g, char const * s)
+{
+    char * end;
+    unsigned long v;
+    uint_t k;
+
+    for (k = 0; k < HZA_GEN_KINDS; ++k)
+    {
+        v = strtoul(s, &end, 0);
+        if (end == s || v > 0xFFFF) return -1;
+        g->mix[k] = (uint32_t) v;
+        if (k + 1 < HZA_GEN_KINDS && *end != ',') return -1;
+        s = end + 1;
+    }
+    return *end ? -1 : 0;
+}
+
+/* gen **********************************************************************/
+uint8_t gen (c41_cli_t * cli_p)
+{
+    hza_mod00_gen_t g;
+    c41_io_t * log = cli_p->stderr_p;
+    uint8_t * data;
+    size_t size, wz, ofs;
+    ssize_t z;
+    unsigned long long v;
+    uint_t ai, ioe;
+    char * a;
+    char * end;
+    hza_error_t hzae;
+    uint8_t rc;
+
+    C41_VAR_ZERO(g);
+    g.proc_count = 1;
+    g.insn_count = GEN_INSNS;
+    g.export_count = 1;
+    g.data_block_size = 0x10;
+
+    for (ai = 1; ai < cli_p->arg_n; ++ai)
+    {
+        a = cli_p->arg_a[ai];
+        if (ai + 1 == cli_p->arg_n) break;
+        if (C41_STR_EQUAL(a, "--mix"))
+        {
+            if (gen_mix(&g, cli_p->arg_a[++ai])) break;
+            continue;
+        }
+        v = strtoull(cli_p->arg_a[++ai], &end, 0);
+        if (*end) break;
+        if (C41_STR_EQUAL(a, "--seed")) g.seed = v;
+        else if (v > 0xFFFFFFFF) break;
+        else if (C41_STR_EQUAL(a, "--procs")) g.proc_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--insns")) g.insn_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--const128"))
+            g.const128_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--const64")) g.const64_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--const32")) g.const32_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--exports")) g.export_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--blocks"))
+            g.data_block_count = (uint32_t) v;
+        else if (C41_STR_EQUAL(a, "--block-size"))
+            g.data_block_size = (uint32_t) v;
+        else break;
+    }
+    if (ai < cli_p->arg_n)
+    {
+        z = c41_io_fmt(log, "Error: bad arguments for command 'gen' "
+                       "(see 'hazna help')\n");
+        return z < 0 ? EC_INVOKE | EC_LOG : EC_INVOKE;
+    }
+
+    size = hza_mod00_gen_size(&g);
+    if (!size)
+    {
+        z = c41_io_fmt(log, "Error: bad module parameters (too large, or "
+                       "more exports than procs)\n");
+        return z < 0 ? EC_INVOKE | EC_LOG : EC_INVOKE;
+    }
+    if (c41_ma_alloc(cli_p->ma_p, (void * *) &data, size))
+    {
+        z = c41_io_fmt(log, "Error: failed allocating $Xz bytes\n", size);
+        return z < 0 ? EC_INIT | EC_LOG : EC_INIT;
+    }
+
+    rc = 0;
+    hzae = hza_mod00_gen(&g, data, size);
+    if (hzae)
+    {
+        rc |= EC_PROC;
+        z = c41_io_fmt(log, "Error: generating module failed (code $Ui: $s)\n",
+                       hzae, hza_error_name(hzae));
+        if (z < 0) rc |= EC_LOG;
+    }
+    for (ofs = 0; !rc && ofs < size; ofs += wz)
+    {
+        ioe = c41_io_write(cli_p->stdout_p, data + ofs, size - ofs, &wz);
+        if (ioe)
+        {
+            rc |= EC_PROC;
+            z = c41_io_fmt(log, "Error: failed writing output (code $Ui)\n",
+                           ioe);
+            if (z < 0) rc |= EC_LOG;
+        }
+    }
+    if (c41_ma_free(cli_p->ma_p, data, size)) rc |= EC_FINISH;
+    return rc;
+}
@@ -0,0 +1,133 @@
+#include "cli.h"
+
+#if !_WIN32
+#   include <sys/mman.h>
+#endif
+
+#define HPMA_ROUND(_z) (((_z) + HPMA_PAGE - 1) & ~(size_t) (HPMA_PAGE - 1))
+
+/* hpma_map *****************************************************************/
+/* maps size bytes (multiple of HPMA_PAGE) at an address aligned to
+ * HPMA_PAGE so that the kernel can back the whole range with huge pages */
+static void * hpma_map (hpma_t * hp, size_t size)
+{
+#if _WIN32
+    (void) hp;
+    (void) size;
+    return NULL;
+#else
+    uint8_t * p;
+    size_t head;
+
+#ifdef MAP_HUGETLB
+    if (hp->mode == HPMA_HUGETLB)
+    {
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return p;
+        /* the hugetlb pool is empty or not configured; use THP */
+    }
+#endif
+    p = mmap(NULL, size + HPMA_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    head = (HPMA_PAGE - ((uintptr_t) p & (HPMA_PAGE - 1))) & (HPMA_PAGE - 1);
+    if (head) munmap(p, head);
+    munmap(p + head + size, HPMA_PAGE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(p + head, size, MADV_HUGEPAGE);
+#endif
+    return p + head;
+#endif
+}
+
+/* hpma_unmap ***************************************************************/
+static uint_t hpma_unmap (void * p, size_t size)
+{
+#if _WIN32
+    (void) p;
+    (void) size;
+    return HPMA_UNMAP_ERROR;
+#else
+    return munmap(p, size) ? HPMA_UNMAP_ERROR : C41_MA_OK;
+#endif
+}
+
+/* hpma_handler *************************************************************/
+static uint_t C41_CALL hpma_handler
+(
+    void * * ptr_p,
+    size_t old_size,
+    size_t new_size,
+    void * ctx
+)
+{
+    hpma_t * hp = ctx;
+    c41_ma_t * wma = hp->worker_ma;
+    void * p;
+    uint_t mae;
+    char old_huge, new_huge;
+
+    old_huge = hp->mode != HPMA_OFF && old_size >= hp->min_size;
+    new_huge = hp->mode != HPMA_OFF && new_size >= hp->min_size;
+    if (!old_huge && !new_huge)
+        return wma->handler(ptr_p, old_size, new_size, wma->context);
+    if (old_huge && new_huge && HPMA_ROUND(old_size) == HPMA_ROUND(new_size))
+        return C41_MA_OK;
+
+    p = NULL;
+    if (new_huge)
+    {
+        p = hpma_map(hp, HPMA_ROUND(new_size));
+        if (!p) return C41_MA_NO_MEM;
+    }
+    else if (new_size)
+    {
+        mae = wma->handler(&p, 0, new_size, wma->context);
+        if (mae) return mae;
+    }
+
+    if (old_size)
+    {
+        if (new_size)
+            C41_MEM_COPY(p, *ptr_p,
+                         old_size < new_size ? old_size : new_size);
+        mae = old_huge ? hpma_unmap(*ptr_p, HPMA_ROUND(old_size))
+            : wma->handler(ptr_p, old_size, 0, wma->context);
+        if (mae)
+        {
+            /* the old block stays with the caller; drop the new one */
+            if (new_huge) hpma_unmap(p, HPMA_ROUND(new_size));
+            else if (new_size) wma->handler(&p, new_size, 0, wma->context);
+            return mae;
+        }
+    }
+    *ptr_p = p;
+    return C41_MA_OK;
+}
+
+/* hpma_init ****************************************************************/
+void hpma_init (hpma_t * hp, c41_ma_t * worker_ma, uint_t mode,
+                size_t min_size)
+{
+    hp->ma.handler = hpma_handler;
+    hp->ma.context = hp;
+    hp->worker_ma = worker_ma;
+#if _WIN32
+    /* large pages need SeLockMemoryPrivilege; not worth it for a cli */
+    (void) mode;
+    hp->mode = HPMA_OFF;
+#else
+    hp->mode = mode;
+#endif
+    hp->min_size = min_size < HPMA_PAGE ? HPMA_PAGE : min_size;
+}
+
+/* hpma_mode ****************************************************************/
+int hpma_mode (char const * name)
+{
+    if (C41_STR_EQUAL(name, "off")) return HPMA_OFF;
+    if (C41_STR_EQUAL(name, "thp")) return HPMA_THP;
+    if (C41_STR_EQUAL(name, "hugetlb")) return HPMA_HUGETLB;
+    return -1;
+}
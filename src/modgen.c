@@ -0,0 +1,353 @@
+#include "../include/hazna.h"
+
+/* internal configurable constants ******************************************/
+#define GEN_NAME_LEN            9 /* "p" + 8 hex digits */
+#define GEN_MIN_DATA_BLOCK      0x10
+#define GEN_REG_BYTES           0x20 /* registers used by generated insns */
+#define GEN_KIND_SALT           0x6B696E64 /* separates the kind stream */
+#define GEN_MAX_PROC_TARGETS    0xFFFE /* branch c operands are 16-bit */
+
+typedef struct gen_layout_s                     gen_layout_t;
+
+/* gen_layout_t *************************************************************/
+/**
+ * Counts and sizes derived from the generator parameters.
+ */
+struct gen_layout_s
+{
+    uint64_t target_count;
+    uint64_t insn_count;
+    uint64_t data_block_count; // including the empty block 0
+    uint64_t data_size;
+    uint64_t size;
+    uint32_t mix[HZA_GEN_KINDS];
+    uint32_t mix_total;
+};
+
+/* gen_rand *****************************************************************/
+/**
+ * splitmix64 step: advances the state and returns the next value.
+ */
+static uint64_t gen_rand
+(
+    uint64_t * state
+);
+
+/* gen_kind *****************************************************************/
+/**
+ * Picks the HZA_GEN_xxx kind of the next body insn; branches become nops
+ * once the proc has GEN_MAX_PROC_TARGETS targets.
+ */
+static uint_t gen_kind
+(
+    gen_layout_t const * l,
+    uint64_t * state,
+    uint32_t proc_targets
+);
+
+/* gen_layout ***************************************************************/
+/**
+ * Validates the parameters and fills in the layout; replays the kind stream
+ * to count the branch targets.
+ * Returns 0 on success, HZAE_GEN_PARAMS for bad/too large parameters.
+ */
+static hza_error_t gen_layout
+(
+    hza_mod00_gen_t const * g,
+    gen_layout_t * l
+);
+
+/* gen_proc_name ************************************************************/
+/**
+ * Writes "pXXXXXXXX" for the given proc index.
+ */
+static void gen_proc_name
+(
+    uint8_t * p,
+    uint32_t index
+);
+
+/* gen_rand *****************************************************************/
+static uint64_t gen_rand
+(
+    uint64_t * state
+)
+{
+    uint64_t z;
+
+    z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* gen_kind *****************************************************************/
+static uint_t gen_kind
+(
+    gen_layout_t const * l,
+    uint64_t * state,
+    uint32_t proc_targets
+)
+{
+    uint32_t r;
+    uint_t k;
+
+    r = (uint32_t) (gen_rand(state) % l->mix_total);
+    for (k = 0; r >= l->mix[k]; ++k) r -= l->mix[k];
+    if (k == HZA_GEN_BRANCH && proc_targets >= GEN_MAX_PROC_TARGETS)
+        k = HZA_GEN_NOP;
+    return k;
+}
+
+/* gen_layout ***************************************************************/
+static hza_error_t gen_layout
+(
+    hza_mod00_gen_t const * g,
+    gen_layout_t * l
+)
+{
+    uint64_t state, pc, n;
+    uint32_t i, j, t;
+    uint_t k;
+
+    pc = g->proc_count;
+    if (!pc || !g->insn_count || g->export_count > g->proc_count
+        || (g->data_block_count && g->data_block_size < GEN_MIN_DATA_BLOCK)
+        || pc * g->insn_count > 0xFFFFFFFF
+        || pc * g->const128_count > 0xFFFFFFFF
+        || pc * g->const64_count > 0xFFFFFFFF
+        || pc * g->const32_count > 0xFFFFFFFF
+        || (uint64_t) g->data_block_count + g->export_count >= 0xFFFFFFFF)
+        return HZAE_GEN_PARAMS;
+
+    for (l->mix_total = 0, k = 0; k < HZA_GEN_KINDS; ++k)
+    {
+        l->mix[k] = g->mix[k];
+        if (l->mix[k] > 0xFFFFFFFF - l->mix_total) return HZAE_GEN_PARAMS;
+        l->mix_total += l->mix[k];
+    }
+    if (!l->mix_total)
+        for (k = 0; k < HZA_GEN_KINDS; ++k) l->mix[k] = 1, ++l->mix_total;
+
+    /* 2 targets per branch */
+    l->target_count = 0;
+    state = g->seed ^ GEN_KIND_SALT;
+    for (i = 0; i < g->proc_count; ++i)
+    {
+        for (t = 0, j = 1; j < g->insn_count; ++j)
+            if (gen_kind(l, &state, t) == HZA_GEN_BRANCH) t += 2;
+        l->target_count += t;
+    }
+    if (l->target_count >= 0xFFFFFFFF) return HZAE_GEN_PARAMS;
+
+    l->insn_count = pc * g->insn_count;
+    l->data_block_count = 1 + (uint64_t) g->export_count + g->data_block_count;
+    l->data_size = (uint64_t) g->export_count * GEN_NAME_LEN
+        + (uint64_t) g->data_block_count * g->data_block_size;
+
+    n = sizeof(hza_mod00_hdr_t);
+    n += pc * g->const128_count * 0x10;
+    n += pc * g->const64_count * 8;
+    n += pc * g->const32_count * 4;
+    n += (pc + 1) * sizeof(hza_mod00_proc_t);
+    n += (l->data_block_count + 1) * 4;
+    n += sizeof(hza_mod00_impmod_t);
+    n += (uint64_t) g->export_count * 4;
+    n += l->target_count * 4;
+    n += l->insn_count * 8;
+    n += l->data_size;
+    if (n > 0xFFFFFFFF || n > (size_t) -1) return HZAE_GEN_PARAMS;
+    l->size = n;
+    return 0;
+}
+
+/* gen_proc_name ************************************************************/
+static void gen_proc_name
+(
+    uint8_t * p,
+    uint32_t index
+)
+{
+    uint_t i;
+
+    p[0] = 'p';
+    for (i = 8; i; --i, index >>= 4) p[i] = "0123456789ABCDEF"[index & 15];
+}
+
+/* hza_mod00_gen_size *******************************************************/
+HAZNA_API size_t C41_CALL hza_mod00_gen_size
+(
+    hza_mod00_gen_t const * g
+)
+{
+    gen_layout_t l;
+
+    return gen_layout(g, &l) ? 0 : (size_t) l.size;
+}
+
+/* hza_mod00_gen ************************************************************/
+HAZNA_API hza_error_t C41_CALL hza_mod00_gen
+(
+    hza_mod00_gen_t const * g,
+    uint8_t * data,
+    size_t size
+)
+{
+    gen_layout_t l;
+    uint8_t * c128; uint8_t * c64; uint8_t * c32; uint8_t * pt;
+    uint8_t * dbt; uint8_t * ex; uint8_t * tgt; uint8_t * insn; uint8_t * d;
+    uint64_t kst, ost, r;
+    uint32_t i, j, k, n, ti, tb, ofs;
+    uint16_t opcode, a, b, c;
+    hza_error_t e;
+
+    e = gen_layout(g, &l);
+    if (e) return e;
+    if (size < l.size) return HZAE_MOD00_TRUNC;
+    n = g->proc_count;
+
+    /* section pointers */
+    c128 = data + sizeof(hza_mod00_hdr_t);
+    c64 = c128 + (size_t) n * g->const128_count * 0x10;
+    c32 = c64 + (size_t) n * g->const64_count * 8;
+    pt = c32 + (size_t) n * g->const32_count * 4;
+    dbt = pt + (size_t) (n + 1) * sizeof(hza_mod00_proc_t);
+    ex = dbt + (size_t) (l.data_block_count + 1) * 4
+        + sizeof(hza_mod00_impmod_t);
+    tgt = ex + (size_t) g->export_count * 4;
+    insn = tgt + (size_t) l.target_count * 4;
+    d = insn + (size_t) l.insn_count * 8;
+
+    /* header */
+    C41_MEM_COPY(data, HZA_MOD00_MAGIC, HZA_MOD00_MAGIC_LEN);
+    c41_write_u32be(data + 0x08, (uint32_t) l.size);
+    c41_write_u32be(data + 0x0C, 0); // checksum, filled in at the end
+    c41_write_u32be(data + 0x10, 0); // name
+    c41_write_u32be(data + 0x14, n * g->const128_count);
+    c41_write_u32be(data + 0x18, n * g->const64_count);
+    c41_write_u32be(data + 0x1C, n * g->const32_count);
+    c41_write_u32be(data + 0x20, n);
+    c41_write_u32be(data + 0x24, (uint32_t) l.data_block_count);
+    c41_write_u32be(data + 0x28, 0); // import_module_count
+    c41_write_u32be(data + 0x2C, 0); // import_count
+    c41_write_u32be(data + 0x30, g->export_count);
+    c41_write_u32be(data + 0x34, (uint32_t) l.target_count);
+    c41_write_u32be(data + 0x38, (uint32_t) l.insn_count);
+    c41_write_u32be(data + 0x3C, (uint32_t) l.data_size);
+
+    /* constants: filler */
+    ost = g->seed;
+    for (i = 0; i < n * g->const128_count * 2; ++i)
+        c41_write_u64be(c128 + i * 8, gen_rand(&ost));
+    for (i = 0; i < n * g->const64_count; ++i)
+        c41_write_u64be(c64 + i * 8, gen_rand(&ost));
+    for (i = 0; i < n * g->const32_count; ++i)
+        c41_write_u32be(c32 + i * 4, (uint32_t) gen_rand(&ost));
+
+    /* data blocks: empty block 0, proc names, then the filler blocks which
+     * are longer than names and start with their index to keep them sorted */
+    c41_write_u32be(dbt, 0);
+    for (i = 1, ofs = 0; i < l.data_block_count; ++i)
+    {
+        c41_write_u32be(dbt + i * 4, ofs);
+        if (i <= g->export_count)
+        {
+            gen_proc_name(d + ofs, i - 1);
+            ofs += GEN_NAME_LEN;
+        }
+        else
+        {
+            c41_write_u32be(d + ofs, i);
+            for (k = 4; k < g->data_block_size; ++k)
+                d[ofs + k] = (uint8_t) gen_rand(&ost);
+            ofs += g->data_block_size;
+        }
+    }
+    c41_write_u32be(dbt + i * 4, ofs);
+
+    /* import module table: just the terminator */
+    c41_write_u32be(ex - 8, 0);
+    c41_write_u32be(ex - 4, 0);
+
+    /* exports: proc i is named by block i + 1 */
+    for (i = 0; i < g->export_count; ++i) c41_write_u32be(ex + i * 4, i);
+
+    /* procs */
+    kst = g->seed ^ GEN_KIND_SALT;
+    for (i = 0, ti = 0; i <= n; ++i)
+    {
+        uint8_t * pe = pt + i * sizeof(hza_mod00_proc_t);
+
+        c41_write_u32be(pe + 0x00, i * g->insn_count);
+        c41_write_u32be(pe + 0x04, ti);
+        c41_write_u32be(pe + 0x08, i * g->const128_count);
+        c41_write_u32be(pe + 0x0C, i * g->const64_count);
+        c41_write_u32be(pe + 0x10, i * g->const32_count);
+        c41_write_u32be(pe + 0x14, i < g->export_count ? i + 1 : 0);
+        if (i == n) break;
+
+        for (tb = ti, j = 0; j + 1 < g->insn_count; ++j)
+        {
+            r = gen_rand(&ost);
+            a = b = c = 0;
+            switch (gen_kind(&l, &kst, ti - tb))
+            {
+            case HZA_GEN_NOP:
+                opcode = HZAO_NOP;
+                break;
+            case HZA_GEN_INIT:
+                if (r & 1)
+                {
+                    opcode = HZAO_INIT_16;
+                    a = (uint16_t) (((r >> 1) % (GEN_REG_BYTES / 2)) * 16);
+                    b = (uint16_t) (r >> 16);
+                }
+                else
+                {
+                    opcode = HZAO_INIT_8;
+                    a = (uint16_t) (((r >> 1) % GEN_REG_BYTES) * 8);
+                    b = (uint8_t) (r >> 16);
+                }
+                break;
+            case HZA_GEN_ADD:
+                opcode = HZAO_WRAP_ADD_CONST_8;
+                a = (uint16_t) (((r >> 1) % GEN_REG_BYTES) * 8);
+                b = (uint16_t) (((r >> 8) % GEN_REG_BYTES) * 8);
+                c = (uint8_t) (r >> 16);
+                break;
+            default: /* HZA_GEN_BRANCH: both targets ahead */
+                if (r & 1)
+                {
+                    opcode = HZAO_BRANCH_ZERO_16;
+                    a = (uint16_t) (((r >> 1) % (GEN_REG_BYTES / 2)) * 16);
+                }
+                else
+                {
+                    opcode = HZAO_BRANCH_ZERO_8;
+                    a = (uint16_t) (((r >> 1) % GEN_REG_BYTES) * 8);
+                }
+                c = (uint16_t) (ti - tb);
+                k = g->insn_count - 1 - j;
+                c41_write_u32be(tgt + ti * 4,
+                                j + 1 + (uint32_t) ((r >> 8) % k));
+                c41_write_u32be(tgt + ti * 4 + 4,
+                                j + 1 + (uint32_t) ((r >> 36) % k));
+                ti += 2;
+            }
+            k = i * g->insn_count + j;
+            c41_write_u16be(insn + k * 8, opcode);
+            c41_write_u16be(insn + k * 8 + 2, a);
+            c41_write_u16be(insn + k * 8 + 4, b);
+            c41_write_u16be(insn + k * 8 + 6, c);
+        }
+        k = i * g->insn_count + j;
+        c41_write_u16be(insn + k * 8, HZAO_RET);
+        c41_write_u16be(insn + k * 8 + 2, 0);
+        c41_write_u16be(insn + k * 8 + 4, 0);
+        c41_write_u16be(insn + k * 8 + 6, 0);
+    }
+
+    c41_write_u32be(data + HZA_MOD00_CHECKSUM_OFS,
+                    hza_mod00_checksum(data, (size_t) l.size));
+    return 0;
+}
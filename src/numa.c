@@ -0,0 +1,182 @@
+#if !_WIN32
+#   define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "cli.h"
+
+#if _WIN32
+#   include <windows.h>
+#else
+#   include <sched.h>
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#   if defined(SYS_mbind)
+#       include <linux/mempolicy.h>
+#   endif
+#endif
+
+#if !_WIN32
+#define NUMA_SYSFS "/sys/devices/system/node"
+
+/* numa_cpulist *************************************************************/
+/* parses a sysfs cpu list like "0-3,8-11" into node's cpu mask */
+static int numa_cpulist (numa_node_t * nn, char const * s)
+{
+    unsigned long a, b;
+    char * end;
+
+    while (*s && *s != '\n')
+    {
+        a = b = strtoul(s, &end, 10);
+        if (end == s) return -1;
+        if (*end == '-') b = strtoul(end + 1, &end, 10);
+        if (a > b || b >= NUMA_CPU_LIMIT) return -1;
+        for (; a <= b; ++a)
+        {
+            nn->cpu_mask[a >> 6] |= (uint64_t) 1 << (a & 63);
+            nn->cpu_count += 1;
+        }
+        s = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+#endif
+
+/* numa_cpu_count ***********************************************************/
+static uint_t numa_cpu_count ()
+{
+#if _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > NUMA_CPU_LIMIT ? NUMA_CPU_LIMIT : (uint_t) n);
+#endif
+}
+
+/* numa_bind ****************************************************************/
+/* asks the kernel to place the whole pages of the block on the node */
+static void numa_bind (numa_node_t * nn, void * p, size_t size)
+{
+#if !_WIN32 && defined(SYS_mbind)
+    uintptr_t a, b, ps;
+    unsigned long mask;
+
+    ps = (uintptr_t) sysconf(_SC_PAGESIZE);
+    a = ((uintptr_t) p + ps - 1) & ~(ps - 1);
+    b = ((uintptr_t) p + size) & ~(ps - 1);
+    if (a >= b) return;
+    mask = 1UL << nn->index;
+    /* best effort: the block works wherever its pages end up */
+    syscall(SYS_mbind, a, b - a, MPOL_PREFERRED, &mask, HZA_NODE_LIMIT + 1,
+            MPOL_MF_MOVE);
+#else
+    (void) nn;
+    (void) p;
+    (void) size;
+#endif
+}
+
+/* numa_handler *************************************************************/
+static uint_t C41_CALL numa_handler
+(
+    void * * ptr_p,
+    size_t old_size,
+    size_t new_size,
+    void * ctx
+)
+{
+    numa_node_t * nn = ctx;
+    c41_ma_t * wma = nn->numa->worker_ma;
+    uint_t mae;
+
+    mae = wma->handler(ptr_p, old_size, new_size, wma->context);
+    if (!mae && new_size && !nn->numa->simulated)
+        numa_bind(nn, *ptr_p, new_size);
+    return mae;
+}
+
+/* numa_init ****************************************************************/
+uint_t numa_init (numa_t * numa, c41_ma_t * worker_ma, uint_t sim_nodes)
+{
+    numa_node_t * nn;
+#if !_WIN32
+    char path[0x80];
+    char line[0x400];
+    FILE * f;
+#endif
+    uint_t i, n, cpu, cpu_count;
+
+    C41_VAR_ZERO(*numa);
+    numa->worker_ma = worker_ma;
+    for (i = 0; i < HZA_NODE_LIMIT; ++i)
+    {
+        nn = numa->node_a + i;
+        nn->ma.handler = numa_handler;
+        nn->ma.context = nn;
+        nn->numa = numa;
+        nn->index = i;
+    }
+
+    if (sim_nodes)
+    {
+        /* deal the cpus to the nodes in contiguous runs, sharing them when
+         * there are fewer cpus than nodes */
+        numa->simulated = 1;
+        numa->node_count = sim_nodes;
+        cpu_count = numa_cpu_count();
+        n = cpu_count > sim_nodes ? cpu_count : sim_nodes;
+        for (i = 0; i < n; ++i)
+        {
+            nn = numa->node_a + i * sim_nodes / n;
+            cpu = i % cpu_count;
+            nn->cpu_mask[cpu >> 6] |= (uint64_t) 1 << (cpu & 63);
+            nn->cpu_count += 1;
+        }
+        return 0;
+    }
+
+#if _WIN32
+    /* no topology discovery: a single default node */
+    return 1;
+#else
+    for (i = 0; i < HZA_NODE_LIMIT; ++i)
+    {
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%u/cpulist", i);
+        f = fopen(path, "r");
+        if (!f) break;
+        nn = numa->node_a + i;
+        if (!fgets(line, sizeof(line), f) || numa_cpulist(nn, line))
+        {
+            fclose(f);
+            return 1;
+        }
+        fclose(f);
+    }
+    numa->node_count = i;
+    return i ? 0 : 1;
+#endif
+}
+
+/* numa_pin *****************************************************************/
+uint_t numa_pin (numa_t * numa, uint_t node)
+{
+#if _WIN32
+    (void) numa;
+    (void) node;
+    return 0;
+#else
+    numa_node_t * nn = numa->node_a + node;
+    cpu_set_t set;
+    uint_t i;
+
+    if (!nn->cpu_count) return 0;
+    CPU_ZERO(&set);
+    for (i = 0; i < NUMA_CPU_LIMIT && i < CPU_SETSIZE; ++i)
+        if (nn->cpu_mask[i >> 6] & ((uint64_t) 1 << (i & 63)))
+            CPU_SET(i, &set);
+    return sched_setaffinity(0, sizeof(set), &set) ? 1 : 0;
+#endif
+}
@@ -2,6 +2,679 @@
 
 #define DO(_expr) if ((hze = (_expr))) \
     { err_line = __LINE__; rc |= 1; break; } else ((void) 0)
+#define EXPECT(_expr, _err) if ((hze = (_expr)) != (_err)) \
+    { err_line = __LINE__; rc |= 1; break; } else ((void) 0)
+#define CHECK(_cond) if ((_cond)) ; \
+    else { err_line = __LINE__; rc |= 1; break; }
+
+#define C32(_v) \
+    ((_v) >> 24), ((_v) >> 16) & 0xFF, ((_v) >> 8) & 0xFF, (_v) & 0xFF
+#define C16(_v) ((_v) >> 8), ((_v) & 0xFF)
+/* mod_ret ******************************************************************/
+/* smallest valid module: one proc that returns */
+static uint8_t mod_ret[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0x88),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(0),                     // target_count
+    C32(1),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(1), C32(0), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: insn table */
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x0088: end */
+};
+
+/* mod_imp ******************************************************************/
+/* imports proc '_test0' from module 'core' */
+static uint8_t mod_imp[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xA6),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(3),                     // data_block_count
+    C32(1),                     // import_module_count
+    C32(1),                     // import_count
+    C32(0),                     // export_count
+    C32(0),                     // target_count
+    C32(1),                     // insn_count
+    C32(0x0A),                  // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(1), C32(0), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0),                     // #0 - ''
+    C32(0),                     // #1 - 'core'
+    C32(4),                     // #2 - '_test0'
+    C32(0x0A),                  // END
+
+    /* 0x0080: import modules */
+    C32(1), C32(0),             // 'core', procs from 0
+    C32(0), C32(1),             // END
+
+    /* 0x0090: import proc table */
+    C32(2),                     // '_test0'
+
+    /* 0x0094: insn table */
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+
+    /* 0x009C: data area */
+    'c', 'o', 'r', 'e',
+    '_', 't', 'e', 's', 't', '0',
+    /* 0x00A6: end */
+};
+
+/* mod_cat ******************************************************************/
+/* copies input to output byte by byte */
+static uint8_t mod_cat[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xB8),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(4),                     // target_count
+    C32(5),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(5), C32(4), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: target table */
+    C32(2), C32(4),             // in: got byte, end of input
+    C32(1), C32(1),             // loop
+
+    /* 0x0090: insn table */
+    C16(HZAO_INIT_8), C16(0x08), C16(0), C16(0),
+    C16(HZAO_IN_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_OUT_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_BRANCH_ZERO_8), C16(0x08), C16(0), C16(2),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x00B8: end */
+};
+
+/* mod_bcat *****************************************************************/
+/* copies input to output in blocks of up to 4 bytes */
+static uint8_t mod_bcat[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xB8),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(4),                     // target_count
+    C32(5),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(5), C32(4), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: target table */
+    C32(4), C32(2),             // count: end of input, got bytes
+    C32(4), C32(0),             // loop
+
+    /* 0x0090: insn table */
+    C16(HZAO_IN_BLOCK_8), C16(0x40), C16(4), C16(0x00),
+    C16(HZAO_BRANCH_ZERO_16), C16(0x00), C16(0), C16(0),
+    C16(HZAO_OUT_BLOCK_8), C16(0x40), C16(4), C16(0x00),
+    C16(HZAO_BRANCH_ZERO_16), C16(0x00), C16(0), C16(2),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x00B8: end */
+};
+
+/* mod_bits *****************************************************************/
+/* outputs '0' + (bit 6 ? 1) + (bits 0..1 ? 2) + (bits 4..7 ? 4) per byte */
+static uint8_t mod_bits[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0x100),                 // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(10),                    // target_count
+    C32(11),                    // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(11), C32(10), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: target table */
+    C32(1), C32(10),            // in: got byte, end of input
+    C32(4), C32(3),             // bit 6
+    C32(6), C32(5),             // bits 0..1
+    C32(8), C32(7),             // bits 4..7
+    C32(0), C32(0),             // loop
+
+    /* 0x00A8: insn table */
+    C16(HZAO_IN_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_INIT_8), C16(0x08), C16('0'), C16(0),
+    C16(HZAO_BRANCH_ZERO_1), C16(0x06), C16(0), C16(2),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x08), C16(0x08), C16(1),
+    C16(HZAO_BRANCH_ZERO_2), C16(0x00), C16(0), C16(4),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x08), C16(0x08), C16(2),
+    C16(HZAO_BRANCH_ZERO_4), C16(0x04), C16(0), C16(6),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x08), C16(0x08), C16(4),
+    C16(HZAO_OUT_8), C16(0x08), C16(0), C16(0),
+    C16(HZAO_BRANCH_ZERO_8), C16(0x08), C16(0), C16(8),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x0100: end */
+};
+
+/* mod_host *****************************************************************/
+/* calls host function 0 twice on an 8-byte window holding 5 and 7 */
+static uint8_t mod_host[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xA8),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(0),                     // target_count
+    C32(5),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(5), C32(0), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: insn table */
+    C16(HZAO_INIT_16), C16(0x00), C16(5), C16(0),
+    C16(HZAO_INIT_16), C16(0x10), C16(7), C16(0),
+    C16(HZAO_HOST_CALL), C16(0x00), C16(8), C16(0),
+    C16(HZAO_HOST_CALL), C16(0x00), C16(8), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x00A8: end */
+};
+
+/* mod_rec ******************************************************************/
+/* outputs n, n - 1, ... 1 calling itself with n - 1 in the regs after its
+ * own, then calls '_test0' from module 'core' on the way back */
+static uint8_t mod_rec[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xD6),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(3),                     // data_block_count
+    C32(1),                     // import_module_count
+    C32(1),                     // import_count
+    C32(0),                     // export_count
+    C32(2),                     // target_count
+    C32(6),                     // insn_count
+    C32(0x0A),                  // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(6), C32(2), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0),                     // #0 - ''
+    C32(0),                     // #1 - 'core'
+    C32(4),                     // #2 - '_test0'
+    C32(0x0A),                  // END
+
+    /* 0x0080: import modules */
+    C32(1), C32(0),             // 'core', procs from 0
+    C32(0), C32(1),             // END
+
+    /* 0x0090: import proc table */
+    C32(2),                     // '_test0'
+
+    /* 0x0094: target table */
+    C32(4), C32(1),             // n is 0, n is not 0
+
+    /* 0x009C: insn table */
+    C16(HZAO_BRANCH_ZERO_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_OUT_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x80), C16(0x00), C16(0xFF),
+    C16(HZAO_CALL), C16(0x80), C16(0), C16(0),
+    C16(HZAO_CALL_IMPORT), C16(0x80), C16(0), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+
+    /* 0x00CC: data area */
+    'c', 'o', 'r', 'e',
+    '_', 't', 'e', 's', 't', '0',
+    /* 0x00D6: end */
+};
+/* mod_fail *****************************************************************/
+/* proc 0 calls proc 1, which outputs a 4-byte block and calls host function
+ * 0 on the same 8-byte window; both can fail inside the callee */
+static uint8_t mod_fail[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xC8),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(2),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(0),                     // target_count
+    C32(6),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: proc 01 */
+    C32(2), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0070: end of proc table */
+    C32(6), C32(0), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0088: data block table */
+    C32(0), C32(0),
+
+    /* 0x0090: import modules */
+    C32(0), C32(0),
+
+    /* 0x0098: insn table */
+    C16(HZAO_CALL), C16(0x80), C16(1), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    C16(HZAO_INIT_16), C16(0x00), C16(4), C16(0),
+    C16(HZAO_OUT_BLOCK_8), C16(0x40), C16(4), C16(0x00),
+    C16(HZAO_HOST_CALL), C16(0x40), C16(8), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x00C8: end */
+};
+/* mod_tail *****************************************************************/
+/* two procs passing control back and forth with tail calls; proc 0 counts
+ * n in reg 0 down to 0, proc 1 counts up in reg 1 */
+static uint8_t mod_tail[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0xD0),                  // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(2),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(2),                     // target_count
+    C32(6),                     // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: proc 01 */
+    C32(4), C32(2), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0070: end of proc table */
+    C32(6), C32(2), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0088: data block table */
+    C32(0), C32(0),
+
+    /* 0x0090: import modules */
+    C32(0), C32(0),
+
+    /* 0x0098: target table */
+    C32(3), C32(1),             // n is 0, n is not 0
+
+    /* 0x00A0: insn table */
+    C16(HZAO_BRANCH_ZERO_8), C16(0x00), C16(0), C16(0),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x00), C16(0x00), C16(0xFF),
+    C16(HZAO_TAIL_CALL), C16(0x00), C16(1), C16(0),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    C16(HZAO_WRAP_ADD_CONST_8), C16(0x08), C16(0x08), C16(1),
+    C16(HZAO_TAIL_CALL), C16(0x00), C16(0), C16(0),
+    /* 0x00D0: end */
+};
+/* mod_lane *****************************************************************/
+/* runs each lane op once on regs b at 0x00 and c at 0x10 (bytes); the
+ * result of op k is at 0x20 + 0x10 * k */
+static uint8_t mod_lane[] =
+{
+    /* 0x0000: header */
+    '[', 'h', 'z', 'a', '0', '0', ']', 0x0A,
+    C32(0x170),                 // size (in bytes)
+    C32(0),                     // checksum (computed by test)
+    C32(0),                     // name
+    C32(0),                     // const128_count
+    C32(0),                     // const64_count
+    C32(0),                     // const32_count
+    C32(1),                     // proc_count
+    C32(1),                     // data_block_count
+    C32(0),                     // import_module_count
+    C32(0),                     // import_count
+    C32(0),                     // export_count
+    C32(0),                     // target_count
+    C32(0x1E),                  // insn_count
+    C32(0),                     // data_size
+
+    /* 0x0040: proc 00 */
+    C32(0), C32(0), C32(0), C32(0), C32(0), C32(0),
+    /* 0x0058: end of proc table */
+    C32(0x1E), C32(0), C32(0), C32(0), C32(0), C32(0),
+
+    /* 0x0070: data block table */
+    C32(0), C32(0),
+
+    /* 0x0078: import modules */
+    C32(0), C32(0),
+
+    /* 0x0080: insn table */
+    C16(HZAO_VADD_8), C16(0x100), C16(0x000), C16(0x080),
+    C16(HZAO_VADD_16), C16(0x180), C16(0x000), C16(0x080),
+    C16(HZAO_VADD_32), C16(0x200), C16(0x000), C16(0x080),
+    C16(HZAO_VADD_64), C16(0x280), C16(0x000), C16(0x080),
+    C16(HZAO_VSUB_8), C16(0x300), C16(0x000), C16(0x080),
+    C16(HZAO_VSUB_16), C16(0x380), C16(0x000), C16(0x080),
+    C16(HZAO_VSUB_32), C16(0x400), C16(0x000), C16(0x080),
+    C16(HZAO_VSUB_64), C16(0x480), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_EQ_8), C16(0x500), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_EQ_16), C16(0x580), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_EQ_32), C16(0x600), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_EQ_64), C16(0x680), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_GT_8), C16(0x700), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_GT_16), C16(0x780), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_GT_32), C16(0x800), C16(0x000), C16(0x080),
+    C16(HZAO_VCMP_GT_64), C16(0x880), C16(0x000), C16(0x080),
+    C16(HZAO_VMIN_8), C16(0x900), C16(0x000), C16(0x080),
+    C16(HZAO_VMIN_16), C16(0x980), C16(0x000), C16(0x080),
+    C16(HZAO_VMIN_32), C16(0xA00), C16(0x000), C16(0x080),
+    C16(HZAO_VMIN_64), C16(0xA80), C16(0x000), C16(0x080),
+    C16(HZAO_VMAX_8), C16(0xB00), C16(0x000), C16(0x080),
+    C16(HZAO_VMAX_16), C16(0xB80), C16(0x000), C16(0x080),
+    C16(HZAO_VMAX_32), C16(0xC00), C16(0x000), C16(0x080),
+    C16(HZAO_VMAX_64), C16(0xC80), C16(0x000), C16(0x080),
+    C16(HZAO_VSHUFFLE_8), C16(0xD00), C16(0x000), C16(0x080),
+    C16(HZAO_VAND_128), C16(0xD80), C16(0x000), C16(0x080),
+    C16(HZAO_VOR_128), C16(0xE00), C16(0x000), C16(0x080),
+    C16(HZAO_VXOR_128), C16(0xE80), C16(0x000), C16(0x080),
+    C16(HZAO_VMOVEMASK_8), C16(0xF00), C16(0x000), C16(0x080),
+    C16(HZAO_RET), C16(0), C16(0), C16(0),
+    /* 0x0170: end */
+};
+
+/* lane_opcodes: the ops of mod_lane in order */
+static uint16_t const lane_opcodes[] =
+{
+    HZAO_VADD_8, HZAO_VADD_16, HZAO_VADD_32,
+    HZAO_VADD_64, HZAO_VSUB_8, HZAO_VSUB_16,
+    HZAO_VSUB_32, HZAO_VSUB_64, HZAO_VCMP_EQ_8,
+    HZAO_VCMP_EQ_16, HZAO_VCMP_EQ_32, HZAO_VCMP_EQ_64,
+    HZAO_VCMP_GT_8, HZAO_VCMP_GT_16, HZAO_VCMP_GT_32,
+    HZAO_VCMP_GT_64, HZAO_VMIN_8, HZAO_VMIN_16,
+    HZAO_VMIN_32, HZAO_VMIN_64, HZAO_VMAX_8,
+    HZAO_VMAX_16, HZAO_VMAX_32, HZAO_VMAX_64,
+    HZAO_VSHUFFLE_8, HZAO_VAND_128, HZAO_VOR_128,
+    HZAO_VXOR_128, HZAO_VMOVEMASK_8,
+};
+#undef C16
+#undef C32
+
+/* set_u32be ****************************************************************/
+static void set_u32be (uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+/* test_image_t: in-memory stream for task images */
+typedef struct test_image_s                     test_image_t;
+struct test_image_s
+{
+    uint8_t data[0x2000];
+    size_t size;
+    size_t pos;
+};
+
+/* test_image_write *********************************************************/
+static uint_t C41_CALL test_image_write (void * ctx, void * data, size_t size)
+{
+    test_image_t * img = ctx;
+
+    if (size > sizeof(img->data) - img->size) return 1;
+    C41_MEM_COPY(img->data + img->size, data, size);
+    img->size += size;
+    return 0;
+}
+
+/* test_image_read **********************************************************/
+static uint_t C41_CALL test_image_read (void * ctx, void * data, size_t size)
+{
+    test_image_t * img = ctx;
+
+    if (size > img->size - img->pos) return 1;
+    C41_MEM_COPY(data, img->data + img->pos, size);
+    img->pos += size;
+    return 0;
+}
+
+/* test_clock ***************************************************************/
+/* ticks once per call so lock stats are deterministic */
+static uint64_t test_ticks;
+static uint64_t C41_CALL test_clock (void)
+{
+    return ++test_ticks;
+}
+
+/* test_host ****************************************************************/
+/* stores the sum of the first two 16-bit regs in the third one and counts
+ * the calls in the uint_t at ctx; asks to stop on the second call */
+static uint_t C41_CALL test_host (hza_context_t * hc, uint8_t * regs,
+                                  void * ctx)
+{
+    uint_t * count = ctx;
+    uint16_t v[3];
+
+    (void) hc;
+    C41_MEM_COPY(v, regs, 4);
+    v[2] = v[0] + v[1];
+    C41_MEM_COPY(regs + 4, v + 2, 2);
+    return ++*count == 2;
+}
+
+/* test_proc_hook ***********************************************************/
+/* counts enters/exits in the uint_t[2] at proc_hook_ctx and checks labels */
+static void C41_CALL test_proc_hook
+(
+    hza_context_t * hc,
+    hza_frame_t const * f,
+    uint_t event
+)
+{
+    uint_t * count = hc->proc_hook_ctx;
+    char label[0x20];
+
+    if (hza_proc_label(hc, f, label, sizeof(label))
+        || !C41_STR_EQUAL(label + C41_STR_LEN(label) - 10, ".p00000001"))
+        return;
+    count[event] += 1;
+}
+
+/* test_count_hook **********************************************************/
+/* counts all enters/exits in the uint_t[2] at proc_hook_ctx */
+static void C41_CALL test_count_hook
+(
+    hza_context_t * hc,
+    hza_frame_t const * f,
+    uint_t event
+)
+{
+    uint_t * count = hc->proc_hook_ctx;
+
+    (void) f;
+    count[event] += 1;
+}
+
+/* test_lane_get ************************************************************/
+/* reads a lane of w bytes in host order */
+static uint64_t test_lane_get (uint8_t const * p, uint_t w)
+{
+    uint16_t u16;
+    uint32_t u32;
+    uint64_t u64;
+
+    switch (w)
+    {
+    case 1:
+        return *p;
+    case 2:
+        C41_MEM_COPY(&u16, p, 2);
+        return u16;
+    case 4:
+        C41_MEM_COPY(&u32, p, 4);
+        return u32;
+    }
+    C41_MEM_COPY(&u64, p, 8);
+    return u64;
+}
+
+/* test_lane_ok *************************************************************/
+/* checks that a holds the result of the lane op on b and c */
+static int test_lane_ok (uint16_t opcode, uint8_t const * a,
+                         uint8_t const * b, uint8_t const * c)
+{
+    uint64_t x, y, z, mask;
+    uint_t k, w;
+
+    if (opcode == HZAO_VMOVEMASK_8)
+    {
+        for (z = 0, k = 0; k < 16; ++k) z |= (uint64_t) (b[k] >> 7) << k;
+        return test_lane_get(a, 2) == z;
+    }
+    if (opcode == HZAO_VSHUFFLE_8)
+    {
+        for (k = 0; k < 16; ++k)
+            if (a[k] != (c[k] & 0x80 ? 0 : b[c[k] & 15])) return 0;
+        return 1;
+    }
+    w = HZA_OPCODE_SEC_SIZE(opcode) == HZAS_128
+        ? 8 : 1 << (HZA_OPCODE_SEC_SIZE(opcode) - HZAS_8);
+    mask = w == 8 ? ~(uint64_t) 0 : ((uint64_t) 1 << (w * 8)) - 1;
+    for (k = 0; k < 16; k += w)
+    {
+        x = test_lane_get(b + k, w);
+        y = test_lane_get(c + k, w);
+        switch (HZA_OPCODE_SEC_SIZE(opcode) == HZAS_128
+                ? 8 | (opcode & 0x1F) : opcode & 0x1F)
+        {
+        case 0: z = x + y; break;
+        case 1: z = x - y; break;
+        case 2: z = x == y ? mask : 0; break;
+        case 3: z = x > y ? mask : 0; break;
+        case 4: z = x < y ? x : y; break;
+        case 5: z = x > y ? x : y; break;
+        case 8: z = x & y; break;
+        case 9: z = x | y; break;
+        case 10: z = x ^ y; break;
+        default: return 0;
+        }
+        if ((z ^ test_lane_get(a + k, w)) & mask) return 0;
+    }
+    return 1;
+}
 
 /* test *********************************************************************/
 uint8_t test (c41_io_t * log_io, c41_ma_t * ma, c41_smt_t * smt)
@@ -9,7 +682,32 @@ uint8_t test (c41_io_t * log_io, c41_ma_t * ma, c41_smt_t * smt)
     uint8_t rc;
     hza_error_t hze;
     hza_context_t hcd;
+    hza_context_t hc2;
     hza_task_t * t;
+    hza_task_t * ft;
+    hza_module_t * m;
+    hza_module_t * cm;
+    hza_module_t * dm;
+    hza_world_stats_t ws;
+    hza_mod00_gen_t gp;
+    uint8_t cat_in[3] = { 'a', 'b', 'c' };
+    uint8_t cat_out[4];
+    uint8_t obuf[2];
+    uint8_t bits_in[6] = { 0x00, 0x40, 0x02, 0x10, 0x43, 0x04 };
+    uint8_t bits_out[8];
+    uint8_t * ibuf;
+    uint8_t * gbuf;
+    uint8_t * tr;
+    size_t gz, fz;
+    uint32_t i, gmi;
+    uint_t hook_count[2];
+    uint_t host_count;
+    uint_t mc;
+    uint16_t host_sum;
+    uint8_t rec_out[0x30];
+    uint8_t warm_out[sizeof(rec_out)];
+    c41_ma_counter_t node_mac;
+    static test_image_t img;
 
     char inited = 0;
     int err_line = 0;
@@ -29,8 +727,477 @@ uint8_t test (c41_io_t * log_io, c41_ma_t * ma, c41_smt_t * smt)
         inited = 1;
 
         DO(hza_task_create(&hcd, &t));
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.task_count[HZA_TASK_SUSPENDED] == 1);
+        CHECK(ws.mem_live[HZA_MEM_TASK] == HZA_TASK_ALLOC_SIZE);
+        CHECK(ws.module_count == 1 && ws.context_count == 1);
+        DO(hza_enter(&hcd, 0, 1, 0x80));
+        DO(hza_run(&hcd, 0, 100));
+
+        /* module checksum */
+        set_u32be(mod_ret + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_ret, sizeof(mod_ret)));
+        DO(hza_module_load(&hcd, mod_ret, sizeof(mod_ret), 0, &m));
+        mod_ret[HZA_MOD00_CHECKSUM_OFS] ^= 0x20;
+        EXPECT(hza_module_load(&hcd, mod_ret, sizeof(mod_ret), 0, &m),
+               HZAE_MOD00_CHECKSUM);
+        DO(hza_module_load(&hcd, mod_ret, sizeof(mod_ret),
+                           HZA_LOAD_NO_CHECKSUM, &m));
+        mod_ret[HZA_MOD00_CHECKSUM_OFS] ^= 0x20;
+
+        /* import linking */
+        DO(hza_module_by_name(&hcd, (uint8_t const *) "core", 4, &cm));
+        set_u32be(mod_imp + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_imp, sizeof(mod_imp)));
+        DO(hza_module_load(&hcd, mod_imp, sizeof(mod_imp), 0, &m));
+        CHECK(m->import_table[0] == cm->proc_table + 1);
+        DO(hza_import(&hcd, m, 0));
+        CHECK(hcd.args.module_index == 1);
+        CHECK(t->module_table[1].impmod_index[0] == 0);
+        mod_imp[0x9C + 9] = '1'; // '_test1' is not exported
+        EXPECT(hza_module_load(&hcd, mod_imp, sizeof(mod_imp),
+                               HZA_LOAD_NO_CHECKSUM, &m), HZAE_IMPORT_PROC);
+        mod_imp[0x9C + 9] = '0';
+
+        /* byte channels */
+        set_u32be(mod_cat + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_cat, sizeof(mod_cat)));
+        DO(hza_module_load(&hcd, mod_cat, sizeof(mod_cat), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        DO(hza_task_output(&hcd, obuf, sizeof(obuf)));
+        DO(hza_task_input(&hcd, cat_in, sizeof(cat_in), 0));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_OUTPUT && t->out.pos == 2);
+        cat_out[0] = obuf[0];
+        cat_out[1] = obuf[1];
+        DO(hza_task_output(&hcd, obuf, sizeof(obuf)));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_INPUT && t->out.pos == 1);
+        cat_out[2] = obuf[0];
+        DO(hza_task_output(&hcd, obuf, sizeof(obuf)));
+        DO(hza_task_input(&hcd, NULL, 0, 1));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->out.pos == 0);
+        CHECK(cat_out[0] == 'a' && cat_out[1] == 'b' && cat_out[2] == 'c');
+
+        /* sub-byte branches */
+        set_u32be(mod_bits + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_bits, sizeof(mod_bits)));
+        DO(hza_module_load(&hcd, mod_bits, sizeof(mod_bits), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        DO(hza_task_output(&hcd, bits_out, sizeof(bits_out)));
+        DO(hza_task_input(&hcd, bits_in, sizeof(bits_in), 1));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->out.pos == 6);
+        CHECK(C41_MEM_EQUAL(bits_out, "052470", 6));
+
+        /* host calls get the caller's regs in place and can stop the run */
+        host_count = 0;
+        DO(hza_host_register(&hcd, test_host, &host_count, 6, &i));
+        CHECK(i == 0);
+        DO(hza_host_register(&hcd, test_host, &host_count, 0x10, &i));
+        set_u32be(mod_host + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_host, sizeof(mod_host)));
+        DO(hza_module_load(&hcd, mod_host, sizeof(mod_host), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        gmi = hcd.args.module_index;
+        DO(hza_enter(&hcd, gmi, 0, 0));
+        fz = t->frame_table[t->frame_index].reg_base;
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_HOST && host_count == 2);
+        /* the stopping call is not made again */
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && host_count == 2);
+        C41_MEM_COPY(&host_sum, t->reg_space + fz + 4, 2);
+        CHECK(host_sum == 12);
+        /* function 1 needs a bigger window than the insn passes */
+        m->proc_table[0].insn_table[2].c = 1;
+        DO(hza_enter(&hcd, gmi, 0, 0));
+        EXPECT(hza_run(&hcd, 0, 1000), HZAE_HOST_CALL);
+        m->proc_table[0].insn_table[2].c = 0;
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && host_count == 4);
+
+        /* calls from VM code push frames, growing the task on the way */
+        set_u32be(mod_rec + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_rec, sizeof(mod_rec)));
+        DO(hza_module_load(&hcd, mod_rec, sizeof(mod_rec), 0, &m));
+        CHECK(m->proc_table[0].module == m);
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        t->reg_space[t->frame_table[t->frame_index].reg_base] =
+            sizeof(rec_out);
+        DO(hza_task_output(&hcd, rec_out, sizeof(rec_out)));
+        DO(hza_run(&hcd, 0, 0x10000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        CHECK(t->out.pos == sizeof(rec_out) && t->frame_limit > 0x30);
+        CHECK(rec_out[0] == 0x30 && rec_out[1] == 0x2F && rec_out[0x2F] == 1);
+        mod_rec[0x9C + 0x1D] = 1; // call proc 1 of a 1-proc module
+        EXPECT(hza_module_load(&hcd, mod_rec, sizeof(mod_rec),
+                               HZA_LOAD_NO_CHECKSUM, &m), HZAE_MOD00_CORRUPT);
+        mod_rec[0x9C + 0x1D] = 0;
+
+        /* an insn failing in a callee leaves the task on that insn */
+        set_u32be(mod_fail + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_fail, sizeof(mod_fail)));
+        DO(hza_module_load(&hcd, mod_fail, sizeof(mod_fail), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        gmi = hcd.args.module_index;
+        DO(hza_enter(&hcd, gmi, 0, 0));
+        fz = t->frame_index;
+        DO(hza_task_output(&hcd, obuf, sizeof(obuf)));
+        EXPECT(hza_run(&hcd, 0, 1000), HZAE_CHAN_SIZE);
+        CHECK(t->frame_index == fz + 1);
+        CHECK(t->frame_table[fz].insn_index == 1);
+        CHECK(t->frame_table[fz + 1].insn_index == 1);
+        DO(hza_task_output(&hcd, cat_out, sizeof(cat_out)));
+        host_count = 0;
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == fz - 1);
+        CHECK(t->out.pos == 4 && host_count == 1);
+        /* function 1 needs a bigger window than the insn passes */
+        m->proc_table[1].insn_table[2].c = 1;
+        DO(hza_enter(&hcd, gmi, 0, 0));
+        DO(hza_task_output(&hcd, NULL, 0));
+        EXPECT(hza_run(&hcd, 0, 1000), HZAE_HOST_CALL);
+        CHECK(t->frame_index == fz + 1);
+        CHECK(t->frame_table[fz + 1].insn_index == 2);
+        m->proc_table[1].insn_table[2].c = 0;
+        host_count = 2;
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == fz - 1);
+        CHECK(t->out.pos == 4 && host_count == 3);
+
+        /* tail calls reuse the frame: a state machine runs in one frame */
+        set_u32be(mod_tail + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_tail, sizeof(mod_tail)));
+        DO(hza_module_load(&hcd, mod_tail, sizeof(mod_tail), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        fz = t->frame_limit;
+        tr = t->reg_space + t->frame_table[t->frame_index].reg_base;
+        tr[0] = 0xC8;
+        tr[1] = 0;
+        hook_count[HZA_PROC_ENTER] = hook_count[HZA_PROC_EXIT] = 0;
+        DO(hza_proc_hook(&hcd, test_count_hook, hook_count));
+        DO(hza_run(&hcd, 0, 0x1000));
+        DO(hza_proc_hook(&hcd, NULL, NULL));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        CHECK(t->frame_limit == fz && tr[0] == 0 && tr[1] == 0xC8);
+        /* each tail call exits the caller and enters the callee */
+        CHECK(hook_count[HZA_PROC_ENTER] == 2 * 0xC8);
+        CHECK(hook_count[HZA_PROC_EXIT] == 2 * 0xC8 + 1);
+        mod_tail[0xA0 + 0x2D] = 2; // tail call proc 2 of a 2-proc module
+        EXPECT(hza_module_load(&hcd, mod_tail, sizeof(mod_tail),
+                               HZA_LOAD_NO_CHECKSUM, &m), HZAE_MOD00_CORRUPT);
+        mod_tail[0xA0 + 0x2D] = 0;
+        mod_tail[0xA0 + 0x29] = (uint8_t) HZAO_CALL; // call cannot end a proc
+        EXPECT(hza_module_load(&hcd, mod_tail, sizeof(mod_tail),
+                               HZA_LOAD_NO_CHECKSUM, &m), HZAE_MOD00_CORRUPT);
+        mod_tail[0xA0 + 0x29] = (uint8_t) HZAO_TAIL_CALL;
+        /* failed loads give their arena space back: more of them than a
+         * chunk holds leave the world as it was */
+        DO(hza_world_stats(&hcd, &ws));
+        fz = ws.mem_total;
+        gz = ws.mem_live[HZA_MEM_MODULE];
+        mod_tail[0xA0 + 0x2D] = 2;
+        hcd.world->log_level = HZA_LL_FATAL;
+        for (i = 0; i < 0x200; ++i)
+            EXPECT(hza_module_load(&hcd, mod_tail, sizeof(mod_tail),
+                                   HZA_LOAD_NO_CHECKSUM, &m),
+                   HZAE_MOD00_CORRUPT);
+        hcd.world->log_level = HZA_LL_DEBUG;
+        mod_tail[0xA0 + 0x2D] = 0;
+        if (rc) break;
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.mem_total == fz && ws.mem_live[HZA_MEM_MODULE] == gz);
+
+        /* lane ops against a per-lane reference; c equals b in its low
+         * 8 bytes and has some shuffle indexes with bit 7 set */
+        set_u32be(mod_lane + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_lane, sizeof(mod_lane)));
+        DO(hza_module_load(&hcd, mod_lane, sizeof(mod_lane), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        tr = t->reg_space + t->frame_table[t->frame_index].reg_base;
+        for (i = 0; i < 0x10; ++i)
+        {
+            tr[i] = (uint8_t) (i * 0x35 + 0x9C);
+            tr[0x10 + i] = i < 8 ? tr[i] : (uint8_t) (i * 0x5B);
+        }
+        DO(hza_run(&hcd, 0, 0x100));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        for (i = 0; i < sizeof(lane_opcodes) / sizeof(lane_opcodes[0]); ++i)
+            CHECK(test_lane_ok(lane_opcodes[i], tr + 0x20 + 0x10 * i,
+                               tr, tr + 0x10));
+        if (rc) break;
+
+        /* block channel ops on task-owned buffers, profiled */
+        hze = hza_prof_enable(&hcd);
+        CHECK(!hze || hze == HZAE_NOT_SUPPORTED);
+        DO(hza_sample_enable(&hcd, 2));
+        set_u32be(mod_bcat + HZA_MOD00_CHECKSUM_OFS,
+                  hza_mod00_checksum(mod_bcat, sizeof(mod_bcat)));
+        DO(hza_module_load(&hcd, mod_bcat, sizeof(mod_bcat), 0, &m));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        DO(hza_task_input(&hcd, cat_in, sizeof(cat_in), 0));
+        DO(hza_task_chan_alloc(&hcd, 8, 4, &ibuf));
+        CHECK(t->in.data == ibuf && t->in.size == 0 && t->in.pos == 0);
+        C41_MEM_COPY(ibuf, "abcdef", 6);
+        DO(hza_task_input(&hcd, ibuf, 6, 0));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_OUTPUT && t->out.pos == 4);
+        CHECK(C41_MEM_EQUAL(t->out.data, "abcd", 4));
+        DO(hza_task_output(&hcd, NULL, 0));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_INPUT && t->out.pos == 2);
+        CHECK(C41_MEM_EQUAL(t->out.data, "ef", 2));
+        DO(hza_task_output(&hcd, NULL, 0));
+        DO(hza_task_input(&hcd, ibuf, 0, 1));
+        DO(hza_run(&hcd, 0, 1000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->out.pos == 0);
+        /* insns that stopped the run are counted once, when resumed */
+        CHECK(!hcd.prof || (hcd.prof->opcode_count[HZAO_IN_BLOCK_8] == 3
+                            && hcd.prof->opcode_count[HZAO_OUT_BLOCK_8] == 2
+                            && hcd.prof->opcode_count[HZAO_BRANCH_ZERO_16] == 5
+                            && hcd.prof->branch_count == 2));
+        DO(hza_prof_report(&hcd, log_io));
+        CHECK(!hcd.prof || (hcd.prof->opcode_count[HZAO_RET] == 0
+                            && hcd.world->prof->opcode_count[HZAO_RET] == 1));
+        DO(hza_prof_disable(&hcd));
+        DO(hza_sample_disable(&hcd));
+        CHECK(hcd.world->sample_count > 0);
+        DO(hza_sample_report(&hcd, log_io));
+
+        /* synthetic modules: same seed, same image; every proc returns */
+        C41_VAR_ZERO(gp);
+        gp.seed = 0x5EED;
+        gp.proc_count = 8;
+        gp.insn_count = 0x40;
+        gp.const128_count = gp.const64_count = gp.const32_count = 1;
+        gp.export_count = 5;
+        gp.data_block_count = 3;
+        gp.data_block_size = 0x18;
+        gz = hza_mod00_gen_size(&gp);
+        CHECK(gz > 0);
+        CHECK(!c41_ma_alloc(ma, (void * *) &gbuf, gz * 2));
+        hze = hza_mod00_gen(&gp, gbuf, gz);
+        if (!hze) hze = hza_mod00_gen(&gp, gbuf + gz, gz);
+        if (!hze && !C41_MEM_EQUAL(gbuf, gbuf + gz, gz)) hze = HZAF_BUG;
+        if (!hze) hze = hza_module_load(&hcd, gbuf, gz, 0, &m);
+        if (!hze && hza_mod00_gen(&gp, gbuf, gz - 1) != HZAE_MOD00_TRUNC)
+            hze = HZAF_BUG;
+        c41_ma_free(ma, gbuf, gz * 2);
+        DO(hze);
+        CHECK(m->proc_count == 8);
+        CHECK(hza_export_by_name(m, (uint8_t const *) "p00000004", 9) == 4);
+        CHECK(hza_export_by_name(m, (uint8_t const *) "p00000005", 9) < 0);
+        DO(hza_import(&hcd, m, 0));
+        gmi = hcd.args.module_index;
+        for (i = 0; i < gp.proc_count; ++i)
+        {
+            DO(hza_enter(&hcd, gmi, i, 0));
+            DO(hza_run(&hcd, 0, gp.insn_count + 1));
+            CHECK(hcd.run_stop == HZA_RUN_FRAME);
+        }
+        if (rc) break;
+        hook_count[HZA_PROC_ENTER] = hook_count[HZA_PROC_EXIT] = 0;
+        DO(hza_proc_hook(&hcd, test_proc_hook, hook_count));
+        DO(hza_enter(&hcd, gmi, 1, 0));
+        DO(hza_run(&hcd, 0, gp.insn_count + 1));
+        DO(hza_proc_hook(&hcd, NULL, NULL));
+        CHECK(hook_count[HZA_PROC_ENTER] == 1);
+        CHECK(hook_count[HZA_PROC_EXIT] == 1);
+        /* growing the frame table keeps the frames */
+        for (i = 0; i < 0x20; ++i) DO(hza_enter(&hcd, gmi, 2, 0));
+        CHECK(t->frame_limit > 0x20 && t->frame_index == 0x20);
+        CHECK(t->frame_table[1].proc == m->proc_table + 2);
+        CHECK(t->frame_table[0x20].insn_index == 0);
+        DO(hza_run(&hcd, 0, 0x20 * (gp.insn_count + 1)));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        gp.export_count = 9;
+        CHECK(!hza_mod00_gen_size(&gp));
+
+        /* a fork copies the frames, regs and module map of a stopped task
+         * and runs on its own */
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        DO(hza_world_stats(&hcd, &ws));
+        fz = ws.mem_total;
+        DO(hza_task_fork(&hcd, t, &ft));
+        CHECK(hcd.active_task == ft && ft != t && ft->frame_index == 2);
+        CHECK(ft->module_count == t->module_count);
+        CHECK(ft->module_table[1].impmod_index != t->module_table[1].impmod_index
+              && ft->module_table[1].impmod_index[0] == 0);
+        CHECK(C41_MEM_EQUAL(ft->reg_space, t->reg_space, t->reg_limit));
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.task_count[HZA_TASK_SUSPENDED] == 2);
+        CHECK(ws.mem_total - fz == HZA_TASK_ALLOC_SIZE + t->reg_limit
+              + t->frame_limit * sizeof(hza_frame_t)
+              + t->module_limit * sizeof(hza_modmap_t)
+              + 2 * sizeof(uint32_t)); // impmod tables of mod_imp, mod_rec
+        DO(hza_run(&hcd, 0, 2 * (gp.insn_count + 1)));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && ft->frame_index == 0);
+        CHECK(t->frame_index == 2);
+        DO(hza_task_deref(&hcd, ft));
+        hcd.active_task = t;
+        DO(hza_run(&hcd, 0, 2 * (gp.insn_count + 1)));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+
+        /* checkpoint and restore a task stopped in a proc; a second copy
+         * of mod_cat must come back as a second copy */
+        DO(hza_module_load(&hcd, mod_cat, sizeof(mod_cat), 0, &dm));
+        DO(hza_import(&hcd, dm, 0));
+        CHECK(hcd.args.module_index == t->module_count - 1);
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        img.size = 0;
+        DO(hza_task_save(&hcd, test_image_write, &img));
+        CHECK(img.size <= 0x10 + (t->module_count - 1) * 0x18 + 2 * 0x10
+              + 4 + t->reg_limit + 4);
+        img.pos = 0;
+        DO(hza_task_restore(&hcd, test_image_read, &img, &ft));
+        CHECK(hcd.active_task == ft && img.pos == img.size);
+        CHECK(ft->module_count == t->module_count && ft->frame_index == 1);
+        CHECK(ft->frame_table[1].proc == t->frame_table[1].proc);
+        CHECK(ft->module_table[gmi].module == m);
+        CHECK(ft->module_table[ft->module_count - 1].module == dm);
+        CHECK(C41_MEM_EQUAL(ft->reg_space, t->reg_space, t->reg_limit));
+        DO(hza_run(&hcd, 0, gp.insn_count + 1));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && ft->frame_index == 0);
+        DO(hza_task_deref(&hcd, ft));
+        img.data[0] ^= 1;
+        img.pos = 0;
+        EXPECT(hza_task_restore(&hcd, test_image_read, &img, &ft),
+               HZAE_IMAGE_CORRUPT);
+        img.data[0] ^= 1;
+        img.data[0x10] ^= 1; // checksum of module 1
+        img.pos = 0;
+        EXPECT(hza_task_restore(&hcd, test_image_read, &img, &ft),
+               HZAE_IMAGE_MODULE);
+        img.data[0x10] ^= 1;
+        img.size -= 4;
+        img.pos = 0;
+        EXPECT(hza_task_restore(&hcd, test_image_read, &img, &ft),
+               HZAE_IMAGE_IO);
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.task_count[HZA_TASK_SUSPENDED] == 1);
+        hcd.active_task = t;
+        DO(hza_run(&hcd, 0, gp.insn_count + 1));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+
+        /* trimming gives back what deep calls grew, once */
+        for (i = 0; i < 0x40; ++i) DO(hza_enter(&hcd, gmi, 2, 0x800));
+        CHECK(t->reg_limit > 0x40 * 0x100 && t->frame_limit == 0x80);
+        DO(hza_run(&hcd, 0, 0x40 * (gp.insn_count + 1)));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        DO(hza_world_stats(&hcd, &ws));
+        fz = ws.mem_live[HZA_MEM_REG] + ws.mem_live[HZA_MEM_FRAME];
+        DO(hza_task_trim(&hcd, &gz));
+        CHECK(t->reg_limit <= 0x200 && t->frame_limit < 0x20);
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(gz && fz - gz == ws.mem_live[HZA_MEM_REG]
+              + ws.mem_live[HZA_MEM_FRAME]);
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        DO(hza_task_trim(&hcd, &gz));
+        CHECK(!gz && t->frame_index == 1);
+        DO(hza_run(&hcd, 0, gp.insn_count + 1));
+
+        /* unwinding drops entered frames without running them */
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        DO(hza_enter(&hcd, gmi, 2, 0));
+        DO(hza_task_unwind(&hcd, 0));
+        CHECK(t->frame_index == 0);
+
+        /* lock stats and host functions change only while one context is
+         * attached */
+        DO(hza_attach(&hc2, hcd.world));
+        EXPECT(hza_lock_stats_enable(&hcd, test_clock), HZAE_STATE);
+        EXPECT(hza_host_register(&hcd, test_host, &host_count, 6, &i),
+               HZAE_STATE);
+        DO(hza_finish(&hc2));
+
+        /* task refs: the last deref frees the task */
+        DO(hza_world_stats(&hcd, &ws));
+        mc = ws.module_count;
+        DO(hza_lock_stats_enable(&hcd, test_clock));
+        DO(hza_task_ref(&hcd, t));
+        DO(hza_task_deref(&hcd, t));
+        CHECK(hcd.active_task == t);
+        DO(hza_task_deref(&hcd, t));
+        CHECK(hcd.active_task == NULL);
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.task_count[HZA_TASK_SUSPENDED] == 0);
+        CHECK(ws.mem_live[HZA_MEM_TASK] == 0 && ws.mem_live[HZA_MEM_REG] == 0);
+        CHECK(ws.mem_peak[HZA_MEM_TASK] == 2 * HZA_TASK_ALLOC_SIZE);
+        CHECK(ws.mem_live[HZA_MEM_MODULE] > 0 && ws.mem_live[HZA_MEM_NAME] > 0);
+        /* modules and name cells share arena chunks */
+        CHECK(ws.mem_peak[HZA_MEM_MODULE] == ws.mem_live[HZA_MEM_MODULE]);
+        CHECK(ws.mem_total >= ws.mem_live[HZA_MEM_MODULE]
+              + ws.mem_live[HZA_MEM_NAME] + ws.mem_live[HZA_MEM_OTHER]);
+        /* freeing the task keeps the modules it imported loaded */
+        CHECK(ws.module_count == mc);
+        /* ref, 2 derefs, stats call / task free, stats call */
+        CHECK(ws.lock[HZA_MUTEX_TASK].count == 4);
+        CHECK(ws.lock[HZA_MUTEX_WORLD].count == 2);
+        CHECK(ws.lock[HZA_MUTEX_TASK].contended == 0);
+        CHECK(ws.lock[HZA_MUTEX_TASK].hold_total >= 3);
+        DO(hza_lock_stats_enable(&hcd, NULL));
+
+        /* simulated 2-node topology: task memory comes from the allocator
+         * of its home node and moves only when migrated */
+        c41_ma_counter_init(&node_mac, ma,
+                            C41_SSIZE_MAX, C41_SSIZE_MAX, C41_SSIZE_MAX);
+        DO(hza_node_ma(&hcd, 1, &node_mac.ma));
+        DO(hza_node_set(&hcd, 1));
+        DO(hza_task_create(&hcd, &t));
+        CHECK(t->node == 1 && node_mac.count == 2);
+        EXPECT(hza_node_ma(&hcd, 1, NULL), HZAE_STATE);
+        EXPECT(hza_node_set(&hcd, HZA_NODE_LIMIT), HZAE_NODE);
+        DO(hza_task_migrate(&hcd, 0));
+        CHECK(t->node == 0 && node_mac.count == 0);
+        DO(hza_world_stats(&hcd, &ws));
+        CHECK(ws.migrate_count == 1 && ws.node_mem_live[1] == 0);
+        CHECK(ws.node_mem_live[0] == ws.mem_live[HZA_MEM_REG]
+              + ws.mem_live[HZA_MEM_FRAME]);
+        DO(hza_task_migrate(&hcd, 1));
         DO(hza_enter(&hcd, 0, 1, 0x80));
         DO(hza_run(&hcd, 0, 100));
+        DO(hza_task_deref(&hcd, t));
+        CHECK(node_mac.count == 0 && node_mac.total_size == 0);
+        DO(hza_node_ma(&hcd, 1, NULL));
+
+        /* warm start: a task saved in the middle of mod_rec restores into a
+         * new world and finishes with the output of an uninterrupted run */
+        DO(hza_module_load(&hcd, mod_rec, sizeof(mod_rec), 0, &m));
+        DO(hza_task_create(&hcd, &t));
+        DO(hza_import(&hcd, m, 0));
+        DO(hza_enter(&hcd, hcd.args.module_index, 0, 0));
+        t->reg_space[t->frame_table[t->frame_index].reg_base] =
+            sizeof(warm_out);
+        DO(hza_task_output(&hcd, warm_out, 0x10));
+        DO(hza_run(&hcd, 0, 0x10000));
+        CHECK(hcd.run_stop == HZA_RUN_OUTPUT && t->frame_index == 0x11);
+        img.size = 0;
+        DO(hza_task_save(&hcd, test_image_write, &img));
+        DO(hza_task_deref(&hcd, t));
+        inited = 0;
+        DO(hza_finish(&hcd));
+        DO(hza_init(&hcd, ma, smt, log_io, HZA_LL_DEBUG));
+        inited = 1;
+        DO(hza_module_load(&hcd, mod_rec, sizeof(mod_rec), 0, &m));
+        img.pos = 0;
+        DO(hza_task_restore(&hcd, test_image_read, &img, &t));
+        CHECK(t->frame_index == 0x11
+              && t->frame_table[1].proc == m->proc_table);
+        DO(hza_task_output(&hcd, warm_out + 0x10, sizeof(warm_out) - 0x10));
+        DO(hza_run(&hcd, 0, 0x10000));
+        CHECK(hcd.run_stop == HZA_RUN_FRAME && t->frame_index == 0);
+        CHECK(t->out.pos == sizeof(warm_out) - 0x10);
+        CHECK(C41_MEM_EQUAL(warm_out, rec_out, sizeof(rec_out)));
+        DO(hza_task_deref(&hcd, t));
     }
     while (0);
     if (inited) hze = hza_finish(&hcd);
@@ -42,4 +1209,3 @@ uint8_t test (c41_io_t * log_io, c41_ma_t * ma, c41_smt_t * smt)
 
     return rc;
 }
-
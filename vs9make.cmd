@@ -9,8 +9,8 @@
 
 set N=hazna
 set D=HAZNA
-set CSRC=src\core.c
-set CSRC_CLI=src\cli.c src\test.c
+set CSRC=src\core.c src\modgen.c
+set CSRC_CLI=src\cli.c src\test.c src\bsp.c src\bench.c src\gen.c src\corpus.c src\hpma.c src\numa.c
 call %VS90COMNTOOLS%\vsvars32.bat
 
 if not exist out\win32-rls-sl mkdir out\win32-rls-sl